@@ -78,6 +78,7 @@ static const char * const cdjpeg_message_table[] = {
  */
 
 static boolean is_targa;        /* records user -targa switch */
+static int num_threads = 1;     /* records user -threads switch */
 
 
 LOCAL(cjpeg_source_ptr)
@@ -187,6 +188,7 @@ usage (void)
   fprintf(stderr, "  -smooth N      Smooth dithered input (N=1..100 is strength)\n");
 #endif
   fprintf(stderr, "  -maxmemory N   Maximum memory to use (in kbytes)\n");
+  fprintf(stderr, "  -threads N     Use N threads to encode the scans of a multi-scan file\n");
   fprintf(stderr, "  -outfile name  Specify name for output file\n");
 #if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
   fprintf(stderr, "  -memdst        Compress to memory instead of file (useful for benchmarking)\n");
@@ -436,6 +438,13 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
       /* Input file is Targa format. */
       is_targa = TRUE;
 
+    } else if (keymatch(arg, "threads", 2)) {
+      /* Number of threads to use when encoding scans. */
+      if (++argn >= argc)       /* advance to next argument */
+        usage();
+      if (sscanf(argv[argn], "%d", &num_threads) != 1 || num_threads < 1)
+        usage();
+
     } else {
       usage();                  /* bogus switch */
     }
@@ -608,6 +617,8 @@ main (int argc, char **argv)
 
   /* Start compressor */
   jpeg_start_compress(&cinfo, TRUE);
+  if (num_threads > 1)
+    jpeg_set_scan_threads(&cinfo, num_threads);
 
   /* Process data */
   while (cinfo.next_scanline < cinfo.image_height) {
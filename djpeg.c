@@ -148,6 +148,7 @@ usage (void)
   fprintf(stderr, "  -dct float     Use floating-point DCT method%s\n",
           (JDCT_DEFAULT == JDCT_FLOAT ? " (default)" : ""));
 #endif
+  fprintf(stderr, "  -dctupsample   Upsample 4:2:0 chroma in the IDCT (16x16 IDCT)\n");
   fprintf(stderr, "  -dither fs     Use F-S dithering (default)\n");
   fprintf(stderr, "  -dither none   Don't use dithering in quantization\n");
   fprintf(stderr, "  -dither ordered  Use ordered dither (medium speed, quality)\n");
@@ -234,6 +235,13 @@ parse_switches (j_decompress_ptr cinfo, int argc, char **argv,
       } else
         usage();
 
+    } else if (keymatch(arg, "dctupsample", 4)) {
+      /* Upsample h2v2 chroma in the IDCT.  This can be set only after
+       * jpeg_read_header(), so skip it on the dummy pass.
+       */
+      if (for_real)
+        jpeg_set_idct_upsampling(cinfo, TRUE);
+
     } else if (keymatch(arg, "dither", 2)) {
       /* Select dithering algorithm. */
       if (++argn >= argc)       /* advance to next argument */
@@ -126,6 +126,12 @@ public class TJTransform extends Rectangle {
    * them.
    */
   public static final int OPT_NOOUTPUT = 16;
+  /**
+   * This option will cause {@link TJTransformer#transform
+   * TJTransformer.transform()} to use arithmetic entropy coding in the output
+   * image, rather than Huffman coding.
+   */
+  public static final int OPT_ARITHMETIC = 32;
 
 
   /**
@@ -4,8 +4,8 @@
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1994-1998, Thomas G. Lane.
  * Modified 2003-2010 by Guido Vollbeding.
- * It was modified by The libjpeg-turbo Project to include only code relevant
- * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains application interface code for the compression half
@@ -22,6 +22,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jtrace.h"
 
 
 /*
@@ -163,7 +164,8 @@ jpeg_finish_compress (j_compress_ptr cinfo)
   JDIMENSION iMCU_row;
 
   if (cinfo->global_state == CSTATE_SCANNING ||
-      cinfo->global_state == CSTATE_RAW_OK) {
+      cinfo->global_state == CSTATE_RAW_OK ||
+      cinfo->global_state == CSTATE_WRCOEFROWS) {
     /* Terminate first pass */
     if (cinfo->next_scanline < cinfo->image_height)
       ERREXIT(cinfo, JERR_TOO_LITTLE_DATA);
@@ -171,6 +173,7 @@ jpeg_finish_compress (j_compress_ptr cinfo)
   } else if (cinfo->global_state != CSTATE_WRCOEFS)
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
   /* Perform any remaining passes */
+  (*cinfo->master->encode_remaining_scans) (cinfo);
   while (! cinfo->master->is_last_pass) {
     (*cinfo->master->prepare_for_pass) (cinfo);
     for (iMCU_row = 0; iMCU_row < cinfo->total_iMCU_rows; iMCU_row++) {
@@ -190,6 +193,15 @@ jpeg_finish_compress (j_compress_ptr cinfo)
   /* Write EOI, do final cleanup */
   (*cinfo->marker->write_file_trailer) (cinfo);
   (*cinfo->dest->term_destination) (cinfo);
+#ifdef WITH_USDT
+  {
+    jpeg_memory_stats stats;
+
+    jpeg_get_memory_stats((j_common_ptr) cinfo, &stats);
+    JTRACE4(compress__done, cinfo->image_width, cinfo->image_height,
+            cinfo->num_components, stats.peak_bytes);
+  }
+#endif
   /* We can use jpeg_abort to release memory and reset global_state */
   jpeg_abort((j_common_ptr) cinfo);
 }
@@ -211,7 +223,8 @@ jpeg_write_marker (j_compress_ptr cinfo, int marker,
   if (cinfo->next_scanline != 0 ||
       (cinfo->global_state != CSTATE_SCANNING &&
        cinfo->global_state != CSTATE_RAW_OK &&
-       cinfo->global_state != CSTATE_WRCOEFS))
+       cinfo->global_state != CSTATE_WRCOEFS &&
+       cinfo->global_state != CSTATE_WRCOEFROWS))
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
 
   (*cinfo->marker->write_marker_header) (cinfo, marker, datalen);
@@ -230,7 +243,8 @@ jpeg_write_m_header (j_compress_ptr cinfo, int marker, unsigned int datalen)
   if (cinfo->next_scanline != 0 ||
       (cinfo->global_state != CSTATE_SCANNING &&
        cinfo->global_state != CSTATE_RAW_OK &&
-       cinfo->global_state != CSTATE_WRCOEFS))
+       cinfo->global_state != CSTATE_WRCOEFS &&
+       cinfo->global_state != CSTATE_WRCOEFROWS))
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
 
   (*cinfo->marker->write_marker_header) (cinfo, marker, datalen);
@@ -17,6 +17,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jtrace.h"
 
 
 /*
@@ -48,6 +49,8 @@ jpeg_start_compress (j_compress_ptr cinfo, boolean write_all_tables)
   (*cinfo->dest->init_destination) (cinfo);
   /* Perform master selection of active modules */
   jinit_compress_master(cinfo);
+  JTRACE4(compress__start, cinfo->image_width, cinfo->image_height,
+          cinfo->input_components, cinfo->num_components);
   /* Set up for the first pass */
   (*cinfo->master->prepare_for_pass) (cinfo);
   /* Ready for application to drive first pass through jpeg_write_scanlines
@@ -5,6 +5,8 @@
  * Developed 1997-2009 by Guido Vollbeding.
  * It was modified by The libjpeg-turbo Project to include only code relevant
  * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains portable arithmetic entropy encoding routines for JPEG
@@ -18,19 +20,46 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jconfigint.h"
 
 
-/* Expanded entropy encoder object for arithmetic encoding. */
+/*
+ * Table D.2, expanded so that it can be indexed directly by a statistics bin
+ * (MPS sense in the highest bit, state index in the lower bits.)  The next
+ * bin value for each outcome already includes the MPS sense (and the MPS/LPS
+ * exchange, if any), which saves several operations per decision.
+ */
 
 typedef struct {
-  struct jpeg_entropy_encoder pub; /* public fields */
+  unsigned short qe;            /* Qe_Value */
+  unsigned char next_mps;       /* bin value after coding the MPS */
+  unsigned char next_lps;       /* bin value after coding the LPS */
+} arith_transition;
+
 
+/* Arithmetic encoding state.  This is copied into local storage by each of
+ * the MCU encoding routines, so that the compiler can keep it in registers
+ * (updates to the statistics bins would otherwise force it to reload the
+ * registers from the entropy encoder object after every decision.)
+ */
+
+typedef struct {
   INT32 c; /* C register, base of coding interval, layout as in sec. D.1.3 */
   INT32 a;               /* A register, normalized size of coding interval */
+  int ct;  /* bit shift counter, determines when next byte will be written */
+  const arith_transition * trans; /* -> expanded Table D.2 */
+} arith_state;
+
+
+/* Expanded entropy encoder object for arithmetic encoding. */
+
+typedef struct {
+  struct jpeg_entropy_encoder pub; /* public fields */
+
+  arith_state state;            /* arithmetic encoding state */
   INT32 sc;        /* counter for stacked 0xFF values which might overflow */
   INT32 zc;          /* counter for pending 0x00 output values which might *
                           * be discarded at the end ("Pacman" termination) */
-  int ct;  /* bit shift counter, determines when next byte will be written */
   int buffer;                /* buffer for most recent output byte != 0xFF */
 
   int last_dc_val[MAX_COMPS_IN_SCAN]; /* last DC coef for each component */
@@ -45,6 +74,8 @@ typedef struct {
 
   /* Statistics bin for coding with fixed probability 0.5 */
   unsigned char fixed_bin[4];
+
+  arith_transition trans[256];  /* expanded Table D.2 */
 } arith_entropy_encoder;
 
 typedef arith_entropy_encoder * arith_entropy_ptr;
@@ -114,6 +145,27 @@ typedef arith_entropy_encoder * arith_entropy_ptr;
 #endif
 
 
+/*
+ * Renormalization shifts A left until it is >= 0x8000.  With a
+ * count-leading-zeros operation, we can compute the shift count directly
+ * instead of shifting one bit at a time.
+ */
+
+#if defined __GNUC__
+#define RENORM_SHIFT(a)  (__builtin_clz((unsigned int) (a)) - 16)
+#elif defined _MSC_VER
+#include <intrin.h>
+#define RENORM_SHIFT(a)  jrenorm_shift(a)
+LOCAL(int)
+jrenorm_shift (INT32 a)
+{
+  unsigned long index;
+  _BitScanReverse(&index, (unsigned long) a);
+  return 15 - (int) index;
+}
+#endif
+
+
 LOCAL(void)
 emit_byte (int val, j_compress_ptr cinfo)
 /* Write next output byte; we do not support suspension in this module. */
@@ -139,15 +191,15 @@ finish_pass (j_compress_ptr cinfo)
 
   /* Section D.1.8: Termination of encoding */
 
-  /* Find the e->c in the coding interval with the largest
+  /* Find the e->state.c in the coding interval with the largest
    * number of trailing zero bits */
-  if ((temp = (e->a - 1 + e->c) & 0xFFFF0000L) < e->c)
-    e->c = temp + 0x8000L;
+  if ((temp = (e->state.a - 1 + e->state.c) & 0xFFFF0000L) < e->state.c)
+    e->state.c = temp + 0x8000L;
   else
-    e->c = temp;
+    e->state.c = temp;
   /* Send remaining bytes to output */
-  e->c <<= e->ct;
-  if (e->c & 0xF8000000L) {
+  e->state.c <<= e->state.ct;
+  if (e->state.c & 0xF8000000L) {
     /* One final overflow has to be handled */
     if (e->buffer >= 0) {
       if (e->zc)
@@ -179,16 +231,16 @@ finish_pass (j_compress_ptr cinfo)
     }
   }
   /* Output final bytes only if they are not 0x00 */
-  if (e->c & 0x7FFF800L) {
+  if (e->state.c & 0x7FFF800L) {
     if (e->zc)  /* output final pending zero bytes */
       do emit_byte(0x00, cinfo);
       while (--e->zc);
-    emit_byte((e->c >> 19) & 0xFF, cinfo);
-    if (((e->c >> 19) & 0xFF) == 0xFF)
+    emit_byte((e->state.c >> 19) & 0xFF, cinfo);
+    if (((e->state.c >> 19) & 0xFF) == 0xFF)
       emit_byte(0x00, cinfo);
-    if (e->c & 0x7F800L) {
-      emit_byte((e->c >> 11) & 0xFF, cinfo);
-      if (((e->c >> 11) & 0xFF) == 0xFF)
+    if (e->state.c & 0x7F800L) {
+      emit_byte((e->state.c >> 11) & 0xFF, cinfo);
+      if (((e->state.c >> 11) & 0xFF) == 0xFF)
         emit_byte(0x00, cinfo);
     }
   }
@@ -218,98 +270,132 @@ finish_pass (j_compress_ptr cinfo)
  */
 
 LOCAL(void)
-arith_encode (j_compress_ptr cinfo, unsigned char *st, int val)
+output_byte (j_compress_ptr cinfo, INT32 temp)
+/* Handle a byte that is ready for output (temp = C >> 19, including the
+ * carry bit), per section D.1.6 */
 {
   register arith_entropy_ptr e = (arith_entropy_ptr) cinfo->entropy;
-  register unsigned char nl, nm;
-  register INT32 qe, temp;
-  register int sv;
 
-  /* Fetch values from our compact representation of Table D.2:
-   * Qe values and probability estimation state machine
-   */
-  sv = *st;
-  qe = jpeg_aritab[sv & 0x7F];  /* => Qe_Value */
-  nl = qe & 0xFF; qe >>= 8;     /* Next_Index_LPS + Switch_MPS */
-  nm = qe & 0xFF; qe >>= 8;     /* Next_Index_MPS */
-
-  /* Encode & estimation procedures per sections D.1.4 & D.1.5 */
-  e->a -= qe;
-  if (val != (sv >> 7)) {
-    /* Encode the less probable symbol */
-    if (e->a >= qe) {
-      /* If the interval size (qe) for the less probable symbol (LPS)
-       * is larger than the interval size for the MPS, then exchange
-       * the two symbols for coding efficiency, otherwise code the LPS
-       * as usual: */
-      e->c += e->a;
-      e->a = qe;
+  if (temp > 0xFF) {
+    /* Handle overflow over all stacked 0xFF bytes */
+    if (e->buffer >= 0) {
+      if (e->zc)
+        do emit_byte(0x00, cinfo);
+        while (--e->zc);
+      emit_byte(e->buffer + 1, cinfo);
+      if (e->buffer + 1 == 0xFF)
+        emit_byte(0x00, cinfo);
     }
-    *st = (sv & 0x80) ^ nl;     /* Estimate_after_LPS */
+    e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
+    e->sc = 0;
+    /* Note: The 3 spacer bits in the C register guarantee
+     * that the new buffer byte can't be 0xFF here
+     * (see page 160 in the P&M JPEG book). */
+    e->buffer = temp & 0xFF;  /* new output byte, might overflow later */
+  } else if (temp == 0xFF) {
+    ++e->sc;  /* stack 0xFF byte (which might overflow later) */
   } else {
-    /* Encode the more probable symbol */
-    if (e->a >= 0x8000L)
-      return;  /* A >= 0x8000 -> ready, no renormalization required */
-    if (e->a < qe) {
-      /* If the interval size (qe) for the less probable symbol (LPS)
-       * is larger than the interval size for the MPS, then exchange
-       * the two symbols for coding efficiency: */
-      e->c += e->a;
-      e->a = qe;
+    /* Output all stacked 0xFF bytes, they will not overflow any more */
+    if (e->buffer == 0)
+      ++e->zc;
+    else if (e->buffer >= 0) {
+      if (e->zc)
+        do emit_byte(0x00, cinfo);
+        while (--e->zc);
+      emit_byte(e->buffer, cinfo);
+    }
+    if (e->sc) {
+      if (e->zc)
+        do emit_byte(0x00, cinfo);
+        while (--e->zc);
+      do {
+        emit_byte(0xFF, cinfo);
+        emit_byte(0x00, cinfo);
+      } while (--e->sc);
     }
-    *st = (sv & 0x80) ^ nm;     /* Estimate_after_MPS */
+    e->buffer = temp & 0xFF;  /* new output byte (can still overflow) */
+  }
+}
+
+
+/*
+ * The core arithmetic encoding routine (common in JPEG and JBIG).
+ * This needs to go as fast as possible.
+ *
+ * Parameter 'val' to be encoded may be 0 or 1 (binary decision).
+ *
+ * Note: I've added full "Pacman" termination support to the
+ * byte output routines, which is equivalent to the optional
+ * Discard_final_zeros procedure (Figure D.15) in the spec.
+ * Thus, we always produce the shortest possible output
+ * stream compliant to the spec (no trailing zero bytes,
+ * except for FF stuffing).
+ *
+ * I've also introduced a new scheme for accessing
+ * the probability estimation state machine table,
+ * derived from Markus Kuhn's JBIG implementation.
+ *
+ * libjpeg-turbo note: the decision is coded without branching on whether
+ * 'val' is the MPS or the LPS, and renormalization shifts A and C by the
+ * required number of bits all at once, stopping only when a byte is ready
+ * for output.
+ */
+
+INLINE
+LOCAL(void)
+arith_encode (j_compress_ptr cinfo, arith_state * state, unsigned char *st,
+              int val)
+{
+  register const arith_transition * t;
+  register INT32 qe, a, mask;
+  register int sv, lps, exchange, nbits;
+
+  /* Fetch values from our expanded representation of Table D.2:
+   * Qe values and probability estimation state machine
+   */
+  sv = *st;
+  t = &state->trans[sv];
+  qe = t->qe;
+
+  /* Encode & estimation procedures per sections D.1.4 & D.1.5
+   *
+   * If the interval size (qe) for the less probable symbol (LPS) is larger
+   * than the interval size for the MPS, then the two symbols are exchanged
+   * for coding efficiency.  Thus, C moves to the upper subinterval when
+   * coding the LPS without an exchange or the MPS with one.
+   */
+  a = state->a - qe;
+  lps = val ^ (sv >> 7);
+  exchange = (a < qe);
+  mask = -(INT32) (lps ^ exchange); /* all 1's if C moves up, else 0 */
+  state->c += a & mask;
+  a ^= (a ^ qe) & mask;             /* A = Qe if C moves up */
+  if (a >= 0x8000L) {
+    /* MPS, A >= 0x8000 -> ready, no renormalization required */
+    state->a = a;
+    return;
   }
+  *st = lps ? t->next_lps : t->next_mps; /* Estimate_after_LPS/MPS */
 
   /* Renormalization & data output per section D.1.6 */
-  do {
-    e->a <<= 1;
-    e->c <<= 1;
-    if (--e->ct == 0) {
-      /* Another byte is ready for output */
-      temp = e->c >> 19;
-      if (temp > 0xFF) {
-        /* Handle overflow over all stacked 0xFF bytes */
-        if (e->buffer >= 0) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          emit_byte(e->buffer + 1, cinfo);
-          if (e->buffer + 1 == 0xFF)
-            emit_byte(0x00, cinfo);
-        }
-        e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
-        e->sc = 0;
-        /* Note: The 3 spacer bits in the C register guarantee
-         * that the new buffer byte can't be 0xFF here
-         * (see page 160 in the P&M JPEG book). */
-        e->buffer = temp & 0xFF;  /* new output byte, might overflow later */
-      } else if (temp == 0xFF) {
-        ++e->sc;  /* stack 0xFF byte (which might overflow later) */
-      } else {
-        /* Output all stacked 0xFF bytes, they will not overflow any more */
-        if (e->buffer == 0)
-          ++e->zc;
-        else if (e->buffer >= 0) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          emit_byte(e->buffer, cinfo);
-        }
-        if (e->sc) {
-          if (e->zc)
-            do emit_byte(0x00, cinfo);
-            while (--e->zc);
-          do {
-            emit_byte(0xFF, cinfo);
-            emit_byte(0x00, cinfo);
-          } while (--e->sc);
-        }
-        e->buffer = temp & 0xFF;  /* new output byte (can still overflow) */
-      }
-      e->c &= 0x7FFFFL;
-      e->ct += 8;
-    }
-  } while (e->a < 0x8000L);
+#ifdef RENORM_SHIFT
+  nbits = RENORM_SHIFT(a);
+#else
+  nbits = 0;
+  do nbits++;
+  while ((a << nbits) < 0x8000L);
+#endif
+  state->a = a << nbits;
+  while (nbits >= state->ct) {
+    /* Another byte is ready for output */
+    state->c <<= state->ct;
+    nbits -= state->ct;
+    output_byte(cinfo, state->c >> 19);
+    state->c &= 0x7FFFFL;
+    state->ct = 8;
+  }
+  state->c <<= nbits;
+  state->ct -= nbits;
 }
 
 
@@ -346,15 +432,46 @@ emit_restart (j_compress_ptr cinfo, int restart_num)
   }
 
   /* Reset arithmetic encoding variables */
-  entropy->c = 0;
-  entropy->a = 0x10000L;
+  entropy->state.c = 0;
+  entropy->state.a = 0x10000L;
   entropy->sc = 0;
   entropy->zc = 0;
-  entropy->ct = 11;
+  entropy->state.ct = 11;
   entropy->buffer = -1;  /* empty */
 }
 
 
+/*
+ * Apply the point transform by Al to the coefficients Ss..Se of a block, and
+ * store their absolute values and signs in zigzag order.  For AC coefficients,
+ * the point transform is an integer division with rounding towards 0, so we
+ * shift after obtaining the absolute value.  This is done without branches,
+ * and it also establishes the EOB (end-of-block) index *ke, along with the
+ * EOBx (previous stage end-of-block) index *kex for refinement scans.  (An
+ * index is 0 if there is no such coefficient in the band.)
+ */
+
+LOCAL(void)
+prepare_AC_block (const JCOEF *block, int Ss, int Se, int Al,
+                  int *absvalues, int *signs, int *ke, int *kex)
+{
+  register int k, temp, sign, eob = 0, eobx = 0;
+
+  for (k = Ss; k <= Se; k++) {
+    temp = block[jpeg_natural_order[k]];
+    sign = temp >> 31;          /* -1 if the coefficient is negative, else 0 */
+    temp = ((temp ^ sign) - sign) >> Al;
+    absvalues[k] = temp;
+    signs[k] = sign & 1;
+    eob = temp ? k : eob;
+    eobx = (temp >> 1) ? k : eobx;
+  }
+
+  *ke = eob;
+  *kex = eobx;
+}
+
+
 /*
  * MCU encoding for DC initial scan (either spectral selection,
  * or first pass of successive approximation).
@@ -366,6 +483,7 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int blkn, ci, tbl;
   int v, v2, m;
   ISHIFT_TEMPS
@@ -381,6 +499,8 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
+
   /* Encode the MCU data blocks */
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     block = MCU_data[blkn];
@@ -399,37 +519,37 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 
     /* Figure F.4: Encode_DC_DIFF */
     if ((v = m - entropy->last_dc_val[ci]) == 0) {
-      arith_encode(cinfo, st, 0);
+      arith_encode(cinfo, &state, st, 0);
       entropy->dc_context[ci] = 0;      /* zero diff category */
     } else {
       entropy->last_dc_val[ci] = m;
-      arith_encode(cinfo, st, 1);
+      arith_encode(cinfo, &state, st, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-        arith_encode(cinfo, st + 1, 0); /* Table F.4: SS = S0 + 1 */
-        st += 2;                        /* Table F.4: SP = S0 + 2 */
+        arith_encode(cinfo, &state, st + 1, 0); /* Table F.4: SS = S0 + 1 */
+        st += 2;                                /* Table F.4: SP = S0 + 2 */
         entropy->dc_context[ci] = 4;    /* small positive diff category */
       } else {
         v = -v;
-        arith_encode(cinfo, st + 1, 1); /* Table F.4: SS = S0 + 1 */
-        st += 3;                        /* Table F.4: SN = S0 + 3 */
+        arith_encode(cinfo, &state, st + 1, 1); /* Table F.4: SS = S0 + 1 */
+        st += 3;                                /* Table F.4: SN = S0 + 3 */
         entropy->dc_context[ci] = 8;    /* small negative diff category */
       }
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-        arith_encode(cinfo, st, 1);
+        arith_encode(cinfo, &state, st, 1);
         m = 1;
         v2 = v;
         st = entropy->dc_stats[tbl] + 20; /* Table F.4: X1 = 20 */
         while (v2 >>= 1) {
-          arith_encode(cinfo, st, 1);
+          arith_encode(cinfo, &state, st, 1);
           m <<= 1;
           st += 1;
         }
       }
-      arith_encode(cinfo, st, 0);
+      arith_encode(cinfo, &state, st, 0);
       /* Section F.1.4.4.1.2: Establish dc_context conditioning category */
       if (m < (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1))
         entropy->dc_context[ci] = 0;    /* zero diff category */
@@ -438,10 +558,12 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        arith_encode(cinfo, st, (m & v) ? 1 : 0);
+        arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -457,8 +579,10 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   JBLOCKROW block;
   unsigned char *st;
-  int tbl, k, ke;
+  arith_state state;
+  int tbl, k, ke, kex;
   int v, v2, m;
+  int absvalues[DCTSIZE2], signs[DCTSIZE2];
 
   /* Emit restart marker if needed */
   if (cinfo->restart_interval) {
@@ -471,6 +595,8 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
+
   /* Encode the MCU data block */
   block = MCU_data[0];
   tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
@@ -478,70 +604,51 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
 
   /* Establish EOB (end-of-block) index */
-  for (ke = cinfo->Se; ke > 0; ke--)
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  To do this portably
-     * in C, we shift after obtaining the absolute value.
-     */
-    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
-      if (v >>= cinfo->Al) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Al) break;
-    }
+  prepare_AC_block(*block, cinfo->Ss, cinfo->Se, cinfo->Al, absvalues, signs,
+                   &ke, &kex);
 
   /* Figure F.5: Encode_AC_Coefficients */
   for (k = cinfo->Ss; k <= ke; k++) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
-    arith_encode(cinfo, st, 0);         /* EOB decision */
-    for (;;) {
-      if ((v = (*block)[jpeg_natural_order[k]]) >= 0) {
-        if (v >>= cinfo->Al) {
-          arith_encode(cinfo, st + 1, 1);
-          arith_encode(cinfo, entropy->fixed_bin, 0);
-          break;
-        }
-      } else {
-        v = -v;
-        if (v >>= cinfo->Al) {
-          arith_encode(cinfo, st + 1, 1);
-          arith_encode(cinfo, entropy->fixed_bin, 1);
-          break;
-        }
-      }
-      arith_encode(cinfo, st + 1, 0); st += 3; k++;
+    arith_encode(cinfo, &state, st, 0); /* EOB decision */
+    while ((v = absvalues[k]) == 0) {
+      arith_encode(cinfo, &state, st + 1, 0); st += 3; k++;
     }
+    arith_encode(cinfo, &state, st + 1, 1);
+    arith_encode(cinfo, &state, entropy->fixed_bin, signs[k]);
     st += 2;
     /* Figure F.8: Encoding the magnitude category of v */
     m = 0;
     if (v -= 1) {
-      arith_encode(cinfo, st, 1);
+      arith_encode(cinfo, &state, st, 1);
       m = 1;
       v2 = v;
       if (v2 >>= 1) {
-        arith_encode(cinfo, st, 1);
+        arith_encode(cinfo, &state, st, 1);
         m <<= 1;
         st = entropy->ac_stats[tbl] +
              (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
         while (v2 >>= 1) {
-          arith_encode(cinfo, st, 1);
+          arith_encode(cinfo, &state, st, 1);
           m <<= 1;
           st += 1;
         }
       }
     }
-    arith_encode(cinfo, st, 0);
+    arith_encode(cinfo, &state, st, 0);
     /* Figure F.9: Encoding the magnitude bit pattern of v */
     st += 14;
     while (m >>= 1)
-      arith_encode(cinfo, st, (m & v) ? 1 : 0);
+      arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
   }
   /* Encode EOB decision only if k <= cinfo->Se */
   if (k <= cinfo->Se) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
-    arith_encode(cinfo, st, 1);
+    arith_encode(cinfo, &state, st, 1);
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -555,6 +662,7 @@ encode_mcu_DC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 {
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   unsigned char *st;
+  arith_state state;
   int Al, blkn;
 
   /* Emit restart marker if needed */
@@ -568,15 +676,19 @@ encode_mcu_DC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
+
   st = entropy->fixed_bin;      /* use fixed probability estimation */
   Al = cinfo->Al;
 
   /* Encode the MCU data blocks */
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     /* We simply emit the Al'th bit of the DC coefficient value. */
-    arith_encode(cinfo, st, (MCU_data[blkn][0][0] >> Al) & 1);
+    arith_encode(cinfo, &state, st, (MCU_data[blkn][0][0] >> Al) & 1);
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -591,8 +703,10 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int tbl, k, ke, kex;
   int v;
+  int absvalues[DCTSIZE2], signs[DCTSIZE2];
 
   /* Emit restart marker if needed */
   if (cinfo->restart_interval) {
@@ -605,71 +719,43 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
+
   /* Encode the MCU data block */
   block = MCU_data[0];
   tbl = cinfo->cur_comp_info[0]->ac_tbl_no;
 
   /* Section G.1.3.3: Encoding of AC coefficients */
 
-  /* Establish EOB (end-of-block) index */
-  for (ke = cinfo->Se; ke > 0; ke--)
-    /* We must apply the point transform by Al.  For AC coefficients this
-     * is an integer division with rounding towards 0.  To do this portably
-     * in C, we shift after obtaining the absolute value.
-     */
-    if ((v = (*block)[jpeg_natural_order[ke]]) >= 0) {
-      if (v >>= cinfo->Al) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Al) break;
-    }
-
-  /* Establish EOBx (previous stage end-of-block) index */
-  for (kex = ke; kex > 0; kex--)
-    if ((v = (*block)[jpeg_natural_order[kex]]) >= 0) {
-      if (v >>= cinfo->Ah) break;
-    } else {
-      v = -v;
-      if (v >>= cinfo->Ah) break;
-    }
+  /* Establish EOB (end-of-block) and EOBx (previous stage end-of-block)
+   * indices
+   */
+  prepare_AC_block(*block, cinfo->Ss, cinfo->Se, cinfo->Al, absvalues, signs,
+                   &ke, &kex);
 
   /* Figure G.10: Encode_AC_Coefficients_SA */
   for (k = cinfo->Ss; k <= ke; k++) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
     if (k > kex)
-      arith_encode(cinfo, st, 0);       /* EOB decision */
-    for (;;) {
-      if ((v = (*block)[jpeg_natural_order[k]]) >= 0) {
-        if (v >>= cinfo->Al) {
-          if (v >> 1)                   /* previously nonzero coef */
-            arith_encode(cinfo, st + 2, (v & 1));
-          else {                        /* newly nonzero coef */
-            arith_encode(cinfo, st + 1, 1);
-            arith_encode(cinfo, entropy->fixed_bin, 0);
-          }
-          break;
-        }
-      } else {
-        v = -v;
-        if (v >>= cinfo->Al) {
-          if (v >> 1)                   /* previously nonzero coef */
-            arith_encode(cinfo, st + 2, (v & 1));
-          else {                        /* newly nonzero coef */
-            arith_encode(cinfo, st + 1, 1);
-            arith_encode(cinfo, entropy->fixed_bin, 1);
-          }
-          break;
-        }
-      }
-      arith_encode(cinfo, st + 1, 0); st += 3; k++;
+      arith_encode(cinfo, &state, st, 0); /* EOB decision */
+    while ((v = absvalues[k]) == 0) {
+      arith_encode(cinfo, &state, st + 1, 0); st += 3; k++;
+    }
+    if (v >> 1)                         /* previously nonzero coef */
+      arith_encode(cinfo, &state, st + 2, (v & 1));
+    else {                              /* newly nonzero coef */
+      arith_encode(cinfo, &state, st + 1, 1);
+      arith_encode(cinfo, &state, entropy->fixed_bin, signs[k]);
     }
   }
   /* Encode EOB decision only if k <= cinfo->Se */
   if (k <= cinfo->Se) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
-    arith_encode(cinfo, st, 1);
+    arith_encode(cinfo, &state, st, 1);
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -685,6 +771,7 @@ encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   jpeg_component_info * compptr;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int blkn, ci, tbl, k, ke;
   int v, v2, m;
 
@@ -699,6 +786,8 @@ encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
+
   /* Encode the MCU data blocks */
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     block = MCU_data[blkn];
@@ -714,37 +803,37 @@ encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 
     /* Figure F.4: Encode_DC_DIFF */
     if ((v = (*block)[0] - entropy->last_dc_val[ci]) == 0) {
-      arith_encode(cinfo, st, 0);
+      arith_encode(cinfo, &state, st, 0);
       entropy->dc_context[ci] = 0;      /* zero diff category */
     } else {
       entropy->last_dc_val[ci] = (*block)[0];
-      arith_encode(cinfo, st, 1);
+      arith_encode(cinfo, &state, st, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-        arith_encode(cinfo, st + 1, 0); /* Table F.4: SS = S0 + 1 */
-        st += 2;                        /* Table F.4: SP = S0 + 2 */
+        arith_encode(cinfo, &state, st + 1, 0); /* Table F.4: SS = S0 + 1 */
+        st += 2;                                /* Table F.4: SP = S0 + 2 */
         entropy->dc_context[ci] = 4;    /* small positive diff category */
       } else {
         v = -v;
-        arith_encode(cinfo, st + 1, 1); /* Table F.4: SS = S0 + 1 */
-        st += 3;                        /* Table F.4: SN = S0 + 3 */
+        arith_encode(cinfo, &state, st + 1, 1); /* Table F.4: SS = S0 + 1 */
+        st += 3;                                /* Table F.4: SN = S0 + 3 */
         entropy->dc_context[ci] = 8;    /* small negative diff category */
       }
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-        arith_encode(cinfo, st, 1);
+        arith_encode(cinfo, &state, st, 1);
         m = 1;
         v2 = v;
         st = entropy->dc_stats[tbl] + 20; /* Table F.4: X1 = 20 */
         while (v2 >>= 1) {
-          arith_encode(cinfo, st, 1);
+          arith_encode(cinfo, &state, st, 1);
           m <<= 1;
           st += 1;
         }
       }
-      arith_encode(cinfo, st, 0);
+      arith_encode(cinfo, &state, st, 0);
       /* Section F.1.4.4.1.2: Establish dc_context conditioning category */
       if (m < (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1))
         entropy->dc_context[ci] = 0;    /* zero diff category */
@@ -753,7 +842,7 @@ encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        arith_encode(cinfo, st, (m & v) ? 1 : 0);
+        arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
 
     /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
@@ -767,51 +856,53 @@ encode_mcu (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     /* Figure F.5: Encode_AC_Coefficients */
     for (k = 1; k <= ke; k++) {
       st = entropy->ac_stats[tbl] + 3 * (k - 1);
-      arith_encode(cinfo, st, 0);       /* EOB decision */
+      arith_encode(cinfo, &state, st, 0); /* EOB decision */
       while ((v = (*block)[jpeg_natural_order[k]]) == 0) {
-        arith_encode(cinfo, st + 1, 0); st += 3; k++;
+        arith_encode(cinfo, &state, st + 1, 0); st += 3; k++;
       }
-      arith_encode(cinfo, st + 1, 1);
+      arith_encode(cinfo, &state, st + 1, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-        arith_encode(cinfo, entropy->fixed_bin, 0);
+        arith_encode(cinfo, &state, entropy->fixed_bin, 0);
       } else {
         v = -v;
-        arith_encode(cinfo, entropy->fixed_bin, 1);
+        arith_encode(cinfo, &state, entropy->fixed_bin, 1);
       }
       st += 2;
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-        arith_encode(cinfo, st, 1);
+        arith_encode(cinfo, &state, st, 1);
         m = 1;
         v2 = v;
         if (v2 >>= 1) {
-          arith_encode(cinfo, st, 1);
+          arith_encode(cinfo, &state, st, 1);
           m <<= 1;
           st = entropy->ac_stats[tbl] +
                (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
           while (v2 >>= 1) {
-            arith_encode(cinfo, st, 1);
+            arith_encode(cinfo, &state, st, 1);
             m <<= 1;
             st += 1;
           }
         }
       }
-      arith_encode(cinfo, st, 0);
+      arith_encode(cinfo, &state, st, 0);
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        arith_encode(cinfo, st, (m & v) ? 1 : 0);
+        arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
     /* Encode EOB decision only if k <= DCTSIZE2 - 1 */
     if (k <= DCTSIZE2 - 1) {
       st = entropy->ac_stats[tbl] + 3 * (k - 1);
-      arith_encode(cinfo, st, 1);
+      arith_encode(cinfo, &state, st, 1);
     }
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -886,11 +977,11 @@ start_pass (j_compress_ptr cinfo, boolean gather_statistics)
   }
 
   /* Initialize arithmetic encoding variables */
-  entropy->c = 0;
-  entropy->a = 0x10000L;
+  entropy->state.c = 0;
+  entropy->state.a = 0x10000L;
   entropy->sc = 0;
   entropy->zc = 0;
-  entropy->ct = 11;
+  entropy->state.ct = 11;
   entropy->buffer = -1;  /* empty */
 
   /* Initialize restart stuff */
@@ -924,4 +1015,18 @@ jinit_arith_encoder (j_compress_ptr cinfo)
 
   /* Initialize index for fixed probability estimation */
   entropy->fixed_bin[0] = 113;
+
+  /* Expand Table D.2 for both senses of the MPS */
+  MEMZERO(entropy->trans, sizeof(entropy->trans));
+  for (i = 0; i <= 113; i++) {
+    INT32 qe = jpeg_aritab[i];
+    int nl = (int) (qe & 0xFF), nm = (int) ((qe >> 8) & 0xFF), mps;
+
+    for (mps = 0; mps <= 0x80; mps += 0x80) {
+      entropy->trans[mps | i].qe = (unsigned short) (qe >> 16);
+      entropy->trans[mps | i].next_mps = (unsigned char) (mps ^ nm);
+      entropy->trans[mps | i].next_lps = (unsigned char) (mps ^ nl);
+    }
+  }
+  entropy->state.trans = entropy->trans;
 }
@@ -3,8 +3,8 @@
  *
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1994-1997, Thomas G. Lane.
- * It was modified by The libjpeg-turbo Project to include only code and
- * information relevant to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains the coefficient buffer controller for compression.
@@ -15,6 +15,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jtrace.h"
 
 
 /* We use a full-image coefficient buffer when doing Huffman optimization,
@@ -41,14 +42,20 @@ typedef struct {
   int MCU_vert_offset;          /* counts MCU rows within iMCU row */
   int MCU_rows_per_iMCU_row;    /* number of such rows needed */
 
-  /* For single-pass compression, it's sufficient to buffer just one MCU
-   * (although this may prove a bit slow in practice).  We allocate a
-   * workspace of C_MAX_BLOCKS_IN_MCU coefficient blocks, and reuse it for each
-   * MCU constructed and sent.  In multi-pass modes, this array points to the
-   * current MCU's blocks within the virtual arrays.
+  /* Pointers to the current MCU's blocks within the iMCU row buffers or the
+   * virtual arrays.
    */
   JBLOCKROW MCU_buffer[C_MAX_BLOCKS_IN_MCU];
 
+  /* For single-pass compression, we buffer one iMCU row of coefficient blocks
+   * for each component.  This allows each call on forward_DCT to transform a
+   * complete horizontal row of DCT blocks, rather than just the blocks in one
+   * MCU.  row_ready is TRUE once the current iMCU row has been transformed, so
+   * that a suspension doesn't cause the row to be transformed again.
+   */
+  JBLOCKARRAY row_buffer[MAX_COMPONENTS];
+  boolean row_ready;
+
   /* In multi-pass modes, we need a virtual block array for each component. */
   jvirt_barray_ptr whole_image[MAX_COMPONENTS];
 } my_coef_controller;
@@ -88,6 +95,7 @@ start_iMCU_row (j_compress_ptr cinfo)
 
   coef->mcu_ctr = 0;
   coef->MCU_vert_offset = 0;
+  coef->row_ready = FALSE;
 }
 
 
@@ -129,77 +137,120 @@ start_pass_coef (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
 
 
 /*
- * Process some data in the single-pass case.
- * We process the equivalent of one fully interleaved MCU row ("iMCU" row)
- * per call, ie, v_samp_factor block rows for each component in the image.
+ * DCT and quantize one iMCU row of a component, ie, v_samp_factor block rows,
+ * and store the coefficients in buffer, which must be padded to a multiple of
+ * h_samp_factor DCT blocks.  Each call on forward_DCT processes a complete
+ * horizontal row of DCT blocks.  We also generate suitable dummy blocks as
+ * needed at the right and lower edges.  The data in them does not matter for
+ * image reconstruction, so we fill them with values that will encode to the
+ * smallest amount of data, viz: all zeroes in the AC entries, DC entries equal
+ * to previous block's DC value.  (Thanks to Thomas Kinsman for this idea.)
+ * This makes it possible for the MCU output loop not to worry about real vs.
+ * dummy blocks.
+ */
+
+LOCAL(void)
+transform_iMCU_row (j_compress_ptr cinfo, jpeg_component_info * compptr,
+                    JSAMPARRAY input_data, JBLOCKARRAY buffer)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
+  JDIMENSION blocks_across, MCUs_across, MCUindex;
+  int bi, h_samp_factor, block_row, block_rows, ndummy;
+  JCOEF lastDC;
+  JBLOCKROW thisblockrow, lastblockrow;
+
+  /* Count non-dummy DCT block rows in this iMCU row. */
+  if (coef->iMCU_row_num < last_iMCU_row)
+    block_rows = compptr->v_samp_factor;
+  else {
+    /* NB: can't use last_row_height here, since may not be set! */
+    block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
+    if (block_rows == 0) block_rows = compptr->v_samp_factor;
+  }
+  blocks_across = compptr->width_in_blocks;
+  h_samp_factor = compptr->h_samp_factor;
+  /* Count number of dummy blocks to be added at the right margin. */
+  ndummy = (int) (blocks_across % h_samp_factor);
+  if (ndummy > 0)
+    ndummy = h_samp_factor - ndummy;
+  /* Perform DCT for all non-dummy blocks in this iMCU row. */
+  for (block_row = 0; block_row < block_rows; block_row++) {
+    thisblockrow = buffer[block_row];
+    (*cinfo->fdct->forward_DCT) (cinfo, compptr, input_data, thisblockrow,
+                                 (JDIMENSION) (block_row * DCTSIZE),
+                                 (JDIMENSION) 0, blocks_across);
+    if (ndummy > 0) {
+      /* Create dummy blocks at the right edge of the image. */
+      thisblockrow += blocks_across; /* => first dummy block */
+      jzero_far((void *) thisblockrow, ndummy * sizeof(JBLOCK));
+      lastDC = thisblockrow[-1][0];
+      for (bi = 0; bi < ndummy; bi++) {
+        thisblockrow[bi][0] = lastDC;
+      }
+    }
+  }
+  /* If at end of image, create dummy block rows as needed.
+   * The tricky part here is that within each MCU, we want the DC values
+   * of the dummy blocks to match the last real block's DC value.
+   * This squeezes a few more bytes out of the resulting file...
+   */
+  if (coef->iMCU_row_num == last_iMCU_row) {
+    blocks_across += ndummy;    /* include lower right corner */
+    MCUs_across = blocks_across / h_samp_factor;
+    for (block_row = block_rows; block_row < compptr->v_samp_factor;
+         block_row++) {
+      thisblockrow = buffer[block_row];
+      lastblockrow = buffer[block_row-1];
+      jzero_far((void *) thisblockrow,
+                (size_t) (blocks_across * sizeof(JBLOCK)));
+      for (MCUindex = 0; MCUindex < MCUs_across; MCUindex++) {
+        lastDC = lastblockrow[h_samp_factor-1][0];
+        for (bi = 0; bi < h_samp_factor; bi++) {
+          thisblockrow[bi][0] = lastDC;
+        }
+        thisblockrow += h_samp_factor; /* advance to next MCU in row */
+        lastblockrow += h_samp_factor;
+      }
+    }
+  }
+}
+
+
+/*
+ * Emit one iMCU row of coefficient blocks to the entropy encoder.
+ * buffer[ci] holds the iMCU row for the ci'th component in the scan.
  * Returns TRUE if the iMCU row is completed, FALSE if suspended.
- *
- * NB: input_buf contains a plane for each component in image,
- * which we index according to the component's SOF position.
  */
 
-METHODDEF(boolean)
-compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+LOCAL(boolean)
+emit_iMCU_row (j_compress_ptr cinfo, JBLOCKARRAY * buffer)
 {
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
   JDIMENSION MCU_col_num;       /* index of current MCU within row */
-  JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
-  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  int blkn, bi, ci, yindex, yoffset, blockcnt;
-  JDIMENSION ypos, xpos;
+  int blkn, ci, xindex, yindex, yoffset;
+  JDIMENSION start_col;
+  JBLOCKROW buffer_ptr;
   jpeg_component_info *compptr;
 
-  /* Loop to write as much as one whole iMCU row */
+  /* Loop to process one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
        yoffset++) {
-    for (MCU_col_num = coef->mcu_ctr; MCU_col_num <= last_MCU_col;
+    for (MCU_col_num = coef->mcu_ctr; MCU_col_num < cinfo->MCUs_per_row;
          MCU_col_num++) {
-      /* Determine where data comes from in input_buf and do the DCT thing.
-       * Each call on forward_DCT processes a horizontal row of DCT blocks
-       * as wide as an MCU; we rely on having allocated the MCU_buffer[] blocks
-       * sequentially.  Dummy blocks at the right or bottom edge are filled in
-       * specially.  The data in them does not matter for image reconstruction,
-       * so we fill them with values that will encode to the smallest amount of
-       * data, viz: all zeroes in the AC entries, DC entries equal to previous
-       * block's DC value.  (Thanks to Thomas Kinsman for this idea.)
-       */
-      blkn = 0;
+      /* Construct list of pointers to DCT blocks belonging to this MCU */
+      blkn = 0;                 /* index of current DCT block within MCU */
       for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
         compptr = cinfo->cur_comp_info[ci];
-        blockcnt = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
-                                                : compptr->last_col_width;
-        xpos = MCU_col_num * compptr->MCU_sample_width;
-        ypos = yoffset * DCTSIZE; /* ypos == (yoffset+yindex) * DCTSIZE */
+        start_col = MCU_col_num * compptr->MCU_width;
         for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
-          if (coef->iMCU_row_num < last_iMCU_row ||
-              yoffset+yindex < compptr->last_row_height) {
-            (*cinfo->fdct->forward_DCT) (cinfo, compptr,
-                                         input_buf[compptr->component_index],
-                                         coef->MCU_buffer[blkn],
-                                         ypos, xpos, (JDIMENSION) blockcnt);
-            if (blockcnt < compptr->MCU_width) {
-              /* Create some dummy blocks at the right edge of the image. */
-              jzero_far((void *) coef->MCU_buffer[blkn + blockcnt],
-                        (compptr->MCU_width - blockcnt) * sizeof(JBLOCK));
-              for (bi = blockcnt; bi < compptr->MCU_width; bi++) {
-                coef->MCU_buffer[blkn+bi][0][0] = coef->MCU_buffer[blkn+bi-1][0][0];
-              }
-            }
-          } else {
-            /* Create a row of dummy blocks at the bottom of the image. */
-            jzero_far((void *) coef->MCU_buffer[blkn],
-                      compptr->MCU_width * sizeof(JBLOCK));
-            for (bi = 0; bi < compptr->MCU_width; bi++) {
-              coef->MCU_buffer[blkn+bi][0][0] = coef->MCU_buffer[blkn-1][0][0];
-            }
+          buffer_ptr = buffer[ci][yindex+yoffset] + start_col;
+          for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+            coef->MCU_buffer[blkn++] = buffer_ptr++;
           }
-          blkn += compptr->MCU_width;
-          ypos += DCTSIZE;
         }
       }
-      /* Try to write the MCU.  In event of a suspension failure, we will
-       * re-DCT the MCU on restart (a bit inefficient, could be fixed...)
-       */
+      /* Try to write the MCU. */
       if (! (*cinfo->entropy->encode_mcu) (cinfo, coef->MCU_buffer)) {
         /* Suspension forced; update state counters and exit */
         coef->MCU_vert_offset = yoffset;
@@ -211,12 +262,50 @@ compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
     coef->mcu_ctr = 0;
   }
   /* Completed the iMCU row, advance counters for next one */
+  JTRACE4(encode__row, coef->iMCU_row_num, cinfo->total_iMCU_rows,
+          cinfo->image_width, cinfo->dest->free_in_buffer);
   coef->iMCU_row_num++;
   start_iMCU_row(cinfo);
   return TRUE;
 }
 
 
+/*
+ * Process some data in the single-pass case.
+ * We process the equivalent of one fully interleaved MCU row ("iMCU" row)
+ * per call, ie, v_samp_factor block rows for each component in the image.
+ * This amount of data is read from the source buffer, DCT'd and quantized
+ * into the iMCU row buffers, and then emitted to the entropy encoder.
+ * Returns TRUE if the iMCU row is completed, FALSE if suspended.
+ *
+ * NB: input_buf contains a plane for each component in image,
+ * which we index according to the component's SOF position.
+ */
+
+METHODDEF(boolean)
+compress_data (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  int ci;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  jpeg_component_info *compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    buffer[ci] = coef->row_buffer[compptr->component_index];
+    /* If we suspended partway through the iMCU row, then the coefficients
+     * are already in the buffer.
+     */
+    if (! coef->row_ready)
+      transform_iMCU_row(cinfo, compptr, input_buf[compptr->component_index],
+                         buffer[ci]);
+  }
+  coef->row_ready = TRUE;
+
+  return emit_iMCU_row(cinfo, buffer);
+}
+
+
 #ifdef FULL_COEF_BUFFER_SUPPORTED
 
 /*
@@ -244,13 +333,9 @@ METHODDEF(boolean)
 compress_first_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
 {
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
-  JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  JDIMENSION blocks_across, MCUs_across, MCUindex;
-  int bi, ci, h_samp_factor, block_row, block_rows, ndummy;
-  JCOEF lastDC;
+  int ci;
   jpeg_component_info *compptr;
   JBLOCKARRAY buffer;
-  JBLOCKROW thisblockrow, lastblockrow;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -259,63 +344,7 @@ compress_first_pass (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
       ((j_common_ptr) cinfo, coef->whole_image[ci],
        coef->iMCU_row_num * compptr->v_samp_factor,
        (JDIMENSION) compptr->v_samp_factor, TRUE);
-    /* Count non-dummy DCT block rows in this iMCU row. */
-    if (coef->iMCU_row_num < last_iMCU_row)
-      block_rows = compptr->v_samp_factor;
-    else {
-      /* NB: can't use last_row_height here, since may not be set! */
-      block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
-      if (block_rows == 0) block_rows = compptr->v_samp_factor;
-    }
-    blocks_across = compptr->width_in_blocks;
-    h_samp_factor = compptr->h_samp_factor;
-    /* Count number of dummy blocks to be added at the right margin. */
-    ndummy = (int) (blocks_across % h_samp_factor);
-    if (ndummy > 0)
-      ndummy = h_samp_factor - ndummy;
-    /* Perform DCT for all non-dummy blocks in this iMCU row.  Each call
-     * on forward_DCT processes a complete horizontal row of DCT blocks.
-     */
-    for (block_row = 0; block_row < block_rows; block_row++) {
-      thisblockrow = buffer[block_row];
-      (*cinfo->fdct->forward_DCT) (cinfo, compptr,
-                                   input_buf[ci], thisblockrow,
-                                   (JDIMENSION) (block_row * DCTSIZE),
-                                   (JDIMENSION) 0, blocks_across);
-      if (ndummy > 0) {
-        /* Create dummy blocks at the right edge of the image. */
-        thisblockrow += blocks_across; /* => first dummy block */
-        jzero_far((void *) thisblockrow, ndummy * sizeof(JBLOCK));
-        lastDC = thisblockrow[-1][0];
-        for (bi = 0; bi < ndummy; bi++) {
-          thisblockrow[bi][0] = lastDC;
-        }
-      }
-    }
-    /* If at end of image, create dummy block rows as needed.
-     * The tricky part here is that within each MCU, we want the DC values
-     * of the dummy blocks to match the last real block's DC value.
-     * This squeezes a few more bytes out of the resulting file...
-     */
-    if (coef->iMCU_row_num == last_iMCU_row) {
-      blocks_across += ndummy;  /* include lower right corner */
-      MCUs_across = blocks_across / h_samp_factor;
-      for (block_row = block_rows; block_row < compptr->v_samp_factor;
-           block_row++) {
-        thisblockrow = buffer[block_row];
-        lastblockrow = buffer[block_row-1];
-        jzero_far((void *) thisblockrow,
-                  (size_t) (blocks_across * sizeof(JBLOCK)));
-        for (MCUindex = 0; MCUindex < MCUs_across; MCUindex++) {
-          lastDC = lastblockrow[h_samp_factor-1][0];
-          for (bi = 0; bi < h_samp_factor; bi++) {
-            thisblockrow[bi][0] = lastDC;
-          }
-          thisblockrow += h_samp_factor; /* advance to next MCU in row */
-          lastblockrow += h_samp_factor;
-        }
-      }
-    }
+    transform_iMCU_row(cinfo, compptr, input_buf[ci], buffer);
   }
   /* NB: compress_output will increment iMCU_row_num if successful.
    * A suspension return will result in redoing all the work above next time.
@@ -340,11 +369,8 @@ METHODDEF(boolean)
 compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
 {
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
-  JDIMENSION MCU_col_num;       /* index of current MCU within row */
-  int blkn, ci, xindex, yindex, yoffset;
-  JDIMENSION start_col;
+  int ci;
   JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
-  JBLOCKROW buffer_ptr;
   jpeg_component_info *compptr;
 
   /* Align the virtual buffers for the components used in this scan.
@@ -359,38 +385,26 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
        (JDIMENSION) compptr->v_samp_factor, FALSE);
   }
 
-  /* Loop to process one whole iMCU row */
-  for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
-       yoffset++) {
-    for (MCU_col_num = coef->mcu_ctr; MCU_col_num < cinfo->MCUs_per_row;
-         MCU_col_num++) {
-      /* Construct list of pointers to DCT blocks belonging to this MCU */
-      blkn = 0;                 /* index of current DCT block within MCU */
-      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
-        compptr = cinfo->cur_comp_info[ci];
-        start_col = MCU_col_num * compptr->MCU_width;
-        for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
-          buffer_ptr = buffer[ci][yindex+yoffset] + start_col;
-          for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
-            coef->MCU_buffer[blkn++] = buffer_ptr++;
-          }
-        }
-      }
-      /* Try to write the MCU. */
-      if (! (*cinfo->entropy->encode_mcu) (cinfo, coef->MCU_buffer)) {
-        /* Suspension forced; update state counters and exit */
-        coef->MCU_vert_offset = yoffset;
-        coef->mcu_ctr = MCU_col_num;
-        return FALSE;
-      }
-    }
-    /* Completed an MCU row, but perhaps not an iMCU row */
-    coef->mcu_ctr = 0;
-  }
-  /* Completed the iMCU row, advance counters for next one */
-  coef->iMCU_row_num++;
-  start_iMCU_row(cinfo);
-  return TRUE;
+  return emit_iMCU_row(cinfo, buffer);
+}
+
+/*
+ * Create a controller for another compression object (a copy of this one,
+ * which is used to encode a scan in parallel with the others.)  It shares the
+ * whole-image buffer but has its own position counters and MCU_buffer[].
+ */
+
+METHODDEF(void)
+clone_coef (j_compress_ptr cinfo, j_compress_ptr dstinfo)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  my_coef_ptr newcoef;
+
+  newcoef = (my_coef_ptr)
+    (*dstinfo->mem->alloc_small) ((j_common_ptr) dstinfo, JPOOL_IMAGE,
+                                  sizeof(my_coef_controller));
+  MEMCOPY(newcoef, coef, sizeof(my_coef_controller));
+  dstinfo->coef = (struct jpeg_c_coef_controller *) newcoef;
 }
 
 #endif /* FULL_COEF_BUFFER_SUPPORTED */
@@ -410,6 +424,7 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
                                 sizeof(my_coef_controller));
   cinfo->coef = (struct jpeg_c_coef_controller *) coef;
   coef->pub.start_pass = start_pass_coef;
+  coef->pub.clone = NULL;
 
   /* Create the coefficient buffer. */
   if (need_full_buffer) {
@@ -429,19 +444,23 @@ jinit_c_coef_controller (j_compress_ptr cinfo, boolean need_full_buffer)
                                 (long) compptr->v_samp_factor),
          (JDIMENSION) compptr->v_samp_factor);
     }
+    coef->pub.clone = clone_coef;
 #else
     ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
 #endif
   } else {
-    /* We only need a single-MCU buffer. */
-    JBLOCKROW buffer;
-    int i;
-
-    buffer = (JBLOCKROW)
-      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-                                  C_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
-    for (i = 0; i < C_MAX_BLOCKS_IN_MCU; i++) {
-      coef->MCU_buffer[i] = buffer + i;
+    /* We only need a one-iMCU-row buffer for each component, */
+    /* padded to a multiple of h_samp_factor DCT blocks. */
+    int ci;
+    jpeg_component_info *compptr;
+
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      coef->row_buffer[ci] = (*cinfo->mem->alloc_barray)
+        ((j_common_ptr) cinfo, JPOOL_IMAGE,
+         (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+                                (long) compptr->h_samp_factor),
+         (JDIMENSION) compptr->v_samp_factor);
     }
     coef->whole_image[0] = NULL; /* flag for no virtual arrays */
   }
@@ -397,6 +397,7 @@ quantize (JCOEFPTR coef_block, DCTELEM * divisors, DCTELEM * workspace)
 
   UDCTELEM recip, corr, shift;
   UDCTELEM2 product;
+  DCTELEM sign;
 
   for (i = 0; i < DCTSIZE2; i++) {
     temp = workspace[i];
@@ -404,18 +405,15 @@ quantize (JCOEFPTR coef_block, DCTELEM * divisors, DCTELEM * workspace)
     corr =  divisors[i + DCTSIZE2 * 1];
     shift = divisors[i + DCTSIZE2 * 3];
 
-    if (temp < 0) {
-      temp = -temp;
-      product = (UDCTELEM2)(temp + corr) * recip;
-      product >>= shift + sizeof(DCTELEM)*8;
-      temp = product;
-      temp = -temp;
-    } else {
-      product = (UDCTELEM2)(temp + corr) * recip;
-      product >>= shift + sizeof(DCTELEM)*8;
-      temp = product;
-    }
-    output_ptr[i] = (JCOEF) temp;
+    /* Take the absolute value, divide, and restore the sign without
+     * branching.  sign is 0 for positive values and -1 for negative values.
+     */
+    sign = temp >> (sizeof(DCTELEM) * 8 - 1);
+    temp = (temp ^ sign) - sign;
+    product = (UDCTELEM2)(temp + corr) * recip;
+    product >>= shift + sizeof(DCTELEM)*8;
+    temp = (DCTELEM) product;
+    output_ptr[i] = (JCOEF) ((temp ^ sign) - sign);
   }
 
 #else
@@ -5,7 +5,7 @@
  * Copyright (C) 1991-1997, Thomas G. Lane.
  * Modified 2003-2010 by Guido Vollbeding.
  * libjpeg-turbo Modifications:
- * Copyright (C) 2010, D. R. Commander.
+ * Copyright (C) 2010, 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains master control logic for the JPEG compressor.
@@ -18,6 +18,11 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jpegcomp.h"
+#include "jtrace.h"
+#ifdef WITH_THREADS
+#include <setjmp.h>
+#include "jthread.h"
+#endif
 
 
 /* Private state */
@@ -37,6 +42,12 @@ typedef struct {
   int total_passes;             /* total # of passes needed */
 
   int scan_number;              /* current index in scan_info[] */
+
+  int num_scan_threads;         /* # of threads for encoding scans */
+#ifdef WITH_THREADS
+  void (*error_exit) (j_common_ptr cinfo); /* application's error_exit */
+  jmp_buf setjmp_buffer;        /* for catching errors in the destination */
+#endif
 } my_comp_master;
 
 typedef my_comp_master * my_master_ptr;
@@ -502,6 +513,10 @@ prepare_for_pass (j_compress_ptr cinfo)
 
   master->pub.is_last_pass = (master->pass_number == master->total_passes-1);
 
+  JTRACE6(compress__pass, master->pass_number, master->total_passes,
+          (int) master->pass_type, master->scan_number, cinfo->image_width,
+          cinfo->image_height);
+
   /* Set up progress monitor's pass info if present */
   if (cinfo->progress != NULL) {
     cinfo->progress->completed_passes = master->pass_number;
@@ -570,6 +585,393 @@ finish_pass_master (j_compress_ptr cinfo)
 }
 
 
+#ifdef WITH_THREADS
+
+/*
+ * Parallel encoding of the scans of a multi-scan image.
+ *
+ * Once the whole-image coefficient buffer has been filled, each scan can be
+ * Huffman-encoded independently of the others.  The entropy encoder's state
+ * (DC predictions, EOB run, and correction bits) starts afresh with each scan,
+ * and a refinement scan needs only the coefficients, not the output of the
+ * earlier scans.  Thus, we encode all of the remaining scans concurrently,
+ * each into its own in-memory buffer, and then write them to the destination
+ * in script order, along with their tables and headers.  With Huffman
+ * optimization, each scan's statistics-gathering pass is performed by the
+ * same thread that encodes the scan.
+ *
+ * Each scan is encoded using a private copy of the compression object, which
+ * has its own memory manager, error manager, destination, component info,
+ * Huffman tables, entropy encoder, and coefficient controller.  The latter is
+ * cloned from the real one so that it reads the same coefficient buffer.  The
+ * buffer is only read, which is safe because jmemnobs.c never places any part
+ * of a virtual array in backing store.  Errors are caught by the private error
+ * manager and are reissued to the application's error manager once all of the
+ * scans have finished.
+ */
+
+#define SCAN_BUFFER_SIZE  65536 /* size of each chunk of a scan's output */
+
+typedef struct scan_buffer_struct {
+  struct scan_buffer_struct * next;
+  size_t bytes;                 /* # of bytes of compressed data in chunk */
+  JOCTET data[SCAN_BUFFER_SIZE];
+} scan_buffer;
+
+typedef struct {
+  struct jpeg_compress_struct cinfo; /* private copy of compression object */
+  j_compress_ptr srcinfo;       /* the real compression object */
+  my_comp_master master;        /* private copy of master state */
+  struct jpeg_error_mgr jerr;   /* private error manager */
+  jmp_buf setjmp_buffer;        /* for returning from error_exit */
+  boolean failed;               /* TRUE if an error occurred */
+  struct jpeg_destination_mgr dest; /* in-memory destination */
+  scan_buffer * head;           /* first chunk of compressed data */
+  scan_buffer * tail;           /* chunk currently being filled */
+} scan_job;
+
+
+METHODDEF(void)
+scan_error_exit (j_common_ptr cinfo)
+{
+  /* cinfo is the first member of the scan job, and the message code and
+   * parameters remain in the private error manager for reissuing.
+   */
+  scan_job * job = (scan_job *) cinfo;
+
+  longjmp(job->setjmp_buffer, 1);
+}
+
+
+/*
+ * In-memory destination for a scan.  The compressed data is accumulated in a
+ * list of fixed-size chunks, which are allocated from the private memory
+ * manager.
+ */
+
+METHODDEF(void)
+init_scan_destination (j_compress_ptr cinfo)
+{
+  scan_job * job = (scan_job *) cinfo;
+
+  job->head = job->tail = (scan_buffer *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                sizeof(scan_buffer));
+  job->tail->next = NULL;
+  job->dest.next_output_byte = job->tail->data;
+  job->dest.free_in_buffer = SCAN_BUFFER_SIZE;
+}
+
+METHODDEF(boolean)
+empty_scan_output_buffer (j_compress_ptr cinfo)
+{
+  scan_job * job = (scan_job *) cinfo;
+  scan_buffer * chunk;
+
+  chunk = (scan_buffer *)
+    (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                sizeof(scan_buffer));
+  chunk->next = NULL;
+  job->tail->bytes = SCAN_BUFFER_SIZE;
+  job->tail->next = chunk;
+  job->tail = chunk;
+  job->dest.next_output_byte = chunk->data;
+  job->dest.free_in_buffer = SCAN_BUFFER_SIZE;
+  return TRUE;
+}
+
+METHODDEF(void)
+term_scan_destination (j_compress_ptr cinfo)
+{
+  scan_job * job = (scan_job *) cinfo;
+
+  job->tail->bytes = SCAN_BUFFER_SIZE - job->dest.free_in_buffer;
+}
+
+
+LOCAL(void)
+copy_huff_table (j_compress_ptr cinfo, JHUFF_TBL ** htblptr)
+/* Replace *htblptr with a private copy of the table, if any */
+{
+  JHUFF_TBL * htbl;
+
+  if (*htblptr != NULL) {
+    htbl = jpeg_alloc_huff_table((j_common_ptr) cinfo);
+    MEMCOPY(htbl, *htblptr, sizeof(JHUFF_TBL));
+    *htblptr = htbl;
+  }
+}
+
+
+LOCAL(void)
+encode_scan_pass (j_compress_ptr cinfo, boolean gather_statistics)
+/* Perform one pass over the coefficient buffer for the current scan */
+{
+  JDIMENSION iMCU_row;
+
+  (*cinfo->entropy->start_pass) (cinfo, gather_statistics);
+  (*cinfo->coef->start_pass) (cinfo, JBUF_CRANK_DEST);
+  for (iMCU_row = 0; iMCU_row < cinfo->total_iMCU_rows; iMCU_row++) {
+    if (! (*cinfo->coef->compress_data) (cinfo, (JSAMPIMAGE) NULL))
+      ERREXIT(cinfo, JERR_CANT_SUSPEND);
+  }
+  (*cinfo->entropy->finish_pass) (cinfo);
+}
+
+
+/*
+ * Encode one scan.  This is called from the worker threads.
+ */
+
+LOCAL(void)
+encode_scan (void * arg, int task)
+{
+  scan_job * job = (scan_job *) arg + task;
+  j_compress_ptr cinfo = &job->cinfo;
+  j_compress_ptr srcinfo = job->srcinfo;
+  int i;
+
+  if (setjmp(job->setjmp_buffer)) {
+    job->failed = TRUE;
+    return;
+  }
+
+  jinit_memory_mgr((j_common_ptr) cinfo);
+
+  /* per_scan_setup() modifies the component info, and Huffman optimization
+   * modifies the Huffman tables, so we need our own copies of both.
+   */
+  cinfo->comp_info = (jpeg_component_info *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                cinfo->num_components *
+                                sizeof(jpeg_component_info));
+  MEMCOPY(cinfo->comp_info, srcinfo->comp_info,
+          cinfo->num_components * sizeof(jpeg_component_info));
+  for (i = 0; i < NUM_HUFF_TBLS; i++) {
+    copy_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[i]);
+    copy_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[i]);
+  }
+
+  select_scan_parameters(cinfo);
+  per_scan_setup(cinfo);
+
+  if (cinfo->progressive_mode) {
+#ifdef C_PROGRESSIVE_SUPPORTED
+    jinit_phuff_encoder(cinfo);
+#else
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+  } else
+    jinit_huff_encoder(cinfo);
+  (*srcinfo->coef->clone) (srcinfo, cinfo);
+
+  /* Huffman DC refinement scans need no Huffman table and therefore no
+   * optimization pass.
+   */
+  if (cinfo->optimize_coding && (cinfo->Ss != 0 || cinfo->Ah == 0))
+    encode_scan_pass(cinfo, TRUE);
+
+  (*cinfo->dest->init_destination) (cinfo);
+  encode_scan_pass(cinfo, FALSE);
+  (*cinfo->dest->term_destination) (cinfo);
+}
+
+
+METHODDEF(void)
+stitch_error_exit (j_common_ptr cinfo)
+{
+  my_master_ptr master = (my_master_ptr) ((j_compress_ptr) cinfo)->master;
+
+  longjmp(master->setjmp_buffer, 1);
+}
+
+
+LOCAL(void)
+release_scan_jobs (scan_job * jobs, int num_jobs)
+{
+  int i;
+
+  for (i = 0; i < num_jobs; i++)
+    jpeg_destroy((j_common_ptr) &jobs[i].cinfo);
+}
+
+
+LOCAL(void)
+write_scan_data (j_compress_ptr cinfo, scan_job * job)
+/* Copy a scan's compressed data to the real destination */
+{
+  struct jpeg_destination_mgr * dest = cinfo->dest;
+  scan_buffer * chunk;
+  const JOCTET * data;
+  size_t bytes, count;
+
+  for (chunk = job->head; chunk != NULL; chunk = chunk->next) {
+    data = chunk->data;
+    bytes = chunk->bytes;
+    while (bytes > 0) {
+      if (dest->free_in_buffer == 0) {
+        if (! (*dest->empty_output_buffer) (cinfo))
+          ERREXIT(cinfo, JERR_CANT_SUSPEND);
+      }
+      count = MIN(bytes, dest->free_in_buffer);
+      MEMCOPY(dest->next_output_byte, data, count);
+      dest->next_output_byte += count;
+      dest->free_in_buffer -= count;
+      data += count;
+      bytes -= count;
+    }
+  }
+}
+
+#endif /* WITH_THREADS */
+
+
+/*
+ * Encode the remaining scans in parallel, if the application has asked for
+ * more than one thread and there are at least two scans left.  This is called
+ * by jpeg_finish_compress() before it performs any remaining passes.
+ */
+
+METHODDEF(void)
+encode_remaining_scans (j_compress_ptr cinfo)
+{
+#ifdef WITH_THREADS
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  int first_scan = master->scan_number;
+  int num_jobs = cinfo->num_scans - first_scan;
+  int i, ci, passes_left;
+  scan_job * jobs;
+  scan_job * job;
+  jpeg_component_info * compptr;
+
+  if (master->num_scan_threads < 2 || master->pub.is_last_pass ||
+      num_jobs < 2 || cinfo->arith_code || cinfo->coef->clone == NULL)
+    return;
+
+  jobs = (scan_job *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                num_jobs * sizeof(scan_job));
+  for (i = 0; i < num_jobs; i++) {
+    job = &jobs[i];
+    job->cinfo = *cinfo;
+    job->srcinfo = cinfo;
+    job->master = *master;
+    job->master.scan_number = first_scan + i;
+    job->cinfo.master = (struct jpeg_comp_master *) &job->master;
+    job->cinfo.err = jpeg_std_error(&job->jerr);
+    job->jerr.error_exit = scan_error_exit;
+    job->cinfo.mem = NULL;
+    job->cinfo.progress = NULL;
+    job->dest.init_destination = init_scan_destination;
+    job->dest.empty_output_buffer = empty_scan_output_buffer;
+    job->dest.term_destination = term_scan_destination;
+    job->cinfo.dest = &job->dest;
+    job->failed = FALSE;
+    job->head = job->tail = NULL;
+  }
+
+  jthread_run_tasks(encode_scan, (void *) jobs, num_jobs,
+                    master->num_scan_threads);
+
+  for (i = 0; i < num_jobs; i++) {
+    if (jobs[i].failed) {
+      /* Reissue the first error, using the application's error manager */
+      cinfo->err->msg_code = jobs[i].jerr.msg_code;
+      MEMCOPY(&cinfo->err->msg_parm, &jobs[i].jerr.msg_parm,
+              sizeof(cinfo->err->msg_parm));
+      release_scan_jobs(jobs, num_jobs);
+      (*cinfo->err->error_exit) ((j_common_ptr) cinfo);
+    }
+  }
+
+  /* The destination manager may issue an error while we write the scans, so
+   * we intercept error_exit until we have freed the scans' memory.
+   */
+  master->error_exit = cinfo->err->error_exit;
+  if (setjmp(master->setjmp_buffer)) {
+    cinfo->err->error_exit = master->error_exit;
+    release_scan_jobs(jobs, num_jobs);
+    (*cinfo->err->error_exit) ((j_common_ptr) cinfo);
+  }
+  cinfo->err->error_exit = stitch_error_exit;
+
+  passes_left = master->total_passes - master->pass_number;
+  for (i = 0; i < num_jobs; i++) {
+    job = &jobs[i];
+    if (cinfo->progress != NULL) {
+      cinfo->progress->completed_passes =
+        master->pass_number + passes_left * i / num_jobs;
+      cinfo->progress->total_passes = master->total_passes;
+      cinfo->progress->pass_counter = 0L;
+      cinfo->progress->pass_limit = 1L;
+      (*cinfo->progress->progress_monitor) ((j_common_ptr) cinfo);
+    }
+
+    master->scan_number = first_scan + i;
+    select_scan_parameters(cinfo);
+    per_scan_setup(cinfo);
+
+    /* Install the optimal Huffman tables that were computed for this scan.
+     * These are the same tables that write_scan_header() will emit.
+     */
+    if (cinfo->optimize_coding) {
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        if (cinfo->Ss == 0 && cinfo->Ah == 0) {
+          if (cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no] == NULL)
+            cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no] =
+              jpeg_alloc_huff_table((j_common_ptr) cinfo);
+          MEMCOPY(cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no],
+                  job->cinfo.dc_huff_tbl_ptrs[compptr->dc_tbl_no],
+                  sizeof(JHUFF_TBL));
+        }
+        if (cinfo->Se) {
+          if (cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no] == NULL)
+            cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no] =
+              jpeg_alloc_huff_table((j_common_ptr) cinfo);
+          MEMCOPY(cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no],
+                  job->cinfo.ac_huff_tbl_ptrs[compptr->ac_tbl_no],
+                  sizeof(JHUFF_TBL));
+        }
+      }
+    }
+
+    if (master->scan_number == 0)
+      (*cinfo->marker->write_frame_header) (cinfo);
+    (*cinfo->marker->write_scan_header) (cinfo);
+    write_scan_data(cinfo, job);
+  }
+
+  cinfo->err->error_exit = master->error_exit;
+  release_scan_jobs(jobs, num_jobs);
+
+  master->pass_number = master->total_passes;
+  master->pub.is_last_pass = TRUE;
+#endif
+}
+
+
+/*
+ * Set the number of threads that jpeg_finish_compress() may use to encode
+ * the scans of a multi-scan image.  This must be called after
+ * jpeg_start_compress() or jpeg_write_coefficients().
+ */
+
+GLOBAL(void)
+jpeg_set_scan_threads (j_compress_ptr cinfo, int num_threads)
+{
+  my_master_ptr master;
+
+  if (cinfo->global_state != CSTATE_SCANNING &&
+      cinfo->global_state != CSTATE_RAW_OK &&
+      cinfo->global_state != CSTATE_WRCOEFS &&
+      cinfo->global_state != CSTATE_WRCOEFROWS)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  master = (my_master_ptr) cinfo->master;
+  master->num_scan_threads = num_threads;
+}
+
+
 /*
  * Initialize master compression control.
  */
@@ -586,7 +988,9 @@ jinit_c_master_control (j_compress_ptr cinfo, boolean transcode_only)
   master->pub.prepare_for_pass = prepare_for_pass;
   master->pub.pass_startup = pass_startup;
   master->pub.finish_pass = finish_pass_master;
+  master->pub.encode_remaining_scans = encode_remaining_scans;
   master->pub.is_last_pass = FALSE;
+  master->num_scan_threads = 1;
 
   /* Validate parameters, determine derived values */
   initial_setup(cinfo, transcode_only);
@@ -3,8 +3,8 @@
  *
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1995-1997, Thomas G. Lane.
- * It was modified by The libjpeg-turbo Project to include only code relevant
- * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains Huffman entropy encoding routines for progressive JPEG.
@@ -21,6 +21,41 @@
 
 #ifdef C_PROGRESSIVE_SUPPORTED
 
+/*
+ * NOTE: The AC scan encoders make a pre-pass over each block that gathers the
+ * coefficients in zigzag order, applies the point transform, and builds a
+ * 64-bit mask of the coefficients that are nonzero afterward.  The main loop
+ * then visits only those coefficients rather than testing every coefficient
+ * in the band.  Walking the mask requires an intrinsic for counting trailing
+ * zero bits, so this is done only with compilers that provide one (GCC, Clang,
+ * and 64-bit Visual C++.)  Other compilers use the original scalar loops.
+ */
+
+#if defined __GNUC__
+#define USE_CTZ_INTRINSIC
+#define CTZ64(x)  __builtin_ctzll(x)
+#define JPEG_NBITS_NONZERO(x)  (32 - __builtin_clz(x))
+#elif defined _MSC_VER && defined _WIN64
+#include <intrin.h>
+#define USE_CTZ_INTRINSIC
+#define CTZ64(x)  jctz64(x)
+#define JPEG_NBITS_NONZERO(x)  jnbits(x)
+LOCAL(int)
+jctz64 (unsigned __int64 x)
+{
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (int) index;
+}
+LOCAL(int)
+jnbits (unsigned int x)
+{
+  unsigned long index;
+  _BitScanReverse(&index, x);
+  return (int) index + 1;
+}
+#endif
+
 /* Expanded entropy encoder object for progressive Huffman encoding. */
 
 typedef struct {
@@ -297,13 +332,21 @@ LOCAL(void)
 emit_buffered_bits (phuff_entropy_ptr entropy, char * bufstart,
                     unsigned int nbits)
 {
+  register unsigned int code;
+  register int size, i;
+
   if (entropy->gather_statistics)
     return;                     /* no real work */
 
+  /* Pack up to 16 correction bits into each call to emit_bits(). */
   while (nbits > 0) {
-    emit_bits(entropy, (unsigned int) (*bufstart), 1);
-    bufstart++;
-    nbits--;
+    size = nbits > 16 ? 16 : (int) nbits;
+    code = 0;
+    for (i = 0; i < size; i++)
+      code = (code << 1) | (unsigned int) bufstart[i];
+    emit_bits(entropy, code, size);
+    bufstart += size;
+    nbits -= size;
   }
 }
 
@@ -455,6 +498,43 @@ encode_mcu_DC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+#ifdef USE_CTZ_INTRINSIC
+
+/*
+ * Pre-pass for an AC initial scan.  Gathers the Sl coefficients of the band in
+ * zigzag order and applies the point transform by Al.  For AC coefficients,
+ * this is an integer division with rounding towards 0, so we shift after
+ * obtaining the absolute value.  values[k] receives the transformed absolute
+ * value and values[k + DCTSIZE2] the output bits (the bitwise complement of
+ * the absolute value, if the coefficient is negative.)  Returns a mask in
+ * which bit k is set if the k'th transformed coefficient is nonzero.
+ *
+ * The loop contains no data-dependent branches, so apart from the gather it
+ * can be vectorized by the compiler.
+ */
+
+LOCAL(unsigned long long)
+encode_mcu_AC_first_prepare (const JCOEF *block, const int *natural_order,
+                             int Sl, int Al, int *values)
+{
+  register int k, temp, sign;
+  unsigned long long nonzero = 0;
+
+  for (k = 0; k < Sl; k++) {
+    temp = block[natural_order[k]];
+    sign = temp >> 31;          /* -1 if the coefficient is negative, else 0 */
+    temp = ((temp ^ sign) - sign) >> Al;
+    values[k] = temp;
+    values[k + DCTSIZE2] = temp ^ sign;
+    nonzero |= ((unsigned long long) (temp != 0)) << k;
+  }
+
+  return nonzero;
+}
+
+#endif /* USE_CTZ_INTRINSIC */
+
+
 /*
  * MCU encoding for AC initial scan (either spectral selection,
  * or first pass of successive approximation).
@@ -467,9 +547,15 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   register int temp, temp2;
   register int nbits;
   register int r, k;
+  int Ss = cinfo->Ss;
   int Se = cinfo->Se;
   int Al = cinfo->Al;
   JBLOCKROW block;
+#ifdef USE_CTZ_INTRINSIC
+  int idx;
+  unsigned long long nonzero;
+  int values[2 * DCTSIZE2];
+#endif
 
   entropy->next_output_byte = cinfo->dest->next_output_byte;
   entropy->free_in_buffer = cinfo->dest->free_in_buffer;
@@ -484,9 +570,52 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 
   /* Encode the AC coefficients per section G.1.2.2, fig. G.3 */
 
+#ifdef USE_CTZ_INTRINSIC
+
+  nonzero = encode_mcu_AC_first_prepare(*block, jpeg_natural_order + Ss,
+                                        Se - Ss + 1, Al, values);
+
   r = 0;                        /* r = run length of zeros */
+  k = 0;                        /* k = index after last nonzero coef */
+
+  while (nonzero) {
+    idx = CTZ64(nonzero);
+    nonzero &= nonzero - 1;
+    r = idx - k;
+    k = idx + 1;
+    temp = values[idx];
+    temp2 = values[idx + DCTSIZE2];
 
-  for (k = cinfo->Ss; k <= Se; k++) {
+    /* Emit any pending EOBRUN */
+    if (entropy->EOBRUN > 0)
+      emit_eobrun(entropy);
+    /* if run length > 15, must emit special run-length-16 codes (0xF0) */
+    while (r > 15) {
+      emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
+      r -= 16;
+    }
+
+    /* Find the number of bits needed for the magnitude of the coefficient */
+    nbits = JPEG_NBITS_NONZERO(temp);
+    /* Check for out-of-range coefficient values */
+    if (nbits > MAX_COEF_BITS)
+      ERREXIT(cinfo, JERR_BAD_DCT_COEF);
+
+    /* Count/emit Huffman symbol for run length / number of bits */
+    emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + nbits);
+
+    /* Emit that number of bits of the value, if positive, */
+    /* or the complement of its magnitude, if negative. */
+    emit_bits(entropy, (unsigned int) temp2, nbits);
+  }
+
+  r = Se - Ss + 1 - k;          /* trailing zeroes */
+
+#else
+
+  r = 0;                        /* r = run length of zeros */
+
+  for (k = Ss; k <= Se; k++) {
     if ((temp = (*block)[jpeg_natural_order[k]]) == 0) {
       r++;
       continue;
@@ -538,6 +667,8 @@ encode_mcu_AC_first (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     r = 0;                      /* reset zero run length */
   }
 
+#endif /* USE_CTZ_INTRINSIC */
+
   if (r > 0) {                  /* If there are trailing zeroes, */
     entropy->EOBRUN++;          /* count an EOB */
     if (entropy->EOBRUN == 0x7FFF)
@@ -610,6 +741,43 @@ encode_mcu_DC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+#ifdef USE_CTZ_INTRINSIC
+
+/*
+ * Pre-pass for an AC refinement scan.  absvalues[k] receives the absolute
+ * value of the k'th coefficient of the band after the point transform, and
+ * absvalues[k + DCTSIZE2] is 1 if the coefficient is positive.  *nonzero
+ * receives a mask of the transformed coefficients that are nonzero.  Returns
+ * the index of the last newly-nonzero coefficient (the EOB position), or -1 if
+ * there are none.
+ */
+
+LOCAL(int)
+encode_mcu_AC_refine_prepare (const JCOEF *block, const int *natural_order,
+                              int Sl, int Al, int *absvalues,
+                              unsigned long long *nonzero)
+{
+  register int k, temp, sign;
+  int EOB = -1;
+  unsigned long long mask = 0;
+
+  for (k = 0; k < Sl; k++) {
+    temp = block[natural_order[k]];
+    sign = temp >> 31;          /* -1 if the coefficient is negative, else 0 */
+    temp = ((temp ^ sign) - sign) >> Al;
+    absvalues[k] = temp;
+    absvalues[k + DCTSIZE2] = sign + 1;
+    mask |= ((unsigned long long) (temp != 0)) << k;
+    EOB = (temp == 1) ? k : EOB;
+  }
+
+  *nonzero = mask;
+  return EOB;
+}
+
+#endif /* USE_CTZ_INTRINSIC */
+
+
 /*
  * MCU encoding for AC successive approximation refinement scan.
  */
@@ -623,10 +791,17 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   int EOB;
   char *BR_buffer;
   unsigned int BR;
+  int Ss = cinfo->Ss;
   int Se = cinfo->Se;
   int Al = cinfo->Al;
   JBLOCKROW block;
+#ifdef USE_CTZ_INTRINSIC
+  int idx;
+  unsigned long long nonzero;
+  int absvalues[2 * DCTSIZE2];
+#else
   int absvalues[DCTSIZE2];
+#endif
 
   entropy->next_output_byte = cinfo->dest->next_output_byte;
   entropy->free_in_buffer = cinfo->dest->free_in_buffer;
@@ -639,11 +814,70 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   /* Encode the MCU data block */
   block = MCU_data[0];
 
+#ifdef USE_CTZ_INTRINSIC
+
+  EOB = encode_mcu_AC_refine_prepare(*block, jpeg_natural_order + Ss,
+                                     Se - Ss + 1, Al, absvalues, &nonzero);
+
+  /* Encode the AC coefficients per section G.1.2.3, fig. G.7 */
+
+  r = 0;                        /* r = run length of zeros */
+  k = 0;                        /* k = index after last nonzero coef */
+  BR = 0;                       /* BR = count of buffered bits added now */
+  BR_buffer = entropy->bit_buffer + entropy->BE; /* Append bits to buffer */
+
+  while (nonzero) {
+    idx = CTZ64(nonzero);
+    nonzero &= nonzero - 1;
+    r += idx - k;
+    k = idx + 1;
+    temp = absvalues[idx];
+
+    /* Emit any required ZRLs, but not if they can be folded into EOB */
+    while (r > 15 && idx <= EOB) {
+      /* emit any pending EOBRUN and the BE correction bits */
+      emit_eobrun(entropy);
+      /* Emit ZRL */
+      emit_symbol(entropy, entropy->ac_tbl_no, 0xF0);
+      r -= 16;
+      /* Emit buffered correction bits that must be associated with ZRL */
+      emit_buffered_bits(entropy, BR_buffer, BR);
+      BR_buffer = entropy->bit_buffer; /* BE bits are gone now */
+      BR = 0;
+    }
+
+    /* If the coef was previously nonzero, it only needs a correction bit. */
+    if (temp > 1) {
+      /* The correction bit is the next bit of the absolute value. */
+      BR_buffer[BR++] = (char) (temp & 1);
+      continue;
+    }
+
+    /* Emit any pending EOBRUN and the BE correction bits */
+    emit_eobrun(entropy);
+
+    /* Count/emit Huffman symbol for run length / number of bits */
+    emit_symbol(entropy, entropy->ac_tbl_no, (r << 4) + 1);
+
+    /* Emit output bit for newly-nonzero coef */
+    emit_bits(entropy, (unsigned int) absvalues[idx + DCTSIZE2], 1);
+
+    /* Emit buffered correction bits that must be associated with this code */
+    emit_buffered_bits(entropy, BR_buffer, BR);
+    BR_buffer = entropy->bit_buffer; /* BE bits are gone now */
+    BR = 0;
+    r = 0;                      /* reset zero run length */
+  }
+
+  r += Se - Ss + 1 - k;         /* trailing zeroes */
+
+#else
+
   /* It is convenient to make a pre-pass to determine the transformed
    * coefficients' absolute values and the EOB position.
    */
   EOB = 0;
-  for (k = cinfo->Ss; k <= Se; k++) {
+  for (k = Ss; k <= Se; k++) {
     temp = (*block)[jpeg_natural_order[k]];
     /* We must apply the point transform by Al.  For AC coefficients this
      * is an integer division with rounding towards 0.  To do this portably
@@ -663,7 +897,7 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
   BR = 0;                       /* BR = count of buffered bits added now */
   BR_buffer = entropy->bit_buffer + entropy->BE; /* Append bits to buffer */
 
-  for (k = cinfo->Ss; k <= Se; k++) {
+  for (k = Ss; k <= Se; k++) {
     if ((temp = absvalues[k]) == 0) {
       r++;
       continue;
@@ -710,6 +944,8 @@ encode_mcu_AC_refine (j_compress_ptr cinfo, JBLOCKROW *MCU_data)
     r = 0;                      /* reset zero run length */
   }
 
+#endif /* USE_CTZ_INTRINSIC */
+
   if (r > 0 || BR > 0) {        /* If there are trailing zeroes, */
     entropy->EOBRUN++;          /* count an EOB */
     entropy->BE += BR;          /* concat my correction bits to older ones */
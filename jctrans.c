@@ -4,12 +4,13 @@
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1995-1998, Thomas G. Lane.
  * Modified 2000-2009 by Guido Vollbeding.
- * It was modified by The libjpeg-turbo Project to include only code relevant
- * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains library routines for transcoding compression,
- * that is, writing raw DCT coefficient arrays to an output JPEG file.
+ * that is, writing raw DCT coefficient arrays (or rows of them) to an output
+ * JPEG file.
  * The routines in jcapimin.c will also be needed by a transcoder.
  */
 
@@ -35,6 +36,11 @@ LOCAL(void) transencode_coef_controller
  * the time write_coefficients is called; indeed, if the virtual arrays
  * were requested from this compression object's memory manager, they
  * typically will be realized during this routine and filled afterwards.
+ *
+ * If coef_arrays is NULL, then the coefficients are instead passed to
+ * jpeg_write_coefficient_row() one iMCU row at a time, after any markers have
+ * been written.  That requires an output file that can be written in a single
+ * pass: one scan and no Huffman table optimization.
  */
 
 GLOBAL(void)
@@ -49,9 +55,60 @@ jpeg_write_coefficients (j_compress_ptr cinfo, jvirt_barray_ptr * coef_arrays)
   (*cinfo->dest->init_destination) (cinfo);
   /* Perform master selection of active modules */
   transencode_master_selection(cinfo, coef_arrays);
-  /* Wait for jpeg_finish_compress() call */
+  /* Wait for jpeg_finish_compress() or jpeg_write_coefficient_row() call */
   cinfo->next_scanline = 0;     /* so jpeg_write_marker works */
-  cinfo->global_state = CSTATE_WRCOEFS;
+  cinfo->global_state = coef_arrays ? CSTATE_WRCOEFS : CSTATE_WRCOEFROWS;
+}
+
+
+/*
+ * Write the coefficients of the next iMCU row, after
+ * jpeg_write_coefficients(cinfo, NULL).  data[ci] points to v_samp_factor
+ * block rows for component ci, each of which is width_in_blocks wide, in the
+ * same layout that jpeg_read_coefficient_row() produces.  Once all
+ * total_iMCU_rows rows have been written, call jpeg_finish_compress().
+ *
+ * Returns FALSE if the data destination suspended, in which case the same row
+ * must be passed again, or if too many rows were passed.
+ */
+
+GLOBAL(boolean)
+jpeg_write_coefficient_row (j_compress_ptr cinfo, JBLOCKIMAGE data)
+{
+  JDIMENSION lines_per_iMCU_row;
+
+  if (cinfo->global_state != CSTATE_WRCOEFROWS)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (cinfo->next_scanline >= cinfo->image_height) {
+    WARNMS(cinfo, JWRN_TOO_MUCH_DATA);
+    return FALSE;
+  }
+
+  /* Call progress monitor hook if present */
+  if (cinfo->progress != NULL) {
+    cinfo->progress->pass_counter = (long) cinfo->next_scanline;
+    cinfo->progress->pass_limit = (long) cinfo->image_height;
+    (*cinfo->progress->progress_monitor) ((j_common_ptr) cinfo);
+  }
+
+  /* Start the (only) output pass on the first call.  This emits the frame
+   * and scan headers, so the application can write markers up until then.
+   */
+  if (! cinfo->master->is_last_pass)
+    (*cinfo->master->prepare_for_pass) (cinfo);
+
+  /* Directly compress the row.  The coefficient controller knows to treat
+   * the input buffer as a JBLOCKIMAGE.
+   */
+  if (! (*cinfo->coef->compress_data) (cinfo, (JSAMPIMAGE) data)) {
+    /* If compressor did not consume the whole row, suspend processing. */
+    return FALSE;
+  }
+
+  /* OK, we processed one iMCU row. */
+  lines_per_iMCU_row = cinfo->max_v_samp_factor * DCTSIZE;
+  cinfo->next_scanline += lines_per_iMCU_row;
+  return TRUE;
 }
 
 
@@ -79,6 +136,14 @@ jpeg_copy_critical_parameters (j_decompress_ptr srcinfo,
   dstinfo->image_height = srcinfo->image_height;
   dstinfo->input_components = srcinfo->num_components;
   dstinfo->in_color_space = srcinfo->jpeg_color_space;
+#if JPEG_LIB_VERSION >= 80
+  /* If the coefficients haven't been read yet (which is the case when
+   * transcoding one iMCU row at a time), then compute the source's output
+   * dimensions now.
+   */
+  if (srcinfo->global_state == DSTATE_READY)
+    jpeg_core_output_dimensions(srcinfo);
+#endif
 #if JPEG_LIB_VERSION >= 70
   dstinfo->jpeg_width = srcinfo->output_width;
   dstinfo->jpeg_height = srcinfo->output_height;
@@ -174,6 +239,11 @@ transencode_master_selection (j_compress_ptr cinfo,
   /* Initialize master control (includes parameter checking/processing) */
   jinit_c_master_control(cinfo, TRUE /* transcode only */);
 
+  /* Without coefficient arrays, each iMCU row can be encoded only once. */
+  if (coef_arrays == NULL &&
+      (cinfo->num_scans > 1 || cinfo->optimize_coding))
+    ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
+
   /* Entropy encoding: either Huffman or arithmetic coding. */
   if (cinfo->arith_code) {
 #ifdef C_ARITH_CODING_SUPPORTED
@@ -211,9 +281,9 @@ transencode_master_selection (j_compress_ptr cinfo,
 /*
  * The rest of this file is a special implementation of the coefficient
  * buffer controller.  This is similar to jccoefct.c, but it handles only
- * output from presupplied virtual arrays.  Furthermore, we generate any
- * dummy padding blocks on-the-fly rather than expecting them to be present
- * in the arrays.
+ * output from presupplied virtual arrays (or iMCU rows.)  Furthermore, we
+ * generate any dummy padding blocks on-the-fly rather than expecting them to
+ * be present in the arrays.
  */
 
 /* Private buffer controller object */
@@ -226,7 +296,8 @@ typedef struct {
   int MCU_vert_offset;          /* counts MCU rows within iMCU row */
   int MCU_rows_per_iMCU_row;    /* number of such rows needed */
 
-  /* Virtual block array for each component. */
+  /* Virtual block array for each component (NULL if the coefficients are
+   * supplied by jpeg_write_coefficient_row()) */
   jvirt_barray_ptr * whole_image;
 
   /* Workspace for constructing dummy blocks at right/bottom edges. */
@@ -281,10 +352,13 @@ start_pass_coef (j_compress_ptr cinfo, J_BUF_MODE pass_mode)
  * Process some data.
  * We process the equivalent of one fully interleaved MCU row ("iMCU" row)
  * per call, ie, v_samp_factor block rows for each component in the scan.
- * The data is obtained from the virtual arrays and fed to the entropy coder.
+ * The data is obtained from the virtual arrays (or the application's row
+ * buffer) and fed to the entropy coder.
  * Returns TRUE if the iMCU row is completed, FALSE if suspended.
  *
- * NB: input_buf is ignored; it is likely to be a NULL pointer.
+ * NB: input_buf is actually the application's JBLOCKIMAGE if the coefficients
+ * are supplied by jpeg_write_coefficient_row().  Otherwise, it is ignored; it
+ * is likely to be a NULL pointer.
  */
 
 METHODDEF(boolean)
@@ -304,10 +378,13 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
   /* Align the virtual buffers for the components used in this scan. */
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
-    buffer[ci] = (*cinfo->mem->access_virt_barray)
-      ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
-       coef->iMCU_row_num * compptr->v_samp_factor,
-       (JDIMENSION) compptr->v_samp_factor, FALSE);
+    if (coef->whole_image == NULL)
+      buffer[ci] = ((JBLOCKIMAGE) input_buf)[compptr->component_index];
+    else
+      buffer[ci] = (*cinfo->mem->access_virt_barray)
+        ((j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
+         coef->iMCU_row_num * compptr->v_samp_factor,
+         (JDIMENSION) compptr->v_samp_factor, FALSE);
   }
 
   /* Loop to process one whole iMCU row */
@@ -364,6 +441,37 @@ compress_output (j_compress_ptr cinfo, JSAMPIMAGE input_buf)
 }
 
 
+/*
+ * Create a controller for another compression object (a copy of this one,
+ * which is used to encode a scan in parallel with the others.)  It shares the
+ * coefficient arrays but needs its own dummy blocks, since compress_output()
+ * modifies them.
+ */
+
+METHODDEF(void)
+clone_coef (j_compress_ptr cinfo, j_compress_ptr dstinfo)
+{
+  my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
+  my_coef_ptr newcoef;
+  JBLOCKROW buffer;
+  int i;
+
+  newcoef = (my_coef_ptr)
+    (*dstinfo->mem->alloc_small) ((j_common_ptr) dstinfo, JPOOL_IMAGE,
+                                  sizeof(my_coef_controller));
+  MEMCOPY(newcoef, coef, sizeof(my_coef_controller));
+  dstinfo->coef = (struct jpeg_c_coef_controller *) newcoef;
+
+  buffer = (JBLOCKROW)
+    (*dstinfo->mem->alloc_large) ((j_common_ptr) dstinfo, JPOOL_IMAGE,
+                                  C_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+  jzero_far((void *) buffer, C_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+  for (i = 0; i < C_MAX_BLOCKS_IN_MCU; i++) {
+    newcoef->dummy_buffer[i] = buffer + i;
+  }
+}
+
+
 /*
  * Initialize coefficient buffer controller.
  *
@@ -386,6 +494,7 @@ transencode_coef_controller (j_compress_ptr cinfo,
   cinfo->coef = (struct jpeg_c_coef_controller *) coef;
   coef->pub.start_pass = start_pass_coef;
   coef->pub.compress_data = compress_output;
+  coef->pub.clone = clone_coef;
 
   /* Save pointer to virtual arrays */
   coef->whole_image = coef_arrays;
@@ -21,6 +21,7 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jtrace.h"
 
 
 /*
@@ -389,6 +390,15 @@ jpeg_finish_decompress (j_decompress_ptr cinfo)
     if ((*cinfo->inputctl->consume_input) (cinfo) == JPEG_SUSPENDED)
       return FALSE;             /* Suspend, come back later */
   }
+#ifdef WITH_USDT
+  {
+    jpeg_memory_stats stats;
+
+    jpeg_get_memory_stats((j_common_ptr) cinfo, &stats);
+    JTRACE4(decompress__done, cinfo->output_width, cinfo->output_height,
+            cinfo->out_color_components, stats.peak_bytes);
+  }
+#endif
   /* Do final cleanup */
   (*cinfo->src->term_source) (cinfo);
   /* We can use jpeg_abort to release memory and reset global_state */
@@ -4,7 +4,7 @@
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1994-1996, Thomas G. Lane.
  * libjpeg-turbo Modifications:
- * Copyright (C) 2010, D. R. Commander.
+ * Copyright (C) 2010, 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains application interface code for the decompression half
@@ -20,6 +20,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jpegcomp.h"
+#include "jtrace.h"
 
 
 /* Forward declarations */
@@ -43,6 +44,9 @@ jpeg_start_decompress (j_decompress_ptr cinfo)
   if (cinfo->global_state == DSTATE_READY) {
     /* First call: initialize master control, select active modules */
     jinit_master_decompress(cinfo);
+    JTRACE6(decompress__start, cinfo->image_width, cinfo->image_height,
+            cinfo->num_components, cinfo->output_width, cinfo->output_height,
+            cinfo->out_color_components);
     if (cinfo->buffered_image) {
       /* No more work here; expecting jpeg_start_output next */
       cinfo->global_state = DSTATE_BUFIMAGE;
@@ -275,4 +279,67 @@ jpeg_finish_output (j_decompress_ptr cinfo)
   return TRUE;
 }
 
+
+/*
+ * Absorb input in buffered-image mode until max_scans scans have been
+ * completed or at least max_bytes bytes have been consumed from the data
+ * source by this call, whichever comes first (either limit is ignored if it
+ * is <= 0.)  The byte count is checked at the end of each iMCU row.  If a
+ * limit is reached before the end of the file, the rest of the input is
+ * abandoned: any partially read scan is terminated, and the input side is
+ * treated as though EOI had been reached, so that subsequent output passes
+ * use the partially refined coefficients without reading more data.  The
+ * application should then call jpeg_start_output() with
+ * cinfo->input_scan_number as the target scan.
+ *
+ * Returns FALSE if suspended.  The return value need be inspected only if
+ * a suspending data source is used.
+ */
+
+GLOBAL(boolean)
+jpeg_consume_scans (j_decompress_ptr cinfo, int max_scans, long max_bytes)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+  struct jpeg_input_controller * inputctl = cinfo->inputctl;
+  long nbytes;
+  int retcode;
+
+  if (cinfo->global_state != DSTATE_BUFIMAGE)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  /* Count the bytes consumed, including those in buffers that the data source
+   * discards when it refills (see jfill_input_buffer().)
+   */
+  inputctl->bytes_consumed = 0;
+  inputctl->last_byte = src->next_input_byte;
+
+  while (! inputctl->eoi_reached) {
+    if ((retcode = (*inputctl->consume_input) (cinfo)) == JPEG_SUSPENDED) {
+      inputctl->last_byte = NULL;
+      return FALSE;
+    }
+    nbytes = inputctl->bytes_consumed +
+             (long) (src->next_input_byte - inputctl->last_byte);
+
+    if (retcode == JPEG_SCAN_COMPLETED && max_scans > 0 &&
+        cinfo->input_scan_number >= max_scans)
+      break;
+    if (retcode == JPEG_ROW_COMPLETED && max_bytes > 0 &&
+        nbytes >= max_bytes) {
+      /* Terminate the current scan early. */
+      cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+      (*inputctl->finish_input_pass) (cinfo);
+      break;
+    }
+    if (retcode == JPEG_SCAN_COMPLETED && max_bytes > 0 &&
+        nbytes >= max_bytes)
+      break;
+  }
+  inputctl->last_byte = NULL;
+
+  /* Don't read any further. */
+  inputctl->eoi_reached = TRUE;
+  return TRUE;
+}
+
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
@@ -5,6 +5,8 @@
  * Developed 1997-2009 by Guido Vollbeding.
  * It was modified by The libjpeg-turbo Project to include only code relevant
  * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains portable arithmetic entropy decoding routines for JPEG
@@ -18,23 +20,76 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jconfigint.h"
 
 
-/* Expanded entropy decoder object for arithmetic decoding. */
+/*
+ * The C register holds the base of the coding interval (16 bits) followed by
+ * ct bits of not-yet-consumed input.  Rather than inserting one byte whenever
+ * the bit buffer part runs dry, we insert as many bytes as will fit in a
+ * machine word, so the input is touched only once every few decisions on
+ * 64-bit platforms.  With A <= 0x10000, C < (A << ct) < 2^(17 + ct), so ct can
+ * be as large as (ARITH_BUF_SIZE - 17).
+ */
+
+#if __WORDSIZE == 64 || defined(_WIN64)
+
+typedef size_t arith_buf_type;  /* type of C register */
+#define ARITH_BUF_SIZE  64              /* size of C register in bits */
+
+#else
+
+typedef unsigned int arith_buf_type; /* type of C register */
+#define ARITH_BUF_SIZE  32              /* size of C register in bits */
+
+#endif
+
+#define MAX_CT  (ARITH_BUF_SIZE - 17)   /* max # of bits in bit buffer part */
+
+
+/*
+ * Table D.2, expanded so that it can be indexed directly by a statistics bin
+ * (MPS sense in the highest bit, state index in the lower bits.)  The next
+ * bin value for each outcome already includes the MPS sense (and the MPS/LPS
+ * exchange, if any), which saves several operations per decision.
+ */
 
 typedef struct {
-  struct jpeg_entropy_decoder pub; /* public fields */
+  unsigned short qe;            /* Qe_Value */
+  unsigned char next_mps;       /* bin value after decoding the MPS */
+  unsigned char next_lps;       /* bin value after decoding the LPS */
+} arith_transition;
+
+
+/* Arithmetic decoding state.  This is copied into local storage by each of
+ * the MCU decoding routines, so that the compiler can keep it in registers
+ * (updates to the statistics bins would otherwise force it to reload the
+ * registers from the entropy decoder object after every decision.)
+ */
 
-  INT32 c;       /* C register, base of coding interval + input bit buffer */
+typedef struct {
+  arith_buf_type c;    /* C register, base of interval + input bit buffer */
   INT32 a;               /* A register, normalized size of coding interval */
   int ct;     /* bit shift counter, # of bits left in bit buffer part of C */
                                                          /* init: ct = -16 */
-                                                         /* run: ct = 0..7 */
+                                                         /* run: ct >= 0 */
                                                          /* error: ct = -1 */
+  const arith_transition * trans; /* -> expanded Table D.2 */
+} arith_state;
+
+
+/* Expanded entropy decoder object for arithmetic decoding. */
+
+typedef struct {
+  struct jpeg_entropy_decoder pub; /* public fields */
+
+  arith_state state;            /* arithmetic decoding state */
+
   int last_dc_val[MAX_COMPS_IN_SCAN]; /* last DC coef for each component */
   int dc_context[MAX_COMPS_IN_SCAN]; /* context index for DC conditioning */
 
   unsigned int restarts_to_go;  /* MCUs left in this restart interval */
+  int stuffed_bytes;            /* # of zero bytes inserted after a marker */
 
   /* Pointers to statistics areas (these workspaces have image lifespan) */
   unsigned char * dc_stats[NUM_ARITH_TBLS];
@@ -42,6 +97,8 @@ typedef struct {
 
   /* Statistics bin for coding with fixed probability 0.5 */
   unsigned char fixed_bin[4];
+
+  arith_transition trans[256];  /* expanded Table D.2 */
 } arith_entropy_decoder;
 
 typedef arith_entropy_decoder * arith_entropy_ptr;
@@ -63,6 +120,27 @@ typedef arith_entropy_decoder * arith_entropy_ptr;
 #define AC_STAT_BINS 256
 
 
+/*
+ * Renormalization shifts A left until it is >= 0x8000.  With a
+ * count-leading-zeros operation, we can compute the shift count directly
+ * instead of shifting one bit at a time.
+ */
+
+#if defined __GNUC__
+#define RENORM_SHIFT(a)  (__builtin_clz((unsigned int) (a)) - 16)
+#elif defined _MSC_VER
+#include <intrin.h>
+#define RENORM_SHIFT(a)  jrenorm_shift(a)
+LOCAL(int)
+jrenorm_shift (INT32 a)
+{
+  unsigned long index;
+  _BitScanReverse(&index, (unsigned long) a);
+  return 15 - (int) index;
+}
+#endif
+
+
 LOCAL(int)
 get_byte (j_decompress_ptr cinfo)
 /* Read next input byte; we do not support suspension in this module. */
@@ -70,20 +148,81 @@ get_byte (j_decompress_ptr cinfo)
   struct jpeg_source_mgr * src = cinfo->src;
 
   if (src->bytes_in_buffer == 0)
-    if (! (*src->fill_input_buffer) (cinfo))
+    if (! jfill_input_buffer(cinfo))
       ERREXIT(cinfo, JERR_CANT_SUSPEND);
   src->bytes_in_buffer--;
   return GETJOCTET(*src->next_input_byte++);
 }
 
 
+/*
+ * Insert the next nbytes bytes of compressed data into the C register, and
+ * return the new value of the register.
+ */
+
+LOCAL(arith_buf_type)
+fill_c_register (j_decompress_ptr cinfo, arith_buf_type c, int nbytes)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+  register int data;
+
+  /* Fast path: if the source buffer holds enough data, read directly from it,
+   * handling stuffed zero bytes in line.  We stop at anything else that
+   * begins with 0xFF, which is left for the general case below.
+   */
+  if (! cinfo->unread_marker && src->bytes_in_buffer >= (size_t) nbytes * 2) {
+    const JOCTET * buffer = src->next_input_byte;
+
+    while (nbytes > 0) {
+      data = GETJOCTET(buffer[0]);
+      if (data == 0xFF) {
+        if (GETJOCTET(buffer[1]) != 0)
+          break;
+        buffer++;               /* discard stuffed zero byte */
+      }
+      buffer++;
+      c = (c << 8) | data;
+      nbytes--;
+    }
+    src->bytes_in_buffer -= (size_t) (buffer - src->next_input_byte);
+    src->next_input_byte = buffer;
+  }
+
+  /* General case, per section D.2.6 */
+  while (nbytes-- > 0) {
+    if (cinfo->unread_marker) {
+      data = 0;                 /* stuff zero data */
+      ((arith_entropy_ptr) cinfo->entropy)->stuffed_bytes++;
+    } else {
+      data = get_byte(cinfo);   /* read next input byte */
+      if (data == 0xFF) {       /* zero stuff or marker code */
+        do data = get_byte(cinfo);
+        while (data == 0xFF);   /* swallow extra 0xFF bytes */
+        if (data == 0)
+          data = 0xFF;          /* discard stuffed zero byte */
+        else {
+          /* Note: Different from the Huffman decoder, hitting
+           * a marker while processing the compressed data
+           * segment is legal in arithmetic coding.
+           * The convention is to supply zero data
+           * then until decoding is complete.
+           */
+          cinfo->unread_marker = data;
+          data = 0;
+          ((arith_entropy_ptr) cinfo->entropy)->stuffed_bytes++;
+        }
+      }
+    }
+    c = (c << 8) | data;        /* insert data into C register */
+  }
+
+  return c;
+}
+
+
 /*
  * The core arithmetic decoding routine (common in JPEG and JBIG).
  * This needs to go as fast as possible.
- * Machine-dependent optimization facilities
- * are not utilized in this portable implementation.
- * However, this code should be fairly efficient and
- * may be a good base for further optimizations anyway.
  *
  * Return value is 0 or 1 (binary decision).
  *
@@ -102,85 +241,119 @@ get_byte (j_decompress_ptr cinfo)
  * I've also introduced a new scheme for accessing
  * the probability estimation state machine table,
  * derived from Markus Kuhn's JBIG implementation.
+ *
+ * libjpeg-turbo note: since C is never changed by renormalization, we can
+ * shift A by the required number of bits all at once and then refill the bit
+ * buffer part of C (if needed) a whole word at a time.  The initial state
+ * (A = 0x10000, CT = -16) causes the first call to read the 2 initial bytes
+ * of C, along with whatever else fits.
  */
 
+INLINE
 LOCAL(int)
-arith_decode (j_decompress_ptr cinfo, unsigned char *st)
+arith_decode (j_decompress_ptr cinfo, arith_state * state, unsigned char *st)
 {
-  register arith_entropy_ptr e = (arith_entropy_ptr) cinfo->entropy;
-  register unsigned char nl, nm;
-  register INT32 qe, temp;
-  register int sv, data;
+  register const arith_transition * t;
+  register arith_buf_type temp;
+  register INT32 qe, a;
+  register int sv, nbytes, upper, lps;
 
   /* Renormalization & data input per section D.2.6 */
-  while (e->a < 0x8000L) {
-    if (--e->ct < 0) {
-      /* Need to fetch next data byte */
-      if (cinfo->unread_marker)
-        data = 0;               /* stuff zero data */
-      else {
-        data = get_byte(cinfo); /* read next input byte */
-        if (data == 0xFF) {     /* zero stuff or marker code */
-          do data = get_byte(cinfo);
-          while (data == 0xFF); /* swallow extra 0xFF bytes */
-          if (data == 0)
-            data = 0xFF;        /* discard stuffed zero byte */
-          else {
-            /* Note: Different from the Huffman decoder, hitting
-             * a marker while processing the compressed data
-             * segment is legal in arithmetic coding.
-             * The convention is to supply zero data
-             * then until decoding is complete.
-             */
-            cinfo->unread_marker = data;
-            data = 0;
-          }
-        }
-      }
-      e->c = (e->c << 8) | data; /* insert data into C register */
-      if ((e->ct += 8) < 0)      /* update bit shift counter */
-        /* Need more initial bytes */
-        if (++e->ct == 0)
-          /* Got 2 initial bytes -> re-init A and exit loop */
-          e->a = 0x8000L; /* => e->a = 0x10000L after loop exit */
-    }
-    e->a <<= 1;
+  if (state->a < 0x8000L) {
+#ifdef RENORM_SHIFT
+    int nbits = RENORM_SHIFT(state->a);
+
+    state->a <<= nbits;
+    state->ct -= nbits;
+#else
+    do {
+      state->a <<= 1;
+      state->ct--;
+    } while (state->a < 0x8000L);
+#endif
+  }
+  if (state->ct < 0) {
+    /* Fill the bit buffer part of C as much as possible */
+    nbytes = (MAX_CT - state->ct) >> 3;
+    state->c = fill_c_register(cinfo, state->c, nbytes);
+    state->ct += nbytes << 3;
   }
 
-  /* Fetch values from our compact representation of Table D.2:
+  /* Fetch values from our expanded representation of Table D.2:
    * Qe values and probability estimation state machine
    */
   sv = *st;
-  qe = jpeg_aritab[sv & 0x7F];  /* => Qe_Value */
-  nl = qe & 0xFF; qe >>= 8;     /* Next_Index_LPS + Switch_MPS */
-  nm = qe & 0xFF; qe >>= 8;     /* Next_Index_MPS */
-
-  /* Decode & estimation procedures per sections D.2.4 & D.2.5 */
-  temp = e->a - qe;
-  e->a = temp;
-  temp <<= e->ct;
-  if (e->c >= temp) {
-    e->c -= temp;
-    /* Conditional LPS (less probable symbol) exchange */
-    if (e->a < qe) {
-      e->a = qe;
-      *st = (sv & 0x80) ^ nm;   /* Estimate_after_MPS */
-    } else {
-      e->a = qe;
-      *st = (sv & 0x80) ^ nl;   /* Estimate_after_LPS */
-      sv ^= 0x80;               /* Exchange LPS/MPS */
-    }
-  } else if (e->a < 0x8000L) {
-    /* Conditional MPS (more probable symbol) exchange */
-    if (e->a < qe) {
-      *st = (sv & 0x80) ^ nl;   /* Estimate_after_LPS */
-      sv ^= 0x80;               /* Exchange LPS/MPS */
-    } else {
-      *st = (sv & 0x80) ^ nm;   /* Estimate_after_MPS */
+  t = &state->trans[sv];
+  qe = t->qe;
+
+  /* Decode & estimation procedures per sections D.2.4 & D.2.5
+   *
+   * If C lies in the upper subinterval, then we take the LPS path, with a
+   * conditional exchange if the new A is smaller than Qe.  Otherwise, if A
+   * needs renormalization, then we take the MPS path, with a conditional
+   * exchange if A is smaller than Qe.  In both cases, the estimate is
+   * updated.  Otherwise, the decision is the MPS and nothing changes.  The
+   * outcome of the decision is data-dependent and poorly predicted, so it is
+   * computed without branches.
+   */
+  a = state->a - qe;
+  temp = (arith_buf_type) a << state->ct;
+  upper = (state->c >= temp);
+  lps = upper ^ (a < qe);
+  if (upper | (a < 0x8000L))
+    *st = lps ? t->next_lps : t->next_mps;
+  state->c -= upper ? temp : 0;
+  state->a = upper ? qe : a;
+  sv ^= lps << 7;               /* Exchange LPS/MPS */
+
+  return sv >> 7;
+}
+
+
+/*
+ * Account for input that was read ahead but never used.
+ *
+ * The decoder of section D.2.6 reads one byte at a time, so it never holds
+ * more than 7 unused bits in C.  fill_c_register() reads further ahead, and
+ * any whole bytes still unused at a restart marker or at the end of the scan
+ * were not part of the compressed data.  next_marker() would have counted
+ * them as extraneous data, so we do the same.  Zero bytes that were stuffed
+ * after a marker did not come from the input and are not counted.
+ */
+
+LOCAL(void)
+discard_read_ahead (j_decompress_ptr cinfo)
+{
+  arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
+  int nbytes;
+
+  if (entropy->state.ct < 8)    /* nothing read ahead, or decoding error */
+    return;
+  nbytes = (entropy->state.ct >> 3) - entropy->stuffed_bytes;
+  if (nbytes > 0) {
+    cinfo->marker->discarded_bytes += (unsigned int) nbytes;
+    /* If we already hit the marker, then next_marker() won't be called to
+     * report the extraneous data, so report it here.
+     */
+    if (cinfo->unread_marker) {
+      WARNMS2(cinfo, JWRN_EXTRANEOUS_DATA, cinfo->marker->discarded_bytes,
+              cinfo->unread_marker);
+      cinfo->marker->discarded_bytes = 0;
     }
   }
+  entropy->state.ct &= 7;
+  entropy->stuffed_bytes = 0;
+}
 
-  return sv >> 7;
+
+/*
+ * Finish up at the end of an arithmetic-compressed scan.
+ */
+
+METHODDEF(void)
+finish_pass (j_decompress_ptr cinfo)
+{
+  discard_read_ahead(cinfo);
 }
 
 
@@ -195,6 +368,8 @@ process_restart (j_decompress_ptr cinfo)
   int ci;
   jpeg_component_info * compptr;
 
+  discard_read_ahead(cinfo);
+
   /* Advance past the RSTn marker */
   if (! (*cinfo->marker->read_restart_marker) (cinfo))
     ERREXIT(cinfo, JERR_CANT_SUSPEND);
@@ -214,9 +389,10 @@ process_restart (j_decompress_ptr cinfo)
   }
 
   /* Reset arithmetic decoding variables */
-  entropy->c = 0;
-  entropy->a = 0;
-  entropy->ct = -16;    /* force reading 2 initial bytes to fill C */
+  entropy->state.c = 0;
+  entropy->state.a = 0x10000L;
+  entropy->state.ct = -16;      /* force reading 2 initial bytes to fill C */
+  entropy->stuffed_bytes = 0;
 
   /* Reset restart counter */
   entropy->restarts_to_go = cinfo->restart_interval;
@@ -245,6 +421,7 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int blkn, ci, tbl, sign;
   int v, m;
 
@@ -255,7 +432,9 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
-  if (entropy->ct == -1) return TRUE;   /* if error do nothing */
+  if (entropy->state.ct == -1) return TRUE; /* if error do nothing */
+
+  state = entropy->state;
 
   /* Outer loop handles each block in the MCU */
 
@@ -270,20 +449,20 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     st = entropy->dc_stats[tbl] + entropy->dc_context[ci];
 
     /* Figure F.19: Decode_DC_DIFF */
-    if (arith_decode(cinfo, st) == 0)
+    if (arith_decode(cinfo, &state, st) == 0)
       entropy->dc_context[ci] = 0;
     else {
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = arith_decode(cinfo, st + 1);
+      sign = arith_decode(cinfo, &state, st + 1);
       st += 2; st += sign;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = arith_decode(cinfo, st)) != 0) {
+      if ((m = arith_decode(cinfo, &state, st)) != 0) {
         st = entropy->dc_stats[tbl] + 20;       /* Table F.4: X1 = 20 */
-        while (arith_decode(cinfo, st)) {
+        while (arith_decode(cinfo, &state, st)) {
           if ((m <<= 1) == 0x8000) {
             WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-            entropy->ct = -1;                   /* magnitude overflow */
+            entropy->state.ct = -1;             /* magnitude overflow */
             return TRUE;
           }
           st += 1;
@@ -300,7 +479,7 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        if (arith_decode(cinfo, st)) v |= m;
+        if (arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       entropy->last_dc_val[ci] += v;
     }
@@ -309,6 +488,8 @@ decode_mcu_DC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     (*block)[0] = (JCOEF) (entropy->last_dc_val[ci] << cinfo->Al);
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -324,6 +505,7 @@ decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int tbl, sign, k;
   int v, m;
 
@@ -334,7 +516,9 @@ decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
-  if (entropy->ct == -1) return TRUE;   /* if error do nothing */
+  if (entropy->state.ct == -1) return TRUE; /* if error do nothing */
+
+  state = entropy->state;
 
   /* There is always only one block per MCU */
   block = MCU_data[0];
@@ -345,29 +529,29 @@ decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   /* Figure F.20: Decode_AC_coefficients */
   for (k = cinfo->Ss; k <= cinfo->Se; k++) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
-    if (arith_decode(cinfo, st)) break;         /* EOB flag */
-    while (arith_decode(cinfo, st + 1) == 0) {
+    if (arith_decode(cinfo, &state, st)) break; /* EOB flag */
+    while (arith_decode(cinfo, &state, st + 1) == 0) {
       st += 3; k++;
       if (k > cinfo->Se) {
         WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-        entropy->ct = -1;                       /* spectral overflow */
+        entropy->state.ct = -1;                 /* spectral overflow */
         return TRUE;
       }
     }
     /* Figure F.21: Decoding nonzero value v */
     /* Figure F.22: Decoding the sign of v */
-    sign = arith_decode(cinfo, entropy->fixed_bin);
+    sign = arith_decode(cinfo, &state, entropy->fixed_bin);
     st += 2;
     /* Figure F.23: Decoding the magnitude category of v */
-    if ((m = arith_decode(cinfo, st)) != 0) {
-      if (arith_decode(cinfo, st)) {
+    if ((m = arith_decode(cinfo, &state, st)) != 0) {
+      if (arith_decode(cinfo, &state, st)) {
         m <<= 1;
         st = entropy->ac_stats[tbl] +
              (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
-        while (arith_decode(cinfo, st)) {
+        while (arith_decode(cinfo, &state, st)) {
           if ((m <<= 1) == 0x8000) {
             WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-            entropy->ct = -1;                   /* magnitude overflow */
+            entropy->state.ct = -1;             /* magnitude overflow */
             return TRUE;
           }
           st += 1;
@@ -378,12 +562,14 @@ decode_mcu_AC_first (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     /* Figure F.24: Decoding the magnitude bit pattern of v */
     st += 14;
     while (m >>= 1)
-      if (arith_decode(cinfo, st)) v |= m;
+      if (arith_decode(cinfo, &state, st)) v |= m;
     v += 1; if (sign) v = -v;
     /* Scale and output coefficient in natural (dezigzagged) order */
     (*block)[jpeg_natural_order[k]] = (JCOEF) (v << cinfo->Al);
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -397,6 +583,7 @@ decode_mcu_DC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 {
   arith_entropy_ptr entropy = (arith_entropy_ptr) cinfo->entropy;
   unsigned char *st;
+  arith_state state;
   int p1, blkn;
 
   /* Process restart marker if needed */
@@ -406,6 +593,7 @@ decode_mcu_DC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  state = entropy->state;
   st = entropy->fixed_bin;      /* use fixed probability estimation */
   p1 = 1 << cinfo->Al;          /* 1 in the bit position being coded */
 
@@ -413,10 +601,12 @@ decode_mcu_DC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     /* Encoded data is simply the next bit of the two's-complement DC value */
-    if (arith_decode(cinfo, st))
+    if (arith_decode(cinfo, &state, st))
       MCU_data[blkn][0][0] |= p1;
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -432,6 +622,7 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   JBLOCKROW block;
   JCOEFPTR thiscoef;
   unsigned char *st;
+  arith_state state;
   int tbl, k, kex;
   int p1, m1;
 
@@ -442,7 +633,9 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
-  if (entropy->ct == -1) return TRUE;   /* if error do nothing */
+  if (entropy->state.ct == -1) return TRUE; /* if error do nothing */
+
+  state = entropy->state;
 
   /* There is always only one block per MCU */
   block = MCU_data[0];
@@ -458,11 +651,11 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   for (k = cinfo->Ss; k <= cinfo->Se; k++) {
     st = entropy->ac_stats[tbl] + 3 * (k - 1);
     if (k > kex)
-      if (arith_decode(cinfo, st)) break;       /* EOB flag */
+      if (arith_decode(cinfo, &state, st)) break; /* EOB flag */
     for (;;) {
       thiscoef = *block + jpeg_natural_order[k];
       if (*thiscoef) {                          /* previously nonzero coef */
-        if (arith_decode(cinfo, st + 2)) {
+        if (arith_decode(cinfo, &state, st + 2)) {
           if (*thiscoef < 0)
             *thiscoef += m1;
           else
@@ -470,8 +663,8 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
         }
         break;
       }
-      if (arith_decode(cinfo, st + 1)) {        /* newly nonzero coef */
-        if (arith_decode(cinfo, entropy->fixed_bin))
+      if (arith_decode(cinfo, &state, st + 1)) { /* newly nonzero coef */
+        if (arith_decode(cinfo, &state, entropy->fixed_bin))
           *thiscoef = m1;
         else
           *thiscoef = p1;
@@ -480,12 +673,14 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       st += 3; k++;
       if (k > cinfo->Se) {
         WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-        entropy->ct = -1;                       /* spectral overflow */
+        entropy->state.ct = -1;                 /* spectral overflow */
         return TRUE;
       }
     }
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -501,6 +696,7 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   jpeg_component_info * compptr;
   JBLOCKROW block;
   unsigned char *st;
+  arith_state state;
   int blkn, ci, tbl, sign, k;
   int v, m;
 
@@ -511,7 +707,9 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
-  if (entropy->ct == -1) return TRUE;   /* if error do nothing */
+  if (entropy->state.ct == -1) return TRUE; /* if error do nothing */
+
+  state = entropy->state;
 
   /* Outer loop handles each block in the MCU */
 
@@ -528,20 +726,20 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     st = entropy->dc_stats[tbl] + entropy->dc_context[ci];
 
     /* Figure F.19: Decode_DC_DIFF */
-    if (arith_decode(cinfo, st) == 0)
+    if (arith_decode(cinfo, &state, st) == 0)
       entropy->dc_context[ci] = 0;
     else {
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = arith_decode(cinfo, st + 1);
+      sign = arith_decode(cinfo, &state, st + 1);
       st += 2; st += sign;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = arith_decode(cinfo, st)) != 0) {
+      if ((m = arith_decode(cinfo, &state, st)) != 0) {
         st = entropy->dc_stats[tbl] + 20;       /* Table F.4: X1 = 20 */
-        while (arith_decode(cinfo, st)) {
+        while (arith_decode(cinfo, &state, st)) {
           if ((m <<= 1) == 0x8000) {
             WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-            entropy->ct = -1;                   /* magnitude overflow */
+            entropy->state.ct = -1;             /* magnitude overflow */
             return TRUE;
           }
           st += 1;
@@ -558,7 +756,7 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        if (arith_decode(cinfo, st)) v |= m;
+        if (arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       entropy->last_dc_val[ci] += v;
     }
@@ -572,29 +770,29 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
     /* Figure F.20: Decode_AC_coefficients */
     for (k = 1; k <= DCTSIZE2 - 1; k++) {
       st = entropy->ac_stats[tbl] + 3 * (k - 1);
-      if (arith_decode(cinfo, st)) break;       /* EOB flag */
-      while (arith_decode(cinfo, st + 1) == 0) {
+      if (arith_decode(cinfo, &state, st)) break; /* EOB flag */
+      while (arith_decode(cinfo, &state, st + 1) == 0) {
         st += 3; k++;
         if (k > DCTSIZE2 - 1) {
           WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-          entropy->ct = -1;                     /* spectral overflow */
+          entropy->state.ct = -1;               /* spectral overflow */
           return TRUE;
         }
       }
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = arith_decode(cinfo, entropy->fixed_bin);
+      sign = arith_decode(cinfo, &state, entropy->fixed_bin);
       st += 2;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = arith_decode(cinfo, st)) != 0) {
-        if (arith_decode(cinfo, st)) {
+      if ((m = arith_decode(cinfo, &state, st)) != 0) {
+        if (arith_decode(cinfo, &state, st)) {
           m <<= 1;
           st = entropy->ac_stats[tbl] +
                (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
-          while (arith_decode(cinfo, st)) {
+          while (arith_decode(cinfo, &state, st)) {
             if ((m <<= 1) == 0x8000) {
               WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-              entropy->ct = -1;                 /* magnitude overflow */
+              entropy->state.ct = -1;           /* magnitude overflow */
               return TRUE;
             }
             st += 1;
@@ -605,12 +803,14 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-        if (arith_decode(cinfo, st)) v |= m;
+        if (arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       (*block)[jpeg_natural_order[k]] = (JCOEF) v;
     }
   }
 
+  entropy->state = state;
+
   return TRUE;
 }
 
@@ -715,9 +915,10 @@ start_pass (j_decompress_ptr cinfo)
   }
 
   /* Initialize arithmetic decoding variables */
-  entropy->c = 0;
-  entropy->a = 0;
-  entropy->ct = -16;    /* force reading 2 initial bytes to fill C */
+  entropy->state.c = 0;
+  entropy->state.a = 0x10000L;
+  entropy->state.ct = -16;      /* force reading 2 initial bytes to fill C */
+  entropy->stuffed_bytes = 0;
 
   /* Initialize restart counter */
   entropy->restarts_to_go = cinfo->restart_interval;
@@ -739,6 +940,7 @@ jinit_arith_decoder (j_decompress_ptr cinfo)
                                 sizeof(arith_entropy_decoder));
   cinfo->entropy = (struct jpeg_entropy_decoder *) entropy;
   entropy->pub.start_pass = start_pass;
+  entropy->pub.finish_pass = finish_pass;
 
   /* Mark tables unallocated */
   for (i = 0; i < NUM_ARITH_TBLS; i++) {
@@ -749,6 +951,20 @@ jinit_arith_decoder (j_decompress_ptr cinfo)
   /* Initialize index for fixed probability estimation */
   entropy->fixed_bin[0] = 113;
 
+  /* Expand Table D.2 for both senses of the MPS */
+  MEMZERO(entropy->trans, sizeof(entropy->trans));
+  for (i = 0; i <= 113; i++) {
+    INT32 qe = jpeg_aritab[i];
+    int nl = (int) (qe & 0xFF), nm = (int) ((qe >> 8) & 0xFF), mps;
+
+    for (mps = 0; mps <= 0x80; mps += 0x80) {
+      entropy->trans[mps | i].qe = (unsigned short) (qe >> 16);
+      entropy->trans[mps | i].next_mps = (unsigned char) (mps ^ nm);
+      entropy->trans[mps | i].next_lps = (unsigned char) (mps ^ nl);
+    }
+  }
+  entropy->state.trans = entropy->trans;
+
   if (cinfo->progressive_mode) {
     /* Create progression status table */
     int *coef_bit_ptr, ci;
@@ -761,3 +977,58 @@ jinit_arith_decoder (j_decompress_ptr cinfo)
         *coef_bit_ptr++ = -1;
   }
 }
+
+
+/*
+ * Tally the memory that jinit_arith_decoder() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_arith_decoder (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  jtally_small(tally, sizeof(arith_entropy_decoder));
+  if (cinfo->progressive_mode)
+    jtally_small(tally, cinfo->num_components*DCTSIZE2*sizeof(int));
+}
+
+
+/*
+ * Tally the statistics areas that start_pass() would allocate.  The tables
+ * used by later scans aren't known yet, so assume that the components of the
+ * current (first) scan keep their table assignments throughout, and that
+ * the DC scans of a progressive image come first.
+ */
+
+GLOBAL(void)
+jtally_arith_decoder_passes (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  boolean dc_used[NUM_ARITH_TBLS], ac_used[NUM_ARITH_TBLS];
+  int ci, tbl;
+
+  MEMZERO(dc_used, sizeof(dc_used));
+  MEMZERO(ac_used, sizeof(ac_used));
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+    if (tbl >= 0 && tbl < NUM_ARITH_TBLS && ! dc_used[tbl]) {
+      jtally_small(tally, DC_STAT_BINS);
+      dc_used[tbl] = TRUE;
+    }
+    if (cinfo->progressive_mode)
+      continue;
+    tbl = cinfo->cur_comp_info[ci]->ac_tbl_no;
+    if (tbl >= 0 && tbl < NUM_ARITH_TBLS && ! ac_used[tbl]) {
+      jtally_small(tally, AC_STAT_BINS);
+      ac_used[tbl] = TRUE;
+    }
+  }
+  if (cinfo->progressive_mode) {
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      tbl = cinfo->cur_comp_info[ci]->ac_tbl_no;
+      if (tbl >= 0 && tbl < NUM_ARITH_TBLS && ! ac_used[tbl]) {
+        jtally_small(tally, AC_STAT_BINS);
+        ac_used[tbl] = TRUE;
+      }
+    }
+  }
+}
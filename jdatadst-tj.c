@@ -178,7 +178,7 @@ jpeg_mem_dest_tj (j_compress_ptr cinfo,
   dest->outsize = outsize;
   dest->alloc = alloc;
 
-  if (*outbuffer == NULL || *outsize == 0) {
+  if (*outbuffer == NULL || (*outsize == 0 && !reused)) {
     if (alloc) {
       /* Allocate initial buffer */
       dest->newbuffer = *outbuffer = (unsigned char *) malloc(OUTPUT_BUF_SIZE);
@@ -189,6 +189,13 @@ jpeg_mem_dest_tj (j_compress_ptr cinfo,
     else ERREXIT(cinfo, JERR_BUFFER_SIZE);
   }
 
+  /* If the buffer can be reallocated, then it was allocated by TurboJPEG (or
+   * by the application using tjAlloc()), so it is ours to free once it has
+   * been replaced.  A buffer that was allocated during a previous call may
+   * still be in use by the application and must not be freed.
+   */
+  if (alloc)
+    dest->newbuffer = *outbuffer;
   dest->pub.next_output_byte = dest->buffer = *outbuffer;
   if (!reused)
     dest->bufsize = *outsize;
@@ -4,7 +4,7 @@
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1994-1997, Thomas G. Lane.
  * libjpeg-turbo Modifications:
- * Copyright (C) 2010, D. R. Commander.
+ * Copyright (C) 2010, 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains the coefficient buffer controller for decompression.
@@ -20,6 +20,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jpegcomp.h"
+#include "jtrace.h"
 
 /* Block smoothing is only applicable for progressive JPEG, so: */
 #ifndef D_PROGRESSIVE_SUPPORTED
@@ -47,8 +48,10 @@ typedef struct {
    */
   JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
 
-  /* Temporary workspace for one MCU */
-  JCOEF * workspace;
+  /* In single-pass mode, TRUE if the inverse DCT uses only the DC coefficient
+   * of every block (ie, when producing a 1/8th-size image.)
+   */
+  boolean DC_only;
 
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* In multi-pass modes, we need a virtual block array for each component. */
@@ -58,6 +61,8 @@ typedef struct {
 #ifdef BLOCK_SMOOTHING_SUPPORTED
   /* When doing block smoothing, we latch coefficient Al values here */
   int * coef_bits_latch;
+  /* Workspace for one block row of smoothed coefficients */
+  JBLOCKROW workspace;
 #define SAVED_COEFS  6          /* we save coef_bits[0..5] */
 #endif
 } my_coef_controller;
@@ -153,20 +158,28 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JDIMENSION MCU_col_num;       /* index of current MCU within row */
   JDIMENSION last_MCU_col = cinfo->MCUs_per_row - 1;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  int blkn, ci, xindex, yindex, yoffset, useful_width;
+  int blkn, ci, yindex, yoffset, useful_width;
   JSAMPARRAY output_ptr;
-  JDIMENSION start_col, output_col;
+  JDIMENSION start_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_row_method_ptr inverse_DCT_row;
 
   /* Loop to process as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
        yoffset++) {
     for (MCU_col_num = coef->MCU_ctr; MCU_col_num <= last_MCU_col;
          MCU_col_num++) {
-      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed. */
-      jzero_far((void *) coef->MCU_buffer[0],
-                (size_t) (cinfo->blocks_in_MCU * sizeof(JBLOCK)));
+      /* Try to fetch an MCU.  Entropy decoder expects buffer to be zeroed.
+       * If only the DC coefficients will be used, then it suffices to zero
+       * those, since the AC coefficients are either not stored (Huffman) or
+       * ignored (arithmetic.)
+       */
+      if (coef->DC_only) {
+        for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++)
+          coef->MCU_buffer[blkn][0][0] = 0;
+      } else
+        jzero_far((void *) coef->MCU_buffer[0],
+                  (size_t) (cinfo->blocks_in_MCU * sizeof(JBLOCK)));
       if (! (*cinfo->entropy->decode_mcu) (cinfo, coef->MCU_buffer)) {
         /* Suspension forced; update state counters and exit */
         coef->MCU_vert_offset = yoffset;
@@ -175,8 +188,8 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       }
       /* Determine where data should go in output_buf and do the IDCT thing.
        * We skip dummy blocks at the right and bottom edges (but blkn gets
-       * incremented past them!).  Note the inner loop relies on having
-       * allocated the MCU_buffer[] blocks sequentially.
+       * incremented past them!).  Note that the inverse_DCT_row method relies
+       * on our having allocated the MCU_buffer[] blocks sequentially.
        */
       blkn = 0;                 /* index of current DCT block within MCU */
       for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
@@ -186,7 +199,8 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
           blkn += compptr->MCU_blocks;
           continue;
         }
-        inverse_DCT = cinfo->idct->inverse_DCT[compptr->component_index];
+        inverse_DCT_row =
+          cinfo->idct->inverse_DCT_row[compptr->component_index];
         useful_width = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
                                                     : compptr->last_col_width;
         output_ptr = output_buf[compptr->component_index] +
@@ -194,15 +208,10 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
         start_col = MCU_col_num * compptr->MCU_sample_width;
         for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
           if (cinfo->input_iMCU_row < last_iMCU_row ||
-              yoffset+yindex < compptr->last_row_height) {
-            output_col = start_col;
-            for (xindex = 0; xindex < useful_width; xindex++) {
-              (*inverse_DCT) (cinfo, compptr,
-                              (JCOEFPTR) coef->MCU_buffer[blkn+xindex],
-                              output_ptr, output_col);
-              output_col += compptr->_DCT_scaled_size;
-            }
-          }
+              yoffset+yindex < compptr->last_row_height)
+            (*inverse_DCT_row) (cinfo, compptr, coef->MCU_buffer[blkn],
+                                output_ptr, start_col,
+                                (JDIMENSION) useful_width);
           blkn += compptr->MCU_width;
           output_ptr += compptr->_DCT_scaled_size;
         }
@@ -212,6 +221,10 @@ decompress_onepass (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     coef->MCU_ctr = 0;
   }
   /* Completed the iMCU row, advance counters for next one */
+  JTRACE4(decode__row, cinfo->input_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->input_scan_number, cinfo->src->bytes_in_buffer);
+  JTRACE4(output__row, cinfo->output_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->output_scan_number, cinfo->output_width);
   cinfo->output_iMCU_row++;
   if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
     start_iMCU_row(cinfo);
@@ -296,6 +309,8 @@ consume_data (j_decompress_ptr cinfo)
     coef->MCU_ctr = 0;
   }
   /* Completed the iMCU row, advance counters for next one */
+  JTRACE4(decode__row, cinfo->input_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->input_scan_number, cinfo->src->bytes_in_buffer);
   if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
     start_iMCU_row(cinfo);
     return JPEG_ROW_COMPLETED;
@@ -319,14 +334,11 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
 {
   my_coef_ptr coef = (my_coef_ptr) cinfo->coef;
   JDIMENSION last_iMCU_row = cinfo->total_iMCU_rows - 1;
-  JDIMENSION block_num;
   int ci, block_row, block_rows;
   JBLOCKARRAY buffer;
-  JBLOCKROW buffer_ptr;
   JSAMPARRAY output_ptr;
-  JDIMENSION output_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_row_method_ptr inverse_DCT_row;
 
   /* Force some input to be done if we are getting ahead of the input. */
   while (cinfo->input_scan_number < cinfo->output_scan_number ||
@@ -355,22 +367,18 @@ decompress_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       block_rows = (int) (compptr->height_in_blocks % compptr->v_samp_factor);
       if (block_rows == 0) block_rows = compptr->v_samp_factor;
     }
-    inverse_DCT = cinfo->idct->inverse_DCT[ci];
+    inverse_DCT_row = cinfo->idct->inverse_DCT_row[ci];
     output_ptr = output_buf[ci];
-    /* Loop over all DCT blocks to be processed. */
+    /* Loop over all DCT block rows to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
-      buffer_ptr = buffer[block_row];
-      output_col = 0;
-      for (block_num = 0; block_num < compptr->width_in_blocks; block_num++) {
-        (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) buffer_ptr,
-                        output_ptr, output_col);
-        buffer_ptr++;
-        output_col += compptr->_DCT_scaled_size;
-      }
+      (*inverse_DCT_row) (cinfo, compptr, buffer[block_row], output_ptr,
+                          (JDIMENSION) 0, compptr->width_in_blocks);
       output_ptr += compptr->_DCT_scaled_size;
     }
   }
 
+  JTRACE4(output__row, cinfo->output_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->output_scan_number, cinfo->output_width);
   if (++(cinfo->output_iMCU_row) < cinfo->total_iMCU_rows)
     return JPEG_ROW_COMPLETED;
   return JPEG_SCAN_COMPLETED;
@@ -414,16 +422,27 @@ smoothing_ok (j_decompress_ptr cinfo)
   JQUANT_TBL * qtable;
   int * coef_bits;
   int * coef_bits_latch;
+  JDIMENSION max_width_in_blocks;
 
   if (! cinfo->progressive_mode || cinfo->coef_bits == NULL)
     return FALSE;
 
-  /* Allocate latch area if not already done */
-  if (coef->coef_bits_latch == NULL)
+  /* Allocate latch area and workspace if not already done */
+  if (coef->coef_bits_latch == NULL) {
     coef->coef_bits_latch = (int *)
       (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
                                   cinfo->num_components *
                                   (SAVED_COEFS * sizeof(int)));
+    max_width_in_blocks = 0;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      if (compptr->width_in_blocks > max_width_in_blocks)
+        max_width_in_blocks = compptr->width_in_blocks;
+    }
+    coef->workspace = (JBLOCKROW)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  max_width_in_blocks * sizeof(JBLOCK));
+  }
   coef_bits_latch = coef->coef_bits_latch;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
@@ -470,9 +489,8 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   JBLOCKARRAY buffer;
   JBLOCKROW buffer_ptr, prev_block_row, next_block_row;
   JSAMPARRAY output_ptr;
-  JDIMENSION output_col;
   jpeg_component_info *compptr;
-  inverse_DCT_method_ptr inverse_DCT;
+  inverse_DCT_row_method_ptr inverse_DCT_row;
   boolean first_row, last_row;
   JCOEF * workspace;
   int *coef_bits;
@@ -481,9 +499,6 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
   int DC1,DC2,DC3,DC4,DC5,DC6,DC7,DC8,DC9;
   int Al, pred;
 
-  /* Keep a local variable to avoid looking it up more than once */
-  workspace = coef->workspace;
-
   /* Force some input to be done if we are getting ahead of the input. */
   while (cinfo->input_scan_number <= cinfo->output_scan_number &&
          ! cinfo->inputctl->eoi_reached) {
@@ -543,7 +558,7 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
     Q20 = quanttbl->quantval[Q20_POS];
     Q11 = quanttbl->quantval[Q11_POS];
     Q02 = quanttbl->quantval[Q02_POS];
-    inverse_DCT = cinfo->idct->inverse_DCT[ci];
+    inverse_DCT_row = cinfo->idct->inverse_DCT_row[ci];
     output_ptr = output_buf[ci];
     /* Loop over all DCT blocks to be processed. */
     for (block_row = 0; block_row < block_rows; block_row++) {
@@ -562,11 +577,14 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
       DC1 = DC2 = DC3 = (int) prev_block_row[0][0];
       DC4 = DC5 = DC6 = (int) buffer_ptr[0][0];
       DC7 = DC8 = DC9 = (int) next_block_row[0][0];
-      output_col = 0;
+      /* Fetch the current DCT block row into the workspace so we can modify
+       * it.  The estimates use only the DC values in the coefficient buffer,
+       * so the whole row can be smoothed before any of it is transformed.
+       */
+      jcopy_block_row(buffer_ptr, coef->workspace, compptr->width_in_blocks);
       last_block_column = compptr->width_in_blocks - 1;
       for (block_num = 0; block_num <= last_block_column; block_num++) {
-        /* Fetch current DCT block into workspace so we can modify it. */
-        jcopy_block_row(buffer_ptr, (JBLOCKROW) workspace, (JDIMENSION) 1);
+        workspace = coef->workspace[block_num];
         /* Update DC values */
         if (block_num < last_block_column) {
           DC3 = (int) prev_block_row[1][0];
@@ -652,20 +670,21 @@ decompress_smooth_data (j_decompress_ptr cinfo, JSAMPIMAGE output_buf)
           }
           workspace[2] = (JCOEF) pred;
         }
-        /* OK, do the IDCT */
-        (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) workspace,
-                        output_ptr, output_col);
         /* Advance for next column */
         DC1 = DC2; DC2 = DC3;
         DC4 = DC5; DC5 = DC6;
         DC7 = DC8; DC8 = DC9;
         buffer_ptr++, prev_block_row++, next_block_row++;
-        output_col += compptr->_DCT_scaled_size;
       }
+      /* OK, do the IDCT */
+      (*inverse_DCT_row) (cinfo, compptr, coef->workspace, output_ptr,
+                          (JDIMENSION) 0, compptr->width_in_blocks);
       output_ptr += compptr->_DCT_scaled_size;
     }
   }
 
+  JTRACE4(output__row, cinfo->output_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->output_scan_number, cinfo->output_width);
   if (++(cinfo->output_iMCU_row) < cinfo->total_iMCU_rows)
     return JPEG_ROW_COMPLETED;
   return JPEG_SCAN_COMPLETED;
@@ -728,6 +747,7 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     /* We only need a single-MCU buffer. */
     JBLOCKROW buffer;
     int i;
+    jpeg_component_info *compptr;
 
     buffer = (JBLOCKROW)
       (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
@@ -735,13 +755,72 @@ jinit_d_coef_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     for (i = 0; i < D_MAX_BLOCKS_IN_MCU; i++) {
       coef->MCU_buffer[i] = buffer + i;
     }
+    coef->DC_only = TRUE;
+    for (i = 0, compptr = cinfo->comp_info; i < cinfo->num_components;
+         i++, compptr++) {
+      if (compptr->component_needed && compptr->_DCT_scaled_size > 1)
+        coef->DC_only = FALSE;
+    }
     coef->pub.consume_data = dummy_consume_data;
     coef->pub.decompress_data = decompress_onepass;
     coef->pub.coef_arrays = NULL; /* flag for no virtual arrays */
   }
+}
 
-  /* Allocate the workspace buffer */
-  coef->workspace = (JCOEF *)
-    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
-                                sizeof(JCOEF) * DCTSIZE2);
+
+/*
+ * Tally the memory that jinit_d_coef_controller() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_d_coef_controller (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                          boolean need_full_buffer)
+{
+  int ci;
+  jpeg_component_info *compptr;
+
+  jtally_small(tally, sizeof(my_coef_controller));
+  if (need_full_buffer) {
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      jtally_virt_barray(tally,
+        (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+                               (long) compptr->h_samp_factor),
+        (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+                               (long) compptr->v_samp_factor));
+    }
+  } else
+    jtally_large(tally, D_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+}
+
+
+/*
+ * Tally the block smoothing latch and workspace that smoothing_ok() would
+ * allocate at the start of the first output pass.
+ */
+
+GLOBAL(void)
+jtally_d_coef_controller_passes (j_decompress_ptr cinfo,
+                                 jpeg_mem_tally * tally,
+                                 boolean need_full_buffer)
+{
+#ifdef BLOCK_SMOOTHING_SUPPORTED
+  JDIMENSION max_width_in_blocks;
+  int ci;
+  jpeg_component_info *compptr;
+
+  if (! need_full_buffer || ! cinfo->progressive_mode ||
+      ! cinfo->do_block_smoothing)
+    return;
+
+  jtally_small(tally, cinfo->num_components * (SAVED_COEFS * sizeof(int)));
+  max_width_in_blocks = 0;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (compptr->width_in_blocks > max_width_in_blocks)
+      max_width_in_blocks = compptr->width_in_blocks;
+  }
+  jtally_large(tally, max_width_in_blocks * sizeof(JBLOCK));
+#endif
 }
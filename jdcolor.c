@@ -864,3 +864,67 @@ jinit_color_deconverter (j_decompress_ptr cinfo)
   else
     cinfo->output_components = cinfo->out_color_components;
 }
+
+
+/*
+ * Tally the memory that jinit_color_deconverter() would allocate,
+ * for jpeg_calc_decompress_requirements().  Also clear the entries of
+ * component_needed[] for the components that it would mark as unused.
+ */
+
+GLOBAL(void)
+jtally_color_deconverter (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                          boolean * component_needed)
+{
+  boolean ycc_tables = FALSE;
+  int ci;
+
+  jtally_small(tally, sizeof(my_color_deconverter));
+
+  switch (cinfo->out_color_space) {
+  case JCS_GRAYSCALE:
+    if (cinfo->jpeg_color_space == JCS_GRAYSCALE ||
+        cinfo->jpeg_color_space == JCS_YCbCr) {
+      for (ci = 1; ci < cinfo->num_components; ci++)
+        component_needed[ci] = FALSE;
+    } else if (cinfo->jpeg_color_space == JCS_RGB)
+      jtally_small(tally, TABLE_SIZE * sizeof(INT32));
+    break;
+
+  case JCS_RGB:
+  case JCS_EXT_RGB:
+  case JCS_EXT_RGBX:
+  case JCS_EXT_BGR:
+  case JCS_EXT_BGRX:
+  case JCS_EXT_XBGR:
+  case JCS_EXT_XRGB:
+  case JCS_EXT_RGBA:
+  case JCS_EXT_BGRA:
+  case JCS_EXT_ABGR:
+  case JCS_EXT_ARGB:
+    ycc_tables = (cinfo->jpeg_color_space == JCS_YCbCr &&
+                  ! jsimd_can_ycc_rgb());
+    break;
+
+  case JCS_RGB565:
+    ycc_tables = (cinfo->jpeg_color_space == JCS_YCbCr &&
+                  (cinfo->dither_mode != JDITHER_NONE ||
+                   ! jsimd_can_ycc_rgb565()));
+    break;
+
+  case JCS_CMYK:
+    ycc_tables = (cinfo->jpeg_color_space == JCS_YCCK);
+    break;
+
+  default:
+    break;
+  }
+
+  /* build_ycc_rgb_table() */
+  if (ycc_tables) {
+    jtally_small(tally, (MAXJSAMPLE+1) * sizeof(int));
+    jtally_small(tally, (MAXJSAMPLE+1) * sizeof(int));
+    jtally_small(tally, (MAXJSAMPLE+1) * sizeof(INT32));
+    jtally_small(tally, (MAXJSAMPLE+1) * sizeof(INT32));
+  }
+}
@@ -86,6 +86,31 @@ typedef union {
 #endif
 
 
+/*
+ * Apply a component's inverse DCT to num_blocks horizontally adjacent DCT
+ * blocks, storing the output samples in output_buf starting at output_col.
+ * This is the default inverse_DCT_row method; a SIMD implementation can
+ * replace it in order to transform several blocks per call.
+ */
+
+METHODDEF(void)
+idct_row (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+          JBLOCKROW coef_row, JSAMPARRAY output_buf, JDIMENSION output_col,
+          JDIMENSION num_blocks)
+{
+  /* Make sure the compiler doesn't look these up for every block */
+  inverse_DCT_method_ptr inverse_DCT =
+    cinfo->idct->inverse_DCT[compptr->component_index];
+  int output_step = compptr->_DCT_scaled_size;
+
+  for (; num_blocks > 0; num_blocks--, coef_row++) {
+    (*inverse_DCT) (cinfo, compptr, (JCOEFPTR) coef_row, output_buf,
+                    output_col);
+    output_col += output_step;
+  }
+}
+
+
 /*
  * Prepare for an output pass.
  * Here we select the proper IDCT routine for each component and build
@@ -100,10 +125,12 @@ start_pass (j_decompress_ptr cinfo)
   jpeg_component_info *compptr;
   int method = 0;
   inverse_DCT_method_ptr method_ptr = NULL;
+  inverse_DCT_row_method_ptr row_method_ptr;
   JQUANT_TBL * qtbl;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
+    row_method_ptr = idct_row;
     /* Select the proper IDCT routine for this component's scaling */
     switch (compptr->_DCT_scaled_size) {
 #ifdef IDCT_SCALING_SUPPORTED
@@ -151,9 +178,11 @@ start_pass (j_decompress_ptr cinfo)
       switch (cinfo->dct_method) {
 #ifdef DCT_ISLOW_SUPPORTED
       case JDCT_ISLOW:
-        if (jsimd_can_idct_islow())
+        if (jsimd_can_idct_islow()) {
           method_ptr = jsimd_idct_islow;
-        else
+          if (jsimd_can_idct_islow_row())
+            row_method_ptr = jsimd_idct_islow_row;
+        } else
           method_ptr = jpeg_idct_islow;
         method = JDCT_ISLOW;
         break;
@@ -223,6 +252,7 @@ start_pass (j_decompress_ptr cinfo)
       break;
     }
     idct->pub.inverse_DCT[ci] = method_ptr;
+    idct->pub.inverse_DCT_row[ci] = row_method_ptr;
     /* Create multiplier table from quant table.
      * However, we can skip this if the component is uninteresting
      * or if we already built the table.  Also, if no quant table
@@ -347,3 +377,19 @@ jinit_inverse_dct (j_decompress_ptr cinfo)
     idct->cur_method[ci] = -1;
   }
 }
+
+
+/*
+ * Tally the memory that jinit_inverse_dct() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_inverse_dct (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  int ci;
+
+  jtally_small(tally, sizeof(my_idct_controller));
+  for (ci = 0; ci < cinfo->num_components; ci++)
+    jtally_small(tally, sizeof(multiplier_table));
+}
@@ -125,8 +125,11 @@ start_pass_huff_decoder (j_decompress_ptr cinfo)
     /* Decide whether we really care about the coefficient values */
     if (compptr->component_needed) {
       entropy->dc_needed[blkn] = TRUE;
-      /* we don't need the ACs if producing a 1/8th-size image */
-      entropy->ac_needed[blkn] = (compptr->_DCT_scaled_size > 1);
+      /* we don't need the ACs if producing a 1/8th-size image, unless
+       * buffered-image mode allows a later output pass to use a larger scale
+       */
+      entropy->ac_needed[blkn] = (compptr->_DCT_scaled_size > 1 ||
+                                  cinfo->buffered_image);
     } else {
       entropy->dc_needed[blkn] = entropy->ac_needed[blkn] = FALSE;
     }
@@ -314,7 +317,7 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
 
       /* Attempt to read a byte */
       if (bytes_in_buffer == 0) {
-        if (! (*cinfo->src->fill_input_buffer) (cinfo))
+        if (! jfill_input_buffer(cinfo))
           return FALSE;
         next_input_byte = cinfo->src->next_input_byte;
         bytes_in_buffer = cinfo->src->bytes_in_buffer;
@@ -331,7 +334,7 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
          */
         do {
           if (bytes_in_buffer == 0) {
-            if (! (*cinfo->src->fill_input_buffer) (cinfo))
+            if (! jfill_input_buffer(cinfo))
               return FALSE;
             next_input_byte = cinfo->src->next_input_byte;
             bytes_in_buffer = cinfo->src->bytes_in_buffer;
@@ -394,50 +397,6 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
 }
 
 
-/* Macro version of the above, which performs much better but does not
-   handle markers.  We have to hand off any blocks with markers to the
-   slower routines. */
-
-#define GET_BYTE \
-{ \
-  register int c0, c1; \
-  c0 = GETJOCTET(*buffer++); \
-  c1 = GETJOCTET(*buffer); \
-  /* Pre-execute most common case */ \
-  get_buffer = (get_buffer << 8) | c0; \
-  bits_left += 8; \
-  if (c0 == 0xFF) { \
-    /* Pre-execute case of FF/00, which represents an FF data byte */ \
-    buffer++; \
-    if (c1 != 0) { \
-      /* Oops, it's actually a marker indicating end of compressed data. */ \
-      cinfo->unread_marker = c1; \
-      /* Back out pre-execution and fill the buffer with zero bits */ \
-      buffer -= 2; \
-      get_buffer &= ~0xFF; \
-    } \
-  } \
-}
-
-#if __WORDSIZE == 64 || defined(_WIN64)
-
-/* Pre-fetch 48 bytes, because the holding register is 64-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left < 16) { \
-    GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE GET_BYTE \
-  }
-
-#else
-
-/* Pre-fetch 16 bytes, because the holding register is 32-bit */
-#define FILL_BIT_BUFFER_FAST \
-  if (bits_left < 16) { \
-    GET_BYTE GET_BYTE \
-  }
-
-#endif
-
-
 /*
  * Out-of-line code for Huffman code decoding.
  * See jdhuff.h for info about usage.
@@ -808,9 +767,53 @@ jinit_huff_decoder (j_decompress_ptr cinfo)
   cinfo->entropy = (struct jpeg_entropy_decoder *) entropy;
   entropy->pub.start_pass = start_pass_huff_decoder;
   entropy->pub.decode_mcu = decode_mcu;
+  entropy->pub.finish_pass = NULL;
 
   /* Mark tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
     entropy->dc_derived_tbls[i] = entropy->ac_derived_tbls[i] = NULL;
   }
 }
+
+
+/*
+ * Tally the memory that jinit_huff_decoder() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_huff_decoder (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  jtally_small(tally, sizeof(huff_entropy_decoder));
+}
+
+
+/*
+ * Tally the derived tables that start_pass_huff_decoder() would build.  The
+ * tables used by later scans aren't known yet, so assume that those of the
+ * current (first) scan are used throughout.
+ */
+
+GLOBAL(void)
+jtally_huff_decoder_passes (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  boolean dc_built[NUM_HUFF_TBLS], ac_built[NUM_HUFF_TBLS];
+  jpeg_component_info * compptr;
+  int ci, tbl;
+
+  MEMZERO(dc_built, sizeof(dc_built));
+  MEMZERO(ac_built, sizeof(ac_built));
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    tbl = compptr->dc_tbl_no;
+    if (tbl >= 0 && tbl < NUM_HUFF_TBLS && ! dc_built[tbl]) {
+      jtally_small(tally, sizeof(d_derived_tbl));
+      dc_built[tbl] = TRUE;
+    }
+    tbl = compptr->ac_tbl_no;
+    if (tbl >= 0 && tbl < NUM_HUFF_TBLS && ! ac_built[tbl]) {
+      jtally_small(tally, sizeof(d_derived_tbl));
+      ac_built[tbl] = TRUE;
+    }
+  }
+}
@@ -287,6 +287,8 @@ start_input_pass (j_decompress_ptr cinfo)
 METHODDEF(void)
 finish_input_pass (j_decompress_ptr cinfo)
 {
+  if (cinfo->entropy->finish_pass)
+    (*cinfo->entropy->finish_pass) (cinfo);
   cinfo->inputctl->consume_input = consume_markers;
 }
 
@@ -360,6 +362,8 @@ reset_input_controller (j_decompress_ptr cinfo)
   inputctl->pub.consume_input = consume_markers;
   inputctl->pub.has_multiple_scans = FALSE; /* "unknown" would be better */
   inputctl->pub.eoi_reached = FALSE;
+  inputctl->pub.idct_upsampling = FALSE;
+  inputctl->pub.last_byte = NULL;
   inputctl->inheaders = TRUE;
   /* Reset other modules */
   (*cinfo->err->reset_error_mgr) ((j_common_ptr) cinfo);
@@ -369,6 +373,27 @@ reset_input_controller (j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Tally the quantization table copies that latch_quant_tables() would make,
+ * for jpeg_calc_decompress_requirements().  Every component is assumed to
+ * appear in some scan.
+ */
+
+GLOBAL(void)
+jtally_input_controller_passes (j_decompress_ptr cinfo,
+                                jpeg_mem_tally * tally)
+{
+  int ci;
+  jpeg_component_info *compptr;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (compptr->quant_table == NULL)
+      jtally_small(tally, sizeof(JQUANT_TBL));
+  }
+}
+
+
 /*
  * Initialize the input controller module.
  * This is called only once, when the decompression object is created.
@@ -394,5 +419,53 @@ jinit_input_controller (j_decompress_ptr cinfo)
    */
   inputctl->pub.has_multiple_scans = FALSE; /* "unknown" would be better */
   inputctl->pub.eoi_reached = FALSE;
+  inputctl->pub.idct_upsampling = FALSE;
+  inputctl->pub.last_byte = NULL;
   inputctl->inheaders = TRUE;
 }
+
+
+/*
+ * Refill the data source's buffer.  The marker reader and the entropy
+ * decoders call this rather than the source's fill_input_buffer() method, so
+ * that the bytes consumed from the source can be counted for
+ * jpeg_consume_scans().  The caller must have used up the current buffer, but
+ * it need not have synchronized cinfo->src, since next_input_byte +
+ * bytes_in_buffer always marks the end of the buffer.
+ */
+
+GLOBAL(boolean)
+jfill_input_buffer (j_decompress_ptr cinfo)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+  struct jpeg_input_controller * inputctl = cinfo->inputctl;
+  const JOCTET * buf_end = src->next_input_byte + src->bytes_in_buffer;
+
+  if (! (*src->fill_input_buffer) (cinfo))
+    return FALSE;               /* suspend; the buffer is unchanged */
+  if (inputctl->last_byte != NULL) {
+    inputctl->bytes_consumed += (long) (buf_end - inputctl->last_byte);
+    inputctl->last_byte = src->next_input_byte;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Likewise for the data source's skip_input_data() method.  The caller must
+ * have synchronized cinfo->src.
+ */
+
+GLOBAL(void)
+jskip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+  struct jpeg_source_mgr * src = cinfo->src;
+  struct jpeg_input_controller * inputctl = cinfo->inputctl;
+
+  if (inputctl->last_byte != NULL)
+    inputctl->bytes_consumed +=
+      (long) (src->next_input_byte - inputctl->last_byte) + num_bytes;
+  (*src->skip_input_data) (cinfo, num_bytes);
+  if (inputctl->last_byte != NULL)
+    inputctl->last_byte = src->next_input_byte;
+}
@@ -513,3 +513,43 @@ jinit_d_main_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
                          (JDIMENSION) (rgroup * ngroups));
   }
 }
+
+
+/*
+ * Tally the memory that jinit_d_main_controller() would allocate,
+ * for jpeg_calc_decompress_requirements().  need_context_rows is the value
+ * that the upsampler would report.
+ */
+
+GLOBAL(void)
+jtally_d_main_controller (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                          boolean need_context_rows)
+{
+  int ci, rgroup, ngroups;
+  int M = cinfo->_min_DCT_scaled_size;
+  jpeg_component_info *compptr;
+
+  jtally_small(tally, sizeof(my_main_controller));
+
+  if (need_context_rows) {
+    /* alloc_funny_pointers() */
+    jtally_small(tally, cinfo->num_components * 2 * sizeof(JSAMPARRAY));
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      rgroup = (compptr->v_samp_factor * compptr->_DCT_scaled_size) /
+        cinfo->_min_DCT_scaled_size;
+      jtally_small(tally, 2 * (rgroup * (M + 4)) * sizeof(JSAMPROW));
+    }
+    ngroups = M + 2;
+  } else {
+    ngroups = M;
+  }
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    rgroup = (compptr->v_samp_factor * compptr->_DCT_scaled_size) /
+      cinfo->_min_DCT_scaled_size;
+    jtally_sarray(tally, compptr->width_in_blocks * compptr->_DCT_scaled_size,
+                  (JDIMENSION) (rgroup * ngroups));
+  }
+}
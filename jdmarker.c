@@ -139,7 +139,7 @@ typedef my_marker_reader * my_marker_ptr;
  */
 #define MAKE_BYTE_AVAIL(cinfo,action)  \
         if (bytes_in_buffer == 0) {  \
-          if (! (*datasrc->fill_input_buffer) (cinfo))  \
+          if (! jfill_input_buffer(cinfo))  \
             { action; }  \
           INPUT_RELOAD(cinfo);  \
         }
@@ -743,7 +743,7 @@ get_interesting_appn (j_decompress_ptr cinfo)
   /* skip any remaining data -- could be lots */
   INPUT_SYNC(cinfo);
   if (length > 0)
-    (*cinfo->src->skip_input_data) (cinfo, (long) length);
+    jskip_input_data(cinfo, (long) length);
 
   return TRUE;
 }
@@ -849,7 +849,7 @@ save_marker (j_decompress_ptr cinfo)
   /* skip any remaining data -- could be lots */
   INPUT_SYNC(cinfo);            /* do before skip_input_data */
   if (length > 0)
-    (*cinfo->src->skip_input_data) (cinfo, (long) length);
+    jskip_input_data(cinfo, (long) length);
 
   return TRUE;
 }
@@ -871,7 +871,7 @@ skip_variable (j_decompress_ptr cinfo)
 
   INPUT_SYNC(cinfo);            /* do before skip_input_data */
   if (length > 0)
-    (*cinfo->src->skip_input_data) (cinfo, (long) length);
+    jskip_input_data(cinfo, (long) length);
 
   return TRUE;
 }
@@ -19,6 +19,9 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jpegcomp.h"
+#include "jdct.h"
+#include "jdhuff.h"
+#include "jtrace.h"
 
 
 /* Private state */
@@ -271,19 +274,14 @@ jpeg_core_output_dimensions (j_decompress_ptr cinfo)
  * Also note that it may be called before the master module is initialized!
  */
 
-GLOBAL(void)
-jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
-/* Do computations that are needed before master selection phase */
+LOCAL(void)
+calc_output_dimensions (j_decompress_ptr cinfo)
 {
 #ifdef IDCT_SCALING_SUPPORTED
   int ci;
   jpeg_component_info *compptr;
 #endif
 
-  /* Prevent application from calling me at wrong times */
-  if (cinfo->global_state != DSTATE_READY)
-    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
-
   /* Compute core output image dimensions and DCT scaling choices. */
   jpeg_core_output_dimensions(cinfo);
 
@@ -293,11 +291,16 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
    * scale up the chroma components via IDCT scaling rather than upsampling.
    * This saves time if the upsampler gets to use 1:1 scaling.
    * Note this code adapts subsampling ratios which are powers of 2.
+   * Normally, the IDCT is never scaled beyond DCTSIZE for this purpose, but
+   * if jpeg_set_idct_upsampling() was called, then a 2x-subsampled component
+   * can also be reconstructed at full size with the 16x16 IDCT.  (Only square
+   * IDCTs are supported, so this applies only to h2v2 subsampling.)
    */
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
     int ssize = cinfo->_min_DCT_scaled_size;
-    while (ssize < DCTSIZE &&
+    while ((ssize < DCTSIZE ||
+            (ssize == DCTSIZE && cinfo->inputctl->idct_upsampling)) &&
            ((cinfo->max_h_samp_factor * cinfo->_min_DCT_scaled_size) %
             (compptr->h_samp_factor * ssize * 2) == 0) &&
            ((cinfo->max_v_samp_factor * cinfo->_min_DCT_scaled_size) %
@@ -380,6 +383,37 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
 }
 
 
+GLOBAL(void)
+jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
+/* Do computations that are needed before master selection phase */
+{
+  /* Prevent application from calling me at wrong times */
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  calc_output_dimensions(cinfo);
+}
+
+
+/*
+ * Select whether chroma components that are subsampled by 2 in both
+ * directions are upsampled in the DCT domain, by reconstructing them at
+ * full size with the 16x16 IDCT, rather than by reconstructing them at 8x8
+ * and then upsampling them.  This must be called after jpeg_read_header(),
+ * which resets it to FALSE.
+ */
+
+GLOBAL(void)
+jpeg_set_idct_upsampling (j_decompress_ptr cinfo, boolean enable)
+{
+  /* Prevent application from calling me at wrong times */
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  cinfo->inputctl->idct_upsampling = enable;
+}
+
+
 /*
  * Several decompression processes need to range-limit values to the range
  * 0..MAXJSAMPLE; the input value may fall somewhat outside this range
@@ -655,6 +689,9 @@ prepare_for_output_pass (j_decompress_ptr cinfo)
     }
   }
 
+  JTRACE5(decompress__pass, master->pass_number, master->pub.is_dummy_pass,
+          cinfo->output_scan_number, cinfo->output_width, cinfo->output_height);
+
   /* Set up progress monitor's pass info if present */
   if (cinfo->progress != NULL) {
     cinfo->progress->completed_passes = master->pass_number;
@@ -711,6 +748,63 @@ jpeg_new_colormap (j_decompress_ptr cinfo)
     ERREXIT(cinfo, JERR_MODE_CHANGE);
 }
 
+
+/*
+ * Switch to a new output scaling factor (cinfo->scale_num/scale_denom)
+ * between output passes.  The coefficient buffer is left alone, so the new
+ * pass is produced without decoding the entropy-coded data again.  The
+ * output-side modules whose buffers depend on the output dimensions are
+ * re-created, and their old instances are simply abandoned in the image pool,
+ * so each call consumes a little more memory until the image is finished.
+ */
+
+GLOBAL(void)
+jpeg_new_output_scale (j_decompress_ptr cinfo)
+{
+  my_master_ptr master = (my_master_ptr) cinfo->master;
+  long samplesperrow;
+  JDIMENSION jd_samplesperrow;
+
+  /* Prevent application from calling me at wrong times */
+  if (cinfo->global_state != DSTATE_BUFIMAGE)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  /* The color quantizers size their working storage from the output width
+   * at jpeg_start_decompress() time, so they can't follow a scale change.
+   */
+  if (cinfo->quantize_colors)
+    ERREXIT(cinfo, JERR_MODE_CHANGE);
+
+  calc_output_dimensions(cinfo);
+
+  samplesperrow = (long) cinfo->output_width * (long) cinfo->out_color_components;
+  jd_samplesperrow = (JDIMENSION) samplesperrow;
+  if ((long) jd_samplesperrow != samplesperrow)
+    ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
+
+  /* Re-create the modules that depend on the DCT scaling, in the same order
+   * as master_selection().  The coefficient controller and the input side
+   * don't depend on it.
+   */
+  master->using_merged_upsample = use_merged_upsample(cinfo);
+  if (! cinfo->raw_data_out) {
+    if (master->using_merged_upsample) {
+#ifdef UPSAMPLE_MERGING_SUPPORTED
+      jinit_merged_upsampler(cinfo);
+#else
+      ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+    } else {
+      jinit_color_deconverter(cinfo);
+      jinit_upsampler(cinfo);
+    }
+    jinit_d_post_controller(cinfo, FALSE);
+  }
+  jinit_inverse_dct(cinfo);
+  if (! cinfo->raw_data_out)
+    jinit_d_main_controller(cinfo, FALSE);
+}
+
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
 
 
@@ -735,3 +829,209 @@ jinit_master_decompress (j_decompress_ptr cinfo)
 
   master_selection(cinfo);
 }
+
+
+/*
+ * Estimate the resources that a decompression will need, given the header
+ * information and the current decompression parameters (libjpeg-turbo
+ * extension.)  This can be called any time jpeg_calc_output_dimensions() can
+ * be called.
+ *
+ * Each module that master_selection() would select tallies its own
+ * allocations (see the jtally_* routines), in the order in which they would
+ * be made, using the memory manager's pool accounting.  The memory estimate is
+ * therefore exact as long as the entropy tables of the first scan are used
+ * throughout.  The selection logic below must be kept in sync with
+ * master_selection().
+ */
+
+/*
+ * The CPU estimate is expressed in units of the time required to decode one
+ * 8x8 DCT block of a baseline, 4:4:4 YCbCr image at full size, including its
+ * share of the color conversion to RGB.  The weights below are the relative
+ * costs of the individual decompression steps, measured with the C code paths
+ * on typical photographic images.  (The SIMD extensions speed up the IDCT,
+ * upsampling and color conversion steps, so those steps are somewhat
+ * overweighted when the SIMD code is used.)  Since the amount of entropy-coded
+ * data is not known until it is decoded, entropy decoding is charged per
+ * block.  This is the least accurate part of the estimate, since the actual
+ * cost grows with the number of nonzero coefficients.
+ */
+
+#define COST_HUFF_BLOCK      0.45   /* sequential Huffman decoding */
+#define COST_PHUFF_BLOCK     1.20   /* progressive Huffman decoding */
+#define COST_ARITH_BLOCK     1.50   /* arithmetic decoding */
+#define COST_IDCT_BLOCK      0.35   /* full-size (8x8) IDCT */
+#define COST_UPSAMPLE_BLOCK  0.25   /* upsampling, per output block */
+#define COST_CCONVERT_BLOCK  0.60   /* color conversion, per output block */
+#define COST_QUANTIZE_BLOCK  5.00   /* color quantization, per output block */
+
+
+GLOBAL(void)
+jpeg_calc_decompress_requirements (j_decompress_ptr cinfo,
+                                   jpeg_decompress_requirements * req)
+{
+  jpeg_mem_tally tally;
+  jpeg_memory_stats stats;
+  jpeg_component_info *compptr;
+  boolean merged, full_buffer, context_rows;
+  boolean enable_1pass, enable_2pass, enable_external;
+  boolean needed[MAX_COMPONENTS];
+  int ci;
+  size_t mark;
+  double blocks, out_blocks, scale;
+
+  /* This also checks the decompressor state */
+  jpeg_calc_output_dimensions(cinfo);
+
+  MEMZERO(req, sizeof(jpeg_decompress_requirements));
+  jtally_init((j_common_ptr) cinfo, &tally);
+
+  merged = use_merged_upsample(cinfo);
+  full_buffer = cinfo->inputctl->has_multiple_scans || cinfo->buffered_image;
+  for (ci = 0; ci < cinfo->num_components; ci++)
+    needed[ci] = TRUE;
+
+  /* jinit_master_decompress() and prepare_range_limit_table() */
+  jtally_small(&tally, sizeof(my_decomp_master));
+  jtally_small(&tally, (5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * sizeof(JSAMPLE));
+
+  /* Color quantizer selection, as in master_selection() */
+  enable_1pass = enable_2pass = enable_external = FALSE;
+  if (cinfo->quantize_colors && !cinfo->raw_data_out) {
+    if (cinfo->buffered_image) {
+      enable_1pass = cinfo->enable_1pass_quant;
+      enable_2pass = cinfo->enable_2pass_quant;
+      enable_external = cinfo->enable_external_quant;
+    }
+    if (cinfo->out_color_components != 3) {
+      enable_1pass = TRUE;
+      enable_2pass = enable_external = FALSE;
+    } else if (cinfo->colormap != NULL)
+      enable_external = TRUE;
+    else if (cinfo->two_pass_quantize)
+      enable_2pass = TRUE;
+    else
+      enable_1pass = TRUE;
+
+    mark = tally.bytes;
+#ifdef QUANT_1PASS_SUPPORTED
+    if (enable_1pass)
+      jtally_1pass_quantizer(cinfo, &tally);
+#endif
+#ifdef QUANT_2PASS_SUPPORTED
+    if (enable_2pass || enable_external)
+      jtally_2pass_quantizer(cinfo, &tally, enable_2pass);
+#endif
+    req->sample_buffer_bytes += tally.bytes - mark;
+  }
+
+  /* Post-processing */
+  context_rows = FALSE;
+  if (!cinfo->raw_data_out) {
+    mark = tally.bytes;
+    if (merged) {
+#ifdef UPSAMPLE_MERGING_SUPPORTED
+      jtally_merged_upsampler(cinfo, &tally);
+#endif
+    } else {
+      jtally_color_deconverter(cinfo, &tally, needed);
+      context_rows = jtally_upsampler(cinfo, &tally, needed);
+    }
+    jtally_d_post_controller(cinfo, &tally, enable_2pass);
+    req->sample_buffer_bytes += tally.bytes - mark;
+  }
+
+  jtally_inverse_dct(cinfo, &tally);
+  if (cinfo->arith_code) {
+#ifdef D_ARITH_CODING_SUPPORTED
+    jtally_arith_decoder(cinfo, &tally);
+#endif
+  } else if (cinfo->progressive_mode) {
+#ifdef D_PROGRESSIVE_SUPPORTED
+    jtally_phuff_decoder(cinfo, &tally);
+#endif
+  } else
+    jtally_huff_decoder(cinfo, &tally);
+  jtally_d_coef_controller(cinfo, &tally, full_buffer);
+  if (!cinfo->raw_data_out) {
+    mark = tally.bytes;
+    jtally_d_main_controller(cinfo, &tally, context_rows);
+    req->sample_buffer_bytes += tally.bytes - mark;
+  }
+
+  jtally_realize_virt_arrays(&tally);
+  req->sample_buffer_bytes += tally.virt_sarray_bytes;
+  req->coef_buffer_bytes = tally.virt_barray_bytes;
+
+  /* Allocations made by the input side when it starts the first scan, and
+   * by the output side during the first output pass.  If both quantizers are
+   * initialized, the 2-pass one is left active.
+   */
+  jtally_input_controller_passes(cinfo, &tally);
+  if (cinfo->arith_code) {
+#ifdef D_ARITH_CODING_SUPPORTED
+    jtally_arith_decoder_passes(cinfo, &tally);
+#endif
+  } else if (cinfo->progressive_mode) {
+#ifdef D_PROGRESSIVE_SUPPORTED
+    jtally_phuff_decoder_passes(cinfo, &tally);
+#endif
+  } else
+    jtally_huff_decoder_passes(cinfo, &tally);
+  jtally_d_coef_controller_passes(cinfo, &tally, full_buffer);
+#ifdef QUANT_1PASS_SUPPORTED
+  if (enable_1pass && !enable_2pass && !enable_external)
+    jtally_1pass_quantizer_passes(cinfo, &tally);
+#endif
+#ifdef QUANT_2PASS_SUPPORTED
+  if (enable_2pass)
+    jtally_2pass_quantizer_passes(cinfo, &tally);
+#endif
+
+  jpeg_get_memory_stats((j_common_ptr) cinfo, &stats);
+  req->image_bytes = tally.bytes;
+  req->peak_bytes = stats.current_bytes + tally.bytes;
+
+  /* Compute the CPU cost estimate. */
+  blocks = 0.0;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    req->coef_blocks += (long) compptr->width_in_blocks *
+                        (long) compptr->height_in_blocks;
+    if (needed[ci]) {
+      req->idct_blocks += (long) compptr->width_in_blocks *
+                          (long) compptr->height_in_blocks;
+      scale = (double) compptr->_DCT_scaled_size / (double) DCTSIZE;
+      blocks += (double) compptr->width_in_blocks *
+                (double) compptr->height_in_blocks * scale * scale;
+    }
+  }
+  if (cinfo->arith_code)
+    req->cpu_cost = COST_ARITH_BLOCK * (double) req->coef_blocks;
+  else if (cinfo->progressive_mode)
+    req->cpu_cost = COST_PHUFF_BLOCK * (double) req->coef_blocks;
+  else
+    req->cpu_cost = COST_HUFF_BLOCK * (double) req->coef_blocks;
+  req->cpu_cost += COST_IDCT_BLOCK * blocks;
+  if (!cinfo->raw_data_out) {
+    /* # of output blocks per color component */
+    out_blocks = (double) cinfo->output_width *
+                 (double) cinfo->output_height / (double) DCTSIZE2;
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      /* No upsampling is needed if the IDCT produces full-size output */
+      if (needed[ci] && (compptr->h_samp_factor * compptr->_DCT_scaled_size !=
+                         cinfo->max_h_samp_factor * cinfo->_min_DCT_scaled_size ||
+                         compptr->v_samp_factor * compptr->_DCT_scaled_size !=
+                         cinfo->max_v_samp_factor * cinfo->_min_DCT_scaled_size))
+        req->cpu_cost += COST_UPSAMPLE_BLOCK * out_blocks;
+    }
+    if (cinfo->out_color_space != cinfo->jpeg_color_space)
+      req->cpu_cost += COST_CCONVERT_BLOCK * out_blocks *
+                       (double) cinfo->out_color_components / 3.0;
+    if (cinfo->quantize_colors)
+      req->cpu_cost += COST_QUANTIZE_BLOCK * out_blocks *
+                       (double) cinfo->out_color_components / 3.0;
+  }
+}
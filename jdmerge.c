@@ -623,4 +623,25 @@ jinit_merged_upsampler (j_decompress_ptr cinfo)
   build_ycc_rgb_table(cinfo);
 }
 
+
+/*
+ * Tally the memory that jinit_merged_upsampler() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_merged_upsampler (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  jtally_small(tally, sizeof(my_upsampler));
+  if (cinfo->max_v_samp_factor == 2)
+    jtally_large(tally, (size_t) (cinfo->output_width *
+                                  cinfo->out_color_components *
+                                  sizeof(JSAMPLE)));
+  /* build_ycc_rgb_table() */
+  jtally_small(tally, (MAXJSAMPLE+1) * sizeof(int));
+  jtally_small(tally, (MAXJSAMPLE+1) * sizeof(int));
+  jtally_small(tally, (MAXJSAMPLE+1) * sizeof(INT32));
+  jtally_small(tally, (MAXJSAMPLE+1) * sizeof(INT32));
+}
+
 #endif /* UPSAMPLE_MERGING_SUPPORTED */
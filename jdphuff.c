@@ -3,8 +3,8 @@
  *
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1995-1997, Thomas G. Lane.
- * It was modified by The libjpeg-turbo Project to include only code relevant
- * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains Huffman entropy decoding routines for progressive JPEG.
@@ -19,11 +19,34 @@
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jpegcomp.h"
 #include "jdhuff.h"             /* Declarations shared with jdhuff.c */
 
 
 #ifdef D_PROGRESSIVE_SUPPORTED
 
+/*
+ * NOTE: The fast AC refinement decoder needs to count the trailing zero bits
+ * in a 64-bit mask, so it is used only with compilers that provide an
+ * intrinsic for that (GCC, Clang, and 64-bit Visual C++.)
+ */
+
+#if defined __GNUC__
+#define USE_CTZ_INTRINSIC
+#define CTZ64(x)  __builtin_ctzll(x)
+#elif defined _MSC_VER && defined _WIN64
+#include <intrin.h>
+#define USE_CTZ_INTRINSIC
+#define CTZ64(x)  jctz64(x)
+LOCAL(int)
+jctz64 (unsigned __int64 x)
+{
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (int) index;
+}
+#endif
+
 /*
  * Expanded entropy decoder object for progressive Huffman decoding.
  *
@@ -71,6 +94,8 @@ typedef struct {
   d_derived_tbl * derived_tbls[NUM_HUFF_TBLS];
 
   d_derived_tbl * ac_derived_tbl; /* active table during an AC scan */
+
+  boolean skip_saw_FF;          /* decode_mcu_AC_skip() consumed an 0xFF */
 } phuff_entropy_decoder;
 
 typedef phuff_entropy_decoder * phuff_entropy_ptr;
@@ -84,6 +109,8 @@ METHODDEF(boolean) decode_mcu_DC_refine (j_decompress_ptr cinfo,
                                          JBLOCKROW *MCU_data);
 METHODDEF(boolean) decode_mcu_AC_refine (j_decompress_ptr cinfo,
                                          JBLOCKROW *MCU_data);
+METHODDEF(boolean) decode_mcu_AC_skip (j_decompress_ptr cinfo,
+                                       JBLOCKROW *MCU_data);
 
 
 /*
@@ -160,6 +187,18 @@ start_pass_phuff_decoder (j_decompress_ptr cinfo)
       entropy->pub.decode_mcu = decode_mcu_AC_refine;
   }
 
+  /* If the AC coefficients of the component are never used, because we are
+   * producing a 1/8th-size image (so the inverse DCT uses only the DC
+   * coefficient) or because the component is not needed at all, then we can
+   * skip the whole scan.  This isn't safe in buffered-image mode (which
+   * includes transcoding), since the application can obtain the coefficients.
+   */
+  if (!is_DC_band && !cinfo->buffered_image) {
+    compptr = cinfo->cur_comp_info[0];
+    if (! compptr->component_needed || compptr->_DCT_scaled_size == 1)
+      entropy->pub.decode_mcu = decode_mcu_AC_skip;
+  }
+
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
     /* Make sure requested tables are present, and compute derived tables.
@@ -189,6 +228,7 @@ start_pass_phuff_decoder (j_decompress_ptr cinfo)
 
   /* Initialize private state variables */
   entropy->saved.EOBRUN = 0;
+  entropy->skip_saw_FF = FALSE;
 
   /* Initialize restart counter */
   entropy->restarts_to_go = cinfo->restart_interval;
@@ -490,8 +530,8 @@ decode_mcu_DC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
  * MCU decoding for AC successive approximation refinement scan.
  */
 
-METHODDEF(boolean)
-decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+LOCAL(boolean)
+decode_mcu_AC_refine_slow (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 {
   phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
   int Se = cinfo->Se;
@@ -506,125 +546,109 @@ decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
   int num_newnz;
   int newnz_pos[DCTSIZE2];
 
-  /* Process restart marker if needed; may have to suspend */
-  if (cinfo->restart_interval) {
-    if (entropy->restarts_to_go == 0)
-      if (! process_restart(cinfo))
-        return FALSE;
-  }
+  /* Load up working state */
+  BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+  EOBRUN = entropy->saved.EOBRUN; /* only part of saved state we need */
 
-  /* If we've run out of data, don't modify the MCU.
-   */
-  if (! entropy->pub.insufficient_data) {
+  /* There is always only one block per MCU */
+  block = MCU_data[0];
+  tbl = entropy->ac_derived_tbl;
 
-    /* Load up working state */
-    BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
-    EOBRUN = entropy->saved.EOBRUN; /* only part of saved state we need */
-
-    /* There is always only one block per MCU */
-    block = MCU_data[0];
-    tbl = entropy->ac_derived_tbl;
-
-    /* If we are forced to suspend, we must undo the assignments to any newly
-     * nonzero coefficients in the block, because otherwise we'd get confused
-     * next time about which coefficients were already nonzero.
-     * But we need not undo addition of bits to already-nonzero coefficients;
-     * instead, we can test the current bit to see if we already did it.
-     */
-    num_newnz = 0;
+  /* If we are forced to suspend, we must undo the assignments to any newly
+   * nonzero coefficients in the block, because otherwise we'd get confused
+   * next time about which coefficients were already nonzero.
+   * But we need not undo addition of bits to already-nonzero coefficients;
+   * instead, we can test the current bit to see if we already did it.
+   */
+  num_newnz = 0;
 
-    /* initialize coefficient loop counter to start of band */
-    k = cinfo->Ss;
+  /* initialize coefficient loop counter to start of band */
+  k = cinfo->Ss;
 
-    if (EOBRUN == 0) {
-      for (; k <= Se; k++) {
-        HUFF_DECODE(s, br_state, tbl, goto undoit, label3);
-        r = s >> 4;
-        s &= 15;
-        if (s) {
-          if (s != 1)           /* size of new coef should always be 1 */
-            WARNMS(cinfo, JWRN_HUFF_BAD_CODE);
-          CHECK_BIT_BUFFER(br_state, 1, goto undoit);
-          if (GET_BITS(1))
-            s = p1;             /* newly nonzero coef is positive */
-          else
-            s = m1;             /* newly nonzero coef is negative */
-        } else {
-          if (r != 15) {
-            EOBRUN = 1 << r;    /* EOBr, run length is 2^r + appended bits */
-            if (r) {
-              CHECK_BIT_BUFFER(br_state, r, goto undoit);
-              r = GET_BITS(r);
-              EOBRUN += r;
-            }
-            break;              /* rest of block is handled by EOB logic */
-          }
-          /* note s = 0 for processing ZRL */
-        }
-        /* Advance over already-nonzero coefs and r still-zero coefs,
-         * appending correction bits to the nonzeroes.  A correction bit is 1
-         * if the absolute value of the coefficient must be increased.
-         */
-        do {
-          thiscoef = *block + jpeg_natural_order[k];
-          if (*thiscoef != 0) {
-            CHECK_BIT_BUFFER(br_state, 1, goto undoit);
-            if (GET_BITS(1)) {
-              if ((*thiscoef & p1) == 0) { /* do nothing if already set it */
-                if (*thiscoef >= 0)
-                  *thiscoef += p1;
-                else
-                  *thiscoef += m1;
-              }
-            }
-          } else {
-            if (--r < 0)
-              break;            /* reached target zero coefficient */
+  if (EOBRUN == 0) {
+    for (; k <= Se; k++) {
+      HUFF_DECODE(s, br_state, tbl, goto undoit, label3);
+      r = s >> 4;
+      s &= 15;
+      if (s) {
+        if (s != 1)             /* size of new coef should always be 1 */
+          WARNMS(cinfo, JWRN_HUFF_BAD_CODE);
+        CHECK_BIT_BUFFER(br_state, 1, goto undoit);
+        if (GET_BITS(1))
+          s = p1;               /* newly nonzero coef is positive */
+        else
+          s = m1;               /* newly nonzero coef is negative */
+      } else {
+        if (r != 15) {
+          EOBRUN = 1 << r;      /* EOBr, run length is 2^r + appended bits */
+          if (r) {
+            CHECK_BIT_BUFFER(br_state, r, goto undoit);
+            r = GET_BITS(r);
+            EOBRUN += r;
           }
-          k++;
-        } while (k <= Se);
-        if (s) {
-          int pos = jpeg_natural_order[k];
-          /* Output newly nonzero coefficient */
-          (*block)[pos] = (JCOEF) s;
-          /* Remember its position in case we have to suspend */
-          newnz_pos[num_newnz++] = pos;
+          break;                /* rest of block is handled by EOB logic */
         }
+        /* note s = 0 for processing ZRL */
       }
-    }
-
-    if (EOBRUN > 0) {
-      /* Scan any remaining coefficient positions after the end-of-band
-       * (the last newly nonzero coefficient, if any).  Append a correction
-       * bit to each already-nonzero coefficient.  A correction bit is 1
+      /* Advance over already-nonzero coefs and r still-zero coefs,
+       * appending correction bits to the nonzeroes.  A correction bit is 1
        * if the absolute value of the coefficient must be increased.
        */
-      for (; k <= Se; k++) {
+      do {
         thiscoef = *block + jpeg_natural_order[k];
         if (*thiscoef != 0) {
           CHECK_BIT_BUFFER(br_state, 1, goto undoit);
           if (GET_BITS(1)) {
-            if ((*thiscoef & p1) == 0) { /* do nothing if already changed it */
+            if ((*thiscoef & p1) == 0) { /* do nothing if already set it */
               if (*thiscoef >= 0)
                 *thiscoef += p1;
               else
                 *thiscoef += m1;
             }
           }
+        } else {
+          if (--r < 0)
+            break;              /* reached target zero coefficient */
         }
+        k++;
+      } while (k <= Se);
+      if (s) {
+        int pos = jpeg_natural_order[k];
+        /* Output newly nonzero coefficient */
+        (*block)[pos] = (JCOEF) s;
+        /* Remember its position in case we have to suspend */
+        newnz_pos[num_newnz++] = pos;
       }
-      /* Count one block completed in EOB run */
-      EOBRUN--;
     }
-
-    /* Completed MCU, so update state */
-    BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
-    entropy->saved.EOBRUN = EOBRUN; /* only part of saved state we need */
   }
 
-  /* Account for restart interval (no-op if not using restarts) */
-  entropy->restarts_to_go--;
+  if (EOBRUN > 0) {
+    /* Scan any remaining coefficient positions after the end-of-band
+     * (the last newly nonzero coefficient, if any).  Append a correction
+     * bit to each already-nonzero coefficient.  A correction bit is 1
+     * if the absolute value of the coefficient must be increased.
+     */
+    for (; k <= Se; k++) {
+      thiscoef = *block + jpeg_natural_order[k];
+      if (*thiscoef != 0) {
+        CHECK_BIT_BUFFER(br_state, 1, goto undoit);
+        if (GET_BITS(1)) {
+          if ((*thiscoef & p1) == 0) { /* do nothing if already changed it */
+            if (*thiscoef >= 0)
+              *thiscoef += p1;
+            else
+              *thiscoef += m1;
+          }
+        }
+      }
+    }
+    /* Count one block completed in EOB run */
+    EOBRUN--;
+  }
 
+  /* Completed MCU, so update state */
+  BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+  entropy->saved.EOBRUN = EOBRUN; /* only part of saved state we need */
   return TRUE;
 
 undoit:
@@ -636,6 +660,286 @@ undoit:
 }
 
 
+#ifdef USE_CTZ_INTRINSIC
+
+/*
+ * Faster version of the above, which is used when the source buffer is known
+ * to contain enough data for the whole block.  Like decode_mcu_fast() in
+ * jdhuff.c, it reads the input using the lookahead macros and does not handle
+ * markers; we have to hand off any block that contains a marker, an invalid
+ * Huffman code, or a newly nonzero coefficient whose size is not 1 to the
+ * slower routine, which will also issue any necessary warnings.
+ *
+ * Most of the time in a refinement scan is spent stepping over the
+ * coefficients in the band and testing each one for zero, and those tests are
+ * very poorly predicted.  Thus, we instead build a mask of the already-nonzero
+ * coefficients, in zigzag order, and use it to find the coefficients that
+ * receive correction bits and the zero coefficient that each run ends on.
+ * The correction bits are also applied without branching on the sign of the
+ * coefficient (since m1 == -p1, (p1 ^ sign) - sign is either p1 or m1.)
+ */
+
+#define NONZERO(k) \
+  ((unsigned long long) ((*block)[jpeg_natural_order[k]] != 0))
+
+#define APPLY_CORRECTION_BIT(k) { \
+  int coef, bit, sign; \
+  thiscoef = *block + jpeg_natural_order[k]; \
+  coef = *thiscoef; \
+  FILL_BIT_BUFFER_FAST \
+  bit = GET_BITS(1) & ((coef & p1) == 0); \
+  sign = coef >> 31; \
+  *thiscoef = (JCOEF) (coef + (((p1 ^ sign) - sign) & (-bit))); \
+}
+
+LOCAL(boolean)
+decode_mcu_AC_refine_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  int Se = cinfo->Se;
+  int p1 = 1 << cinfo->Al;      /* 1 in the bit position being coded */
+  int m1 = (-1) << cinfo->Al;   /* -1 in the bit position being coded */
+  register int s, k, r, l;
+  unsigned int EOBRUN;
+  JBLOCKROW block;
+  JCOEFPTR thiscoef;
+  BITREAD_STATE_VARS;
+  JOCTET *buffer;
+  d_derived_tbl * tbl;
+  int num_newnz;
+  int newnz_pos[DCTSIZE2];
+  unsigned long long nonzero, band, bits;
+
+  /* Load up working state */
+  BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+  buffer = (JOCTET *) br_state.next_input_byte;
+  EOBRUN = entropy->saved.EOBRUN;
+
+  block = MCU_data[0];
+  tbl = entropy->ac_derived_tbl;
+  num_newnz = 0;
+  k = cinfo->Ss;
+
+  /* Bit k of nonzero is set if the k'th coefficient in zigzag order is
+   * already nonzero.  Four coefficients are tested per iteration so that the
+   * tests can proceed in parallel.
+   */
+  band = (2ULL << Se) - 1;      /* coefficients <= Se */
+  nonzero = 0;
+  for (r = Se; r >= k + 3; r -= 4)
+    nonzero = (nonzero << 4) | (NONZERO(r) << 3) | (NONZERO(r - 1) << 2) |
+              (NONZERO(r - 2) << 1) | NONZERO(r - 3);
+  for (; r >= k; r--)
+    nonzero = (nonzero << 1) | NONZERO(r);
+  nonzero <<= k;
+
+  if (EOBRUN == 0) {
+    for (; k <= Se; k++) {
+      HUFF_DECODE_FAST(s, l, tbl);
+      if (l > 16) goto undoit;
+      r = s >> 4;
+      s &= 15;
+      if (s) {
+        if (s != 1) goto undoit;
+        FILL_BIT_BUFFER_FAST
+        s = GET_BITS(1) ? p1 : m1;
+      } else {
+        if (r != 15) {
+          EOBRUN = 1 << r;
+          if (r) {
+            FILL_BIT_BUFFER_FAST
+            r = GET_BITS(r);
+            EOBRUN += r;
+          }
+          break;
+        }
+      }
+      /* Find the (r+1)'th still-zero coefficient at or after k, and append
+       * correction bits to the already-nonzero coefficients before it.  If
+       * there is no such coefficient, the run ends after Se.
+       */
+      bits = ~nonzero & band & (~0ULL << k);   /* k <= Se here */
+      while (r-- > 0)
+        bits &= bits - 1;
+      if (bits) {
+        r = CTZ64(bits);
+        bits = nonzero & ((1ULL << r) - 1) & (~0ULL << k);
+      } else {
+        r = Se + 1;
+        bits = nonzero & (~0ULL << k);
+      }
+      while (bits) {
+        APPLY_CORRECTION_BIT(CTZ64(bits));
+        bits &= bits - 1;
+      }
+      k = r;
+      if (s) {
+        /* In a corrupt scan, the new coefficient can land after Se (the slow
+         * routine stores it there too, via the padding at the end of
+         * jpeg_natural_order[]), but it must not be recorded in nonzero,
+         * since k may then be 64.
+         */
+        int pos = jpeg_natural_order[k];
+        (*block)[pos] = (JCOEF) s;
+        newnz_pos[num_newnz++] = pos;
+        if (k <= Se)
+          nonzero |= 1ULL << k;
+      }
+    }
+  }
+
+  /* Every shift by k below relies on k <= Se (< 64). */
+  if (EOBRUN > 0) {
+    if (k <= Se) {
+      bits = nonzero & (~0ULL << k);
+      while (bits) {
+        APPLY_CORRECTION_BIT(CTZ64(bits));
+        bits &= bits - 1;
+      }
+    }
+    EOBRUN--;
+  }
+
+  if (cinfo->unread_marker != 0) {
+    cinfo->unread_marker = 0;
+    goto undoit;
+  }
+
+  br_state.bytes_in_buffer -= (buffer - br_state.next_input_byte);
+  br_state.next_input_byte = buffer;
+  BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+  entropy->saved.EOBRUN = EOBRUN;
+  return TRUE;
+
+undoit:
+  while (num_newnz > 0)
+    (*block)[newnz_pos[--num_newnz]] = 0;
+
+  return FALSE;
+}
+
+#else
+
+/* Without a count-trailing-zeros operation, always use the slow routine */
+#define decode_mcu_AC_refine_fast(cinfo, MCU_data)  FALSE
+
+#endif /* USE_CTZ_INTRINSIC */
+
+
+/*
+ * The fast routine does not check the amount of data left in the source
+ * buffer, so we require enough for the worst case:  a 16-bit Huffman code,
+ * a sign bit, and a correction bit for each of the 63 AC coefficients, with
+ * every byte stuffed, plus what FILL_BIT_BUFFER_FAST reads ahead.
+ */
+
+#define BUFSIZE (DCTSIZE2 * 8)
+
+METHODDEF(boolean)
+decode_mcu_AC_refine (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  int usefast = 1;
+
+  /* Process restart marker if needed; may have to suspend */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      if (! process_restart(cinfo))
+        return FALSE;
+    usefast = 0;
+  }
+
+  if (cinfo->src->bytes_in_buffer < BUFSIZE || cinfo->unread_marker != 0)
+    usefast = 0;
+
+  /* If we've run out of data, don't modify the MCU.
+   */
+  if (! entropy->pub.insufficient_data) {
+
+    if (! usefast || ! decode_mcu_AC_refine_fast(cinfo, MCU_data)) {
+      if (! decode_mcu_AC_refine_slow(cinfo, MCU_data))
+        return FALSE;
+    }
+
+  }
+
+  /* Account for restart interval (no-op if not using restarts) */
+  entropy->restarts_to_go--;
+
+  return TRUE;
+}
+
+
+/*
+ * MCU "decoding" for an AC scan whose coefficients are not needed.
+ * Rather than Huffman decoding the scan, we discard all of its entropy-coded
+ * data (including any restart markers) on the first call, stopping at the
+ * next marker, which is left for the marker reader.  The insufficient_data
+ * flag then makes all of the calls into no-ops, leaving the coefficients
+ * unchanged.
+ */
+
+METHODDEF(boolean)
+decode_mcu_AC_skip (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  phuff_entropy_ptr entropy = (phuff_entropy_ptr) cinfo->entropy;
+  struct jpeg_source_mgr * src = cinfo->src;
+  int c;
+
+  if (entropy->pub.insufficient_data)
+    return TRUE;
+
+  for (;;) {
+    if (src->bytes_in_buffer == 0) {
+      if (! jfill_input_buffer(cinfo))
+        return FALSE;
+    }
+    if (! entropy->skip_saw_FF) {
+      /* Discard data bytes up to and including the next 0xFF */
+      while (src->bytes_in_buffer > 0) {
+        src->bytes_in_buffer--;
+        if (*src->next_input_byte++ == 0xFF) {
+          entropy->skip_saw_FF = TRUE;
+          break;
+        }
+      }
+      continue;
+    }
+    /* Examine the byte following an 0xFF.  A zero byte is a stuffed 0xFF in
+     * the data, and an 0xFF byte is fill; neither ends the segment, nor does
+     * an RSTn marker.  A byte below 0xC0 (SOF0) cannot begin a valid marker,
+     * so it is treated as corrupt data, as jpeg_resync_to_restart() would do.
+     * Anything else is the marker that ends the scan.
+     */
+    c = GETJOCTET(*src->next_input_byte);
+    if (c == 0xFF) {
+      src->next_input_byte++;  src->bytes_in_buffer--;
+      continue;
+    }
+    entropy->skip_saw_FF = FALSE;
+    src->next_input_byte++;  src->bytes_in_buffer--;
+    if (c == 0)
+      continue;
+    if (c >= JPEG_RST0 && c <= JPEG_RST0 + 7) {
+      cinfo->marker->next_restart_num = (c - JPEG_RST0 + 1) & 7;
+      continue;
+    }
+    if (c < 0xC0) {
+      if (cinfo->restart_interval)
+        WARNMS2(cinfo, JWRN_MUST_RESYNC, c, cinfo->marker->next_restart_num);
+      else
+        WARNMS(cinfo, JWRN_HIT_MARKER);
+      continue;
+    }
+    cinfo->unread_marker = c;
+    break;
+  }
+
+  entropy->pub.insufficient_data = TRUE;
+  return TRUE;
+}
+
+
 /*
  * Module initialization routine for progressive Huffman entropy decoding.
  */
@@ -652,6 +956,7 @@ jinit_phuff_decoder (j_decompress_ptr cinfo)
                                 sizeof(phuff_entropy_decoder));
   cinfo->entropy = (struct jpeg_entropy_decoder *) entropy;
   entropy->pub.start_pass = start_pass_phuff_decoder;
+  entropy->pub.finish_pass = NULL;
 
   /* Mark derived tables unallocated */
   for (i = 0; i < NUM_HUFF_TBLS; i++) {
@@ -668,4 +973,48 @@ jinit_phuff_decoder (j_decompress_ptr cinfo)
       *coef_bit_ptr++ = -1;
 }
 
+
+/*
+ * Tally the memory that jinit_phuff_decoder() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_phuff_decoder (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  jtally_small(tally, sizeof(phuff_entropy_decoder));
+  jtally_small(tally, cinfo->num_components*DCTSIZE2*sizeof(int));
+}
+
+
+/*
+ * Tally the derived tables that start_pass_phuff_decoder() would build.  DC
+ * and AC tables share one set of table numbers.  The tables used by later
+ * scans aren't known yet, so assume that the components of the current
+ * (first) scan keep their table assignments and that the DC scans come first.
+ */
+
+GLOBAL(void)
+jtally_phuff_decoder_passes (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  boolean built[NUM_HUFF_TBLS];
+  int ci, tbl;
+
+  MEMZERO(built, sizeof(built));
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    tbl = cinfo->cur_comp_info[ci]->dc_tbl_no;
+    if (tbl >= 0 && tbl < NUM_HUFF_TBLS && ! built[tbl]) {
+      jtally_small(tally, sizeof(d_derived_tbl));
+      built[tbl] = TRUE;
+    }
+  }
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    tbl = cinfo->cur_comp_info[ci]->ac_tbl_no;
+    if (tbl >= 0 && tbl < NUM_HUFF_TBLS && ! built[tbl]) {
+      jtally_small(tally, sizeof(d_derived_tbl));
+      built[tbl] = TRUE;
+    }
+  }
+}
+
 #endif /* D_PROGRESSIVE_SUPPORTED */
@@ -287,3 +287,26 @@ jinit_d_post_controller (j_decompress_ptr cinfo, boolean need_full_buffer)
     }
   }
 }
+
+
+/*
+ * Tally the memory that jinit_d_post_controller() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_d_post_controller (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                          boolean need_full_buffer)
+{
+  jtally_small(tally, sizeof(my_post_controller));
+  if (cinfo->quantize_colors) {
+    if (need_full_buffer)
+      jtally_virt_sarray(tally,
+        cinfo->output_width * cinfo->out_color_components,
+        (JDIMENSION) jround_up((long) cinfo->output_height,
+                               (long) cinfo->max_v_samp_factor));
+    else
+      jtally_sarray(tally, cinfo->output_width * cinfo->out_color_components,
+                    (JDIMENSION) cinfo->max_v_samp_factor);
+  }
+}
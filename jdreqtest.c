@@ -0,0 +1,227 @@
+/*
+ * jdreqtest.c
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks the memory estimate of
+ * jpeg_calc_decompress_requirements() against the peak memory usage that the
+ * memory manager reports after the decompression, for the decompression
+ * parameters that the TurboJPEG API cannot select (color quantization in
+ * particular.)  Each JPEG file named on the command line is tested as is and
+ * after being transcoded into a progressive JPEG file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+#include <jerror.h>
+#include <setjmp.h>
+
+
+static char lasterror[JMSG_LENGTH_MAX] = "No error";
+
+typedef struct _error_mgr {
+  struct jpeg_error_mgr pub;
+  jmp_buf jb;
+} error_mgr;
+
+static void my_error_exit(j_common_ptr cinfo)
+{
+  error_mgr *myerr = (error_mgr *)cinfo->err;
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(myerr->jb, 1);
+}
+
+static void my_output_message(j_common_ptr cinfo)
+{
+  (*cinfo->err->format_message)(cinfo, lasterror);
+}
+
+
+typedef struct {
+  const char *name;
+  J_COLOR_SPACE out_color_space;
+  boolean quantize_colors;
+  boolean two_pass_quantize;
+  J_DITHER_MODE dither_mode;
+  int desired_number_of_colors;
+  unsigned int scale_denom;
+  boolean do_fancy_upsampling;
+} test_case;
+
+static const test_case tests[] = {
+  { "RGB", JCS_RGB, FALSE, FALSE, JDITHER_NONE, 256, 1, TRUE },
+  { "RGB, 1/4 scale", JCS_RGB, FALSE, FALSE, JDITHER_NONE, 256, 4, TRUE },
+  { "RGB, merged upsampling", JCS_RGB, FALSE, FALSE, JDITHER_NONE, 256, 1,
+    FALSE },
+  { "grayscale", JCS_GRAYSCALE, FALSE, FALSE, JDITHER_NONE, 256, 1, TRUE },
+  { "1-pass, 256 colors, no dithering", JCS_RGB, TRUE, FALSE, JDITHER_NONE,
+    256, 1, TRUE },
+  { "1-pass, 216 colors, ordered dithering", JCS_RGB, TRUE, FALSE,
+    JDITHER_ORDERED, 216, 1, TRUE },
+  { "1-pass, 256 colors, F-S dithering", JCS_RGB, TRUE, FALSE, JDITHER_FS,
+    256, 1, TRUE },
+  { "1-pass, 64 colors, ordered dithering, 1/2 scale", JCS_RGB, TRUE, FALSE,
+    JDITHER_ORDERED, 64, 2, TRUE },
+  { "1-pass grayscale, 16 colors, ordered dithering", JCS_GRAYSCALE, TRUE,
+    FALSE, JDITHER_ORDERED, 16, 1, TRUE },
+  { "2-pass, 256 colors, F-S dithering", JCS_RGB, TRUE, TRUE, JDITHER_FS,
+    256, 1, TRUE },
+  { "2-pass, 32 colors, no dithering", JCS_RGB, TRUE, TRUE, JDITHER_NONE,
+    32, 1, TRUE },
+  { "2-pass, 256 colors, ordered->F-S dithering, merged upsampling", JCS_RGB,
+    TRUE, TRUE, JDITHER_ORDERED, 256, 1, FALSE }
+};
+
+
+/* Decompress the JPEG file with the parameters of the given test case, and
+   return 0 if the estimated peak memory usage matches the actual usage. */
+
+static int check(FILE *file, const char *filename, const test_case *test)
+{
+  struct jpeg_decompress_struct dinfo;
+  error_mgr jerr;
+  jpeg_decompress_requirements req;
+  jpeg_memory_stats stats;
+  JSAMPROW volatile row = NULL;
+  JSAMPROW rowptr;
+  int retval = -1;
+
+  printf("%s, %s ... ", filename, test->name);
+
+  dinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = my_error_exit;
+  jerr.pub.output_message = my_output_message;
+  jpeg_create_decompress(&dinfo);
+
+  if(setjmp(jerr.jb)) {
+    /* this will execute if libjpeg has an error */
+    printf("FAILED.\n  %s\n", lasterror);
+    goto bailout;
+  }
+
+  rewind(file);
+  jpeg_stdio_src(&dinfo, file);
+  jpeg_read_header(&dinfo, TRUE);
+  dinfo.out_color_space = test->out_color_space;
+  dinfo.quantize_colors = test->quantize_colors;
+  dinfo.two_pass_quantize = test->two_pass_quantize;
+  dinfo.dither_mode = test->dither_mode;
+  dinfo.desired_number_of_colors = test->desired_number_of_colors;
+  dinfo.scale_num = 1;
+  dinfo.scale_denom = test->scale_denom;
+  dinfo.do_fancy_upsampling = test->do_fancy_upsampling;
+
+  jpeg_calc_decompress_requirements(&dinfo, &req);
+
+  jpeg_start_decompress(&dinfo);
+  /* The row buffer must not come from the memory manager, or it would be
+     counted in the peak. */
+  if((row = (JSAMPROW)malloc(dinfo.output_width * dinfo.output_components *
+                             sizeof(JSAMPLE))) == NULL) {
+    printf("FAILED.\n  Memory allocation failure\n");
+    goto bailout;
+  }
+  rowptr = row;
+  while(dinfo.output_scanline < dinfo.output_height)
+    jpeg_read_scanlines(&dinfo, &rowptr, 1);
+  jpeg_get_memory_stats((j_common_ptr)&dinfo, &stats);
+  jpeg_finish_decompress(&dinfo);
+
+  if(req.peak_bytes != stats.peak_bytes) {
+    printf("FAILED.\n  Estimated peak %lu bytes, actual %lu bytes\n",
+           (unsigned long)req.peak_bytes, (unsigned long)stats.peak_bytes);
+    goto bailout;
+  }
+  printf("Passed.\n");
+  retval = 0;
+
+  bailout:
+  if(row) free(row);
+  jpeg_destroy_decompress(&dinfo);
+  return retval;
+}
+
+
+/* Transcode the JPEG file into a progressive JPEG file, without
+   requantizing it. */
+
+static FILE *make_progressive(FILE *file)
+{
+  struct jpeg_decompress_struct dinfo;
+  struct jpeg_compress_struct cinfo;
+  error_mgr jerr;
+  jvirt_barray_ptr *coef_arrays;
+  FILE *outfile;
+
+  if((outfile = tmpfile()) == NULL) {
+    printf("Could not create temporary file\n");
+    return NULL;
+  }
+
+  dinfo.err = jpeg_std_error(&jerr.pub);
+  cinfo.err = &jerr.pub;
+  jerr.pub.error_exit = my_error_exit;
+  jerr.pub.output_message = my_output_message;
+  jpeg_create_decompress(&dinfo);
+  jpeg_create_compress(&cinfo);
+
+  if(setjmp(jerr.jb)) {
+    /* this will execute if libjpeg has an error */
+    printf("Could not transcode into a progressive JPEG file:\n  %s\n",
+           lasterror);
+    fclose(outfile);
+    outfile = NULL;
+    goto bailout;
+  }
+
+  rewind(file);
+  jpeg_stdio_src(&dinfo, file);
+  jpeg_read_header(&dinfo, TRUE);
+  coef_arrays = jpeg_read_coefficients(&dinfo);
+  jpeg_stdio_dest(&cinfo, outfile);
+  jpeg_copy_critical_parameters(&dinfo, &cinfo);
+  jpeg_simple_progression(&cinfo);
+  jpeg_write_coefficients(&cinfo, coef_arrays);
+  jpeg_finish_compress(&cinfo);
+  jpeg_finish_decompress(&dinfo);
+
+  bailout:
+  jpeg_destroy_compress(&cinfo);
+  jpeg_destroy_decompress(&dinfo);
+  return outfile;
+}
+
+
+int main(int argc, char **argv)
+{
+  FILE *file, *progfile;
+  int i, t, retval = 0;
+
+  if(argc < 2) {
+    printf("USAGE: %s <JPEG file> [<JPEG file> ...]\n", argv[0]);
+    return 1;
+  }
+
+  for(i = 1; i < argc; i++) {
+    if((file = fopen(argv[i], "rb")) == NULL) {
+      printf("Could not open %s\n", argv[i]);
+      return 1;
+    }
+    if((progfile = make_progressive(file)) == NULL) {
+      fclose(file);
+      return 1;
+    }
+    for(t = 0; t < (int)(sizeof(tests) / sizeof(test_case)); t++) {
+      if(check(file, argv[i], &tests[t]) == -1)
+        retval = 1;
+      if(check(progfile, "(progressive)", &tests[t]) == -1)
+        retval = 1;
+    }
+    fclose(progfile);
+    fclose(file);
+  }
+
+  return retval;
+}
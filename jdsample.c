@@ -502,3 +502,48 @@ jinit_upsampler (j_decompress_ptr cinfo)
     }
   }
 }
+
+
+/*
+ * Tally the memory that jinit_upsampler() would allocate,
+ * for jpeg_calc_decompress_requirements().  component_needed[] is as left by
+ * jtally_color_deconverter().  Returns the value that jinit_upsampler() would
+ * assign to need_context_rows.
+ */
+
+GLOBAL(boolean)
+jtally_upsampler (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                  const boolean * component_needed)
+{
+  int ci;
+  jpeg_component_info * compptr;
+  boolean need_context_rows, do_fancy;
+  int h_in_group, v_in_group, h_out_group, v_out_group;
+
+  jtally_small(tally, sizeof(my_upsampler));
+
+  need_context_rows = FALSE;
+  do_fancy = cinfo->do_fancy_upsampling && cinfo->_min_DCT_scaled_size > 1;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    h_in_group = (compptr->h_samp_factor * compptr->_DCT_scaled_size) /
+                 cinfo->_min_DCT_scaled_size;
+    v_in_group = (compptr->v_samp_factor * compptr->_DCT_scaled_size) /
+                 cinfo->_min_DCT_scaled_size;
+    h_out_group = cinfo->max_h_samp_factor;
+    v_out_group = cinfo->max_v_samp_factor;
+    if (! component_needed[ci] ||
+        (h_in_group == h_out_group && v_in_group == v_out_group))
+      continue;                 /* no buffer needed */
+    if (h_in_group * 2 == h_out_group && v_in_group * 2 == v_out_group &&
+        do_fancy && compptr->downsampled_width > 2)
+      need_context_rows = TRUE;
+    jtally_sarray(tally,
+                  (JDIMENSION) jround_up((long) cinfo->output_width,
+                                         (long) cinfo->max_h_samp_factor),
+                  (JDIMENSION) cinfo->max_v_samp_factor);
+  }
+
+  return need_context_rows;
+}
@@ -3,22 +3,30 @@
  *
  * This file was part of the Independent JPEG Group's software:
  * Copyright (C) 1995-1997, Thomas G. Lane.
- * It was modified by The libjpeg-turbo Project to include only code relevant
- * to libjpeg-turbo.
+ * libjpeg-turbo Modifications:
+ * Copyright (C) 2015, D. R. Commander.
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains library routines for transcoding decompression,
  * that is, reading raw DCT coefficient arrays from an input JPEG file.
  * The routines in jdapimin.c will also be needed by a transcoder.
+ *
+ * It also contains jpeg_read_coefficient_row(), which reads the coefficients
+ * of a single-scan JPEG file one iMCU row at a time, and jpeg_validate(),
+ * which entropy decodes an input JPEG file without reconstructing the image,
+ * in order to check its integrity.
  */
 
 #define JPEG_INTERNALS
 #include "jinclude.h"
 #include "jpeglib.h"
+#include "jtrace.h"
 
 
 /* Forward declarations */
 LOCAL(void) transdecode_master_selection (j_decompress_ptr cinfo);
+LOCAL(void) rowdecode_master_selection (j_decompress_ptr cinfo);
+LOCAL(void) validate_master_selection (j_decompress_ptr cinfo);
 
 
 /*
@@ -152,3 +160,575 @@ transdecode_master_selection (j_decompress_ptr cinfo)
     cinfo->progress->total_passes = 1;
   }
 }
+
+
+/*
+ * Private coefficient controller for jpeg_read_coefficient_row().
+ *
+ * This takes the place of jdcoefct.c when streaming the coefficients of a
+ * single-scan image.  Rather than a full-image buffer, each iMCU row is
+ * decoded directly into the buffer supplied by the application.
+ */
+
+typedef struct {
+  struct jpeg_d_coef_controller pub; /* public fields */
+
+  /* These variables keep track of the current location of the input side. */
+  /* cinfo->input_iMCU_row is also used for this. */
+  JDIMENSION MCU_ctr;           /* counts MCUs processed in current row */
+  int MCU_vert_offset;          /* counts MCU rows within iMCU row */
+  int MCU_rows_per_iMCU_row;    /* number of such rows needed */
+
+  JBLOCKIMAGE row_buffer;       /* application's buffer for current row */
+  JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
+} my_row_reader;
+
+typedef my_row_reader * my_row_reader_ptr;
+
+
+LOCAL(void)
+rowdecode_start_iMCU_row (j_decompress_ptr cinfo)
+/* Reset within-iMCU-row counters for a new row */
+{
+  my_row_reader_ptr reader = (my_row_reader_ptr) cinfo->coef;
+
+  /* In an interleaved scan, an MCU row is the same as an iMCU row.
+   * In a noninterleaved scan, an iMCU row has v_samp_factor MCU rows.
+   * But at the bottom of the image, process only what's left.
+   */
+  if (cinfo->comps_in_scan > 1) {
+    reader->MCU_rows_per_iMCU_row = 1;
+  } else {
+    if (cinfo->input_iMCU_row < (cinfo->total_iMCU_rows-1))
+      reader->MCU_rows_per_iMCU_row = cinfo->cur_comp_info[0]->v_samp_factor;
+    else
+      reader->MCU_rows_per_iMCU_row =
+        cinfo->cur_comp_info[0]->last_row_height;
+  }
+
+  reader->MCU_ctr = 0;
+  reader->MCU_vert_offset = 0;
+}
+
+
+/*
+ * Initialize for an input processing pass.
+ */
+
+METHODDEF(void)
+rowdecode_start_input_pass (j_decompress_ptr cinfo)
+{
+  cinfo->input_iMCU_row = 0;
+  rowdecode_start_iMCU_row(cinfo);
+}
+
+
+/*
+ * Entropy decode one iMCU row into the application's buffer.
+ * Return value is JPEG_ROW_COMPLETED, JPEG_SCAN_COMPLETED, or JPEG_SUSPENDED.
+ */
+
+METHODDEF(int)
+rowdecode_consume_data (j_decompress_ptr cinfo)
+{
+  my_row_reader_ptr reader = (my_row_reader_ptr) cinfo->coef;
+  JDIMENSION MCU_col_num;       /* index of current MCU within row */
+  int blkn, ci, xindex, yindex, yoffset;
+  JDIMENSION start_col;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info *compptr;
+
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    buffer[ci] = reader->row_buffer[compptr->component_index];
+  }
+
+  /* Loop to process one whole iMCU row */
+  for (yoffset = reader->MCU_vert_offset;
+       yoffset < reader->MCU_rows_per_iMCU_row; yoffset++) {
+    for (MCU_col_num = reader->MCU_ctr; MCU_col_num < cinfo->MCUs_per_row;
+         MCU_col_num++) {
+      /* Construct list of pointers to DCT blocks belonging to this MCU */
+      blkn = 0;                 /* index of current DCT block within MCU */
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+        compptr = cinfo->cur_comp_info[ci];
+        start_col = MCU_col_num * compptr->MCU_width;
+        for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+          buffer_ptr = buffer[ci][yindex+yoffset] + start_col;
+          for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+            reader->MCU_buffer[blkn++] = buffer_ptr++;
+          }
+        }
+      }
+      /* Try to fetch the MCU. */
+      if (! (*cinfo->entropy->decode_mcu) (cinfo, reader->MCU_buffer)) {
+        /* Suspension forced; update state counters and exit */
+        reader->MCU_vert_offset = yoffset;
+        reader->MCU_ctr = MCU_col_num;
+        return JPEG_SUSPENDED;
+      }
+    }
+    /* Completed an MCU row, but perhaps not an iMCU row */
+    reader->MCU_ctr = 0;
+  }
+  /* Completed the iMCU row, advance counters for next one */
+  JTRACE4(decode__row, cinfo->input_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->input_scan_number, cinfo->src->bytes_in_buffer);
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    rowdecode_start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
+/*
+ * Read the coefficients of the next iMCU row from a single-scan JPEG file.
+ * jpeg_read_header must be completed before calling this.
+ *
+ * This is a streaming alternative to jpeg_read_coefficients(): rather than
+ * absorbing the whole file into virtual arrays, each call entropy decodes one
+ * iMCU row into data[], so that the coefficients can be processed (for
+ * instance, passed to jpeg_write_coefficient_row()) while they are still in
+ * the cache.  data[ci] must point to v_samp_factor block rows for component
+ * ci, each of which is at least width_in_blocks (rounded up to a multiple of
+ * h_samp_factor) blocks wide.  The blocks are zeroed before they are filled
+ * in.  Once all total_iMCU_rows rows have been read, call
+ * jpeg_finish_decompress().
+ *
+ * Only a file whose first scan contains all of the components can be read in
+ * this manner.  Use jpeg_has_multiple_scans() to check beforehand.
+ *
+ * Returns FALSE if suspended, in which case the same buffer must be passed
+ * again.  This case need be checked only if a suspending data source is used.
+ */
+
+GLOBAL(boolean)
+jpeg_read_coefficient_row (j_decompress_ptr cinfo, JBLOCKIMAGE data)
+{
+  my_row_reader_ptr reader;
+  int ci, row;
+  jpeg_component_info *compptr;
+
+  if (cinfo->global_state == DSTATE_READY) {
+    /* First call: initialize active modules */
+    if (cinfo->inputctl->has_multiple_scans)
+      ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
+    rowdecode_master_selection(cinfo);
+    cinfo->global_state = DSTATE_RDCOEFROWS;
+  }
+  if (cinfo->global_state != DSTATE_RDCOEFROWS)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  reader = (my_row_reader_ptr) cinfo->coef;
+
+  /* Call progress monitor hook if present */
+  if (cinfo->progress != NULL) {
+    cinfo->progress->pass_counter = (long) cinfo->input_iMCU_row;
+    (*cinfo->progress->progress_monitor) ((j_common_ptr) cinfo);
+  }
+
+  /* The entropy decoder expects the blocks to be zeroed.  If we are resuming
+   * after a suspension, then the row has already been zeroed.
+   */
+  if (reader->MCU_ctr == 0 && reader->MCU_vert_offset == 0) {
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      size_t row_size = (size_t)
+        jround_up((long) compptr->width_in_blocks,
+                  (long) compptr->h_samp_factor) * sizeof(JBLOCK);
+      for (row = 0; row < compptr->v_samp_factor; row++)
+        jzero_far((void *) data[ci][row], row_size);
+    }
+  }
+  reader->row_buffer = data;
+
+  /* The input controller hands this straight to rowdecode_consume_data(). */
+  if ((*cinfo->inputctl->consume_input) (cinfo) == JPEG_SUSPENDED)
+    return FALSE;
+
+  if (cinfo->input_iMCU_row >= cinfo->total_iMCU_rows) {
+    /* Set state so that jpeg_finish_decompress does the right thing */
+    cinfo->global_state = DSTATE_STOPPING;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Master selection of decompression modules for reading coefficient rows.
+ */
+
+LOCAL(void)
+rowdecode_master_selection (j_decompress_ptr cinfo)
+{
+  my_row_reader_ptr reader;
+
+#if JPEG_LIB_VERSION >= 80
+  /* Compute output image dimensions and related values. */
+  jpeg_core_output_dimensions(cinfo);
+#endif
+
+  /* Entropy decoding: either Huffman or arithmetic coding. */
+  if (cinfo->arith_code) {
+#ifdef D_ARITH_CODING_SUPPORTED
+    jinit_arith_decoder(cinfo);
+#else
+    ERREXIT(cinfo, JERR_ARITH_NOTIMPL);
+#endif
+  } else
+    jinit_huff_decoder(cinfo);
+
+  reader = (my_row_reader_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                sizeof(my_row_reader));
+  MEMZERO(reader, sizeof(my_row_reader));
+  cinfo->coef = (struct jpeg_d_coef_controller *) reader;
+  reader->pub.start_input_pass = rowdecode_start_input_pass;
+  reader->pub.consume_data = rowdecode_consume_data;
+  reader->pub.coef_arrays = NULL;
+
+  /* Initialize input side of decompressor to consume first scan. */
+  (*cinfo->inputctl->start_input_pass) (cinfo);
+
+  /* Initialize progress monitoring. */
+  if (cinfo->progress != NULL) {
+    cinfo->progress->pass_counter = 0L;
+    cinfo->progress->pass_limit = (long) cinfo->total_iMCU_rows;
+    cinfo->progress->completed_passes = 0;
+    cinfo->progress->total_passes = 1;
+  }
+}
+
+
+/*
+ * Private coefficient controller for jpeg_validate().
+ *
+ * This takes the place of jdcoefct.c.  The decoded coefficients are not
+ * needed, so in a sequential image, every MCU is decoded into the same scratch
+ * buffer (which is never zeroed), and the Huffman decoder is told not to store
+ * anything at all.  The refinement scans of a progressive image depend on the
+ * coefficients decoded by earlier scans, however, so in that case, a
+ * full-image coefficient buffer is still required.
+ */
+
+typedef struct {
+  struct jpeg_d_coef_controller pub; /* public fields */
+
+  /* These variables keep track of the current location of the input side. */
+  /* cinfo->input_iMCU_row is also used for this. */
+  JDIMENSION MCU_ctr;           /* counts MCUs processed in current row */
+  int MCU_vert_offset;          /* counts MCU rows within iMCU row */
+  int MCU_rows_per_iMCU_row;    /* number of such rows needed */
+
+  /* Pointers to the blocks of the current MCU (sequential images only) */
+  JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
+
+  /* In a progressive image, there is a virtual block array per component. */
+  jvirt_barray_ptr whole_image[MAX_COMPONENTS];
+
+  long num_warnings;            /* cinfo->err->num_warnings as of last check */
+  jpeg_validation_result result; /* results accumulated so far */
+} my_validator;
+
+typedef my_validator * my_validator_ptr;
+
+
+LOCAL(void)
+validate_note_warning (j_decompress_ptr cinfo, long MCU_row, long MCU_col)
+/* Record the location of the first warning since the last check, if any */
+{
+  my_validator_ptr val = (my_validator_ptr) cinfo->coef;
+
+  if (cinfo->err->num_warnings == val->num_warnings)
+    return;
+  if (val->result.bad_scan == 0) {
+    val->result.first_warning = cinfo->err->msg_code;
+    val->result.bad_scan = cinfo->input_scan_number;
+    val->result.bad_MCU_row = MCU_row;
+    val->result.bad_MCU_col = MCU_col;
+  }
+  val->num_warnings = cinfo->err->num_warnings;
+}
+
+
+LOCAL(void)
+validate_start_iMCU_row (j_decompress_ptr cinfo)
+/* Reset within-iMCU-row counters for a new row */
+{
+  my_validator_ptr val = (my_validator_ptr) cinfo->coef;
+
+  /* In an interleaved scan, an MCU row is the same as an iMCU row.
+   * In a noninterleaved scan, an iMCU row has v_samp_factor MCU rows.
+   * But at the bottom of the image, process only what's left.
+   */
+  if (cinfo->comps_in_scan > 1) {
+    val->MCU_rows_per_iMCU_row = 1;
+  } else {
+    if (cinfo->input_iMCU_row < (cinfo->total_iMCU_rows-1))
+      val->MCU_rows_per_iMCU_row = cinfo->cur_comp_info[0]->v_samp_factor;
+    else
+      val->MCU_rows_per_iMCU_row = cinfo->cur_comp_info[0]->last_row_height;
+  }
+
+  val->MCU_ctr = 0;
+  val->MCU_vert_offset = 0;
+}
+
+
+/*
+ * Initialize for an input processing pass (ie, a new scan).
+ */
+
+METHODDEF(void)
+validate_start_input_pass (j_decompress_ptr cinfo)
+{
+  my_validator_ptr val = (my_validator_ptr) cinfo->coef;
+
+  val->result.num_scans++;
+  cinfo->input_iMCU_row = 0;
+  validate_start_iMCU_row(cinfo);
+}
+
+
+/*
+ * Entropy decode one iMCU row and discard the result.
+ * Return value is JPEG_ROW_COMPLETED, JPEG_SCAN_COMPLETED, or JPEG_SUSPENDED.
+ */
+
+METHODDEF(int)
+validate_consume_data (j_decompress_ptr cinfo)
+{
+  my_validator_ptr val = (my_validator_ptr) cinfo->coef;
+  JDIMENSION MCU_col_num;       /* index of current MCU within row */
+  long MCU_row_base;            /* index of first MCU row in this iMCU row */
+  int blkn, ci, xindex, yindex, yoffset;
+  JDIMENSION start_col;
+  JBLOCKARRAY buffer[MAX_COMPS_IN_SCAN];
+  JBLOCKROW buffer_ptr;
+  jpeg_component_info *compptr;
+
+  if (cinfo->comps_in_scan > 1)
+    MCU_row_base = (long) cinfo->input_iMCU_row;
+  else
+    MCU_row_base = (long) cinfo->input_iMCU_row *
+                   cinfo->cur_comp_info[0]->v_samp_factor;
+
+  /* Align the virtual buffers for the components used in this scan. */
+  if (cinfo->progressive_mode) {
+    for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+      compptr = cinfo->cur_comp_info[ci];
+      buffer[ci] = (*cinfo->mem->access_virt_barray)
+        ((j_common_ptr) cinfo, val->whole_image[compptr->component_index],
+         cinfo->input_iMCU_row * compptr->v_samp_factor,
+         (JDIMENSION) compptr->v_samp_factor, TRUE);
+    }
+  }
+
+  /* Loop to process one whole iMCU row */
+  for (yoffset = val->MCU_vert_offset; yoffset < val->MCU_rows_per_iMCU_row;
+       yoffset++) {
+    for (MCU_col_num = val->MCU_ctr; MCU_col_num < cinfo->MCUs_per_row;
+         MCU_col_num++) {
+      if (cinfo->progressive_mode) {
+        /* Construct list of pointers to DCT blocks belonging to this MCU */
+        blkn = 0;               /* index of current DCT block within MCU */
+        for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+          compptr = cinfo->cur_comp_info[ci];
+          start_col = MCU_col_num * compptr->MCU_width;
+          for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+            buffer_ptr = buffer[ci][yindex+yoffset] + start_col;
+            for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+              val->MCU_buffer[blkn++] = buffer_ptr++;
+            }
+          }
+        }
+      }
+      /* Try to fetch the MCU. */
+      if (! (*cinfo->entropy->decode_mcu) (cinfo, val->MCU_buffer)) {
+        /* Suspension forced; update state counters and exit */
+        val->MCU_vert_offset = yoffset;
+        val->MCU_ctr = MCU_col_num;
+        return JPEG_SUSPENDED;
+      }
+      if (cinfo->err->num_warnings != val->num_warnings)
+        validate_note_warning(cinfo, MCU_row_base + yoffset,
+                              (long) MCU_col_num);
+    }
+    /* Completed an MCU row, but perhaps not an iMCU row */
+    val->MCU_ctr = 0;
+  }
+  /* Completed the iMCU row, advance counters for next one */
+  JTRACE4(decode__row, cinfo->input_iMCU_row, cinfo->total_iMCU_rows,
+          cinfo->input_scan_number, cinfo->src->bytes_in_buffer);
+  if (++(cinfo->input_iMCU_row) < cinfo->total_iMCU_rows) {
+    validate_start_iMCU_row(cinfo);
+    return JPEG_ROW_COMPLETED;
+  }
+  /* Completed the scan */
+  (*cinfo->inputctl->finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
+/*
+ * Check the integrity of a JPEG file by entropy decoding all of its scans.
+ * jpeg_read_header must be completed before calling this.
+ *
+ * No coefficients are retained (except when decoding a progressive image),
+ * and no inverse DCT, upsampling, or color conversion is performed.  Corrupt
+ * data is reported through the usual warning mechanism, and *result receives
+ * a summary of the warnings issued after jpeg_read_header, including the
+ * location of the first one.  Call jpeg_finish_decompress() or
+ * jpeg_abort_decompress() afterward.
+ *
+ * Returns FALSE if suspended.  This case need be checked only if
+ * a suspending data source is used.
+ */
+
+GLOBAL(boolean)
+jpeg_validate (j_decompress_ptr cinfo, jpeg_validation_result * result)
+{
+  my_validator_ptr val;
+
+  if (cinfo->global_state == DSTATE_READY) {
+    /* First call: initialize active modules */
+    validate_master_selection(cinfo);
+    cinfo->global_state = DSTATE_VALIDATING;
+  }
+  if (cinfo->global_state != DSTATE_VALIDATING)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  val = (my_validator_ptr) cinfo->coef;
+
+  /* Absorb whole file */
+  for (;;) {
+    int retcode;
+    /* Call progress monitor hook if present */
+    if (cinfo->progress != NULL)
+      (*cinfo->progress->progress_monitor) ((j_common_ptr) cinfo);
+    /* Absorb some more input */
+    retcode = (*cinfo->inputctl->consume_input) (cinfo);
+    /* Warnings issued while reading markers have no MCU position */
+    validate_note_warning(cinfo, -1L, -1L);
+    if (retcode == JPEG_SUSPENDED)
+      return FALSE;
+    if (retcode == JPEG_REACHED_EOI)
+      break;
+    /* Advance progress counter if appropriate */
+    if (cinfo->progress != NULL &&
+        (retcode == JPEG_ROW_COMPLETED || retcode == JPEG_REACHED_SOS)) {
+      if (++cinfo->progress->pass_counter >= cinfo->progress->pass_limit) {
+        /* startup underestimated number of scans; ratchet up one scan */
+        cinfo->progress->pass_limit += (long) cinfo->total_iMCU_rows;
+      }
+    }
+  }
+
+  val->result.num_warnings = cinfo->err->num_warnings -
+                             val->result.num_warnings;
+  *result = val->result;
+  /* Set state so that jpeg_finish_decompress does the right thing */
+  cinfo->global_state = DSTATE_STOPPING;
+  return TRUE;
+}
+
+
+/*
+ * Master selection of decompression modules for validation.
+ */
+
+LOCAL(void)
+validate_master_selection (j_decompress_ptr cinfo)
+{
+  my_validator_ptr val;
+  int ci;
+  jpeg_component_info *compptr;
+
+  /* Entropy decoding: either Huffman or arithmetic coding. */
+  if (cinfo->arith_code) {
+#ifdef D_ARITH_CODING_SUPPORTED
+    jinit_arith_decoder(cinfo);
+#else
+    ERREXIT(cinfo, JERR_ARITH_NOTIMPL);
+#endif
+  } else {
+    if (cinfo->progressive_mode) {
+#ifdef D_PROGRESSIVE_SUPPORTED
+      jinit_phuff_decoder(cinfo);
+#else
+      ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+    } else
+      jinit_huff_decoder(cinfo);
+  }
+
+  val = (my_validator_ptr)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                sizeof(my_validator));
+  MEMZERO(val, sizeof(my_validator));
+  cinfo->coef = (struct jpeg_d_coef_controller *) val;
+  val->pub.start_input_pass = validate_start_input_pass;
+  val->pub.consume_data = validate_consume_data;
+  val->pub.coef_arrays = NULL;
+  val->result.bad_MCU_row = val->result.bad_MCU_col = -1L;
+
+  if (cinfo->progressive_mode) {
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+    /* Allocate a full-image virtual array for each component, */
+    /* padded to a multiple of samp_factor DCT blocks in each direction. */
+    /* Note we ask for a pre-zeroed array. */
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++) {
+      val->whole_image[ci] = (*cinfo->mem->request_virt_barray)
+        ((j_common_ptr) cinfo, JPOOL_IMAGE, TRUE,
+         (JDIMENSION) jround_up((long) compptr->width_in_blocks,
+                                (long) compptr->h_samp_factor),
+         (JDIMENSION) jround_up((long) compptr->height_in_blocks,
+                                (long) compptr->v_samp_factor),
+         (JDIMENSION) compptr->v_samp_factor);
+    }
+    (*cinfo->mem->realize_virt_arrays) ((j_common_ptr) cinfo);
+#else
+    ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+  } else {
+    /* A single scratch MCU suffices, since its contents are never used. */
+    JBLOCKROW buffer = (JBLOCKROW)
+      (*cinfo->mem->alloc_large) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+                                  D_MAX_BLOCKS_IN_MCU * sizeof(JBLOCK));
+    for (ci = 0; ci < D_MAX_BLOCKS_IN_MCU; ci++)
+      val->MCU_buffer[ci] = buffer + ci;
+    /* Tell the Huffman decoder not to store any coefficients. */
+    for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+         ci++, compptr++)
+      compptr->component_needed = FALSE;
+  }
+
+  /* Warnings issued by jpeg_read_header() don't count. */
+  val->num_warnings = val->result.num_warnings = cinfo->err->num_warnings;
+
+  /* Initialize input side of decompressor to consume first scan. */
+  (*cinfo->inputctl->start_input_pass) (cinfo);
+  validate_note_warning(cinfo, -1L, -1L);
+
+  /* Initialize progress monitoring. */
+  if (cinfo->progress != NULL) {
+    int nscans;
+    /* Estimate number of scans to set pass_limit. */
+    if (cinfo->progressive_mode) {
+      /* Arbitrarily estimate 2 interleaved DC scans + 3 AC scans/component. */
+      nscans = 2 + 3 * cinfo->num_components;
+    } else if (cinfo->inputctl->has_multiple_scans) {
+      /* For a nonprogressive multiscan file, estimate 1 scan per component. */
+      nscans = cinfo->num_components;
+    } else {
+      nscans = 1;
+    }
+    cinfo->progress->pass_counter = 0L;
+    cinfo->progress->pass_limit = (long) cinfo->total_iMCU_rows * nscans;
+    cinfo->progress->completed_passes = 0;
+    cinfo->progress->total_passes = 1;
+  }
+}
@@ -134,6 +134,9 @@ typedef struct {
   /* This counts total space obtained from jpeg_get_small/large */
   size_t total_space_allocated;
 
+  /* Statistics reported by jpeg_get_memory_stats() */
+  jpeg_memory_stats stats;
+
   /* alloc_sarray and alloc_barray set this value for use by virtual
    * array routines.
    */
@@ -260,6 +263,27 @@ static const size_t extra_pool_slop[JPOOL_NUMPOOLS] =
 #define MIN_SLOP  50            /* greater than 0 to avoid futile looping */
 
 
+/*
+ * Update the current and peak totals in the memory usage statistics after
+ * space has been obtained from, or returned to, the system.
+ */
+
+LOCAL(void)
+update_mem_stats (my_mem_ptr mem)
+{
+  int pool;
+
+  mem->stats.current_bytes = sizeof(my_memory_mgr);
+  for (pool = JPOOL_PERMANENT; pool < JPOOL_NUMPOOLS; pool++) {
+    mem->stats.current_bytes += mem->stats.pool_bytes[pool];
+    if (mem->stats.pool_bytes[pool] > mem->stats.peak_pool_bytes[pool])
+      mem->stats.peak_pool_bytes[pool] = mem->stats.pool_bytes[pool];
+  }
+  if (mem->stats.current_bytes > mem->stats.peak_bytes)
+    mem->stats.peak_bytes = mem->stats.current_bytes;
+}
+
+
 METHODDEF(void *)
 alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 /* Allocate a "small" object */
@@ -314,6 +338,8 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
         out_of_memory(cinfo, 2); /* jpeg_get_small failed */
     }
     mem->total_space_allocated += min_request + slop;
+    mem->stats.pool_bytes[pool_id] += min_request + slop;
+    update_mem_stats(mem);
     /* Success, initialize the new pool header and add to end of list */
     hdr_ptr->next = NULL;
     hdr_ptr->bytes_used = 0;
@@ -332,6 +358,7 @@ alloc_small (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   data_ptr += hdr_ptr->bytes_used; /* point to place for object */
   hdr_ptr->bytes_used += sizeofobject;
   hdr_ptr->bytes_left -= sizeofobject;
+  mem->stats.small_allocs[pool_id]++;
 
   return (void *) data_ptr;
 }
@@ -379,6 +406,10 @@ alloc_large (j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   if (hdr_ptr == NULL)
     out_of_memory(cinfo, 4);    /* jpeg_get_large failed */
   mem->total_space_allocated += sizeofobject + sizeof(large_pool_hdr) + ALIGN_SIZE - 1;
+  mem->stats.pool_bytes[pool_id] += sizeofobject + sizeof(large_pool_hdr) +
+                                    ALIGN_SIZE - 1;
+  mem->stats.large_allocs[pool_id]++;
+  update_mem_stats(mem);
 
   /* Success, initialize the new pool header and add to list */
   hdr_ptr->next = mem->large_list[pool_id];
@@ -647,6 +678,8 @@ realize_virt_arrays (j_common_ptr cinfo)
   if (space_per_minheight <= 0)
     return;                     /* no unrealized arrays, no work */
 
+  mem->stats.virt_array_bytes += maximum_space;
+
   /* Determine amount of memory to actually use; this is system-dependent. */
   avail_mem = jpeg_mem_available(cinfo, space_per_minheight, maximum_space,
                                  mem->total_space_allocated);
@@ -682,6 +715,9 @@ realize_virt_arrays (j_common_ptr cinfo)
                                 (long) sptr->samplesperrow *
                                 (long) sizeof(JSAMPLE));
         sptr->b_s_open = TRUE;
+        mem->stats.backing_store_bytes += (long) sptr->rows_in_array *
+                                          (long) sptr->samplesperrow *
+                                          sizeof(JSAMPLE);
       }
       sptr->mem_buffer = alloc_sarray(cinfo, JPOOL_IMAGE,
                                       sptr->samplesperrow, sptr->rows_in_mem);
@@ -706,6 +742,9 @@ realize_virt_arrays (j_common_ptr cinfo)
                                 (long) bptr->blocksperrow *
                                 (long) sizeof(JBLOCK));
         bptr->b_s_open = TRUE;
+        mem->stats.backing_store_bytes += (long) bptr->rows_in_array *
+                                          (long) bptr->blocksperrow *
+                                          sizeof(JBLOCK);
       }
       bptr->mem_buffer = alloc_barray(cinfo, JPOOL_IMAGE,
                                       bptr->blocksperrow, bptr->rows_in_mem);
@@ -1022,6 +1061,9 @@ free_pool (j_common_ptr cinfo, int pool_id)
     mem->total_space_allocated -= space_freed;
     shdr_ptr = next_shdr_ptr;
   }
+
+  mem->stats.pool_bytes[pool_id] = 0;
+  update_mem_stats(mem);
 }
 
 
@@ -1123,6 +1165,9 @@ jinit_memory_mgr (j_common_ptr cinfo)
 
   mem->total_space_allocated = sizeof(my_memory_mgr);
 
+  MEMZERO(&mem->stats, sizeof(jpeg_memory_stats));
+  update_mem_stats(mem);
+
   /* Declare ourselves open for business */
   cinfo->mem = & mem->pub;
 
@@ -1148,3 +1193,229 @@ jinit_memory_mgr (j_common_ptr cinfo)
 #endif
 
 }
+
+
+/*
+ * Memory usage statistics (libjpeg-turbo extension.)
+ *
+ * jpeg_get_memory_stats() returns the statistics that have been gathered
+ * since the JPEG object was created or since the most recent call to
+ * jpeg_reset_memory_stats().  Resetting the statistics clears the allocation
+ * counts and the virtual array totals and sets the peak values to the amount
+ * of memory that is currently in use, so the peak values returned afterward
+ * reflect only the operations performed after the reset.
+ */
+
+GLOBAL(void)
+jpeg_get_memory_stats (j_common_ptr cinfo, jpeg_memory_stats * stats)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+
+  if (mem == NULL)
+    MEMZERO(stats, sizeof(jpeg_memory_stats));
+  else
+    MEMCOPY(stats, &mem->stats, sizeof(jpeg_memory_stats));
+}
+
+
+GLOBAL(void)
+jpeg_reset_memory_stats (j_common_ptr cinfo)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  int pool;
+
+  if (mem == NULL)
+    return;
+
+  for (pool = JPOOL_PERMANENT; pool < JPOOL_NUMPOOLS; pool++) {
+    mem->stats.peak_pool_bytes[pool] = mem->stats.pool_bytes[pool];
+    mem->stats.small_allocs[pool] = 0;
+    mem->stats.large_allocs[pool] = 0;
+  }
+  mem->stats.peak_bytes = mem->stats.current_bytes;
+  mem->stats.virt_array_bytes = 0;
+  mem->stats.backing_store_bytes = 0;
+}
+
+
+/*
+ * Memory requirement estimation (libjpeg-turbo extension.)
+ *
+ * These routines let other modules predict how much space a sequence of
+ * JPOOL_IMAGE allocation requests would obtain from the system, by
+ * reproducing the pool and chunking logic of alloc_small(), alloc_large(),
+ * alloc_sarray(), alloc_barray() and realize_virt_arrays() above.  They must
+ * be kept in sync with those routines.  Virtual arrays are assumed to fit in
+ * memory, which is always the case with jmemnobs.c.
+ *
+ * Small objects are placed first-fit into the existing small pools, as
+ * alloc_small() does.  Only the first JTALLY_MAX_POOLS pools are tracked;
+ * space left in any pools beyond that is ignored, so the tally can only err
+ * on the high side.
+ */
+
+GLOBAL(void)
+jtally_init (j_common_ptr cinfo, jpeg_mem_tally * tally)
+{
+  my_mem_ptr mem = (my_mem_ptr) cinfo->mem;
+  small_pool_ptr hdr_ptr;
+
+  tally->bytes = 0;
+  tally->num_pools = 0;
+  tally->num_virt_arrays = 0;
+  tally->virt_sarray_bytes = tally->virt_barray_bytes = 0;
+  for (hdr_ptr = mem->small_list[JPOOL_IMAGE];
+       hdr_ptr != NULL && tally->num_pools < JTALLY_MAX_POOLS;
+       hdr_ptr = hdr_ptr->next)
+    tally->small_left[tally->num_pools++] = hdr_ptr->bytes_left;
+}
+
+
+GLOBAL(void)
+jtally_small (jpeg_mem_tally * tally, size_t sizeofobject)
+{
+  size_t min_request, slop;
+  int pool;
+
+  sizeofobject = round_up_pow2(sizeofobject, ALIGN_SIZE);
+  for (pool = 0; pool < tally->num_pools; pool++) {
+    if (tally->small_left[pool] >= sizeofobject)
+      break;
+  }
+  if (pool == tally->num_pools) {
+    min_request = sizeof(small_pool_hdr) + sizeofobject + ALIGN_SIZE - 1;
+    if (pool == 0)
+      slop = first_pool_slop[JPOOL_IMAGE];
+    else
+      slop = extra_pool_slop[JPOOL_IMAGE];
+    if (slop > (size_t) (MAX_ALLOC_CHUNK-min_request))
+      slop = (size_t) (MAX_ALLOC_CHUNK-min_request);
+    tally->bytes += min_request + slop;
+    if (pool == JTALLY_MAX_POOLS)
+      pool--;                   /* forget the space left in the last pool */
+    else
+      tally->num_pools++;
+    tally->small_left[pool] = sizeofobject + slop;
+  }
+  tally->small_left[pool] -= sizeofobject;
+}
+
+
+GLOBAL(void)
+jtally_large (jpeg_mem_tally * tally, size_t sizeofobject)
+{
+  tally->bytes += round_up_pow2(sizeofobject, ALIGN_SIZE) +
+                  sizeof(large_pool_hdr) + ALIGN_SIZE - 1;
+}
+
+
+LOCAL(void)
+tally_rows (jpeg_mem_tally * tally, size_t rowsize, JDIMENSION numrows)
+/* Common code for sample and block arrays (see alloc_sarray) */
+{
+  JDIMENSION rowsperchunk, currow;
+  long ltemp;
+
+  ltemp = (MAX_ALLOC_CHUNK-sizeof(large_pool_hdr)) / (long) rowsize;
+  if (ltemp <= 0)
+    ltemp = 1;
+  if (ltemp < (long) numrows)
+    rowsperchunk = (JDIMENSION) ltemp;
+  else
+    rowsperchunk = numrows;
+
+  jtally_small(tally, (size_t) numrows * sizeof(void *));
+
+  for (currow = 0; currow < numrows; currow += rowsperchunk) {
+    rowsperchunk = MIN(rowsperchunk, numrows - currow);
+    jtally_large(tally, (size_t) rowsperchunk * rowsize);
+  }
+}
+
+
+GLOBAL(void)
+jtally_sarray (jpeg_mem_tally * tally, JDIMENSION samplesperrow,
+               JDIMENSION numrows)
+{
+  samplesperrow = (JDIMENSION) round_up_pow2(samplesperrow,
+                                             (2 * ALIGN_SIZE) / sizeof(JSAMPLE));
+  tally_rows(tally, (size_t) samplesperrow * sizeof(JSAMPLE), numrows);
+}
+
+
+GLOBAL(void)
+jtally_barray (jpeg_mem_tally * tally, JDIMENSION blocksperrow,
+               JDIMENSION numrows)
+{
+  tally_rows(tally, (size_t) blocksperrow * sizeof(JBLOCK), numrows);
+}
+
+
+LOCAL(void)
+tally_virt_array (jpeg_mem_tally * tally, boolean is_barray,
+                  JDIMENSION width, JDIMENSION height)
+/* Common code for request_virt_sarray/barray */
+{
+  if (is_barray)
+    jtally_small(tally, sizeof(struct jvirt_barray_control));
+  else
+    jtally_small(tally, sizeof(struct jvirt_sarray_control));
+
+  if (tally->num_virt_arrays == JTALLY_MAX_VIRT_ARRAYS) {
+    /* No room to defer this one, so tally the array itself right away */
+    if (is_barray)
+      jtally_barray(tally, width, height);
+    else
+      jtally_sarray(tally, width, height);
+    return;
+  }
+  tally->virt_array[tally->num_virt_arrays].is_barray = is_barray;
+  tally->virt_array[tally->num_virt_arrays].width = width;
+  tally->virt_array[tally->num_virt_arrays].height = height;
+  tally->num_virt_arrays++;
+}
+
+
+GLOBAL(void)
+jtally_virt_sarray (jpeg_mem_tally * tally, JDIMENSION samplesperrow,
+                    JDIMENSION numrows)
+{
+  tally_virt_array(tally, FALSE, samplesperrow, numrows);
+}
+
+
+GLOBAL(void)
+jtally_virt_barray (jpeg_mem_tally * tally, JDIMENSION blocksperrow,
+                    JDIMENSION numrows)
+{
+  tally_virt_array(tally, TRUE, blocksperrow, numrows);
+}
+
+
+GLOBAL(void)
+jtally_realize_virt_arrays (jpeg_mem_tally * tally)
+/* realize_virt_arrays() allocates the most recently requested arrays first,
+ * sample arrays before block arrays.
+ */
+{
+  size_t mark;
+  int i;
+
+  mark = tally->bytes;
+  for (i = tally->num_virt_arrays - 1; i >= 0; i--) {
+    if (! tally->virt_array[i].is_barray)
+      jtally_sarray(tally, tally->virt_array[i].width,
+                    tally->virt_array[i].height);
+  }
+  tally->virt_sarray_bytes = tally->bytes - mark;
+
+  mark = tally->bytes;
+  for (i = tally->num_virt_arrays - 1; i >= 0; i--) {
+    if (tally->virt_array[i].is_barray)
+      jtally_barray(tally, tally->virt_array[i].width,
+                    tally->virt_array[i].height);
+  }
+  tally->virt_barray_bytes = tally->bytes - mark;
+
+  tally->num_virt_arrays = 0;
+}
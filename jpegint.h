@@ -29,6 +29,7 @@ typedef enum {            /* Operating modes for buffer controllers */
 #define CSTATE_SCANNING 101     /* start_compress done, write_scanlines OK */
 #define CSTATE_RAW_OK   102     /* start_compress done, write_raw_data OK */
 #define CSTATE_WRCOEFS  103     /* jpeg_write_coefficients done */
+#define CSTATE_WRCOEFROWS 104   /* jpeg_write_coefficients done, rows OK */
 #define DSTATE_START    200     /* after create_decompress */
 #define DSTATE_INHEADER 201     /* reading header markers, no SOS yet */
 #define DSTATE_READY    202     /* found SOS, ready for start_decompress */
@@ -39,7 +40,9 @@ typedef enum {            /* Operating modes for buffer controllers */
 #define DSTATE_BUFIMAGE 207     /* expecting jpeg_start_output */
 #define DSTATE_BUFPOST  208     /* looking for SOS/EOI in jpeg_finish_output */
 #define DSTATE_RDCOEFS  209     /* reading file in jpeg_read_coefficients */
-#define DSTATE_STOPPING 210     /* looking for EOI in jpeg_finish_decompress */
+#define DSTATE_VALIDATING 210   /* reading file in jpeg_validate */
+#define DSTATE_RDCOEFROWS 211   /* reading file in jpeg_read_coefficient_row */
+#define DSTATE_STOPPING 212     /* looking for EOI in jpeg_finish_decompress */
 
 
 /* Declarations for compression modules */
@@ -49,6 +52,10 @@ struct jpeg_comp_master {
   void (*prepare_for_pass) (j_compress_ptr cinfo);
   void (*pass_startup) (j_compress_ptr cinfo);
   void (*finish_pass) (j_compress_ptr cinfo);
+  /* Encode all of the remaining scans in parallel, if the application asked
+   * for that and it is possible.  Sets is_last_pass if it did so.
+   */
+  void (*encode_remaining_scans) (j_compress_ptr cinfo);
 
   /* State variables made visible to other modules */
   boolean call_pass_startup;    /* True if pass_startup must be called */
@@ -76,6 +83,10 @@ struct jpeg_c_prep_controller {
 struct jpeg_c_coef_controller {
   void (*start_pass) (j_compress_ptr cinfo, J_BUF_MODE pass_mode);
   boolean (*compress_data) (j_compress_ptr cinfo, JSAMPIMAGE input_buf);
+  /* Give dstinfo, a copy of cinfo, its own controller that reads the same
+   * whole-image buffer (NULL if there is no such buffer)
+   */
+  void (*clone) (j_compress_ptr cinfo, j_compress_ptr dstinfo);
 };
 
 /* Colorspace conversion */
@@ -149,6 +160,15 @@ struct jpeg_input_controller {
   /* State variables made visible to other modules */
   boolean has_multiple_scans;   /* True if file has multiple scans */
   boolean eoi_reached;          /* True when EOI has been consumed */
+  /* Set by jpeg_set_idct_upsampling(); kept here because it must be chosen
+   * before the decompressor master control exists.  Reset for each image.
+   */
+  boolean idct_upsampling;      /* True to upsample h2v2 chroma in the IDCT */
+  /* Used by jpeg_consume_scans() to count the bytes read from the source.
+   * Counting is enabled only while last_byte is non-NULL.
+   */
+  long bytes_consumed;          /* Bytes consumed from previous buffers */
+  const JOCTET * last_byte;     /* Start of uncounted bytes in this buffer */
 };
 
 /* Main buffer control (downsampled-data buffer) */
@@ -202,6 +222,7 @@ struct jpeg_marker_reader {
 struct jpeg_entropy_decoder {
   void (*start_pass) (j_decompress_ptr cinfo);
   boolean (*decode_mcu) (j_decompress_ptr cinfo, JBLOCKROW *MCU_data);
+  void (*finish_pass) (j_decompress_ptr cinfo); /* may be NULL */
 
   /* This is here to share code between baseline and progressive decoders; */
   /* other modules probably should not use it */
@@ -215,10 +236,19 @@ typedef void (*inverse_DCT_method_ptr) (j_decompress_ptr cinfo,
                                         JSAMPARRAY output_buf,
                                         JDIMENSION output_col);
 
+/* Inverse DCT of num_blocks horizontally adjacent blocks */
+typedef void (*inverse_DCT_row_method_ptr) (j_decompress_ptr cinfo,
+                                            jpeg_component_info * compptr,
+                                            JBLOCKROW coef_row,
+                                            JSAMPARRAY output_buf,
+                                            JDIMENSION output_col,
+                                            JDIMENSION num_blocks);
+
 struct jpeg_inverse_dct {
   void (*start_pass) (j_decompress_ptr cinfo);
   /* It is useful to allow each component to have a separate IDCT method. */
   inverse_DCT_method_ptr inverse_DCT[MAX_COMPONENTS];
+  inverse_DCT_row_method_ptr inverse_DCT_row[MAX_COMPONENTS];
 };
 
 /* Upsampling (note that upsampler must also call color converter) */
@@ -306,6 +336,8 @@ EXTERN(void) jinit_d_coef_controller (j_decompress_ptr cinfo,
 EXTERN(void) jinit_d_post_controller (j_decompress_ptr cinfo,
                                       boolean need_full_buffer);
 EXTERN(void) jinit_input_controller (j_decompress_ptr cinfo);
+EXTERN(boolean) jfill_input_buffer (j_decompress_ptr cinfo);
+EXTERN(void) jskip_input_data (j_decompress_ptr cinfo, long num_bytes);
 EXTERN(void) jinit_marker_reader (j_decompress_ptr cinfo);
 EXTERN(void) jinit_huff_decoder (j_decompress_ptr cinfo);
 EXTERN(void) jinit_phuff_decoder (j_decompress_ptr cinfo);
@@ -319,6 +351,90 @@ EXTERN(void) jinit_merged_upsampler (j_decompress_ptr cinfo);
 /* Memory manager initialization */
 EXTERN(void) jinit_memory_mgr (j_common_ptr cinfo);
 
+/* Memory requirement estimation in jmemmgr.c.  A tally mirrors the space
+ * accounting of the memory manager's allocation methods for JPOOL_IMAGE
+ * without actually allocating anything.
+ */
+#define JTALLY_MAX_POOLS  32
+#define JTALLY_MAX_VIRT_ARRAYS  (MAX_COMPONENTS+1)
+
+typedef struct {
+  size_t bytes;                 /* space that would be obtained from system */
+  int num_pools;                /* number of small pools being tracked */
+  size_t small_left[JTALLY_MAX_POOLS]; /* space left in each, in list order */
+  int num_virt_arrays;          /* number of unrealized virtual arrays */
+  struct {
+    boolean is_barray;
+    JDIMENSION width;           /* samples or blocks per row */
+    JDIMENSION height;          /* total rows in array */
+  } virt_array[JTALLY_MAX_VIRT_ARRAYS]; /* in request order */
+  size_t virt_sarray_bytes;     /* set by jtally_realize_virt_arrays */
+  size_t virt_barray_bytes;
+} jpeg_mem_tally;
+
+EXTERN(void) jtally_init (j_common_ptr cinfo, jpeg_mem_tally * tally);
+EXTERN(void) jtally_small (jpeg_mem_tally * tally, size_t sizeofobject);
+EXTERN(void) jtally_large (jpeg_mem_tally * tally, size_t sizeofobject);
+EXTERN(void) jtally_sarray (jpeg_mem_tally * tally, JDIMENSION samplesperrow,
+                            JDIMENSION numrows);
+EXTERN(void) jtally_barray (jpeg_mem_tally * tally, JDIMENSION blocksperrow,
+                            JDIMENSION numrows);
+EXTERN(void) jtally_virt_sarray (jpeg_mem_tally * tally,
+                                 JDIMENSION samplesperrow, JDIMENSION numrows);
+EXTERN(void) jtally_virt_barray (jpeg_mem_tally * tally,
+                                 JDIMENSION blocksperrow, JDIMENSION numrows);
+EXTERN(void) jtally_realize_virt_arrays (jpeg_mem_tally * tally);
+
+/* Decompression module memory estimation routines.  Each one tallies what
+ * the corresponding jinit_* routine would allocate; the *_passes variants
+ * tally what the module's pass methods allocate later on.
+ */
+EXTERN(void) jtally_input_controller_passes (j_decompress_ptr cinfo,
+                                             jpeg_mem_tally * tally);
+EXTERN(void) jtally_d_main_controller (j_decompress_ptr cinfo,
+                                       jpeg_mem_tally * tally,
+                                       boolean need_context_rows);
+EXTERN(void) jtally_d_coef_controller (j_decompress_ptr cinfo,
+                                       jpeg_mem_tally * tally,
+                                       boolean need_full_buffer);
+EXTERN(void) jtally_d_coef_controller_passes (j_decompress_ptr cinfo,
+                                              jpeg_mem_tally * tally,
+                                              boolean need_full_buffer);
+EXTERN(void) jtally_d_post_controller (j_decompress_ptr cinfo,
+                                       jpeg_mem_tally * tally,
+                                       boolean need_full_buffer);
+EXTERN(void) jtally_huff_decoder (j_decompress_ptr cinfo,
+                                  jpeg_mem_tally * tally);
+EXTERN(void) jtally_huff_decoder_passes (j_decompress_ptr cinfo,
+                                         jpeg_mem_tally * tally);
+EXTERN(void) jtally_phuff_decoder (j_decompress_ptr cinfo,
+                                   jpeg_mem_tally * tally);
+EXTERN(void) jtally_phuff_decoder_passes (j_decompress_ptr cinfo,
+                                          jpeg_mem_tally * tally);
+EXTERN(void) jtally_arith_decoder (j_decompress_ptr cinfo,
+                                   jpeg_mem_tally * tally);
+EXTERN(void) jtally_arith_decoder_passes (j_decompress_ptr cinfo,
+                                          jpeg_mem_tally * tally);
+EXTERN(void) jtally_inverse_dct (j_decompress_ptr cinfo,
+                                 jpeg_mem_tally * tally);
+EXTERN(boolean) jtally_upsampler (j_decompress_ptr cinfo,
+                                  jpeg_mem_tally * tally,
+                                  const boolean * component_needed);
+EXTERN(void) jtally_color_deconverter (j_decompress_ptr cinfo,
+                                       jpeg_mem_tally * tally,
+                                       boolean * component_needed);
+EXTERN(void) jtally_1pass_quantizer (j_decompress_ptr cinfo,
+                                     jpeg_mem_tally * tally);
+EXTERN(void) jtally_1pass_quantizer_passes (j_decompress_ptr cinfo,
+                                            jpeg_mem_tally * tally);
+EXTERN(void) jtally_2pass_quantizer (j_decompress_ptr cinfo,
+                                     jpeg_mem_tally * tally,
+                                     boolean enable_2pass);
+EXTERN(void) jtally_2pass_quantizer_passes (j_decompress_ptr cinfo,
+                                            jpeg_mem_tally * tally);
+EXTERN(void) jtally_merged_upsampler (j_decompress_ptr cinfo,
+                                      jpeg_mem_tally * tally);
+
 /* Utility routines in jutils.c */
 EXTERN(long) jdiv_round_up (long a, long b);
 EXTERN(long) jround_up (long a, long b);
@@ -869,6 +869,62 @@ struct jpeg_memory_mgr {
 };
 
 
+/* Memory usage statistics for a JPEG object, as returned by
+ * jpeg_get_memory_stats().  All sizes are in bytes and include the memory
+ * manager's own overhead.
+ */
+
+typedef struct {
+  size_t current_bytes;         /* memory currently obtained from the system */
+  size_t peak_bytes;            /* maximum value of current_bytes */
+  size_t pool_bytes[JPOOL_NUMPOOLS];      /* memory currently held by pool */
+  size_t peak_pool_bytes[JPOOL_NUMPOOLS]; /* maximum value of pool_bytes */
+  long small_allocs[JPOOL_NUMPOOLS];      /* # of alloc_small requests */
+  long large_allocs[JPOOL_NUMPOOLS];      /* # of alloc_large requests */
+  size_t virt_array_bytes;      /* full size of realized virtual arrays */
+  size_t backing_store_bytes;   /* portion of the above that was placed in
+                                   backing store rather than memory */
+} jpeg_memory_stats;
+
+
+/* Resource requirements of a decompression, as estimated by
+ * jpeg_calc_decompress_requirements().  Memory sizes are in bytes and include
+ * the memory manager's own overhead.
+ */
+
+typedef struct {
+  size_t peak_bytes;            /* estimated peak_bytes value (see
+                                   jpeg_memory_stats) at the end of the
+                                   decompression */
+  size_t image_bytes;           /* memory that will be allocated by
+                                   jpeg_start_decompress() and the output
+                                   passes */
+  size_t coef_buffer_bytes;     /* portion of image_bytes used by whole-image
+                                   coefficient buffers */
+  size_t sample_buffer_bytes;   /* portion of image_bytes used by sample
+                                   buffers and color quantization */
+  long coef_blocks;             /* # of DCT blocks to be entropy decoded */
+  long idct_blocks;             /* # of DCT blocks to be inverse transformed */
+  double cpu_cost;              /* relative CPU cost (see libjpeg.txt) */
+} jpeg_decompress_requirements;
+
+
+/* Results of an integrity check, as returned by jpeg_validate() */
+
+typedef struct {
+  int num_scans;                /* # of scans that were entropy decoded */
+  long num_warnings;            /* # of warnings issued while reading them */
+  int first_warning;            /* message code of the first such warning,
+                                   or 0 if there were none */
+  int bad_scan;                 /* scan # (counting from 1) in which the first
+                                   warning was issued, or 0 if none */
+  long bad_MCU_row;             /* MCU row and column, within that scan, at */
+  long bad_MCU_col;             /* which the first warning was issued, or -1
+                                   if none or if it was issued while reading
+                                   markers */
+} jpeg_validation_result;
+
+
 /* Routine signature for application-supplied marker processing methods.
  * Need not pass marker code since it is stored in cinfo->unread_marker.
  */
@@ -953,6 +1009,9 @@ EXTERN(JDIMENSION) jpeg_write_scanlines (j_compress_ptr cinfo,
                                          JDIMENSION num_lines);
 EXTERN(void) jpeg_finish_compress (j_compress_ptr cinfo);
 
+/* Use multiple threads to encode the scans of a multi-scan image. */
+EXTERN(void) jpeg_set_scan_threads (j_compress_ptr cinfo, int num_threads);
+
 #if JPEG_LIB_VERSION >= 70
 /* Precalculate JPEG dimensions for current compression parameters. */
 EXTERN(void) jpeg_calc_jpeg_dimensions (j_compress_ptr cinfo);
@@ -1002,6 +1061,9 @@ EXTERN(boolean) jpeg_start_output (j_decompress_ptr cinfo, int scan_number);
 EXTERN(boolean) jpeg_finish_output (j_decompress_ptr cinfo);
 EXTERN(boolean) jpeg_input_complete (j_decompress_ptr cinfo);
 EXTERN(void) jpeg_new_colormap (j_decompress_ptr cinfo);
+EXTERN(void) jpeg_new_output_scale (j_decompress_ptr cinfo);
+EXTERN(boolean) jpeg_consume_scans (j_decompress_ptr cinfo, int max_scans,
+                                    long max_bytes);
 EXTERN(int) jpeg_consume_input (j_decompress_ptr cinfo);
 /* Return value is one of: */
 /* #define JPEG_SUSPENDED       0    Suspended due to lack of input data */
@@ -1015,6 +1077,12 @@ EXTERN(int) jpeg_consume_input (j_decompress_ptr cinfo);
 EXTERN(void) jpeg_core_output_dimensions (j_decompress_ptr cinfo);
 #endif
 EXTERN(void) jpeg_calc_output_dimensions (j_decompress_ptr cinfo);
+EXTERN(void) jpeg_set_idct_upsampling (j_decompress_ptr cinfo,
+                                       boolean enable);
+
+/* Estimate memory and CPU requirements for current decompression parameters. */
+EXTERN(void) jpeg_calc_decompress_requirements
+  (j_decompress_ptr cinfo, jpeg_decompress_requirements * req);
 
 /* Control saving of COM and APPn markers into marker_list. */
 EXTERN(void) jpeg_save_markers (j_decompress_ptr cinfo, int marker_code,
@@ -1032,6 +1100,18 @@ EXTERN(void) jpeg_write_coefficients (j_compress_ptr cinfo,
 EXTERN(void) jpeg_copy_critical_parameters (j_decompress_ptr srcinfo,
                                             j_compress_ptr dstinfo);
 
+/* Read or write raw DCT coefficients one iMCU row at a time (libjpeg-turbo
+ * extension) */
+EXTERN(boolean) jpeg_read_coefficient_row (j_decompress_ptr cinfo,
+                                           JBLOCKIMAGE data);
+EXTERN(boolean) jpeg_write_coefficient_row (j_compress_ptr cinfo,
+                                            JBLOCKIMAGE data);
+
+/* Entropy decode all scans without reconstructing the image (libjpeg-turbo
+ * extension) */
+EXTERN(boolean) jpeg_validate (j_decompress_ptr cinfo,
+                               jpeg_validation_result * result);
+
 /* If you choose to abort compression or decompression before completing
  * jpeg_finish_(de)compress, then you need to clean up to release memory,
  * temporary files, etc.  You can just call jpeg_destroy_(de)compress
@@ -1047,6 +1127,11 @@ EXTERN(void) jpeg_abort_decompress (j_decompress_ptr cinfo);
 EXTERN(void) jpeg_abort (j_common_ptr cinfo);
 EXTERN(void) jpeg_destroy (j_common_ptr cinfo);
 
+/* Memory usage statistics (libjpeg-turbo extension) */
+EXTERN(void) jpeg_get_memory_stats (j_common_ptr cinfo,
+                                    jpeg_memory_stats * stats);
+EXTERN(void) jpeg_reset_memory_stats (j_common_ptr cinfo);
+
 /* Default restart-marker-resync procedure for use by data source modules */
 EXTERN(boolean) jpeg_resync_to_restart (j_decompress_ptr cinfo, int desired);
 
@@ -42,6 +42,8 @@ static const char * progname;   /* program name for error messages */
 static char * outfilename;      /* for -outfile switch */
 static JCOPY_OPTION copyoption; /* -copy switch */
 static jpeg_transform_info transformoption; /* image transformation options */
+static int num_threads = 1;     /* -threads switch */
+static boolean stream;          /* -stream switch */
 
 
 LOCAL(void)
@@ -84,6 +86,8 @@ usage (void)
 #endif
   fprintf(stderr, "  -restart N     Set restart interval in rows, or in blocks with B\n");
   fprintf(stderr, "  -maxmemory N   Maximum memory to use (in kbytes)\n");
+  fprintf(stderr, "  -stream        Transcode one MCU row at a time, if possible\n");
+  fprintf(stderr, "  -threads N     Use N threads to encode the scans of a multi-scan file\n");
   fprintf(stderr, "  -outfile name  Specify name for output file\n");
   fprintf(stderr, "  -verbose  or  -debug   Emit debug output\n");
   fprintf(stderr, "  -version       Print version information and exit\n");
@@ -145,6 +149,7 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
   transformoption.force_grayscale = FALSE;
   transformoption.crop = FALSE;
   transformoption.slow_hflip = FALSE;
+  stream = FALSE;
   cinfo->err->trace_level = 0;
 
   /* Scan command line options, adjust parameters */
@@ -327,6 +332,17 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
       exit(EXIT_FAILURE);
 #endif
 
+    } else if (keymatch(arg, "stream", 2)) {
+      /* Transcode one iMCU row at a time, if possible. */
+      stream = TRUE;
+
+    } else if (keymatch(arg, "threads", 2)) {
+      /* Number of threads to use when encoding scans. */
+      if (++argn >= argc)       /* advance to next argument */
+        usage();
+      if (sscanf(argv[argn], "%d", &num_threads) != 1 || num_threads < 1)
+        usage();
+
     } else if (keymatch(arg, "transpose", 1)) {
       /* Transpose (across UL-to-LR axis). */
       select_transform(JXFORM_TRANSPOSE);
@@ -364,6 +380,48 @@ parse_switches (j_compress_ptr cinfo, int argc, char **argv,
 }
 
 
+/*
+ * Transcode a single-scan JPEG file one iMCU row at a time (-stream).  This
+ * needs only enough memory for one iMCU row of coefficients.
+ */
+
+LOCAL(void)
+transcode_rows (j_decompress_ptr srcinfo, j_compress_ptr dstinfo)
+{
+  JBLOCKARRAY buffer[MAX_COMPONENTS], rows[MAX_COMPONENTS];
+  JDIMENSION iMCU_row, dst_iMCU_row = 0;
+  int ci, yoffset;
+  jpeg_component_info *compptr;
+
+  /* Each block row is padded to a whole number of MCUs. */
+  for (ci = 0, compptr = srcinfo->comp_info; ci < srcinfo->num_components;
+       ci++, compptr++) {
+    JDIMENSION blocks_per_row = (compptr->width_in_blocks +
+                                 compptr->h_samp_factor - 1) /
+                                compptr->h_samp_factor *
+                                compptr->h_samp_factor;
+    buffer[ci] = (*srcinfo->mem->alloc_barray)
+      ((j_common_ptr) srcinfo, JPOOL_IMAGE, blocks_per_row,
+       (JDIMENSION) compptr->v_samp_factor);
+  }
+
+  /* If jtransform_adjust_parameters() gave a single-component image 1x1
+   * sampling factors, then each source iMCU row holds several destination
+   * iMCU rows.  Otherwise, the sampling factors are unchanged.
+   */
+  for (iMCU_row = 0; iMCU_row < srcinfo->total_iMCU_rows; iMCU_row++) {
+    (void) jpeg_read_coefficient_row(srcinfo, buffer);
+    for (yoffset = 0; yoffset < srcinfo->comp_info[0].v_samp_factor &&
+         dst_iMCU_row < dstinfo->total_iMCU_rows;
+         yoffset += dstinfo->comp_info[0].v_samp_factor, dst_iMCU_row++) {
+      for (ci = 0; ci < srcinfo->num_components; ci++)
+        rows[ci] = buffer[ci] + yoffset;
+      (void) jpeg_write_coefficient_row(dstinfo, rows);
+    }
+  }
+}
+
+
 /*
  * The main program.
  */
@@ -382,8 +440,10 @@ main (int argc, char **argv)
   int file_index;
   /* We assume all-in-memory processing and can therefore use only a
    * single file pointer for sequential input and output operation.
+   * (The exception is -stream, which keeps the input file open.)
    */
   FILE * fp;
+  FILE * stream_fp = NULL;
 
   /* On Mac, fetch a command line. */
 #ifdef USE_CCOMMAND
@@ -473,32 +533,59 @@ main (int argc, char **argv)
   }
 #endif
 
-  /* Read source file as DCT coefficients */
-  src_coef_arrays = jpeg_read_coefficients(&srcinfo);
+  /* With -stream, a single-scan file that isn't being transformed can be
+   * transcoded one iMCU row at a time, provided that the output file can be
+   * written in a single pass.  Otherwise, fall back to reading the whole
+   * file.
+   */
+  if (stream && transformoption.transform == JXFORM_NONE &&
+      !transformoption.crop && !transformoption.force_grayscale &&
+      !jpeg_has_multiple_scans(&srcinfo)) {
+    jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+    file_index = parse_switches(&dstinfo, argc, argv, 0, TRUE);
+    if (dstinfo.scan_info == NULL && !dstinfo.optimize_coding)
+      stream_fp = fp;
+  }
 
-  /* Initialize destination compression parameters from source values */
-  jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+  if (stream_fp != NULL) {
+    src_coef_arrays = NULL;
+    /* Make the same adjustments (single-component sampling factors, Exif
+     * handling) as for a buffered transcode, so that the output is identical.
+     */
+#if TRANSFORMS_SUPPORTED
+    dst_coef_arrays = jtransform_adjust_parameters(&srcinfo, &dstinfo,
+                                                   NULL, &transformoption);
+#else
+    dst_coef_arrays = NULL;
+#endif
+  } else {
+    /* Read source file as DCT coefficients */
+    src_coef_arrays = jpeg_read_coefficients(&srcinfo);
 
-  /* Adjust destination parameters if required by transform options;
-   * also find out which set of coefficient arrays will hold the output.
-   */
+    /* Initialize destination compression parameters from source values */
+    jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+
+    /* Adjust destination parameters if required by transform options;
+     * also find out which set of coefficient arrays will hold the output.
+     */
 #if TRANSFORMS_SUPPORTED
-  dst_coef_arrays = jtransform_adjust_parameters(&srcinfo, &dstinfo,
-                                                 src_coef_arrays,
-                                                 &transformoption);
+    dst_coef_arrays = jtransform_adjust_parameters(&srcinfo, &dstinfo,
+                                                   src_coef_arrays,
+                                                   &transformoption);
 #else
-  dst_coef_arrays = src_coef_arrays;
+    dst_coef_arrays = src_coef_arrays;
 #endif
 
-  /* Close input file, if we opened it.
-   * Note: we assume that jpeg_read_coefficients consumed all input
-   * until JPEG_REACHED_EOI, and that jpeg_finish_decompress will
-   * only consume more while (! cinfo->inputctl->eoi_reached).
-   * We cannot call jpeg_finish_decompress here since we still need the
-   * virtual arrays allocated from the source object for processing.
-   */
-  if (fp != stdin)
-    fclose(fp);
+    /* Close input file, if we opened it.
+     * Note: we assume that jpeg_read_coefficients consumed all input
+     * until JPEG_REACHED_EOI, and that jpeg_finish_decompress will
+     * only consume more while (! cinfo->inputctl->eoi_reached).
+     * We cannot call jpeg_finish_decompress here since we still need the
+     * virtual arrays allocated from the source object for processing.
+     */
+    if (fp != stdin)
+      fclose(fp);
+  }
 
   /* Open the output file. */
   if (outfilename != NULL) {
@@ -512,23 +599,31 @@ main (int argc, char **argv)
   }
 
   /* Adjust default compression parameters by re-parsing the options */
-  file_index = parse_switches(&dstinfo, argc, argv, 0, TRUE);
+  if (stream_fp == NULL)
+    file_index = parse_switches(&dstinfo, argc, argv, 0, TRUE);
 
   /* Specify data destination for compression */
   jpeg_stdio_dest(&dstinfo, fp);
 
   /* Start compressor (note no image data is actually written here) */
   jpeg_write_coefficients(&dstinfo, dst_coef_arrays);
+  if (num_threads > 1)
+    jpeg_set_scan_threads(&dstinfo, num_threads);
 
   /* Copy to the output file any extra markers that we want to preserve */
   jcopy_markers_execute(&srcinfo, &dstinfo, copyoption);
 
-  /* Execute image transformation, if any */
+  if (stream_fp != NULL) {
+    /* Transcode the image one iMCU row at a time */
+    transcode_rows(&srcinfo, &dstinfo);
+  } else {
+    /* Execute image transformation, if any */
 #if TRANSFORMS_SUPPORTED
-  jtransform_execute_transformation(&srcinfo, &dstinfo,
-                                    src_coef_arrays,
-                                    &transformoption);
+    jtransform_execute_transformation(&srcinfo, &dstinfo,
+                                      src_coef_arrays,
+                                      &transformoption);
 #endif
+  }
 
   /* Finish compression and release memory */
   jpeg_finish_compress(&dstinfo);
@@ -539,6 +634,9 @@ main (int argc, char **argv)
   /* Close output file, if we opened it */
   if (fp != stdout)
     fclose(fp);
+  /* ... and input file, if we kept it open for -stream */
+  if (stream_fp != NULL && stream_fp != stdin)
+    fclose(stream_fp);
 
 #ifdef PROGRESS_REPORT
   end_progress_monitor((j_common_ptr) &dstinfo);
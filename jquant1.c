@@ -853,4 +853,63 @@ jinit_1pass_quantizer (j_decompress_ptr cinfo)
     alloc_fs_workspace(cinfo);
 }
 
+
+/*
+ * Tally the memory that jinit_1pass_quantizer() would allocate,
+ * for jpeg_calc_decompress_requirements().
+ */
+
+GLOBAL(void)
+jtally_1pass_quantizer (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  int Ncolors[MAX_Q_COMPS];
+  int i;
+
+  if (cinfo->out_color_components > MAX_Q_COMPS)
+    ERREXIT1(cinfo, JERR_QUANT_COMPONENTS, MAX_Q_COMPS);
+
+  jtally_small(tally, sizeof(my_cquantizer));
+  /* create_colormap() */
+  jtally_sarray(tally, (JDIMENSION) select_ncolors(cinfo, Ncolors),
+                (JDIMENSION) cinfo->out_color_components);
+  /* create_colorindex() */
+  jtally_sarray(tally, (JDIMENSION) (MAXJSAMPLE+1 +
+                (cinfo->dither_mode == JDITHER_ORDERED ? MAXJSAMPLE*2 : 0)),
+                (JDIMENSION) cinfo->out_color_components);
+  /* alloc_fs_workspace() */
+  if (cinfo->dither_mode == JDITHER_FS) {
+    for (i = 0; i < cinfo->out_color_components; i++)
+      jtally_large(tally, (size_t) ((cinfo->output_width + 2) *
+                                    sizeof(FSERROR)));
+  }
+}
+
+
+/*
+ * Tally the ordered-dither tables that start_pass_1_quant() would create.
+ */
+
+GLOBAL(void)
+jtally_1pass_quantizer_passes (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  int Ncolors[MAX_Q_COMPS];
+  int i, j;
+
+  if (cinfo->dither_mode != JDITHER_ORDERED)
+    return;
+
+  /* create_odither_tables() shares a table between components having the
+   * same number of colors.
+   */
+  select_ncolors(cinfo, Ncolors);
+  for (i = 0; i < cinfo->out_color_components; i++) {
+    for (j = 0; j < i; j++) {
+      if (Ncolors[i] == Ncolors[j])
+        break;
+    }
+    if (j == i)
+      jtally_small(tally, sizeof(ODITHER_MATRIX));
+  }
+}
+
 #endif /* QUANT_1PASS_SUPPORTED */
@@ -1278,4 +1278,44 @@ jinit_2pass_quantizer (j_decompress_ptr cinfo)
   }
 }
 
+
+/*
+ * Tally the memory that jinit_2pass_quantizer() would allocate,
+ * for jpeg_calc_decompress_requirements().  enable_2pass is the value that
+ * jdmaster.c would assign to cinfo->enable_2pass_quant.
+ */
+
+GLOBAL(void)
+jtally_2pass_quantizer (j_decompress_ptr cinfo, jpeg_mem_tally * tally,
+                        boolean enable_2pass)
+{
+  int i;
+
+  jtally_small(tally, sizeof(my_cquantizer));
+  jtally_small(tally, HIST_C0_ELEMS * sizeof(hist2d));
+  for (i = 0; i < HIST_C0_ELEMS; i++)
+    jtally_large(tally, HIST_C1_ELEMS*HIST_C2_ELEMS * sizeof(histcell));
+  if (enable_2pass)
+    jtally_sarray(tally, (JDIMENSION) cinfo->desired_number_of_colors,
+                  (JDIMENSION) 3);
+  if (cinfo->dither_mode != JDITHER_NONE) {
+    jtally_large(tally,
+                 (size_t) ((cinfo->output_width + 2) * (3 * sizeof(FSERROR))));
+    /* init_error_limit() */
+    jtally_small(tally, (MAXJSAMPLE*2+1) * sizeof(int));
+  }
+}
+
+
+/*
+ * Tally the box list that select_colors() would allocate at the end of the
+ * first pass of 2-pass quantization.
+ */
+
+GLOBAL(void)
+jtally_2pass_quantizer_passes (j_decompress_ptr cinfo, jpeg_mem_tally * tally)
+{
+  jtally_small(tally, cinfo->desired_number_of_colors * sizeof(box));
+}
+
 #endif /* QUANT_2PASS_SUPPORTED */
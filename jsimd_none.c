@@ -387,3 +387,16 @@ jsimd_idct_float (j_decompress_ptr cinfo, jpeg_component_info * compptr,
 {
 }
 
+GLOBAL(int)
+jsimd_can_idct_islow_row (void)
+{
+  return 0;
+}
+
+GLOBAL(void)
+jsimd_idct_islow_row (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+                      JBLOCKROW coef_row, JSAMPARRAY output_buf,
+                      JDIMENSION output_col, JDIMENSION num_blocks)
+{
+}
+
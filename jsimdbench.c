@@ -0,0 +1,743 @@
+/*
+ * jsimdbench.c
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program benchmarks the individual SIMD kernels declared in jsimd.h and
+ * jsimddct.h against their C counterparts, using the same data for both, and
+ * it verifies that the SIMD kernels produce the same output as the C kernels.
+ * The instruction set that is benchmarked can be selected by setting the
+ * JSIMD_FORCE* environment variables supported by the SIMD dispatcher for the
+ * current platform (for instance, JSIMD_FORCEMMX=1 or JSIMD_FORCENONE=1.)
+ *
+ * Most of the C kernels are private to the library modules that use them, so
+ * the module sources are compiled directly into this program (the compression
+ * modules here and the decompression modules in jsimdbenchd.c.)  The kernels
+ * are then called with compression and decompression objects that have been
+ * initialized by the library itself, so the private per-module state that
+ * some of the kernels depend upon (color conversion tables, quantization
+ * divisors, IDCT multiplier tables, etc.) is exactly what the library would
+ * use.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tjutil.h"
+
+
+/*
+ * The module sources.  The global entry points are renamed so that they do not
+ * clash with the same functions in the library, and the few private names that
+ * are shared between modules are renamed so that they do not clash with each
+ * other.
+ */
+
+#define jinit_color_converter  bench_jinit_color_converter
+#include "jccolor.c"
+#undef SCALEBITS
+#undef CBCR_OFFSET
+#undef ONE_HALF
+#undef FIX
+#undef TABLE_SIZE
+#undef RGB_RED
+#undef RGB_GREEN
+#undef RGB_BLUE
+#undef RGB_PIXELSIZE
+#define RGB_RED  0
+#define RGB_GREEN  1
+#define RGB_BLUE  2
+#define RGB_PIXELSIZE  3
+
+#include "jsimdbench.h"
+
+#define jinit_downsampler  bench_jinit_downsampler
+#include "jcsample.c"
+
+#define jinit_forward_dct  bench_jinit_forward_dct
+#include "jcdctmgr.c"
+#undef CONST_BITS
+#undef FIX
+
+/*
+ * Cycle counter
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_RDTSC
+static INLINE unsigned long long rdtsc (void)
+{
+  unsigned int lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long)hi << 32) | lo;
+}
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAVE_RDTSC
+#define rdtsc()  __rdtsc()
+#endif
+
+
+/*
+ * Benchmark parameters and buffers
+ */
+
+static double benchtime = 0.25;
+
+static struct jpeg_compress_struct cinfo;
+struct jpeg_decompress_struct dinfo, dinfo_merged;
+static struct jpeg_error_mgr jerr;
+
+static JSAMPARRAY rgb_rows;             /* RGB source image */
+JSAMPIMAGE ycc_planes;                  /* Full-size Y, Cb, Cr planes */
+JSAMPIMAGE ds_planes;                   /* Downsampled (4:2:0) Y, Cb, Cr planes */
+JCOEF *coefs;                           /* Quantized DCT coefficients */
+static DCTELEM *dct_in;                 /* Forward DCT input */
+static FAST_FLOAT *dct_in_float;
+
+JSAMPIMAGE sample_out[2];               /* Output of the C and SIMD kernels */
+static DCTELEM *dct_out[2];
+static FAST_FLOAT *float_out[2];
+static JCOEF *coef_out[2];
+
+
+/* Output of a kernel, for the purposes of comparing C and SIMD results */
+
+enum { OUT_SAMPLES, OUT_DCTELEM, OUT_FLOAT, OUT_COEF };
+
+typedef struct {
+  const char *name;
+  int (*can) (void);
+  void (*run) (int simd);
+  const char *unit;             /* "pixel" or "block" */
+  long units;                   /* Pixels or blocks processed per call */
+  int out_type;
+  int out_planes, out_rows;     /* Dimensions of OUT_SAMPLES output */
+  long out_width;               /* Samples per row, or elements */
+} kernel_info;
+
+
+LOCAL(JSAMPIMAGE)
+alloc_planes (int nplanes, JDIMENSION width, JDIMENSION height)
+{
+  JSAMPIMAGE image;
+  int i;
+
+  image = (JSAMPIMAGE)
+    (*cinfo.mem->alloc_small) ((j_common_ptr) &cinfo, JPOOL_PERMANENT,
+                               nplanes * sizeof(JSAMPARRAY));
+  for (i = 0; i < nplanes; i++)
+    image[i] = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo,
+                                           JPOOL_PERMANENT, width, height);
+  return image;
+}
+
+
+LOCAL(void *)
+alloc_aligned (size_t size)
+{
+  /* The memory manager aligns large objects suitably for SIMD */
+  return (*cinfo.mem->alloc_large) ((j_common_ptr) &cinfo, JPOOL_PERMANENT,
+                                    size);
+}
+
+
+/*
+ * Color conversion and downsampling kernels
+ */
+
+METHODDEF(void)
+run_rgb_ycc (int simd)
+{
+  if (simd)
+    jsimd_rgb_ycc_convert(&cinfo, rgb_rows, sample_out[1], 0, HEIGHT);
+  else
+    rgb_ycc_convert(&cinfo, rgb_rows, sample_out[0], 0, HEIGHT);
+}
+
+METHODDEF(void)
+run_rgb_gray (int simd)
+{
+  if (simd)
+    jsimd_rgb_gray_convert(&cinfo, rgb_rows, sample_out[1], 0, HEIGHT);
+  else
+    rgb_gray_convert(&cinfo, rgb_rows, sample_out[0], 0, HEIGHT);
+}
+
+METHODDEF(void)
+run_null_convert (int simd)
+{
+  if (simd)
+    jsimd_c_null_convert(&cinfo, rgb_rows, sample_out[1], 0, HEIGHT);
+  else
+    null_convert(&cinfo, rgb_rows, sample_out[0], 0, HEIGHT);
+}
+
+/* Each call downsamples all row groups of the Cb plane */
+
+#define DOWNSAMPLE(name, func, simdfunc, v)  \
+METHODDEF(void)  \
+name (int simd)  \
+{  \
+  jpeg_component_info *compptr = &cinfo.comp_info[1];  \
+  int row;  \
+  for (row = 0; row < HEIGHT; row += cinfo.max_v_samp_factor) {  \
+    if (simd)  \
+      simdfunc(&cinfo, compptr, &ycc_planes[1][row + 1],  \
+               &sample_out[1][0][row / v]);  \
+    else  \
+      func(&cinfo, compptr, &ycc_planes[1][row + 1],  \
+           &sample_out[0][0][row / v]);  \
+  }  \
+}
+
+DOWNSAMPLE(run_h2v1_downsample, h2v1_downsample, jsimd_h2v1_downsample, 1)
+DOWNSAMPLE(run_h2v2_downsample, h2v2_downsample, jsimd_h2v2_downsample, 2)
+DOWNSAMPLE(run_h2v2_smooth_downsample, h2v2_smooth_downsample,
+           jsimd_h2v2_smooth_downsample, 2)
+
+
+/*
+ * Forward DCT and quantization kernels.  The DCT kernels operate in place, so
+ * each call copies the input into the output buffer first.  This adds the same
+ * overhead to both the C and the SIMD measurements.
+ */
+
+METHODDEF(void)
+run_convsamp (int simd)
+{
+  int b;
+  for (b = 0; b < NBLOCKS; b++) {
+    JSAMPARRAY rows = &ycc_planes[0][1 + (b / (WIDTH / DCTSIZE)) * DCTSIZE];
+    JDIMENSION col = (b % (WIDTH / DCTSIZE)) * DCTSIZE;
+    if (simd)
+      jsimd_convsamp(rows, col, &dct_out[1][b * DCTSIZE2]);
+    else
+      convsamp(rows, col, &dct_out[0][b * DCTSIZE2]);
+  }
+}
+
+METHODDEF(void)
+run_convsamp_float (int simd)
+{
+  int b;
+  for (b = 0; b < NBLOCKS; b++) {
+    JSAMPARRAY rows = &ycc_planes[0][1 + (b / (WIDTH / DCTSIZE)) * DCTSIZE];
+    JDIMENSION col = (b % (WIDTH / DCTSIZE)) * DCTSIZE;
+    if (simd)
+      jsimd_convsamp_float(rows, col, &float_out[1][b * DCTSIZE2]);
+    else
+      convsamp_float(rows, col, &float_out[0][b * DCTSIZE2]);
+  }
+}
+
+#define FDCT(name, type, in, out, func, simdfunc)  \
+METHODDEF(void)  \
+name (int simd)  \
+{  \
+  int b;  \
+  MEMCOPY(out[simd], in, NBLOCKS * DCTSIZE2 * sizeof(type));  \
+  for (b = 0; b < NBLOCKS; b++) {  \
+    if (simd)  \
+      simdfunc(&out[1][b * DCTSIZE2]);  \
+    else  \
+      func(&out[0][b * DCTSIZE2]);  \
+  }  \
+}
+
+FDCT(run_fdct_islow, DCTELEM, dct_in, dct_out, jpeg_fdct_islow,
+     jsimd_fdct_islow)
+FDCT(run_fdct_ifast, DCTELEM, dct_in, dct_out, jpeg_fdct_ifast,
+     jsimd_fdct_ifast)
+FDCT(run_fdct_float, FAST_FLOAT, dct_in_float, float_out, jpeg_fdct_float,
+     jsimd_fdct_float)
+
+METHODDEF(void)
+run_quantize (int simd)
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo.fdct;
+  DCTELEM *divisors = fdct->divisors[cinfo.comp_info[0].quant_tbl_no];
+  int b;
+
+  for (b = 0; b < NBLOCKS; b++) {
+    if (simd)
+      jsimd_quantize(&coef_out[1][b * DCTSIZE2], divisors,
+                     &dct_in[b * DCTSIZE2]);
+    else
+      quantize(&coef_out[0][b * DCTSIZE2], divisors, &dct_in[b * DCTSIZE2]);
+  }
+}
+
+METHODDEF(void)
+run_quantize_float (int simd)
+{
+  my_fdct_ptr fdct = (my_fdct_ptr) cinfo.fdct;
+  FAST_FLOAT *divisors = fdct->float_divisors[cinfo.comp_info[0].quant_tbl_no];
+  int b;
+
+  for (b = 0; b < NBLOCKS; b++) {
+    if (simd)
+      jsimd_quantize_float(&coef_out[1][b * DCTSIZE2], divisors,
+                           &dct_in_float[b * DCTSIZE2]);
+    else
+      quantize_float(&coef_out[0][b * DCTSIZE2], divisors,
+                     &dct_in_float[b * DCTSIZE2]);
+  }
+}
+
+
+#define NPIX  ((long) WIDTH * HEIGHT)
+
+static const kernel_info kernels[] = {
+  { "rgb_ycc_convert", jsimd_can_rgb_ycc, run_rgb_ycc, "pixel", NPIX,
+    OUT_SAMPLES, 3, HEIGHT, WIDTH },
+  { "rgb_gray_convert", jsimd_can_rgb_gray, run_rgb_gray, "pixel", NPIX,
+    OUT_SAMPLES, 1, HEIGHT, WIDTH },
+  { "c_null_convert", jsimd_c_can_null_convert, run_null_convert, "pixel",
+    NPIX, OUT_SAMPLES, 3, HEIGHT, WIDTH },
+  { "h2v1_downsample", jsimd_can_h2v1_downsample, run_h2v1_downsample,
+    "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT, WIDTH / 2 },
+  { "h2v2_downsample", jsimd_can_h2v2_downsample, run_h2v2_downsample,
+    "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT / 2, WIDTH / 2 },
+  { "h2v2_smooth_downsample", jsimd_can_h2v2_smooth_downsample,
+    run_h2v2_smooth_downsample, "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT / 2,
+    WIDTH / 2 },
+  { "convsamp", jsimd_can_convsamp, run_convsamp, "block", NBLOCKS,
+    OUT_DCTELEM, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "convsamp_float", jsimd_can_convsamp_float, run_convsamp_float, "block",
+    NBLOCKS, OUT_FLOAT, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "fdct_islow", jsimd_can_fdct_islow, run_fdct_islow, "block", NBLOCKS,
+    OUT_DCTELEM, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "fdct_ifast", jsimd_can_fdct_ifast, run_fdct_ifast, "block", NBLOCKS,
+    OUT_DCTELEM, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "fdct_float", jsimd_can_fdct_float, run_fdct_float, "block", NBLOCKS,
+    OUT_FLOAT, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "quantize", jsimd_can_quantize, run_quantize, "block", NBLOCKS,
+    OUT_COEF, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "quantize_float", jsimd_can_quantize_float, run_quantize_float, "block",
+    NBLOCKS, OUT_COEF, 0, 0, NBLOCKS * DCTSIZE2 },
+  { "idct_islow", jsimd_can_idct_islow, run_idct_islow, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 8, NBLOCKS * 8 },
+  { "idct_ifast", jsimd_can_idct_ifast, run_idct_ifast, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 8, NBLOCKS * 8 },
+  { "idct_float", jsimd_can_idct_float, run_idct_float, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 8, NBLOCKS * 8 },
+  { "idct_2x2", jsimd_can_idct_2x2, run_idct_2x2, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 2, NBLOCKS * 2 },
+  { "idct_4x4", jsimd_can_idct_4x4, run_idct_4x4, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 4, NBLOCKS * 4 },
+  { "idct_6x6", jsimd_can_idct_6x6, run_idct_6x6, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 6, NBLOCKS * 6 },
+  { "idct_12x12", jsimd_can_idct_12x12, run_idct_12x12, "block", NBLOCKS,
+    OUT_SAMPLES, 1, 12, NBLOCKS * 12 },
+  { "h2v1_upsample", jsimd_can_h2v1_upsample, run_h2v1_upsample, "pixel",
+    NPIX, OUT_SAMPLES, 1, HEIGHT, WIDTH },
+  { "h2v2_upsample", jsimd_can_h2v2_upsample, run_h2v2_upsample, "pixel",
+    NPIX, OUT_SAMPLES, 1, HEIGHT, WIDTH },
+  { "h2v1_fancy_upsample", jsimd_can_h2v1_fancy_upsample,
+    run_h2v1_fancy_upsample, "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT, WIDTH },
+  { "h2v2_fancy_upsample", jsimd_can_h2v2_fancy_upsample,
+    run_h2v2_fancy_upsample, "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT, WIDTH },
+  { "ycc_rgb_convert", jsimd_can_ycc_rgb, run_ycc_rgb, "pixel", NPIX,
+    OUT_SAMPLES, 1, HEIGHT, WIDTH * RGB_PIXELSIZE },
+  { "ycc_rgb565_convert", jsimd_can_ycc_rgb565, run_ycc_rgb565, "pixel", NPIX,
+    OUT_SAMPLES, 1, HEIGHT, WIDTH * 2 },
+  { "h2v1_merged_upsample", jsimd_can_h2v1_merged_upsample,
+    run_h2v1_merged_upsample, "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT,
+    WIDTH * RGB_PIXELSIZE },
+  { "h2v2_merged_upsample", jsimd_can_h2v2_merged_upsample,
+    run_h2v2_merged_upsample, "pixel", NPIX, OUT_SAMPLES, 1, HEIGHT,
+    WIDTH * RGB_PIXELSIZE },
+};
+
+#define NKERNELS  ((int) (sizeof(kernels) / sizeof(kernel_info)))
+
+
+/*
+ * Test data
+ */
+
+/* Fill the RGB source image with synthetic data (smooth gradients with
+   some superimposed pseudo-random noise) */
+
+LOCAL(void)
+make_synthetic_image (void)
+{
+  unsigned int seed = 1;
+  int row, col, c;
+
+  for (row = 0; row < HEIGHT + 2; row++) {
+    for (col = 0; col < WIDTH; col++) {
+      for (c = 0; c < RGB_PIXELSIZE; c++) {
+        int val;
+        seed = seed * 1103515245 + 12345;
+        val = (col * (c + 1) + row * 8 * (3 - c)) % 256 +
+              (int) ((seed >> 16) % 32) - 16;
+        rgb_rows[row][col * RGB_PIXELSIZE + c] =
+          (JSAMPLE) (val < 0 ? 0 : (val > 255 ? 255 : val));
+      }
+    }
+  }
+}
+
+
+/* Fill the RGB source image with real data from a binary PPM file.  The image
+   is tiled if it is smaller than the test image. */
+
+LOCAL(int)
+load_ppm (const char *filename)
+{
+  FILE *file;
+  int w, h, maxval, row, col, c, retval = -1;
+  unsigned char *buf = NULL;
+
+  if ((file = fopen(filename, "rb")) == NULL) {
+    fprintf(stderr, "Could not open %s\n", filename);
+    return -1;
+  }
+  if (fscanf(file, "P6 %d %d %d", &w, &h, &maxval) != 3 || maxval != 255 ||
+      w < 1 || h < 1 || fgetc(file) == EOF) {
+    fprintf(stderr, "%s is not a binary PPM file with 8-bit samples\n",
+            filename);
+    goto bailout;
+  }
+  if ((buf = (unsigned char *) malloc((size_t) w * h * 3)) == NULL ||
+      fread(buf, (size_t) w * h * 3, 1, file) != 1) {
+    fprintf(stderr, "Could not read %s\n", filename);
+    goto bailout;
+  }
+  for (row = 0; row < HEIGHT + 2; row++)
+    for (col = 0; col < WIDTH; col++)
+      for (c = 0; c < RGB_PIXELSIZE; c++)
+        rgb_rows[row][col * RGB_PIXELSIZE + c] =
+          buf[((row % h) * w + (col % w)) * 3 + (c < 3 ? c : 0)];
+  retval = 0;
+
+bailout:
+  if (buf) free(buf);
+  fclose(file);
+  return retval;
+}
+
+
+/*
+ * Set up the compression and decompression objects and derive the input data
+ * for each kernel from the RGB source image.  The input arrays have one extra
+ * row above and below the image, for the kernels that require context rows.
+ */
+
+LOCAL(int)
+init_objects (const char *filename)
+{
+  FILE *file;
+  JSAMPARRAY rows;
+  int ci, b, i;
+
+  /* Compress a small JPEG image with the same sampling factors as the test
+     image and leave the compression object initialized. */
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  if ((file = tmpfile()) == NULL) {
+    fprintf(stderr, "Could not create temporary file\n");
+    return -1;
+  }
+  jpeg_stdio_dest(&cinfo, file);
+  cinfo.image_width = WIDTH;
+  cinfo.image_height = HEIGHT;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  cinfo.smoothing_factor = 0;
+
+  rgb_rows = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo,
+                                         JPOOL_PERMANENT,
+                                         WIDTH * RGB_PIXELSIZE, HEIGHT + 2);
+  if (filename) {
+    if (load_ppm(filename) < 0) return -1;
+  } else
+    make_synthetic_image();
+
+  jpeg_start_compress(&cinfo, TRUE);
+  rows = &rgb_rows[1];
+  while (cinfo.next_scanline < cinfo.image_height)
+    jpeg_write_scanlines(&cinfo, &rows[cinfo.next_scanline],
+                         cinfo.image_height - cinfo.next_scanline);
+  jpeg_finish_compress(&cinfo);
+
+  /* Re-initialize the compression object, so that its color converter,
+     downsampler, and forward DCT modules are ready for use. */
+  jpeg_stdio_dest(&cinfo, file);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  /* Build floating point quantization divisors as well */
+  cinfo.dct_method = JDCT_FLOAT;
+  start_pass_fdctmgr(&cinfo);
+  cinfo.dct_method = JDCT_ISLOW;
+  start_pass_fdctmgr(&cinfo);
+
+  /* Initialize two decompression objects: one that uses fancy upsampling and
+     separate color conversion and one that uses merged upsampling */
+  dinfo.err = dinfo_merged.err = &jerr;
+  jpeg_create_decompress(&dinfo);
+  jpeg_create_decompress(&dinfo_merged);
+  rewind(file);
+  jpeg_stdio_src(&dinfo, file);
+  jpeg_read_header(&dinfo, TRUE);
+  dinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&dinfo);
+  rewind(file);
+  jpeg_stdio_src(&dinfo_merged, file);
+  jpeg_read_header(&dinfo_merged, TRUE);
+  dinfo_merged.out_color_space = JCS_RGB;
+  dinfo_merged.do_fancy_upsampling = FALSE;
+  jpeg_start_decompress(&dinfo_merged);
+
+  init_idct_tables();
+
+  /* Input and output buffers */
+  ycc_planes = alloc_planes(3, WIDTH, HEIGHT + 2);
+  ds_planes = alloc_planes(3, WIDTH / 2, HEIGHT / 2 + 2);
+  for (i = 0; i < 2; i++) {
+    sample_out[i] = alloc_planes(3, WIDTH * 4, HEIGHT);
+    dct_out[i] = (DCTELEM *) alloc_aligned(NBLOCKS * DCTSIZE2 *
+                                           sizeof(DCTELEM));
+    float_out[i] = (FAST_FLOAT *) alloc_aligned(NBLOCKS * DCTSIZE2 *
+                                                sizeof(FAST_FLOAT));
+    coef_out[i] = (JCOEF *) alloc_aligned(NBLOCKS * DCTSIZE2 * sizeof(JCOEF));
+  }
+  dct_in = (DCTELEM *) alloc_aligned(NBLOCKS * DCTSIZE2 * sizeof(DCTELEM));
+  dct_in_float = (FAST_FLOAT *) alloc_aligned(NBLOCKS * DCTSIZE2 *
+                                              sizeof(FAST_FLOAT));
+  coefs = (JCOEF *) alloc_aligned(NBLOCKS * DCTSIZE2 * sizeof(JCOEF));
+
+  /* Derive the input data for each stage, using the C kernels */
+  rgb_ycc_convert(&cinfo, rgb_rows, ycc_planes, 0, HEIGHT + 2);
+  for (ci = 0; ci < 3; ci++) {
+    int row;
+    for (row = 0; row < HEIGHT; row += 2)
+      h2v2_downsample(&cinfo, &cinfo.comp_info[1], &ycc_planes[ci][row + 1],
+                      &ds_planes[ci][row / 2 + 1]);
+    jcopy_sample_rows(ds_planes[ci], 1, ds_planes[ci], 0, 1, WIDTH / 2);
+    jcopy_sample_rows(ds_planes[ci], HEIGHT / 2, ds_planes[ci],
+                      HEIGHT / 2 + 1, 1, WIDTH / 2);
+  }
+  run_convsamp(0);
+  MEMCOPY(dct_in, dct_out[0], NBLOCKS * DCTSIZE2 * sizeof(DCTELEM));
+  run_convsamp_float(0);
+  MEMCOPY(dct_in_float, float_out[0], NBLOCKS * DCTSIZE2 * sizeof(FAST_FLOAT));
+  for (b = 0; b < NBLOCKS; b++) {
+    jpeg_fdct_islow(&dct_in[b * DCTSIZE2]);
+    jpeg_fdct_float(&dct_in_float[b * DCTSIZE2]);
+  }
+  run_quantize(0);
+  MEMCOPY(coefs, coef_out[0], NBLOCKS * DCTSIZE2 * sizeof(JCOEF));
+  /* Rebuild the forward DCT input, since the DCT kernels operate in place */
+  run_convsamp(0);
+  MEMCOPY(dct_in, dct_out[0], NBLOCKS * DCTSIZE2 * sizeof(DCTELEM));
+
+  return 0;
+}
+
+
+/*
+ * Benchmarking
+ */
+
+/* Run a kernel repeatedly for the benchmark time and return the average time
+   per call, in seconds, and the average number of cycles per call (if the
+   cycle counter is available.) */
+
+LOCAL(double)
+time_kernel (const kernel_info *k, int simd, double *cycles)
+{
+  double start, elapsed = 0.;
+  long iter = 0, n = 1, i;
+#ifdef HAVE_RDTSC
+  unsigned long long tsc = 0, tsc_start;
+#endif
+
+  (*k->run) (simd);             /* warm up */
+  while (elapsed < benchtime) {
+    start = gettime();
+#ifdef HAVE_RDTSC
+    tsc_start = rdtsc();
+#endif
+    for (i = 0; i < n; i++)
+      (*k->run) (simd);
+#ifdef HAVE_RDTSC
+    tsc += rdtsc() - tsc_start;
+#endif
+    elapsed += gettime() - start;
+    iter += n;
+    n *= 2;
+  }
+#ifdef HAVE_RDTSC
+  *cycles = (double) tsc / (double) iter;
+#else
+  *cycles = 0.;
+#endif
+  return elapsed / (double) iter;
+}
+
+
+/* Compare the output of the C and SIMD kernels and return the maximum
+   absolute difference */
+
+LOCAL(double)
+compare_output (const kernel_info *k)
+{
+  double maxdiff = 0., diff;
+  long i;
+  int p, row;
+
+  switch (k->out_type) {
+  case OUT_SAMPLES:
+    for (p = 0; p < k->out_planes; p++)
+      for (row = 0; row < k->out_rows; row++)
+        for (i = 0; i < k->out_width; i++) {
+          diff = abs(GETJSAMPLE(sample_out[0][p][row][i]) -
+                     GETJSAMPLE(sample_out[1][p][row][i]));
+          if (diff > maxdiff) maxdiff = diff;
+        }
+    break;
+  case OUT_DCTELEM:
+    for (i = 0; i < k->out_width; i++) {
+      diff = abs(dct_out[0][i] - dct_out[1][i]);
+      if (diff > maxdiff) maxdiff = diff;
+    }
+    break;
+  case OUT_FLOAT:
+    for (i = 0; i < k->out_width; i++) {
+      diff = float_out[0][i] - float_out[1][i];
+      if (diff < 0.) diff = -diff;
+      if (diff > maxdiff) maxdiff = diff;
+    }
+    break;
+  case OUT_COEF:
+    for (i = 0; i < k->out_width; i++) {
+      diff = abs(coef_out[0][i] - coef_out[1][i]);
+      if (diff > maxdiff) maxdiff = diff;
+    }
+    break;
+  }
+  return maxdiff;
+}
+
+
+LOCAL(void)
+clear_output (void)
+{
+  int i, p, row;
+
+  for (i = 0; i < 2; i++) {
+    for (p = 0; p < 3; p++)
+      for (row = 0; row < HEIGHT; row++)
+        MEMZERO(sample_out[i][p][row], WIDTH * 4);
+    MEMZERO(dct_out[i], NBLOCKS * DCTSIZE2 * sizeof(DCTELEM));
+    MEMZERO(float_out[i], NBLOCKS * DCTSIZE2 * sizeof(FAST_FLOAT));
+    MEMZERO(coef_out[i], NBLOCKS * DCTSIZE2 * sizeof(JCOEF));
+  }
+}
+
+
+LOCAL(void)
+usage (char *progname)
+{
+  fprintf(stderr, "USAGE: %s [options] [image.ppm]\n\n", progname);
+  fprintf(stderr, "Benchmarks each SIMD kernel against the equivalent C kernel, using\n");
+  fprintf(stderr, "synthetic test data or, if specified, data from a binary PPM file.\n\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "-benchtime <t> = Run each benchmark for at least <t> seconds (default = %.2f)\n",
+          benchtime);
+  fprintf(stderr, "-kernel <name> = Only benchmark kernels whose names contain <name>\n\n");
+  fprintf(stderr, "The SIMD instruction set can be selected with the JSIMD_FORCE* environment\n");
+  fprintf(stderr, "variables (for instance, JSIMD_FORCENONE=1 benchmarks only the C kernels.)\n");
+  exit(1);
+}
+
+
+int
+main (int argc, char **argv)
+{
+  int i, mismatches = 0;
+  char *filename = NULL, *match = NULL;
+  const char *env_vars[] = {
+    "JSIMD_FORCEMMX", "JSIMD_FORCE3DNOW", "JSIMD_FORCESSE", "JSIMD_FORCESSE2",
+    "JSIMD_FORCENEON", "JSIMD_FORCENONE", NULL
+  };
+
+  for (i = 1; i < argc; i++) {
+    if (!strcasecmp(argv[i], "-benchtime") && i < argc - 1) {
+      benchtime = atof(argv[++i]);
+      if (benchtime <= 0.) usage(argv[0]);
+    } else if (!strcasecmp(argv[i], "-kernel") && i < argc - 1)
+      match = argv[++i];
+    else if (argv[i][0] == '-')
+      usage(argv[0]);
+    else
+      filename = argv[i];
+  }
+
+  if (init_objects(filename) < 0)
+    return 1;
+
+  printf("Test data: %s\n", filename ? filename : "synthetic");
+  for (i = 0; env_vars[i]; i++) {
+    char *env = getenv(env_vars[i]);
+    if (env && !strcmp(env, "1"))
+      printf("SIMD instruction set forced with %s=1\n", env_vars[i]);
+  }
+#ifdef HAVE_RDTSC
+  printf("All times in cycles (rdtsc) per pixel or block\n\n");
+#else
+  printf("All times in nanoseconds per pixel or block\n\n");
+#endif
+  printf("%-24s %-6s %10s %10s %8s  %s\n", "Kernel", "Unit", "C", "SIMD",
+         "Speedup", "Bit-exact");
+
+  for (i = 0; i < NKERNELS; i++) {
+    const kernel_info *k = &kernels[i];
+    double c_time, c_cycles, simd_time, simd_cycles, c_val, simd_val;
+
+    if (match && !strstr(k->name, match))
+      continue;
+
+    clear_output();
+    c_time = time_kernel(k, 0, &c_cycles);
+#ifdef HAVE_RDTSC
+    c_val = c_cycles / (double) k->units;
+#else
+    c_val = c_time * 1.0e9 / (double) k->units;
+#endif
+    printf("%-24s %-6s %10.3f ", k->name, k->unit, c_val);
+
+    if (!(*k->can) ()) {
+      printf("%10s\n", "N/A");
+      continue;
+    }
+    simd_time = time_kernel(k, 1, &simd_cycles);
+#ifdef HAVE_RDTSC
+    simd_val = simd_cycles / (double) k->units;
+#else
+    simd_val = simd_time * 1.0e9 / (double) k->units;
+#endif
+    printf("%10.3f %7.2fx  ", simd_val, c_time / simd_time);
+    {
+      double maxdiff = compare_output(k);
+      if (maxdiff == 0.)
+        printf("yes\n");
+      else {
+        printf("NO (max. difference = %g)\n", maxdiff);
+        /* The floating point kernels are not expected to be bit-exact. */
+        if (k->out_type != OUT_FLOAT && strstr(k->name, "float") == NULL)
+          mismatches++;
+      }
+    }
+  }
+
+  jpeg_destroy_decompress(&dinfo);
+  jpeg_destroy_decompress(&dinfo_merged);
+  jpeg_destroy_compress(&cinfo);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * jsimdbench.h
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains the declarations that are shared between jsimdbench.c,
+ * which benchmarks the compression kernels, and jsimdbenchd.c, which
+ * benchmarks the decompression kernels.  The two sets of kernels live in
+ * separate files because the color converters for compression and
+ * decompression use the same names for some of their private functions.
+ */
+
+#define WIDTH  1024             /* Width of the test image, in pixels */
+#define HEIGHT  16              /* Height of the test image, in pixels */
+#define NBLOCKS  (WIDTH / DCTSIZE * 2)  /* DCT blocks processed per call */
+
+/* Decompression objects: one that uses fancy upsampling and separate color
+   conversion and one that uses merged upsampling */
+extern struct jpeg_decompress_struct dinfo, dinfo_merged;
+
+/* Input data.  The arrays have one extra row above and below the image, for
+   the kernels that require context rows. */
+extern JSAMPIMAGE ycc_planes;           /* Full-size Y, Cb, Cr planes */
+extern JSAMPIMAGE ds_planes;            /* Downsampled (4:2:0) planes */
+extern JCOEF *coefs;                    /* Quantized DCT coefficients */
+
+extern JSAMPIMAGE sample_out[2];        /* Output of the C and SIMD kernels */
+
+/* Decompression kernels (jsimdbenchd.c).  The argument selects the SIMD
+   kernel rather than the C kernel. */
+EXTERN(void) init_idct_tables (void);
+EXTERN(void) run_h2v1_upsample (int simd);
+EXTERN(void) run_h2v2_upsample (int simd);
+EXTERN(void) run_h2v1_fancy_upsample (int simd);
+EXTERN(void) run_h2v2_fancy_upsample (int simd);
+EXTERN(void) run_ycc_rgb (int simd);
+EXTERN(void) run_ycc_rgb565 (int simd);
+EXTERN(void) run_h2v1_merged_upsample (int simd);
+EXTERN(void) run_h2v2_merged_upsample (int simd);
+EXTERN(void) run_idct_islow (int simd);
+EXTERN(void) run_idct_ifast (int simd);
+EXTERN(void) run_idct_float (int simd);
+EXTERN(void) run_idct_2x2 (int simd);
+EXTERN(void) run_idct_4x4 (int simd);
+EXTERN(void) run_idct_6x6 (int simd);
+EXTERN(void) run_idct_12x12 (int simd);
@@ -0,0 +1,206 @@
+/*
+ * jsimdbenchd.c
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains the decompression kernel benchmarks for jsimdbench.  See
+ * jsimdbench.c for more details.
+ */
+
+
+/*
+ * The module sources.  As in jsimdbench.c, the global entry points and the
+ * private names that are shared between modules are renamed.
+ */
+
+#define jinit_color_deconverter  bench_jinit_color_deconverter
+#define jtally_color_deconverter  bench_jtally_color_deconverter
+#include "jdcolor.c"
+#undef SCALEBITS
+#undef ONE_HALF
+#undef FIX
+#undef TABLE_SIZE
+#undef PACK_SHORT_565_LE
+#undef PACK_SHORT_565_BE
+#undef PACK_TWO_PIXELS_LE
+#undef PACK_TWO_PIXELS_BE
+#undef PACK_NEED_ALIGNMENT
+#undef DITHER_565_R
+#undef DITHER_565_G
+#undef DITHER_565_B
+#undef DITHER_MASK
+#undef DITHER_ROTATE
+#undef RGB_RED
+#undef RGB_GREEN
+#undef RGB_BLUE
+#undef RGB_PIXELSIZE
+#define RGB_RED  0
+#define RGB_GREEN  1
+#define RGB_BLUE  2
+#define RGB_PIXELSIZE  3
+
+#define jinit_upsampler  bench_jinit_upsampler
+#define jtally_upsampler  bench_jtally_upsampler
+#include "jdsample.c"
+
+#define jinit_merged_upsampler  bench_jinit_merged_upsampler
+#define jtally_merged_upsampler  bench_jtally_merged_upsampler
+#define my_upsampler  my_merged_upsampler
+#define my_upsample_ptr  my_merged_upsample_ptr
+#define build_ycc_rgb_table  merged_build_ycc_rgb_table
+#define dither_matrix  merged_dither_matrix
+#define is_big_endian  merged_is_big_endian
+#include "jdmerge.c"
+#undef my_upsampler
+#undef my_upsample_ptr
+#undef SCALEBITS
+#undef ONE_HALF
+#undef FIX
+#undef RGB_RED
+#undef RGB_GREEN
+#undef RGB_BLUE
+#undef RGB_PIXELSIZE
+#define RGB_RED  0
+#define RGB_GREEN  1
+#define RGB_BLUE  2
+#define RGB_PIXELSIZE  3
+
+#define jinit_inverse_dct  bench_jinit_inverse_dct
+#define jtally_inverse_dct  bench_jtally_inverse_dct
+#include "jddctmgr.c"
+
+#include "jsimdbench.h"
+
+
+static jpeg_component_info idct_comp[3];  /* ISLOW, IFAST, FLOAT tables */
+
+
+/* Build IDCT multiplier tables for all three DCT methods, using the inverse
+   DCT module of the decompression object */
+
+GLOBAL(void)
+init_idct_tables (void)
+{
+  static const J_DCT_METHOD methods[3] = { JDCT_ISLOW, JDCT_IFAST, JDCT_FLOAT };
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    idct_comp[i] = dinfo.comp_info[0];
+    idct_comp[i].dct_table =
+      (*dinfo.mem->alloc_small) ((j_common_ptr) &dinfo, JPOOL_PERMANENT,
+                                 sizeof(multiplier_table));
+    dinfo.dct_method = methods[i];
+    start_pass(&dinfo);
+    MEMCOPY(idct_comp[i].dct_table, dinfo.comp_info[0].dct_table,
+            sizeof(multiplier_table));
+  }
+  dinfo.dct_method = JDCT_ISLOW;
+  start_pass(&dinfo);
+}
+
+
+/*
+ * Upsampling and decompression color conversion kernels
+ */
+
+/* Each call upsamples all row groups of the Cb plane.  The h2v1 upsamplers
+   read the left half of the full-height plane. */
+
+#define UPSAMPLE(name, func, simdfunc, v)  \
+GLOBAL(void)  \
+name (int simd)  \
+{  \
+  jpeg_component_info *compptr = &dinfo.comp_info[1];  \
+  JSAMPARRAY inptr, outptr;  \
+  int row;  \
+  for (row = 0; row < HEIGHT; row += dinfo.max_v_samp_factor) {  \
+    inptr = v == 1 ? &ycc_planes[1][row + 1] : &ds_planes[1][row / 2 + 1];  \
+    outptr = &sample_out[simd][0][row];  \
+    if (simd)  \
+      simdfunc(&dinfo, compptr, inptr, &outptr);  \
+    else  \
+      func(&dinfo, compptr, inptr, &outptr);  \
+  }  \
+}
+
+UPSAMPLE(run_h2v1_upsample, h2v1_upsample, jsimd_h2v1_upsample, 1)
+UPSAMPLE(run_h2v2_upsample, h2v2_upsample, jsimd_h2v2_upsample, 2)
+UPSAMPLE(run_h2v1_fancy_upsample, h2v1_fancy_upsample,
+         jsimd_h2v1_fancy_upsample, 1)
+UPSAMPLE(run_h2v2_fancy_upsample, h2v2_fancy_upsample,
+         jsimd_h2v2_fancy_upsample, 2)
+
+GLOBAL(void)
+run_ycc_rgb (int simd)
+{
+  if (simd)
+    jsimd_ycc_rgb_convert(&dinfo, ycc_planes, 1, sample_out[1][0], HEIGHT);
+  else
+    ycc_rgb_convert(&dinfo, ycc_planes, 1, sample_out[0][0], HEIGHT);
+}
+
+GLOBAL(void)
+run_ycc_rgb565 (int simd)
+{
+  if (simd)
+    jsimd_ycc_rgb565_convert(&dinfo, ycc_planes, 1, sample_out[1][0], HEIGHT);
+  else
+    ycc_rgb565_convert(&dinfo, ycc_planes, 1, sample_out[0][0], HEIGHT);
+}
+
+/* The merged upsamplers take the Y plane at full size and the chroma planes
+   at half width, so build a temporary JSAMPIMAGE that points to both.  The h2v1
+   upsampler reads only the left half of the full-height chroma planes. */
+
+#define MERGED(name, func, simdfunc, rows_per_group)  \
+GLOBAL(void)  \
+name (int simd)  \
+{  \
+  JSAMPARRAY input_buf[3];  \
+  JDIMENSION group;  \
+  input_buf[0] = &ycc_planes[0][1];  \
+  input_buf[1] = &(rows_per_group == 1 ? ycc_planes : ds_planes)[1][1];  \
+  input_buf[2] = &(rows_per_group == 1 ? ycc_planes : ds_planes)[2][1];  \
+  for (group = 0; group < HEIGHT / rows_per_group; group++) {  \
+    if (simd)  \
+      simdfunc(&dinfo_merged, input_buf, group,  \
+               &sample_out[1][0][group * rows_per_group]);  \
+    else  \
+      func(&dinfo_merged, input_buf, group,  \
+           &sample_out[0][0][group * rows_per_group]);  \
+  }  \
+}
+
+MERGED(run_h2v1_merged_upsample, h2v1_merged_upsample,
+       jsimd_h2v1_merged_upsample, 1)
+MERGED(run_h2v2_merged_upsample, h2v2_merged_upsample,
+       jsimd_h2v2_merged_upsample, 2)
+
+
+/*
+ * Inverse DCT kernels.  Blocks are written side by side into the output rows.
+ */
+
+#define IDCT(name, size, table, func, simdfunc)  \
+GLOBAL(void)  \
+name (int simd)  \
+{  \
+  int b;  \
+  for (b = 0; b < NBLOCKS; b++) {  \
+    if (simd)  \
+      simdfunc(&dinfo, &idct_comp[table], &coefs[b * DCTSIZE2],  \
+               sample_out[1][0], b * size);  \
+    else  \
+      func(&dinfo, &idct_comp[table], &coefs[b * DCTSIZE2],  \
+           sample_out[0][0], b * size);  \
+  }  \
+}
+
+IDCT(run_idct_islow, 8, 0, jpeg_idct_islow, jsimd_idct_islow)
+IDCT(run_idct_ifast, 8, 1, jpeg_idct_ifast, jsimd_idct_ifast)
+IDCT(run_idct_float, 8, 2, jpeg_idct_float, jsimd_idct_float)
+IDCT(run_idct_2x2, 2, 0, jpeg_idct_2x2, jsimd_idct_2x2)
+IDCT(run_idct_4x4, 4, 0, jpeg_idct_4x4, jsimd_idct_4x4)
+IDCT(run_idct_6x6, 6, 0, jpeg_idct_6x6, jsimd_idct_6x6)
+IDCT(run_idct_12x12, 12, 0, jpeg_idct_12x12, jsimd_idct_12x12)
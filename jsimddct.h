@@ -72,3 +72,11 @@ EXTERN(void) jsimd_idct_float (j_decompress_ptr cinfo,
                                jpeg_component_info * compptr,
                                JCOEFPTR coef_block, JSAMPARRAY output_buf,
                                JDIMENSION output_col);
+
+EXTERN(int) jsimd_can_idct_islow_row (void);
+
+EXTERN(void) jsimd_idct_islow_row (j_decompress_ptr cinfo,
+                                   jpeg_component_info * compptr,
+                                   JBLOCKROW coef_row, JSAMPARRAY output_buf,
+                                   JDIMENSION output_col,
+                                   JDIMENSION num_blocks);
@@ -0,0 +1,159 @@
+/*
+ * jthread.c
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains a minimal task runner built on top of POSIX threads or
+ * Windows threads.  See jthread.h for details.
+ */
+
+#include "jconfigint.h"
+#include "jthread.h"
+
+#ifdef WITH_THREADS
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+
+#define MAX_THREADS  64         /* max # of threads per call, incl. caller */
+
+
+typedef struct {
+  void (*func) (void * arg, int task);
+  void * arg;
+  int num_tasks;                /* total # of tasks */
+  int next_task;                /* next task to be handed out */
+#ifdef _WIN32
+  CRITICAL_SECTION lock;        /* protects next_task */
+#else
+  pthread_mutex_t lock;         /* protects next_task */
+#endif
+} task_queue;
+
+
+static int
+get_task (task_queue * queue)
+/* Return the next task to perform, or -1 if there are no more tasks. */
+{
+  int task = -1;
+
+#ifdef _WIN32
+  EnterCriticalSection(&queue->lock);
+#else
+  pthread_mutex_lock(&queue->lock);
+#endif
+  if (queue->next_task < queue->num_tasks)
+    task = queue->next_task++;
+#ifdef _WIN32
+  LeaveCriticalSection(&queue->lock);
+#else
+  pthread_mutex_unlock(&queue->lock);
+#endif
+
+  return task;
+}
+
+
+static void
+run_tasks (task_queue * queue)
+{
+  int task;
+
+  while ((task = get_task(queue)) >= 0)
+    (*queue->func) (queue->arg, task);
+}
+
+
+#ifdef _WIN32
+
+static unsigned __stdcall
+thread_main (void * arg)
+{
+  run_tasks((task_queue *) arg);
+  return 0;
+}
+
+#else
+
+static void *
+thread_main (void * arg)
+{
+  run_tasks((task_queue *) arg);
+  return NULL;
+}
+
+#endif
+
+
+void
+jthread_run_tasks (void (*func) (void * arg, int task), void * arg,
+                   int num_tasks, int num_threads)
+{
+  task_queue queue;
+#ifdef _WIN32
+  HANDLE threads[MAX_THREADS];
+#else
+  pthread_t threads[MAX_THREADS];
+#endif
+  int i, num_started = 0;
+
+  if (num_threads > num_tasks)
+    num_threads = num_tasks;
+  if (num_threads > MAX_THREADS)
+    num_threads = MAX_THREADS;
+
+  queue.func = func;
+  queue.arg = arg;
+  queue.num_tasks = num_tasks;
+  queue.next_task = 0;
+
+#ifdef _WIN32
+  InitializeCriticalSection(&queue.lock);
+#else
+  if (pthread_mutex_init(&queue.lock, NULL) != 0) {
+    /* Without a lock, we can only perform the tasks serially. */
+    for (i = 0; i < num_tasks; i++)
+      (*func) (arg, i);
+    return;
+  }
+#endif
+
+  /* The calling thread counts as one of the threads. */
+  for (i = 1; i < num_threads; i++) {
+#ifdef _WIN32
+    threads[num_started] =
+      (HANDLE) _beginthreadex(NULL, 0, thread_main, &queue, 0, NULL);
+    if (threads[num_started] == 0)
+      break;
+#else
+    if (pthread_create(&threads[num_started], NULL, thread_main, &queue) != 0)
+      break;
+#endif
+    num_started++;
+  }
+
+  run_tasks(&queue);
+
+  for (i = 0; i < num_started; i++) {
+#ifdef _WIN32
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+#else
+    pthread_join(threads[i], NULL);
+#endif
+  }
+
+#ifdef _WIN32
+  DeleteCriticalSection(&queue.lock);
+#else
+  pthread_mutex_destroy(&queue.lock);
+#endif
+}
+
+#endif /* WITH_THREADS */
@@ -0,0 +1,25 @@
+/*
+ * jthread.h
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file declares the minimal thread interface that the compressor uses to
+ * encode the scans of a multi-scan JPEG image in parallel.  It deliberately
+ * does not depend on the libjpeg headers, so that jthread.c can include the
+ * system thread headers (windows.h, in particular, which conflicts with some
+ * of the libjpeg type definitions) without including jpeglib.h.
+ *
+ * These declarations are considered internal to the JPEG library; most
+ * applications using the library shouldn't need to include this file.
+ */
+
+/* Call (*func) (arg, task) for each task from 0 to num_tasks-1, using up to
+ * num_threads threads, including the calling thread.  Tasks are handed out in
+ * order, as threads become free, and this function returns once all of them
+ * have completed.  If the additional threads cannot be created, then the
+ * calling thread performs the remaining tasks itself.
+ */
+
+extern void jthread_run_tasks (void (*func) (void * arg, int task),
+                               void * arg, int num_tasks, int num_threads);
@@ -0,0 +1,45 @@
+/*
+ * jtrace.h
+ *
+ * Copyright (C) 2026, agent <agent@local>.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file defines the static tracepoints (USDT probes) that the library
+ * fires at the start and end of each compression and decompression, at the
+ * start of each pass, after each iMCU row, and on entry to and exit from the
+ * TurboJPEG API functions.  The probes are compiled in only if the library is
+ * configured with --with-usdt, and a disabled probe costs a single no-op
+ * instruction.  All probe arguments are integers, except the TurboJPEG
+ * function name, which is a string.  See README-turbo.txt for the list of
+ * probes.
+ *
+ * These declarations are considered internal to the JPEG library; most
+ * applications using the library shouldn't need to include this file.
+ */
+
+#include "jconfigint.h"
+
+#ifdef WITH_USDT
+
+#include <sys/sdt.h>
+
+#define JTRACE4(probe, a1, a2, a3, a4) \
+  DTRACE_PROBE4(libjpeg, probe, a1, a2, a3, a4)
+#define JTRACE5(probe, a1, a2, a3, a4, a5) \
+  DTRACE_PROBE5(libjpeg, probe, a1, a2, a3, a4, a5)
+#define JTRACE6(probe, a1, a2, a3, a4, a5, a6) \
+  DTRACE_PROBE6(libjpeg, probe, a1, a2, a3, a4, a5, a6)
+#define TJTRACE4(probe, a1, a2, a3, a4) \
+  DTRACE_PROBE4(turbojpeg, probe, a1, a2, a3, a4)
+#define TJTRACE5(probe, a1, a2, a3, a4, a5) \
+  DTRACE_PROBE5(turbojpeg, probe, a1, a2, a3, a4, a5)
+
+#else
+
+#define JTRACE4(probe, a1, a2, a3, a4)
+#define JTRACE5(probe, a1, a2, a3, a4, a5)
+#define JTRACE6(probe, a1, a2, a3, a4, a5, a6)
+#define TJTRACE4(probe, a1, a2, a3, a4)
+#define TJTRACE5(probe, a1, a2, a3, a4, a5)
+
+#endif /* WITH_USDT */
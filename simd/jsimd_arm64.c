@@ -542,3 +542,19 @@ jsimd_idct_float (j_decompress_ptr cinfo, jpeg_component_info * compptr,
                   JDIMENSION output_col)
 {
 }
+
+GLOBAL(int)
+jsimd_can_idct_islow_row (void)
+{
+  return jsimd_can_idct_islow();
+}
+
+GLOBAL(void)
+jsimd_idct_islow_row (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+                      JBLOCKROW coef_row, JSAMPARRAY output_buf,
+                      JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  for (; num_blocks > 0; num_blocks--, coef_row++, output_col += DCTSIZE)
+    jsimd_idct_islow_neon(compptr->dct_table, (JCOEFPTR) coef_row, output_buf,
+                          output_col);
+}
@@ -1059,3 +1059,25 @@ jsimd_idct_float (j_decompress_ptr cinfo, jpeg_component_info * compptr,
                            output_col);
 }
 
+GLOBAL(int)
+jsimd_can_idct_islow_row (void)
+{
+  return jsimd_can_idct_islow();
+}
+
+GLOBAL(void)
+jsimd_idct_islow_row (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+                      JBLOCKROW coef_row, JSAMPARRAY output_buf,
+                      JDIMENSION output_col, JDIMENSION num_blocks)
+{
+  if ((simd_support & JSIMD_SSE2) && IS_ALIGNED_SSE(jconst_idct_islow_sse2)) {
+    for (; num_blocks > 0; num_blocks--, coef_row++, output_col += DCTSIZE)
+      jsimd_idct_islow_sse2(compptr->dct_table, (JCOEFPTR) coef_row,
+                            output_buf, output_col);
+  } else if (simd_support & JSIMD_MMX) {
+    for (; num_blocks > 0; num_blocks--, coef_row++, output_col += DCTSIZE)
+      jsimd_idct_islow_mmx(compptr->dct_table, (JCOEFPTR) coef_row,
+                           output_buf, output_col);
+  }
+}
+
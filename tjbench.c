@@ -32,6 +32,19 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 #include <cdjpeg.h>
 #include "./bmp.h"
 #include "./tjutil.h"
@@ -65,6 +78,17 @@ tjscalingfactor *scalingfactors=NULL, sf={1, 1};  int nsf=0;
 int xformop=TJXOP_NONE, xformopt=0;
 int (*customFilter)(short *, tjregion, tjregion, int, int, tjtransform *);
 double benchtime=5.0;
+enum {CORPUS_TEXT=0, CORPUS_CSV, CORPUS_JSON};
+int corpusfmt=CORPUS_TEXT;
+enum {PERF_CYCLES=0, PERF_INSTRUCTIONS, PERF_L1DMISSES, PERF_LLCMISSES,
+	PERF_BRANCHMISSES, PERF_NUMCOUNTERS};
+const char *perfName[PERF_NUMCOUNTERS]=
+{
+	"Cycles:", "Instructions:", "L1D cache misses:", "LLC misses:",
+	"Branch misses:"
+};
+int doperf=0, perffd[PERF_NUMCOUNTERS]={-1, -1, -1, -1, -1};
+double perfcount[PERF_NUMCOUNTERS];
 
 
 char *formatName(int subsamp, int cs, char *buf)
@@ -90,6 +114,144 @@ char *sigfig(double val, int figs, char *buf, int len)
 }
 
 
+/* Hardware performance counters.  These are only supported on Linux, using
+   perf_event_open().  Each counter is opened separately, so that counters the
+   CPU or the kernel do not support can simply be reported as N/A.  The
+   counters measure only user-space execution in the calling thread. */
+
+int perfInit(void)
+{
+	int n=0;
+	#ifdef __linux__
+	struct perf_event_attr attr;
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size=sizeof(attr);
+		attr.disabled=1;
+		attr.exclude_kernel=1;
+		attr.exclude_hv=1;
+		attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED
+			|PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.type=PERF_TYPE_HARDWARE;
+		switch(i)
+		{
+			case PERF_CYCLES:
+				attr.config=PERF_COUNT_HW_CPU_CYCLES;  break;
+			case PERF_INSTRUCTIONS:
+				attr.config=PERF_COUNT_HW_INSTRUCTIONS;  break;
+			case PERF_L1DMISSES:
+				attr.type=PERF_TYPE_HW_CACHE;
+				attr.config=PERF_COUNT_HW_CACHE_L1D|(PERF_COUNT_HW_CACHE_OP_READ<<8)
+					|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+				break;
+			case PERF_LLCMISSES:
+				attr.config=PERF_COUNT_HW_CACHE_MISSES;  break;
+			case PERF_BRANCHMISSES:
+				attr.config=PERF_COUNT_HW_BRANCH_MISSES;  break;
+		}
+		perffd[i]=(int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if(perffd[i]>=0) n++;
+	}
+	#endif
+	return n>0? 0:-1;
+}
+
+
+void perfCleanup(void)
+{
+	#ifdef __linux__
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++)
+	{
+		if(perffd[i]>=0) close(perffd[i]);
+		perffd[i]=-1;
+	}
+	#endif
+}
+
+
+void perfReset(void)
+{
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++) perfcount[i]=0.;
+}
+
+
+void perfStart(void)
+{
+	#ifdef __linux__
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++)
+	{
+		if(perffd[i]<0) continue;
+		ioctl(perffd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perffd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	#endif
+}
+
+
+/* Stop the counters and, if accumulate is non-zero, add their values to the
+   totals for the current benchmark.  If the kernel had to multiplex the
+   counters, then the values are scaled by the fraction of time that each
+   counter was actually running. */
+void perfStop(int accumulate)
+{
+	#ifdef __linux__
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++)
+	{
+		unsigned long long val[3];
+		if(perffd[i]<0) continue;
+		ioctl(perffd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if(!accumulate) continue;
+		if(read(perffd[i], val, sizeof(val))==sizeof(val) && val[2]>0)
+			perfcount[i]+=(double)val[0]*(double)val[1]/(double)val[2];
+	}
+	#endif
+}
+
+
+/* Print the counter totals, normalized to the number of Megapixels that were
+   processed */
+void perfPrint(double mpixels)
+{
+	int i;
+	for(i=0; i<PERF_NUMCOUNTERS; i++)
+	{
+		printf("                  %-20s", perfName[i]);
+		if(perffd[i]<0) printf("N/A\n");
+		else printf("%.0f per Megapixel\n", perfcount[i]/mpixels);
+	}
+	if(perffd[PERF_CYCLES]>=0 && perffd[PERF_INSTRUCTIONS]>=0
+		&& perfcount[PERF_CYCLES]>0.)
+		printf("                  Instructions/cycle: %f\n",
+			perfcount[PERF_INSTRUCTIONS]/perfcount[PERF_CYCLES]);
+}
+
+
+/* Return the greater of peak and the peak memory usage of the codec during the
+   most recent operation.  This is only called during the first warmup
+   iteration, so that it doesn't skew the timing or the performance counters. */
+unsigned long peakMemory(tjhandle handle, unsigned long peak)
+{
+	tjmemstats stats;
+	if(tjGetMemoryStats(handle, &stats)==-1) return peak;
+	return max(peak, stats.peakBytes);
+}
+
+
+void printPeakMemory(unsigned long peak)
+{
+	if(warmup>0)
+		printf("                  Peak memory:        %lu bytes\n", peak);
+	else
+		printf("                  Peak memory:        N/A (use -warmup 1)\n");
+}
+
+
 /* Custom DCT filter which produces a negative of the image */
 int dummyDCTFilter(short *coeffs, tjregion arrayRegion, tjregion planeRegion,
 	int componentIndex, int transformIndex, tjtransform *transform)
@@ -109,6 +271,7 @@ int decomp(unsigned char *srcbuf, unsigned char **jpegbuf,
 	FILE *file=NULL;  tjhandle handle=NULL;
 	int row, col, iter=0, dstbufalloc=0, retval=0;
 	double elapsed, elapsedDecode;
+	unsigned long peak=0, peakDecode=0;
 	int ps=tjPixelSize[pf];
 	int scaledw=TJSCALED(w, sf);
 	int scaledh=TJSCALED(h, sf);
@@ -148,10 +311,12 @@ int decomp(unsigned char *srcbuf, unsigned char **jpegbuf,
 	/* Benchmark */
 	iter=-warmup;
 	elapsed=elapsedDecode=0.;
+	if(doperf) perfReset();
 	while(1)
 	{
-		int tile=0;
+		int tile=0, getmem=(!quiet && warmup>0 && iter==-warmup);
 		double start=gettime();
+		if(doperf) perfStart();
 		for(row=0, dstptr=dstbuf; row<ntilesh; row++, dstptr+=pitch*tileh)
 		{
 			for(col=0, dstptr2=dstptr; col<ntilesw; col++, tile++, dstptr2+=ps*tilew)
@@ -164,18 +329,24 @@ int decomp(unsigned char *srcbuf, unsigned char **jpegbuf,
 					if(tjDecompressToYUV2(handle, jpegbuf[tile], jpegsize[tile], yuvbuf,
 						width, yuvpad, height, flags)==-1)
 						_throwtj("executing tjDecompressToYUV2()");
+					if(getmem) peak=peakMemory(handle, peak);
 					startDecode=gettime();
 					if(tjDecodeYUV(handle, yuvbuf, yuvpad, subsamp, dstptr2, width,
 						pitch, height, pf, flags)==-1)
 						_throwtj("executing tjDecodeYUV()");
 					if(iter>=0) elapsedDecode+=gettime()-startDecode;
+					if(getmem) peakDecode=peakMemory(handle, peakDecode);
 				}
 				else
+				{
 					if(tjDecompress2(handle, jpegbuf[tile], jpegsize[tile], dstptr2,
 						width, pitch, height, pf, flags)==-1)
 						_throwtj("executing tjDecompress2()");
+					if(getmem) peak=peakMemory(handle, peak);
+				}
 			}
 		}
+		if(doperf) perfStop(iter>=0);
 		iter++;
 		if(iter>=1)
 		{
@@ -205,12 +376,19 @@ int decomp(unsigned char *srcbuf, unsigned char **jpegbuf,
 			doyuv? "Decomp to YUV":"Decompress   ", (double)iter/elapsed);
 		printf("                  Throughput:         %f Megapixels/sec\n",
 			(double)(w*h)/1000000.*(double)iter/elapsed);
+		printPeakMemory(peak);
 		if(doyuv)
 		{
 			printf("YUV Decode    --> Frame rate:         %f fps\n",
 				(double)iter/elapsedDecode);
 			printf("                  Throughput:         %f Megapixels/sec\n",
 				(double)(w*h)/1000000.*(double)iter/elapsedDecode);
+			printPeakMemory(peakDecode);
+		}
+		if(doperf)
+		{
+			if(doyuv) printf("Decomp to YUV + YUV Decode:\n");
+			perfPrint((double)(w*h)/1000000.*(double)iter);
 		}
 	}
 	if(sf.num!=1 || sf.denom!=1)
@@ -280,6 +458,7 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 	FILE *file=NULL;  tjhandle handle=NULL;
 	unsigned char **jpegbuf=NULL, *yuvbuf=NULL, *tmpbuf=NULL, *srcptr, *srcptr2;
 	double start, elapsed, elapsedEncode;
+	unsigned long peak, peakEncode;
 	int totaljpegsize=0, row, col, i, tilew=w, tileh=h, retval=0;
 	int iter, yuvsize=0;
 	unsigned long *jpegsize=NULL;
@@ -337,11 +516,14 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 		/* Benchmark */
 		iter=-warmup;
 		elapsed=elapsedEncode=0.;
+		peak=peakEncode=0;
+		if(doperf) perfReset();
 		while(1)
 		{
-			int tile=0;
+			int tile=0, getmem=(!quiet && warmup>0 && iter==-warmup);
 			totaljpegsize=0;
 			start=gettime();
+			if(doperf) perfStart();
 			for(row=0, srcptr=srcbuf; row<ntilesh; row++, srcptr+=pitch*tileh)
 			{
 				for(col=0, srcptr2=srcptr; col<ntilesw; col++, tile++,
@@ -356,6 +538,7 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 							yuvpad, subsamp, flags)==-1)
 							_throwtj("executing tjEncodeYUV3()");
 						if(iter>=0) elapsedEncode+=gettime()-startEncode;
+						if(getmem) peakEncode=peakMemory(handle, peakEncode);
 						if(tjCompressFromYUV(handle, yuvbuf, width, yuvpad, height,
 							subsamp, &jpegbuf[tile], &jpegsize[tile], jpegqual, flags)==-1)
 							_throwtj("executing tjCompressFromYUV()");
@@ -366,9 +549,11 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 							&jpegbuf[tile], &jpegsize[tile], subsamp, jpegqual, flags)==-1)
 							_throwtj("executing tjCompress2()");
 					}
+					if(getmem) peak=peakMemory(handle, peak);
 					totaljpegsize+=jpegsize[tile];
 				}
 			}
+			if(doperf) perfStop(iter>=0);
 			iter++;
 			if(iter>=1)
 			{
@@ -410,6 +595,7 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 					(double)(w*h)/1000000.*(double)iter/elapsedEncode);
 				printf("                  Output bit stream:  %f Megabits/sec\n",
 					(double)yuvsize*8./1000000.*(double)iter/elapsedEncode);
+				printPeakMemory(peakEncode);
 			}
 			printf("%s --> Frame rate:         %f fps\n",
 				doyuv? "Comp from YUV":"Compress     ", (double)iter/elapsed);
@@ -421,6 +607,12 @@ int fullTest(unsigned char *srcbuf, int w, int h, int subsamp, int jpegqual,
 				(double)(w*h)/1000000.*(double)iter/elapsed);
 			printf("                  Output bit stream:  %f Megabits/sec\n",
 				(double)totaljpegsize*8./1000000.*(double)iter/elapsed);
+			printPeakMemory(peak);
+			if(doperf)
+			{
+				if(doyuv) printf("Encode YUV + Comp from YUV:\n");
+				perfPrint((double)(w*h)/1000000.*(double)iter);
+			}
 		}
 		if(tilew==w && tileh==h)
 		{
@@ -485,6 +677,7 @@ int decompTest(char *filename)
 	char *temp=NULL, tempstr[80], tempstr2[80];
 	int row, col, i, iter, tilew, tileh, ntilesw=1, ntilesh=1, retval=0;
 	double start, elapsed;
+	unsigned long peak;
 	int ps=tjPixelSize[pf], tile;
 
 	if((file=fopen(filename, "rb"))==NULL)
@@ -613,12 +806,15 @@ int decompTest(char *filename)
 
 			iter=-warmup;
 			elapsed=0.;
+			peak=0;
 			while(1)
 			{
 				start=gettime();
 				if(tjTransform(handle, srcbuf, srcsize, _ntilesw*_ntilesh, jpegbuf,
 					jpegsize, t, flags)==-1)
 					_throwtj("executing tjTransform()");
+				if(!quiet && warmup>0 && iter==-warmup)
+					peak=peakMemory(handle, peak);
 				iter++;
 				if(iter>=1)
 				{
@@ -650,6 +846,7 @@ int decompTest(char *filename)
 					(double)(w*h)/1000000./elapsed);
 				printf("                  Output bit stream:  %f Megabits/sec\n",
 					(double)totaljpegsize*8./1000000./elapsed);
+				printPeakMemory(peak);
 			}
 		}
 		else
@@ -696,6 +893,292 @@ int decompTest(char *filename)
 	return retval;
 }
 
+/* Corpus benchmark.  Each JPEG image in a directory is decompressed
+   repeatedly, and the latency of each individual decompression operation is
+   recorded, so that the latency distribution (rather than just the mean) can
+   be reported for a realistic mix of image sizes and types. */
+
+typedef struct
+{
+	char *name;
+	unsigned char *buf;
+	unsigned long size;
+	int w, h, subsamp, cs;
+	double *times;
+	int ntimes, maxtimes;
+} corpusfile;
+
+
+int cmpdouble(const void *arg1, const void *arg2)
+{
+	double d1=*(const double *)arg1, d2=*(const double *)arg2;
+	return d1<d2? -1:(d1>d2? 1:0);
+}
+
+
+/* Nearest-rank percentile of a sorted array */
+double percentile(double *sorted, int n, double p)
+{
+	int rank=(int)ceil(p/100.*(double)n);
+	if(rank<1) rank=1;
+	if(rank>n) rank=n;
+	return sorted[rank-1];
+}
+
+
+int addtime(corpusfile *cf, double t)
+{
+	if(cf->ntimes>=cf->maxtimes)
+	{
+		int newmax=cf->maxtimes? cf->maxtimes*2:64;
+		double *newtimes=(double *)realloc(cf->times, sizeof(double)*newmax);
+		if(!newtimes) return -1;
+		cf->times=newtimes;  cf->maxtimes=newmax;
+	}
+	cf->times[cf->ntimes++]=t;
+	return 0;
+}
+
+
+int loadcorpusfile(char *dirname, char *name, corpusfile *cf, tjhandle handle)
+{
+	FILE *file=NULL;  char path[1024];
+	int retval=0;
+
+	memset(cf, 0, sizeof(corpusfile));
+	snprintf(path, 1024, "%s/%s", dirname, name);
+	if((file=fopen(path, "rb"))==NULL
+		|| fseek(file, 0, SEEK_END)<0
+		|| (cf->size=ftell(file))==(unsigned long)-1 || cf->size==0
+		|| fseek(file, 0, SEEK_SET)<0
+		|| (cf->buf=(unsigned char *)malloc(cf->size))==NULL
+		|| fread(cf->buf, cf->size, 1, file)<1)
+	{
+		retval=-1;  goto bailout;
+	}
+	/* Silently skip anything that isn't a JPEG image */
+	if(tjDecompressHeader3(handle, cf->buf, cf->size, &cf->w, &cf->h,
+		&cf->subsamp, &cf->cs)==-1)
+	{
+		retval=-1;  goto bailout;
+	}
+	if((cf->name=strdup(name))==NULL) retval=-1;
+
+	bailout:
+	if(file) fclose(file);
+	if(retval<0 && cf->buf) {free(cf->buf);  cf->buf=NULL;}
+	return retval;
+}
+
+
+/* Print a file name as a quoted CSV or JSON string */
+void printquoted(const char *str)
+{
+	putchar('"');
+	for(; *str; str++)
+	{
+		if(*str=='"') printf(corpusfmt==CORPUS_CSV? "\"\"":"\\\"");
+		else if(*str=='\\' && corpusfmt==CORPUS_JSON) printf("\\\\");
+		else putchar(*str);
+	}
+	putchar('"');
+}
+
+
+void printcorpusstats(const char *name, double *times, int ntimes,
+	double bytes, double pixels, int w, int h, int subsamp, int cs, int last)
+{
+	double p50=0., p90=0., p99=0., maxt=0., total=0.;
+	double bytespersec=0., mpixpersec=0.;
+	int i;
+
+	qsort(times, ntimes, sizeof(double), cmpdouble);
+	for(i=0; i<ntimes; i++) total+=times[i];
+	if(ntimes>0)
+	{
+		p50=percentile(times, ntimes, 50.);
+		p90=percentile(times, ntimes, 90.);
+		p99=percentile(times, ntimes, 99.);
+		maxt=times[ntimes-1];
+	}
+	if(total>0.)
+	{
+		bytespersec=bytes/total;
+		mpixpersec=pixels/1000000./total;
+	}
+
+	if(corpusfmt==CORPUS_CSV)
+	{
+		printquoted(name);
+		if(w>0) printf(",%d,%d", w, h);
+		else printf(",,");
+		printf(",%s,%d,%f,%f,%f,%f,%f,%f\n", subsamp>=0? subName[subsamp]:"",
+			ntimes, p50*1000., p90*1000., p99*1000., maxt*1000., bytespersec,
+			mpixpersec);
+	}
+	else if(corpusfmt==CORPUS_JSON)
+	{
+		printf("    {\"file\": ");
+		printquoted(name);
+		printf(", ");
+		if(w>0) printf("\"width\": %d, \"height\": %d, ", w, h);
+		if(subsamp>=0) printf("\"subsamp\": \"%s\", ", subName[subsamp]);
+		if(cs>=0) printf("\"colorspace\": \"%s\", ", csName[cs]);
+		printf("\"iterations\": %d,\n", ntimes);
+		printf("     \"p50_ms\": %f, \"p90_ms\": %f, \"p99_ms\": %f, \"max_ms\": %f,\n",
+			p50*1000., p90*1000., p99*1000., maxt*1000.);
+		printf("     \"bytes_per_sec\": %f, \"mpixels_per_sec\": %f}%s\n",
+			bytespersec, mpixpersec, last? "":",");
+	}
+	else
+	{
+		char sizestr[24]="";
+		if(w>0) snprintf(sizestr, 24, "%dx%d", w, h);
+		printf("%-24.24s %-11s %-5s %6d  %9.3f %9.3f %9.3f %9.3f  %9.3f %9.3f\n",
+			name, sizestr, subsamp>=0? subName[subsamp]:"", ntimes, p50*1000.,
+			p90*1000., p99*1000., maxt*1000., bytespersec/1000000., mpixpersec);
+	}
+}
+
+
+int corpusTest(char *dirname)
+{
+	tjhandle handle=NULL;  corpusfile *files=NULL;
+	int nfiles=0, maxfiles=0, i, iter, retval=0;
+	unsigned char *dstbuf=NULL;  unsigned long dstbufsize=0;
+	double *alltimes=NULL, elapsed;
+	double totalbytes=0., totalpixels=0.;
+	int ntotal=0;
+	#ifdef _WIN32
+	struct _finddata_t fd;  intptr_t findhandle=-1;
+	char pattern[1024];
+	#else
+	DIR *dir=NULL;  struct dirent *de;
+	#endif
+
+	if((handle=tjInitDecompress())==NULL)
+		_throwtj("executing tjInitDecompress()");
+
+	#ifdef _WIN32
+	snprintf(pattern, 1024, "%s\\*", dirname);
+	if((findhandle=_findfirst(pattern, &fd))==-1)
+		_throwunix("opening corpus directory");
+	do
+	{
+		char *name=fd.name;
+		if(fd.attrib&_A_SUBDIR) continue;
+	#else
+	if((dir=opendir(dirname))==NULL)
+		_throwunix("opening corpus directory");
+	while((de=readdir(dir))!=NULL)
+	{
+		char *name=de->d_name;
+		if(name[0]=='.') continue;
+	#endif
+		if(nfiles>=maxfiles)
+		{
+			int newmax=maxfiles? maxfiles*2:64;
+			corpusfile *newfiles=(corpusfile *)realloc(files,
+				sizeof(corpusfile)*newmax);
+			if(!newfiles) _throwunix("allocating corpus file list");
+			files=newfiles;  maxfiles=newmax;
+		}
+		if(loadcorpusfile(dirname, name, &files[nfiles], handle)==0)
+		{
+			int pitch=TJSCALED(files[nfiles].w, sf)*tjPixelSize[pf];
+			unsigned long size=(unsigned long)pitch
+				*TJSCALED(files[nfiles].h, sf);
+			if(size>dstbufsize) dstbufsize=size;
+			nfiles++;
+		}
+	#ifdef _WIN32
+	} while(_findnext(findhandle, &fd)==0);
+	#else
+	}
+	#endif
+
+	if(nfiles==0) _throw("scanning corpus directory", "No JPEG images found");
+	if((dstbuf=(unsigned char *)malloc(dstbufsize))==NULL)
+		_throwunix("allocating destination buffer");
+
+	if(corpusfmt==CORPUS_TEXT)
+	{
+		printf(">>>>>  Corpus %s (%d images) --> %s (%s)  <<<<<\n\n", dirname,
+			nfiles, pixFormatStr[pf],
+			(flags&TJFLAG_BOTTOMUP)? "Bottom-up":"Top-down");
+		printf("All latencies in ms, bytes/sec in MB/sec, pixels/sec in Mpixels/sec\n\n");
+		printf("%-24s %-11s %-5s %6s  %9s %9s %9s %9s  %9s %9s\n", "File", "Size",
+			"Samp", "Iter", "p50", "p90", "p99", "max", "MB/sec", "Mpix/sec");
+	}
+	else if(corpusfmt==CORPUS_CSV)
+		printf("file,width,height,subsamp,iterations,p50_ms,p90_ms,p99_ms,max_ms,bytes_per_sec,mpixels_per_sec\n");
+	else printf("{\n  \"files\": [\n");
+
+	/* Benchmark.  Each pass decompresses every image in the corpus once. */
+	iter=-warmup;
+	elapsed=0.;
+	while(1)
+	{
+		for(i=0; i<nfiles; i++)
+		{
+			corpusfile *cf=&files[i];
+			int w=TJSCALED(cf->w, sf), h=TJSCALED(cf->h, sf);
+			double start=gettime(), t;
+			if(tjDecompress2(handle, cf->buf, cf->size, dstbuf, w,
+				w*tjPixelSize[pf], h, pf, flags)==-1)
+				_throwtj("executing tjDecompress2()");
+			t=gettime()-start;
+			if(iter>=0)
+			{
+				if(addtime(cf, t)==-1) _throwunix("allocating timing array");
+				elapsed+=t;
+			}
+		}
+		iter++;
+		if(iter>=1 && elapsed>=benchtime) break;
+	}
+
+	for(i=0; i<nfiles; i++) ntotal+=files[i].ntimes;
+	if((alltimes=(double *)malloc(sizeof(double)*ntotal))==NULL)
+		_throwunix("allocating timing array");
+	for(i=0, ntotal=0; i<nfiles; i++)
+	{
+		corpusfile *cf=&files[i];
+		memcpy(&alltimes[ntotal], cf->times, sizeof(double)*cf->ntimes);
+		ntotal+=cf->ntimes;
+		totalbytes+=(double)cf->size*cf->ntimes;
+		totalpixels+=(double)cf->w*cf->h*cf->ntimes;
+		printcorpusstats(cf->name, cf->times, cf->ntimes,
+			(double)cf->size*cf->ntimes, (double)cf->w*cf->h*cf->ntimes, cf->w,
+			cf->h, cf->subsamp, cf->cs, i==nfiles-1);
+	}
+
+	if(corpusfmt==CORPUS_JSON) printf("  ],\n  \"total\":\n");
+	else if(corpusfmt==CORPUS_TEXT) printf("\n");
+	printcorpusstats("TOTAL", alltimes, ntotal, totalbytes, totalpixels, 0, 0,
+		-1, -1, 1);
+	if(corpusfmt==CORPUS_JSON) printf("}\n");
+
+	bailout:
+	#ifdef _WIN32
+	if(findhandle!=-1) _findclose(findhandle);
+	#else
+	if(dir) closedir(dir);
+	#endif
+	if(files)
+	{
+		for(i=0; i<nfiles; i++)
+		{
+			free(files[i].name);  free(files[i].buf);  free(files[i].times);
+		}
+		free(files);
+	}
+	if(alltimes) free(alltimes);
+	if(dstbuf) free(dstbuf);
+	if(handle) tjDestroy(handle);
+	return retval;
+}
+
 
 void usage(char *progname)
 {
@@ -704,6 +1187,8 @@ void usage(char *progname)
 	printf("       <Inputfile (BMP|PPM)> <Quality> [options]\n\n");
 	printf("       %s\n", progname);
 	printf("       <Inputfile (JPG)> [options]\n\n");
+	printf("       %s\n", progname);
+	printf("       <Directory containing JPG files> [options]\n\n");
 	printf("Options:\n\n");
 	printf("-alloc = Dynamically allocate JPEG image buffers\n");
 	printf("-bmp = Generate output images in Windows Bitmap format (default = PPM)\n");
@@ -714,6 +1199,7 @@ void usage(char *progname)
 	printf("     Test the specified color conversion path in the codec (default = BGR)\n");
 	printf("-fastupsample = Use the fastest chrominance upsampling algorithm available in\n");
 	printf("     the underlying codec\n");
+	printf("-dctupsample = Upsample 4:2:0 chrominance in the inverse DCT (16x16 IDCT)\n");
 	printf("-fastdct = Use the fastest DCT/IDCT algorithms available in the underlying\n");
 	printf("     codec\n");
 	printf("-accuratedct = Use the most accurate DCT/IDCT algorithms available in the\n");
@@ -749,9 +1235,21 @@ void usage(char *progname)
 	printf("-benchtime <t> = Run each benchmark for at least <t> seconds (default = 5.0)\n");
 	printf("-warmup <w> = Execute each benchmark <w> times to prime the cache before\n");
 	printf("     taking performance measurements (default = 1)\n");
-	printf("-componly = Stop after running compression tests.  Do not test decompression.\n\n");
+	printf("-componly = Stop after running compression tests.  Do not test decompression.\n");
+	printf("-perf = Use hardware performance counters to measure the number of CPU\n");
+	printf("     cycles, instructions, L1 data cache misses, last-level cache misses, and\n");
+	printf("     branch misses per Megapixel during the compression and decompression\n");
+	printf("     tests (Linux only, ignored in tabular and corpus modes)\n");
+	printf("-csv, -json = When benchmarking a directory of JPEG images (corpus mode),\n");
+	printf("     output the per-image and aggregate latency statistics in CSV or JSON\n");
+	printf("     format rather than as human-readable text\n\n");
 	printf("NOTE:  If the quality is specified as a range (e.g. 90-100), a separate\n");
 	printf("test will be performed for all quality values in the range.\n\n");
+	printf("NOTE:  If a directory is specified, then each JPEG image in the directory is\n");
+	printf("decompressed repeatedly for the benchmark time, and the latency of each\n");
+	printf("decompression operation is recorded.  The 50th, 90th, and 99th percentile\n");
+	printf("and maximum latencies are reported, along with the throughput, for each\n");
+	printf("image and for the corpus as a whole.\n\n");
 	exit(1);
 }
 
@@ -760,7 +1258,8 @@ int main(int argc, char *argv[])
 {
 	unsigned char *srcbuf=NULL;  int w=0, h=0, i, j;
 	int minqual=-1, maxqual=-1;  char *temp;
-	int minarg=2, retval=0, subsamp=-1;
+	int minarg=2, retval=0, subsamp=-1, docorpus=0;
+	struct stat st;
 
 	if((scalingfactors=tjGetScalingFactors(&nsf))==NULL || nsf==0)
 		_throwtj("executing tjGetScalingFactors()");
@@ -768,13 +1267,24 @@ int main(int argc, char *argv[])
 	if(argc<minarg) usage(argv[0]);
 
 	temp=strrchr(argv[1], '.');
-	if(temp!=NULL)
+	if(stat(argv[1], &st)==0 && (st.st_mode&S_IFMT)==S_IFDIR)
+		docorpus=decomponly=1;
+	else if(temp!=NULL)
 	{
 		if(!strcasecmp(temp, ".bmp")) ext="bmp";
 		if(!strcasecmp(temp, ".jpg") || !strcasecmp(temp, ".jpeg")) decomponly=1;
 	}
 
-	printf("\n");
+	for(i=minarg; i<argc; i++)
+	{
+		if(!strcasecmp(argv[i], "-csv")) corpusfmt=CORPUS_CSV;
+		if(!strcasecmp(argv[i], "-json")) corpusfmt=CORPUS_JSON;
+	}
+	/* The output format options are only meaningful in corpus mode.  In that
+	   mode, keep the machine-readable output free of informational messages. */
+	if(!docorpus) corpusfmt=CORPUS_TEXT;
+
+	if(corpusfmt==CORPUS_TEXT) printf("\n");
 
 	if(!decomponly)
 	{
@@ -801,17 +1311,24 @@ int main(int argc, char *argv[])
 			}
 			if(!strcasecmp(argv[i], "-fastupsample"))
 			{
-				printf("Using fast upsampling code\n\n");
+				if(corpusfmt==CORPUS_TEXT) printf("Using fast upsampling code\n\n");
 				flags|=TJFLAG_FASTUPSAMPLE;
 			}
+			if(!strcasecmp(argv[i], "-dctupsample"))
+			{
+				if(corpusfmt==CORPUS_TEXT) printf("Using DCT-domain upsampling\n\n");
+				flags|=TJFLAG_DCTUPSAMPLE;
+			}
 			if(!strcasecmp(argv[i], "-fastdct"))
 			{
-				printf("Using fastest DCT/IDCT algorithm\n\n");
+				if(corpusfmt==CORPUS_TEXT)
+					printf("Using fastest DCT/IDCT algorithm\n\n");
 				flags|=TJFLAG_FASTDCT;
 			}
 			if(!strcasecmp(argv[i], "-accuratedct"))
 			{
-				printf("Using most accurate DCT/IDCT algorithm\n\n");
+				if(corpusfmt==CORPUS_TEXT)
+					printf("Using most accurate DCT/IDCT algorithm\n\n");
 				flags|=TJFLAG_ACCURATEDCT;
 			}
 			if(!strcasecmp(argv[i], "-rgb")) pf=TJPF_RGB;
@@ -863,7 +1380,7 @@ int main(int argc, char *argv[])
 				if(temp>=0)
 				{
 					warmup=temp;
-					printf("Warmup runs = %d\n\n", warmup);
+					if(corpusfmt==CORPUS_TEXT) printf("Warmup runs = %d\n\n", warmup);
 				}
 				else usage(argv[0]);
 			}
@@ -898,9 +1415,18 @@ int main(int argc, char *argv[])
 				}
 			}
 			if(!strcasecmp(argv[i], "-componly")) componly=1;
+			if(!strcasecmp(argv[i], "-perf")) doperf=1;
 		}
 	}
 
+	if(doperf && (quiet || docorpus)) doperf=0;
+	if(doperf && perfInit()==-1)
+	{
+		printf("Disabling hardware performance counters, because none of them are\n");
+		printf("available on this system.\n\n");
+		doperf=0;
+	}
+
 	if((sf.num!=1 || sf.denom!=1) && dotile)
 	{
 		printf("Disabling tiled compression/decompression tests, because those tests do not\n");
@@ -939,6 +1465,12 @@ int main(int argc, char *argv[])
 		printf("\n\n");
 	}
 
+	if(docorpus)
+	{
+		corpusTest(argv[1]);
+		if(corpusfmt==CORPUS_TEXT) printf("\n");
+		goto bailout;
+	}
 	if(decomponly)
 	{
 		decompTest(argv[1]);
@@ -969,5 +1501,6 @@ int main(int argc, char *argv[])
 
 	bailout:
 	if(srcbuf) free(srcbuf);
+	perfCleanup();
 	return retval;
 }
@@ -593,6 +593,40 @@ void doTest(int w, int h, const int *formats, int nformats, int subsamp,
 }
 
 
+/* Create the compressor and (if dhandle is not NULL) the decompressor
+   instance, as well as the source image, for one of the regression tests
+   below.  The caller frees them, even if this function fails. */
+int initFixture(tjhandle *chandle, tjhandle *dhandle, unsigned char **srcBuf,
+	int w, int h, int pf)
+{
+	if((*chandle=tjInitCompress())==NULL) _throwtj();
+	if(dhandle && (*dhandle=tjInitDecompress())==NULL) _throwtj();
+	if((*srcBuf=(unsigned char *)malloc(w*h*tjPixelSize[pf]))==NULL)
+		_throw("Memory allocation failure");
+	initBuf(*srcBuf, w, h, pf, 0);
+	return 0;
+
+	bailout:
+	return -1;
+}
+
+
+/* Compress the source image of a regression test into a freshly allocated
+   JPEG buffer */
+int compFixture(tjhandle handle, unsigned char *srcBuf, int w, int h, int pf,
+	unsigned char **jpegBuf, unsigned long *jpegSize, int subsamp, int jpegQual)
+{
+	if(*jpegBuf) {tjFree(*jpegBuf);  *jpegBuf=NULL;}
+	*jpegSize=0;
+	_tj(tjCompress2(handle, srcBuf, w, 0, h, pf, jpegBuf, jpegSize, subsamp,
+		jpegQual, 0));
+	return 0;
+
+	bailout:
+	return -1;
+}
+
+
 void bufSizeTest(void)
 {
 	int w, h, i, subsamp;
@@ -685,6 +719,867 @@ void bufSizeTest(void)
 	if(handle) tjDestroy(handle);
 }
 
+/* Make sure that a JPEG buffer reused from a previous call is not reallocated
+   when *jpegSize is 0 and that growing a pre-allocated buffer frees only that
+   buffer, not the output of a previous call */
+void bufReuseTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *jpegBuf2=NULL, *refBuf=NULL;
+	unsigned long jpegSize=0, jpegSize2=0, refSize=0;
+	tjhandle handle=NULL;
+	int w=97, h=83, i;
+
+	printf("Buffer reuse test ... ");
+	if((handle=tjInitCompress())==NULL) _throwtj();
+	if((srcBuf=(unsigned char *)malloc(w*h*3))==NULL)
+		_throw("Memory allocation failure");
+	/* Use noise so that the JPEG image is larger than the initial buffer that
+	   TurboJPEG allocates */
+	for(i=0; i<w*h*3; i++) srcBuf[i]=(unsigned char)(random()%256);
+
+	_tj(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+		TJSAMP_444, 100, 0));
+	refSize=jpegSize;
+	if((refBuf=(unsigned char *)malloc(refSize))==NULL)
+		_throw("Memory allocation failure");
+	memcpy(refBuf, jpegBuf, refSize);
+
+	jpegSize=0;
+	_tj(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf, &jpegSize,
+		TJSAMP_444, 100, 0));
+	if(jpegSize!=refSize || memcmp(jpegBuf, refBuf, refSize))
+		_throw("Reused JPEG buffer with a size of 0 produced a different image");
+
+	jpegSize2=64;
+	if((jpegBuf2=tjAlloc(jpegSize2))==NULL)
+		_throw("Memory allocation failure");
+	_tj(tjCompress2(handle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf2, &jpegSize2,
+		TJSAMP_444, 100, 0));
+	if(jpegSize2!=refSize || memcmp(jpegBuf2, refBuf, refSize))
+		_throw("Grown JPEG buffer produced a different image");
+	if(memcmp(jpegBuf, refBuf, refSize))
+		_throw("Growing a JPEG buffer overwrote the output of a previous call");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(refBuf) free(refBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(jpegBuf2) tjFree(jpegBuf2);
+	if(handle) tjDestroy(handle);
+}
+
+/* Make sure that the memory usage statistics are sane and that they are reset
+   at the beginning of each operation */
+void memStatsTest(void)
+{
+	unsigned char *srcBuf=NULL, *dstBuf=NULL, *jpegBuf[2]={NULL, NULL};
+	unsigned long jpegSize[2]={0, 0}, peak[2]={0, 0};
+	tjhandle chandle=NULL, dhandle=NULL;
+	tjmemstats stats;
+	int i, w[2]={192, 32};
+
+	printf("Memory statistics test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w[0], w[0], TJPF_BGRX)==-1)
+		bailout();
+
+	/* Compress a large image followed by a small one.  If the statistics were
+	   not reset between operations, then the peak memory usage would not
+	   decrease. */
+	for(i=0; i<2; i++)
+	{
+		_tj(tjCompress2(chandle, srcBuf, w[i], w[0]*4, w[i], TJPF_BGRX,
+			&jpegBuf[i], &jpegSize[i], TJSAMP_420, 100, 0));
+		_tj(tjGetMemoryStats(chandle, &stats));
+		if(stats.peakBytes==0 || stats.peakBytes<stats.currentBytes
+			|| stats.numAllocs==0 || stats.virtArrayBytes!=0)
+			_throw("Invalid compression statistics");
+		peak[i]=stats.peakBytes;
+	}
+	if(peak[1]>=peak[0]) _throw("Compression statistics were not reset");
+
+	if((dstBuf=(unsigned char *)malloc(w[0]*w[0]*4))==NULL)
+		_throw("Memory allocation failure");
+	for(i=0; i<2; i++)
+	{
+		_tj(tjDecompress2(dhandle, jpegBuf[i], jpegSize[i], dstBuf, w[i], 0,
+			w[i], TJPF_BGRX, 0));
+		_tj(tjGetMemoryStats(dhandle, &stats));
+		if(stats.peakBytes==0 || stats.peakBytes<stats.currentBytes
+			|| stats.numAllocs==0)
+			_throw("Invalid decompression statistics");
+		peak[i]=stats.peakBytes;
+	}
+	if(peak[1]>=peak[0]) _throw("Decompression statistics were not reset");
+
+	if(tjGetMemoryStats(chandle, NULL)!=-1)
+		_throw("tjGetMemoryStats() accepted a NULL argument");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(dstBuf) free(dstBuf);
+	for(i=0; i<2; i++)
+		if(jpegBuf[i]) tjFree(jpegBuf[i]);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+
+/* Make sure that the decompression cost estimate matches the memory that
+   tjDecompress2() actually uses */
+void decompCostTest(void)
+{
+	unsigned char *srcBuf=NULL, *dstBuf=NULL, *jpegBuf=NULL;
+	unsigned long jpegSize=0;
+	tjhandle chandle=NULL, dhandle=NULL;
+	tjmemstats stats;
+	tjdecompcost cost, cost8;
+	int w=45, h=43, mode, subsamp, scale, i;
+	/* Full-size, scaled, merged-upsampling and grayscale output */
+	int flags[]={0, TJFLAG_FASTUPSAMPLE, 0},
+		pf[]={TJPF_BGRX, TJPF_BGRX, TJPF_GRAY};
+
+	printf("Decompression cost test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_BGRX)==-1)
+		bailout();
+	if((dstBuf=(unsigned char *)malloc(w*h*4))==NULL)
+		_throw("Memory allocation failure");
+
+	/* The memory estimate must match the actual peak usage for baseline,
+	   progressive, arithmetic and progressive arithmetic images */
+	for(mode=0; mode<4; mode++)
+	{
+		putenv(mode&1? "TJ_PROGRESSIVE=1":"TJ_PROGRESSIVE=");
+		putenv(mode&2? "TJ_ARITHMETIC=1":"TJ_ARITHMETIC=");
+		for(subsamp=0; subsamp<TJ_NUMSAMP; subsamp++)
+		{
+			if(compFixture(chandle, srcBuf, w, h, TJPF_BGRX, &jpegBuf, &jpegSize,
+				subsamp, 100)==-1)
+				bailout();
+			for(scale=1; scale<=8; scale*=2)
+			{
+				int dw=(w+scale-1)/scale, dh=(h+scale-1)/scale;
+				for(i=0; i<3; i++)
+				{
+					_tj(tjGetDecompressCost(dhandle, jpegBuf, jpegSize, dw, dh, pf[i],
+						flags[i], &cost));
+					_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, dw, 0, dh,
+						pf[i], flags[i]));
+					_tj(tjGetMemoryStats(dhandle, &stats));
+					if(cost.peakBytes!=stats.peakBytes || cost.cpuCost<=0.0
+						|| (cost.coefBufBytes!=0)!=(mode&1))
+					{
+						printf("\n%s %s %s -> %s, 1/%d scale%s:\n",
+							mode&1? "Progressive":"Baseline",
+							mode&2? "arithmetic":"Huffman", subNameLong[subsamp],
+							pixFormatStr[pf[i]], scale,
+							flags[i]&TJFLAG_FASTUPSAMPLE? ", fast upsampling":"");
+						printf("Estimated peak %lu bytes, actual %lu bytes\n",
+							(unsigned long)cost.peakBytes, (unsigned long)stats.peakBytes);
+						_throw("Invalid decompression cost estimate");
+					}
+				}
+			}
+		}
+	}
+	putenv("TJ_PROGRESSIVE=");
+	putenv("TJ_ARITHMETIC=");
+
+	/* Scaling down should reduce the estimated CPU cost */
+	_tj(tjGetDecompressCost(dhandle, jpegBuf, jpegSize, w, h, TJPF_BGRX, 0,
+		&cost));
+	_tj(tjGetDecompressCost(dhandle, jpegBuf, jpegSize, (w+7)/8, (h+7)/8,
+		TJPF_BGRX, 0, &cost8));
+	if(cost8.cpuCost>=cost.cpuCost)
+		_throw("Decompression cost estimate ignores scaling");
+
+	if(tjGetDecompressCost(dhandle, jpegBuf, jpegSize, w, h, TJPF_BGRX, 0,
+		NULL)!=-1)
+		_throw("tjGetDecompressCost() accepted a NULL argument");
+	printf("Passed.\n");
+
+	bailout:
+	putenv("TJ_PROGRESSIVE=");
+	putenv("TJ_ARITHMETIC=");
+	if(srcBuf) free(srcBuf);
+	if(dstBuf) free(dstBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+/* Make sure that tjProbeHeader() agrees with tjDecompressHeader3() and that it
+   detects the Exif orientation and ICC profile markers */
+void probeHeaderTest(void)
+{
+	static const unsigned char exifMM[]={0xFF, 0xE1, 0x00, 0x22,
+		'E', 'x', 'i', 'f', 0, 0, 'M', 'M', 0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,
+		0x00, 0x01, 0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01,
+		0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	static const unsigned char exifII[]={0xFF, 0xE1, 0x00, 0x22,
+		'E', 'x', 'i', 'f', 0, 0, 'I', 'I', 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,
+		0x01, 0x00, 0x12, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00,
+		0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+	static const unsigned char icc[]={0xFF, 0xE2, 0x00, 0x10,
+		'I', 'C', 'C', '_', 'P', 'R', 'O', 'F', 'I', 'L', 'E', 0, 1, 1};
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *buf=NULL;
+	unsigned long jpegSize=0, size;
+	tjhandle chandle=NULL, dhandle=NULL;
+	tjheaderinfo info;
+	int subsamp, width, height, jpegSubsamp, jpegColorspace, w=41, h=35;
+
+	printf("Header probe test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+
+	for(subsamp=0; subsamp<TJ_NUMSAMP; subsamp++)
+	{
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 90)==-1)
+			bailout();
+		_tj(tjDecompressHeader3(dhandle, jpegBuf, jpegSize, &width, &height,
+			&jpegSubsamp, &jpegColorspace));
+		_tj(tjProbeHeader(jpegBuf, jpegSize, &info));
+		if(info.width!=width || info.height!=height
+			|| info.subsamp!=jpegSubsamp || info.colorspace!=jpegColorspace
+			|| info.numComponents!=(subsamp==TJSAMP_GRAY? 1:3)
+			|| info.precision!=8 || info.progressive || info.arithmetic
+			|| info.orientation!=0 || info.hasICCProfile)
+			_throw("tjProbeHeader() returned incorrect header information");
+	}
+
+	/* Insert Exif and ICC markers after the SOI marker */
+	if((buf=(unsigned char *)malloc(jpegSize+sizeof(exifMM)+sizeof(icc)))==NULL)
+		_throw("Memory allocation failure");
+	memcpy(buf, jpegBuf, 2);
+	memcpy(&buf[2], exifMM, sizeof(exifMM));
+	memcpy(&buf[2+sizeof(exifMM)], icc, sizeof(icc));
+	memcpy(&buf[2+sizeof(exifMM)+sizeof(icc)], &jpegBuf[2], jpegSize-2);
+	size=jpegSize+sizeof(exifMM)+sizeof(icc);
+	_tj(tjProbeHeader(buf, size, &info));
+	if(info.orientation!=6 || !info.hasICCProfile || info.width!=w
+		|| info.height!=h)
+		_throw("tjProbeHeader() did not detect Exif/ICC markers");
+	memcpy(&buf[2], exifII, sizeof(exifII));
+	_tj(tjProbeHeader(buf, size, &info));
+	if(info.orientation!=3)
+		_throw("tjProbeHeader() did not detect little-endian Exif orientation");
+
+	/* A buffer that ends before the SOF marker, or that isn't a JPEG image,
+	   should be rejected */
+	if(tjProbeHeader(buf, 2+sizeof(exifMM)+sizeof(icc), &info)!=-1
+		|| tjProbeHeader(srcBuf, w*h*3, &info)!=-1
+		|| tjProbeHeader(jpegBuf, jpegSize, NULL)!=-1)
+		_throw("tjProbeHeader() accepted invalid input");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(buf) free(buf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void validateTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *badBuf=NULL;
+	unsigned long jpegSize=0;
+	tjhandle chandle=NULL, dhandle=NULL;
+	tjvalidateinfo info;
+	int subsamp, w=67, h=53;
+
+	printf("Validation test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+
+	for(subsamp=0; subsamp<TJ_NUMSAMP; subsamp++)
+	{
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 90)==-1)
+			bailout();
+		_tj(tjValidate(dhandle, jpegBuf, jpegSize, &info));
+		if(info.numScans!=1 || info.numWarnings!=0 || info.badScan!=0
+			|| info.badMCUX!=-1 || info.badMCUY!=-1)
+			_throw("tjValidate() reported a problem with an intact image");
+
+		/* Truncate the image partway through the entropy-coded data */
+		if(tjValidate(dhandle, jpegBuf, jpegSize*3/4, &info)!=-1)
+			_throw("tjValidate() accepted a truncated image");
+		if(info.numWarnings<1 || info.badScan!=1 || info.badMCUX<0
+			|| info.badMCUY<0)
+			_throw("tjValidate() did not locate the end of a truncated image");
+	}
+
+	/* The arithmetic decoder reads ahead, but it must still notice a few bytes
+	   of garbage between the end of the entropy-coded data and the EOI
+	   marker.  (A decoder that reads one byte at a time can legitimately
+	   absorb up to two of them.) */
+	putenv("TJ_ARITHMETIC=1");
+	for(subsamp=0; subsamp<TJ_NUMSAMP; subsamp++)
+	{
+		if(badBuf) {free(badBuf);  badBuf=NULL;}
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 90)==-1)
+			bailout();
+		_tj(tjValidate(dhandle, jpegBuf, jpegSize, &info));
+		if(info.numWarnings!=0)
+			_throw("tjValidate() reported a problem with an intact arithmetic image");
+		if((badBuf=(unsigned char *)malloc(jpegSize+3))==NULL)
+			_throw("Memory allocation failure");
+		memcpy(badBuf, jpegBuf, jpegSize-2);
+		memset(&badBuf[jpegSize-2], 0x12, 3);
+		memcpy(&badBuf[jpegSize+1], &jpegBuf[jpegSize-2], 2);
+		if(tjValidate(dhandle, badBuf, jpegSize+3, &info)!=-1
+			|| info.numWarnings<1)
+			_throw("tjValidate() ignored extraneous data in an arithmetic image");
+	}
+	printf("Passed.\n");
+
+	bailout:
+	putenv("TJ_ARITHMETIC=");
+	if(srcBuf) free(srcBuf);
+	if(badBuf) free(badBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void previewTest(void)
+{
+	/* 16x16 grayscale progressive JPEG image with 6 scans */
+	static const unsigned char progJPEG[]={
+		0xFF, 0xD8, 0xFF, 0xDB, 0x00, 0x43, 0x00, 0x03, 0x02, 0x02, 0x03, 0x02,
+		0x02, 0x03, 0x03, 0x03, 0x03, 0x04, 0x03, 0x03, 0x04, 0x05, 0x08, 0x05,
+		0x05, 0x04, 0x04, 0x05, 0x0A, 0x07, 0x07, 0x06, 0x08, 0x0C, 0x0A, 0x0C,
+		0x0C, 0x0B, 0x0A, 0x0B, 0x0B, 0x0D, 0x0E, 0x12, 0x10, 0x0D, 0x0E, 0x11,
+		0x0E, 0x0B, 0x0B, 0x10, 0x16, 0x10, 0x11, 0x13, 0x14, 0x15, 0x15, 0x15,
+		0x0C, 0x0F, 0x17, 0x18, 0x16, 0x14, 0x18, 0x12, 0x14, 0x15, 0x14, 0xFF,
+		0xC2, 0x00, 0x0B, 0x08, 0x00, 0x10, 0x00, 0x10, 0x01, 0x01, 0x11, 0x00,
+		0xFF, 0xC4, 0x00, 0x15, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x06, 0xFF,
+		0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x00, 0x01, 0x44, 0x41, 0xAD,
+		0x3F, 0xFF, 0xC4, 0x00, 0x19, 0x10, 0x00, 0x03, 0x01, 0x01, 0x01, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x04,
+		0x05, 0x02, 0x06, 0x01, 0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x01,
+		0x05, 0x02, 0x25, 0xAC, 0xB0, 0x9C, 0xC4, 0xBD, 0xE6, 0x0C, 0x09, 0xA5,
+		0x15, 0x8E, 0x95, 0x9C, 0xDB, 0x4F, 0xFF, 0xC4, 0x00, 0x20, 0x10, 0x00,
+		0x02, 0x00, 0x04, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x11, 0x31, 0x04, 0x14, 0x15,
+		0x32, 0x33, 0x42, 0x51, 0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x06,
+		0x3F, 0x02, 0xD3, 0xFB, 0x58, 0x78, 0x88, 0xEC, 0xCC, 0xDB, 0xE3, 0xAD,
+		0x48, 0x64, 0xC8, 0xDC, 0xBC, 0x3F, 0xFF, 0xC4, 0x00, 0x18, 0x10, 0x00,
+		0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x01, 0x21, 0x11, 0x91, 0xFF, 0xDA, 0x00, 0x08,
+		0x01, 0x01, 0x00, 0x01, 0x3F, 0x21, 0xC6, 0x5A, 0x99, 0x22, 0x1D, 0x68,
+		0xF4, 0xB7, 0xCC, 0x67, 0x4B, 0x56, 0x0F, 0xFF, 0xDA, 0x00, 0x08, 0x01,
+		0x01, 0x00, 0x00, 0x00, 0x10, 0x6F, 0xFF, 0xC4, 0x00, 0x1A, 0x10, 0x00,
+		0x02, 0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x01, 0x11, 0x00, 0x21, 0x31, 0x41, 0x61, 0xFF, 0xDA,
+		0x00, 0x08, 0x01, 0x01, 0x00, 0x01, 0x3F, 0x10, 0x6F, 0xC0, 0xA9, 0xAF,
+		0x20, 0x79, 0x27, 0x29, 0xF5, 0x1D, 0x83, 0xB0, 0xF0, 0xDC, 0x26, 0x00,
+		0x24, 0x34, 0xE7, 0xFF, 0xD9};
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *fullBuf=NULL, *dstBuf=NULL;
+	unsigned long jpegSize=0;
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=16, h=16;
+
+	printf("Progressive preview test ... ");
+	if((dhandle=tjInitDecompress())==NULL) _throwtj();
+	if((fullBuf=(unsigned char *)malloc(w*h))==NULL
+		|| (dstBuf=(unsigned char *)malloc(w*h))==NULL)
+		_throw("Memory allocation failure");
+
+	_tj(tjDecompress2(dhandle, (unsigned char *)progJPEG, sizeof(progJPEG),
+		fullBuf, w, 0, h, TJPF_GRAY, 0));
+	/* With no limits, or with limits that aren't reached, the whole image
+	   should be decoded */
+	_tj(tjDecompressPreview(dhandle, (unsigned char *)progJPEG,
+		sizeof(progJPEG), dstBuf, w, 0, h, TJPF_GRAY, 0, 0, 0));
+	if(memcmp(dstBuf, fullBuf, w*h))
+		_throw("tjDecompressPreview() without limits did not match tjDecompress2()");
+	_tj(tjDecompressPreview(dhandle, (unsigned char *)progJPEG,
+		sizeof(progJPEG), dstBuf, w, 0, h, TJPF_GRAY, 0, 6, sizeof(progJPEG)));
+	if(memcmp(dstBuf, fullBuf, w*h))
+		_throw("tjDecompressPreview() with all scans did not match tjDecompress2()");
+	/* Stopping early should produce a different (coarser) image */
+	_tj(tjDecompressPreview(dhandle, (unsigned char *)progJPEG,
+		sizeof(progJPEG), dstBuf, w, 0, h, TJPF_GRAY, 0, 1, 0));
+	if(!memcmp(dstBuf, fullBuf, w*h))
+		_throw("tjDecompressPreview() did not stop after the first scan");
+	_tj(tjDecompressPreview(dhandle, (unsigned char *)progJPEG,
+		sizeof(progJPEG), dstBuf, w, 0, h, TJPF_GRAY, 0, 0,
+		sizeof(progJPEG)/2));
+	if(!memcmp(dstBuf, fullBuf, w*h))
+		_throw("tjDecompressPreview() did not stop at the byte limit");
+
+	/* A single-scan image should be decoded in full */
+	if(initFixture(&chandle, NULL, &srcBuf, w, h, TJPF_GRAY)==-1
+		|| compFixture(chandle, srcBuf, w, h, TJPF_GRAY, &jpegBuf, &jpegSize,
+			TJSAMP_GRAY, 90)==-1)
+		bailout();
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, fullBuf, w, 0, h, TJPF_GRAY,
+		0));
+	_tj(tjDecompressPreview(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h,
+		TJPF_GRAY, 0, 1, 1));
+	if(memcmp(dstBuf, fullBuf, w*h))
+		_throw("tjDecompressPreview() did not decode a single-scan image in full");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(fullBuf) free(fullBuf);
+	if(dstBuf) free(dstBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+/* Make sure that corrupt data in a progressive AC scan with restart markers
+   isn't mistaken for a marker when the scan is skipped at 1/8 scale */
+void corruptRestartTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *refBuf=NULL, *dstBuf=NULL;
+	unsigned long jpegSize=0, i, lastSOS=0;
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=48, h=48, sw=6, sh=6, retval;
+
+	printf("Corrupt restart marker test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((refBuf=(unsigned char *)malloc(sw*sh*3))==NULL
+		|| (dstBuf=(unsigned char *)malloc(sw*sh*3))==NULL)
+		_throw("Memory allocation failure");
+
+	putenv("TJ_PROGRESSIVE=1");
+	putenv("TJ_RESTART=1");
+	retval=compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+		TJSAMP_444, 90);
+	putenv("TJ_PROGRESSIVE=");
+	putenv("TJ_RESTART=");
+	if(retval==-1) bailout();
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, refBuf, sw, 0, sh, TJPF_RGB,
+		0));
+
+	/* Replace the first restart marker in the last scan (a luminance AC scan)
+	   with 0xFF7F, which is not a valid marker */
+	for(i=0; i<jpegSize-1; i++)
+		if(jpegBuf[i]==0xFF && jpegBuf[i+1]==0xDA) lastSOS=i;
+	for(i=lastSOS; i<jpegSize-1; i++)
+		if(jpegBuf[i]==0xFF && (jpegBuf[i+1]&0xF8)==0xD0) break;
+	if(lastSOS==0 || i>=jpegSize-1)
+		_throw("Could not find a restart marker in the last scan");
+	jpegBuf[i+1]=0x7F;
+
+	/* The AC scans aren't needed at 1/8 scale, so the corrupt marker should
+	   cause only a warning, and the output should be unchanged. */
+	_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, sw, 0, sh, TJPF_RGB,
+		0));
+	if(memcmp(dstBuf, refBuf, sw*sh*3))
+		_throw("Corrupt AC scan changed the output at 1/8 scale");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(refBuf) free(refBuf);
+	if(dstBuf) free(dstBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void arithTransformTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *arithBuf=NULL,
+		*fullBufs[2]={NULL, NULL}, *huffBuf=NULL;
+	unsigned long jpegSize=0, arithSize=0, fullSizes[2]={0, 0}, huffSize=0;
+	tjhandle chandle=NULL, thandle=NULL;
+	tjtransform xform[2], plain;
+	int subsamp, w=67, h=53;
+
+	printf("Arithmetic transform test ... ");
+	if(initFixture(&chandle, NULL, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((thandle=tjInitTransform())==NULL) _throwtj();
+	memset(xform, 0, sizeof(tjtransform)*2);
+	memset(&plain, 0, sizeof(tjtransform));
+	xform[0].options=xform[1].options=TJXOPT_ARITHMETIC;
+
+	for(subsamp=0; subsamp<TJ_NUMSAMP; subsamp++)
+	{
+		if(arithBuf) {tjFree(arithBuf);  arithBuf=NULL;}
+		if(fullBufs[0]) {tjFree(fullBufs[0]);  fullBufs[0]=NULL;}
+		if(fullBufs[1]) {tjFree(fullBufs[1]);  fullBufs[1]=NULL;}
+		if(huffBuf) {tjFree(huffBuf);  huffBuf=NULL;}
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 90)==-1)
+			bailout();
+
+		/* A single transform is performed one iMCU row at a time, whereas two
+		   transforms require the whole image to be read first.  The results
+		   should be identical. */
+		_tj(tjTransform(thandle, jpegBuf, jpegSize, 1, &arithBuf, &arithSize,
+			xform, 0));
+		_tj(tjTransform(thandle, jpegBuf, jpegSize, 2, fullBufs, fullSizes,
+			xform, 0));
+		if(arithSize!=fullSizes[0] || memcmp(arithBuf, fullBufs[0], arithSize))
+			_throw("Streaming arithmetic transform did not match full transform");
+
+		/* Converting back to Huffman coding should reproduce the original */
+		_tj(tjTransform(thandle, arithBuf, arithSize, 1, &huffBuf, &huffSize,
+			&plain, 0));
+		if(huffSize!=jpegSize || memcmp(huffBuf, jpegBuf, jpegSize))
+			_throw("Huffman -> arithmetic -> Huffman transform was not lossless");
+	}
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(arithBuf) tjFree(arithBuf);
+	if(fullBufs[0]) tjFree(fullBufs[0]);
+	if(fullBufs[1]) tjFree(fullBufs[1]);
+	if(huffBuf) tjFree(huffBuf);
+	if(chandle) tjDestroy(chandle);
+	if(thandle) tjDestroy(thandle);
+}
+
+void compressToSizeTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *dstBuf=NULL;
+	unsigned long jpegSize=0, loSize, hiSize, targetSize;
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=97, h=83, i, qual, subsamp, subsamps[3]={TJSAMP_444, TJSAMP_420,
+		TJSAMP_GRAY};
+
+	printf("Compress-to-size test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((dstBuf=(unsigned char *)malloc(w*h*3))==NULL)
+		_throw("Memory allocation failure");
+	/* Add some detail, so that the size depends strongly on the quality */
+	for(i=0; i<w*h*3; i++) srcBuf[i]^=(unsigned char)(rand()&31);
+
+	for(i=0; i<3; i++)
+	{
+		int jpegWidth, jpegHeight, jpegSubsamp;
+		subsamp=subsamps[i];
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 10)==-1)
+			bailout();
+		loSize=jpegSize;
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 95)==-1)
+			bailout();
+		hiSize=jpegSize;
+		targetSize=(loSize+hiSize)/2;
+		qual=-1;
+		_tj(tjCompressToSize(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+			&jpegSize, subsamp, targetSize, &qual, 0));
+		if(jpegSize>targetSize)
+			_throw("tjCompressToSize() exceeded the target size");
+		if(qual<10 || qual>95)
+			_throw("tjCompressToSize() chose an unexpected quality");
+		_tj(tjDecompressHeader2(dhandle, jpegBuf, jpegSize, &jpegWidth,
+			&jpegHeight, &jpegSubsamp));
+		if(jpegWidth!=w || jpegHeight!=h || jpegSubsamp!=subsamp)
+			_throw("tjCompressToSize() generated an incorrect header");
+		_tj(tjDecompress2(dhandle, jpegBuf, jpegSize, dstBuf, w, 0, h, TJPF_RGB,
+			0));
+	}
+
+	/* A target that cannot be reached should produce an error */
+	if(tjCompressToSize(chandle, srcBuf, w, 0, h, TJPF_RGB, &jpegBuf,
+		&jpegSize, TJSAMP_444, 100, &qual, 0)!=-1)
+		_throw("tjCompressToSize() accepted an unreachable target size");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(dstBuf) free(dstBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void compressMultiTest(void)
+{
+	unsigned char *srcBuf=NULL, *dstBuf=NULL, *jpegBufs[4]={NULL, NULL, NULL,
+		NULL};
+	unsigned long jpegSizes[4]={0, 0, 0, 0};
+	tjqualitylevel levels[4]={{90, 0}, {75, TJQOPT_OPTIMIZE}, {75, 0},
+		{50, TJQOPT_PROGRESSIVE}};
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=97, h=83, i, j, subsamps[3]={TJSAMP_444, TJSAMP_420, TJSAMP_GRAY};
+
+	printf("Multi-quality compression test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((dstBuf=(unsigned char *)malloc(w*h*3))==NULL)
+		_throw("Memory allocation failure");
+
+	for(i=0; i<3; i++)
+	{
+		_tj(tjCompressMulti(chandle, srcBuf, w, 0, h, TJPF_RGB, 4, jpegBufs,
+			jpegSizes, subsamps[i], levels, 0));
+		for(j=0; j<4; j++)
+		{
+			int jpegWidth, jpegHeight, jpegSubsamp;
+			_tj(tjDecompressHeader2(dhandle, jpegBufs[j], jpegSizes[j], &jpegWidth,
+				&jpegHeight, &jpegSubsamp));
+			if(jpegWidth!=w || jpegHeight!=h || jpegSubsamp!=subsamps[i])
+				_throw("tjCompressMulti() generated an incorrect header");
+			_tj(tjDecompress2(dhandle, jpegBufs[j], jpegSizes[j], dstBuf, w, 0, h,
+				TJPF_RGB, 0));
+		}
+		if(jpegSizes[0]<=jpegSizes[2] || jpegSizes[2]<=jpegSizes[3])
+			_throw("tjCompressMulti() did not honor the quality levels");
+		if(jpegSizes[1]>jpegSizes[2])
+			_throw("tjCompressMulti() did not optimize the Huffman tables");
+	}
+
+	levels[3].quality=0;
+	if(tjCompressMulti(chandle, srcBuf, w, 0, h, TJPF_RGB, 4, jpegBufs,
+		jpegSizes, TJSAMP_444, levels, 0)!=-1)
+		_throw("tjCompressMulti() accepted an invalid quality");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(dstBuf) free(dstBuf);
+	for(i=0; i<4; i++) if(jpegBufs[i]) tjFree(jpegBufs[i]);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void decompressScalesTest(void)
+{
+	unsigned char *srcBuf=NULL, *jpegBufs[2]={NULL, NULL}, *refBuf=NULL,
+		*dstBufs[5]={NULL, NULL, NULL, NULL, NULL};
+	unsigned long jpegSizes[2]={0, 0};
+	/* Start with 1/8, which uses only the DC coefficients */
+	tjscalingfactor sfs[5]={{1, 8}, {1, 1}, {1, 2}, {3, 8}, {1, 4}};
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=97, h=83, i, j, k, flags,
+		subsamps[3]={TJSAMP_444, TJSAMP_420, TJSAMP_GRAY};
+
+	printf("Multi-scale decompression test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((refBuf=(unsigned char *)malloc(w*h*3))==NULL)
+		_throw("Memory allocation failure");
+	for(i=0; i<5; i++)
+	{
+		if((dstBufs[i]=(unsigned char *)malloc(TJSCALED(w, sfs[i])*3
+			*TJSCALED(h, sfs[i])))==NULL)
+			_throw("Memory allocation failure");
+	}
+
+	for(i=0; i<3; i++)
+	{
+		/* Generate a baseline and a progressive JPEG image */
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBufs[0],
+			&jpegSizes[0], subsamps[i], 85)==-1)
+			bailout();
+		putenv("TJ_PROGRESSIVE=1");
+		j=compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBufs[1],
+			&jpegSizes[1], subsamps[i], 85);
+		putenv("TJ_PROGRESSIVE=");
+		if(j==-1) bailout();
+		for(j=0; j<2; j++)
+		{
+			/* Each scaled image must match what tjDecompress2() produces */
+			flags=(j==0? 0:TJFLAG_BOTTOMUP);
+			_tj(tjDecompressScales(dhandle, jpegBufs[j], jpegSizes[j], 5, dstBufs,
+				sfs, TJPF_BGR, flags));
+			for(k=0; k<5; k++)
+			{
+				int sw=TJSCALED(w, sfs[k]), sh=TJSCALED(h, sfs[k]);
+				_tj(tjDecompress2(dhandle, jpegBufs[j], jpegSizes[j], refBuf, sw, 0,
+					sh, TJPF_BGR, flags));
+				if(memcmp(dstBufs[k], refBuf, sw*sh*3))
+					_throw("tjDecompressScales() did not match tjDecompress2()");
+			}
+		}
+	}
+
+	sfs[4].num=5;  sfs[4].denom=7;
+	if(tjDecompressScales(dhandle, jpegBufs[0], jpegSizes[0], 5, dstBufs, sfs,
+		TJPF_BGR, 0)!=-1)
+		_throw("tjDecompressScales() accepted an invalid scaling factor");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(refBuf) free(refBuf);
+	for(i=0; i<5; i++) if(dstBufs[i]) free(dstBufs[i]);
+	for(i=0; i<2; i++) if(jpegBufs[i]) tjFree(jpegBufs[i]);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
+
+void pyramidTest(void)
+{
+	unsigned char *srcBuf=NULL, *levelBuf=NULL, *refBuf=NULL,
+		*jpegBufs[4]={NULL, NULL, NULL, NULL}, *refJPEG=NULL;
+	unsigned long jpegSizes[4]={0, 0, 0, 0}, refSize=0;
+	tjhandle chandle=NULL;
+	int w=97, h=83, i, level, x, y, c, lw, lh,
+		subsamps[2]={TJSAMP_420, TJSAMP_GRAY};
+
+	printf("Image pyramid compression test ... ");
+	if(initFixture(&chandle, NULL, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((levelBuf=(unsigned char *)malloc(w*h*3))==NULL
+		|| (refBuf=(unsigned char *)malloc(w*h*3))==NULL)
+		_throw("Memory allocation failure");
+
+	for(i=0; i<2; i++)
+	{
+		_tj(tjCompressPyramid(chandle, srcBuf, w, 0, h, TJPF_RGB, 4, jpegBufs,
+			jpegSizes, subsamps[i], 90, 0));
+
+		/* Each level must be identical to compressing the downsampled image
+		   with tjCompress2() */
+		memcpy(levelBuf, srcBuf, w*h*3);
+		lw=w;  lh=h;
+		for(level=0; level<4; level++)
+		{
+			if(level>0)
+			{
+				int dw=TJPYRAMIDSCALED(w, level), dh=TJPYRAMIDSCALED(h, level);
+				for(y=0; y<dh; y++)
+				{
+					int y1=min(y*2+1, lh-1);
+					for(x=0; x<dw; x++)
+					{
+						int x1=min(x*2+1, lw-1);
+						for(c=0; c<3; c++)
+							refBuf[(y*dw+x)*3+c]=(levelBuf[(y*2*lw+x*2)*3+c]
+								+levelBuf[(y*2*lw+x1)*3+c]+levelBuf[(y1*lw+x*2)*3+c]
+								+levelBuf[(y1*lw+x1)*3+c]+1+(x&1))>>2;
+					}
+				}
+				lw=dw;  lh=dh;
+				memcpy(levelBuf, refBuf, lw*lh*3);
+			}
+			if(compFixture(chandle, levelBuf, lw, lh, TJPF_RGB, &refJPEG, &refSize,
+				subsamps[i], 90)==-1)
+				bailout();
+			if(jpegSizes[level]!=refSize
+				|| memcmp(jpegBufs[level], refJPEG, refSize))
+				_throw("tjCompressPyramid() did not match tjCompress2()");
+		}
+	}
+
+	if(tjCompressPyramid(chandle, srcBuf, w, 0, h, TJPF_RGB, 0, jpegBufs,
+		jpegSizes, TJSAMP_444, 90, 0)!=-1)
+		_throw("tjCompressPyramid() accepted an invalid number of levels");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(levelBuf) free(levelBuf);
+	if(refBuf) free(refBuf);
+	for(i=0; i<4; i++) if(jpegBufs[i]) tjFree(jpegBufs[i]);
+	if(refJPEG) tjFree(refJPEG);
+	if(chandle) tjDestroy(chandle);
+}
+
+void yuvLayoutTest(void)
+{
+	/* Plane, offset, and step of each component in each YUV layout */
+	const int plane[TJ_NUMYUV][3]={{0, 1, 1}, {0, 1, 1}, {0, 0, 0}, {0, 0, 0}};
+	const int offset[TJ_NUMYUV][3]={{0, 0, 1}, {0, 1, 0}, {0, 1, 3}, {1, 0, 2}};
+	const int step[TJ_NUMYUV][3]={{1, 2, 2}, {1, 2, 2}, {2, 4, 4}, {2, 4, 4}};
+	unsigned char *srcBuf=NULL, *jpegBuf=NULL, *refJPEG=NULL, *yuvJPEG=NULL,
+		*yuvBuf=NULL, *refBuf=NULL, *refPlanes[3], *layoutPlanes[2];
+	unsigned long jpegSize=0, refSize=0, yuvSize=0;
+	tjscalingfactor sf={3, 8};
+	tjhandle chandle=NULL, dhandle=NULL;
+	int w=97, h=83, layout, subsamp, i, x, y, c, sw, sh, strides[2];
+
+	printf("Interleaved YUV layout test ... ");
+	if(initFixture(&chandle, &dhandle, &srcBuf, w, h, TJPF_RGB)==-1)
+		bailout();
+	if((refBuf=(unsigned char *)malloc(tjBufSizeYUV2(w, 1, h, TJSAMP_444)))
+			==NULL
+		|| (yuvBuf=(unsigned char *)malloc((w*2+16)*(h+1)*2))==NULL)
+		_throw("Memory allocation failure");
+
+	for(layout=0; layout<TJ_NUMYUV; layout++)
+	{
+		subsamp=tjYUVSubsamp[layout];
+		if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+			subsamp, 90)==-1)
+			bailout();
+
+		/* Decompress at full size and at 3/8 scale, and compare each component
+		   with the output of tjDecompressToYUVPlanes() */
+		for(i=0; i<2; i++)
+		{
+			sw=(i==0? w:TJSCALED(w, sf));
+			sh=(i==0? h:TJSCALED(h, sf));
+			refPlanes[0]=refBuf;
+			refPlanes[1]=refPlanes[0]+tjPlaneSizeYUV(0, sw, 0, sh, subsamp);
+			refPlanes[2]=refPlanes[1]+tjPlaneSizeYUV(1, sw, 0, sh, subsamp);
+			_tj(tjDecompressToYUVPlanes(dhandle, jpegBuf, jpegSize, refPlanes, sw,
+				NULL, sh, 0));
+			/* Pad each line of the interleaved planes by a few bytes */
+			strides[0]=tjPlaneWidth(0, sw, subsamp)*step[layout][0]+3;
+			strides[1]=tjPlaneWidth(1, sw, subsamp)*2+5;
+			layoutPlanes[0]=yuvBuf;
+			layoutPlanes[1]=yuvBuf+strides[0]*tjPlaneHeight(0, sh, subsamp);
+			_tj(tjDecompressToYUVLayout(dhandle, jpegBuf, jpegSize, layoutPlanes,
+				sw, strides, sh, layout, 0));
+			for(c=0; c<3; c++)
+			{
+				int pw=tjPlaneWidth(c, sw, subsamp), ph=tjPlaneHeight(c, sh, subsamp);
+				for(y=0; y<ph; y++)
+				{
+					for(x=0; x<pw; x++)
+					{
+						if(layoutPlanes[plane[layout][c]][y*strides[plane[layout][c]]
+							+offset[layout][c]+x*step[layout][c]]!=refPlanes[c][y*pw+x])
+							_throw("tjDecompressToYUVLayout() did not match tjDecompressToYUVPlanes()");
+					}
+				}
+			}
+			if(i>0) continue;
+
+			/* Compressing the full-size image must produce the same JPEG image as
+			   tjCompressFromYUVPlanes() */
+			_tj(tjCompressFromYUVPlanes(chandle, refPlanes, w, NULL, h, subsamp,
+				&refJPEG, &refSize, 90, 0));
+			_tj(tjCompressFromYUVLayout(chandle, layoutPlanes, w, strides, h,
+				layout, &yuvJPEG, &yuvSize, 90, 0));
+			if(yuvSize!=refSize || memcmp(yuvJPEG, refJPEG, refSize))
+				_throw("tjCompressFromYUVLayout() did not match tjCompressFromYUVPlanes()");
+		}
+	}
+
+	/* A 4:2:0 JPEG image cannot be decompressed to a 4:2:2 layout */
+	if(compFixture(chandle, srcBuf, w, h, TJPF_RGB, &jpegBuf, &jpegSize,
+		TJSAMP_420, 90)==-1)
+		bailout();
+	if(tjDecompressToYUVLayout(dhandle, jpegBuf, jpegSize, layoutPlanes, w,
+		NULL, h, TJYUV_YUYV, 0)!=-1
+		|| tjDecompressToYUVLayout(dhandle, jpegBuf, jpegSize, layoutPlanes, w,
+			NULL, h, TJ_NUMYUV, 0)!=-1)
+		_throw("tjDecompressToYUVLayout() accepted an invalid layout");
+	printf("Passed.\n");
+
+	bailout:
+	if(srcBuf) free(srcBuf);
+	if(refBuf) free(refBuf);
+	if(yuvBuf) free(yuvBuf);
+	if(jpegBuf) tjFree(jpegBuf);
+	if(refJPEG) tjFree(refJPEG);
+	if(yuvJPEG) tjFree(yuvJPEG);
+	if(chandle) tjDestroy(chandle);
+	if(dhandle) tjDestroy(dhandle);
+}
 
 int main(int argc, char *argv[])
 {
@@ -719,6 +1614,19 @@ int main(int argc, char *argv[])
 	doTest(41, 35, _3byteFormats, 2, TJSAMP_GRAY, "test");
 	doTest(35, 39, _4byteFormats, 4, TJSAMP_GRAY, "test");
 	bufSizeTest();
+	bufReuseTest();
+	memStatsTest();
+	decompCostTest();
+	probeHeaderTest();
+	validateTest();
+	previewTest();
+	corruptRestartTest();
+	arithTransformTest();
+	compressToSizeTest();
+	compressMultiTest();
+	decompressScalesTest();
+	pyramidTest();
+	yuvLayoutTest();
 	if(doyuv)
 	{
 		printf("\n--------------------\n\n");
@@ -54,11 +54,19 @@ double gettime(void)
 #else
 
 #include <stdlib.h>
+#include <time.h>
 #include <sys/time.h>
 
 double gettime(void)
 {
 	struct timeval tv;
+	#ifdef CLOCK_MONOTONIC
+	/* Prefer a monotonic clock, so that the benchmark timings are immune to
+	   wall clock adjustments (NTP, etc.) */
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts)==0)
+		return (double)ts.tv_sec+((double)ts.tv_nsec/1000000000.);
+	#endif
 	if(gettimeofday(&tv, NULL)<0) return 0.0;
 	else return (double)tv.tv_sec+((double)tv.tv_usec/1000000.);
 }
@@ -41,6 +41,13 @@
 #include "./tjutil.h"
 #include "transupp.h"
 #include "./jpegcomp.h"
+#include "./jtrace.h"
+#include "jconfigint.h"
+#ifdef WITH_THREADS
+#include "jthread.h"
+#endif
+#include "jpeg_nbits_table.h"
+#define JPEG_NBITS(x) (jpeg_nbits_table[x])
 
 extern void jpeg_mem_dest_tj(j_compress_ptr, unsigned char **,
 	unsigned long *, boolean);
@@ -118,6 +125,8 @@ static const tjscalingfactor sf[NUMSF]={
 
 #define _throw(m) {snprintf(errStr, JMSG_LENGTH_MAX, "%s", m);  \
 	retval=-1;  goto bailout;}
+#define _throwfn(m) {snprintf(errStr, JMSG_LENGTH_MAX, "%s(): %s", funcName,  \
+	m);  retval=-1;  goto bailout;}
 #define getinstance(handle) tjinstance *this=(tjinstance *)handle;  \
 	j_compress_ptr cinfo=NULL;  j_decompress_ptr dinfo=NULL;  \
 	if(!this) {snprintf(errStr, JMSG_LENGTH_MAX, "Invalid handle");  \
@@ -158,6 +167,13 @@ static int getPixelFormat(int pixelSize, int flags)
 	return -1;
 }
 
+static void resetMemoryStats(tjinstance *this)
+{
+	if(this->init&COMPRESS) jpeg_reset_memory_stats((j_common_ptr)&this->cinfo);
+	if(this->init&DECOMPRESS)
+		jpeg_reset_memory_stats((j_common_ptr)&this->dinfo);
+}
+
 static int setCompDefaults(struct jpeg_compress_struct *cinfo,
 	int pixelFormat, int subsamp, int jpegQual, int flags)
 {
@@ -313,7 +329,8 @@ static int setDecompDefaults(struct jpeg_decompress_struct *dinfo,
 }
 
 
-static int getSubsamp(j_decompress_ptr dinfo)
+static int getSubsampFromFactors(int numComponents, J_COLOR_SPACE colorspace,
+	const int *hSampFactor, const int *vSampFactor)
 {
 	int retval=-1, i, k;
 
@@ -321,32 +338,30 @@ static int getSubsamp(j_decompress_ptr dinfo)
 	   and in fact it's possible to generate grayscale JPEGs with sampling
 	   factors > 1 (even though those sampling factors are ignored by the
 	   decompressor.)  Thus, we need to treat grayscale as a special case. */
-	if(dinfo->num_components==1 && dinfo->jpeg_color_space==JCS_GRAYSCALE)
+	if(numComponents==1 && colorspace==JCS_GRAYSCALE)
 		return TJSAMP_GRAY;
 
 	for(i=0; i<NUMSUBOPT; i++)
 	{
-		if(dinfo->num_components==pixelsize[i]
-			|| ((dinfo->jpeg_color_space==JCS_YCCK
-				|| dinfo->jpeg_color_space==JCS_CMYK)
-					&& pixelsize[i]==3 && dinfo->num_components==4))
+		if(numComponents==pixelsize[i]
+			|| ((colorspace==JCS_YCCK || colorspace==JCS_CMYK)
+					&& pixelsize[i]==3 && numComponents==4))
 		{
-			if(dinfo->comp_info[0].h_samp_factor==tjMCUWidth[i]/8
-				&& dinfo->comp_info[0].v_samp_factor==tjMCUHeight[i]/8)
+			if(hSampFactor[0]==tjMCUWidth[i]/8
+				&& vSampFactor[0]==tjMCUHeight[i]/8)
 			{
 				int match=0;
-				for(k=1; k<dinfo->num_components; k++)
+				for(k=1; k<numComponents; k++)
 				{
 					int href=1, vref=1;
-					if(dinfo->jpeg_color_space==JCS_YCCK && k==3)
+					if(colorspace==JCS_YCCK && k==3)
 					{
 						href=tjMCUWidth[i]/8;  vref=tjMCUHeight[i]/8;
 					}
-					if(dinfo->comp_info[k].h_samp_factor==href
-						&& dinfo->comp_info[k].v_samp_factor==vref)
+					if(hSampFactor[k]==href && vSampFactor[k]==vref)
 						match++;
 				}
-				if(match==dinfo->num_components-1)
+				if(match==numComponents-1)
 				{
 					retval=i;  break;
 				}
@@ -356,6 +371,33 @@ static int getSubsamp(j_decompress_ptr dinfo)
 	return retval;
 }
 
+static int getSubsamp(j_decompress_ptr dinfo)
+{
+	int hSampFactor[MAX_COMPONENTS], vSampFactor[MAX_COMPONENTS], i;
+
+	for(i=0; i<dinfo->num_components && i<MAX_COMPONENTS; i++)
+	{
+		hSampFactor[i]=dinfo->comp_info[i].h_samp_factor;
+		vSampFactor[i]=dinfo->comp_info[i].v_samp_factor;
+	}
+	return getSubsampFromFactors(dinfo->num_components, dinfo->jpeg_color_space,
+		hSampFactor, vSampFactor);
+}
+
+
+static int getColorspace(J_COLOR_SPACE colorspace)
+{
+	switch(colorspace)
+	{
+		case JCS_GRAYSCALE:  return TJCS_GRAY;
+		case JCS_RGB:        return TJCS_RGB;
+		case JCS_YCbCr:      return TJCS_YCbCr;
+		case JCS_CMYK:       return TJCS_CMYK;
+		case JCS_YCCK:       return TJCS_YCCK;
+		default:             return -1;
+	}
+}
+
 
 #ifndef JCS_EXTENSIONS
 
@@ -519,6 +561,39 @@ DLLEXPORT int DLLCALL tjDestroy(tjhandle handle)
 }
 
 
+DLLEXPORT int DLLCALL tjGetMemoryStats(tjhandle handle, tjmemstats *stats)
+{
+	jpeg_memory_stats jstats;
+	int i, retval=0;
+
+	getinstance(handle);
+	if(stats==NULL) _throw("tjGetMemoryStats(): Invalid argument");
+
+	memset(stats, 0, sizeof(tjmemstats));
+	if(this->init&COMPRESS)
+	{
+		jpeg_get_memory_stats((j_common_ptr)cinfo, &jstats);
+		stats->peakBytes+=(unsigned long)jstats.peak_bytes;
+		stats->currentBytes+=(unsigned long)jstats.current_bytes;
+		for(i=0; i<JPOOL_NUMPOOLS; i++)
+			stats->numAllocs+=jstats.small_allocs[i]+jstats.large_allocs[i];
+		stats->virtArrayBytes+=(unsigned long)jstats.virt_array_bytes;
+	}
+	if(this->init&DECOMPRESS)
+	{
+		jpeg_get_memory_stats((j_common_ptr)dinfo, &jstats);
+		stats->peakBytes+=(unsigned long)jstats.peak_bytes;
+		stats->currentBytes+=(unsigned long)jstats.current_bytes;
+		for(i=0; i<JPOOL_NUMPOOLS; i++)
+			stats->numAllocs+=jstats.small_allocs[i]+jstats.large_allocs[i];
+		stats->virtArrayBytes+=(unsigned long)jstats.virt_array_bytes;
+	}
+
+	bailout:
+	return retval;
+}
+
+
 /* These are exposed mainly because Windows can't malloc() and free() across
    DLL boundaries except when the CRT DLL is used, and we don't use the CRT DLL
    with turbojpeg.dll for compatibility reasons.  However, these functions
@@ -720,8 +795,10 @@ DLLEXPORT int DLLCALL tjCompress2(tjhandle handle, unsigned char *srcBuf,
 	#endif
 
 	getcinstance(handle)
+	TJTRACE4(api__entry, "tjCompress2", width, height, 0);
 	if((this->init&COMPRESS)==0)
 		_throw("tjCompress2(): Instance has not been initialized for compression");
+	resetMemoryStats(this);
 
 	if(srcBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
 		|| pixelFormat>=TJ_NUMPF || jpegBuf==NULL || jpegSize==NULL
@@ -783,6 +860,8 @@ DLLEXPORT int DLLCALL tjCompress2(tjhandle handle, unsigned char *srcBuf,
 	if(rgbBuf) free(rgbBuf);
 	#endif
 	if(row_pointer) free(row_pointer);
+	TJTRACE5(api__return, "tjCompress2", retval, width, height,
+		jpegSize ? *jpegSize : 0);
 	return retval;
 }
 
@@ -807,6 +886,839 @@ DLLEXPORT int DLLCALL tjCompress(tjhandle handle, unsigned char *srcBuf,
 	return retval;
 }
 
+/* tjCompressToSize() and tjCompressMulti() perform color conversion and the
+   forward DCT only once, using unit quantization tables, and they cache the
+   resulting coefficients.  The coefficients can then be requantized and
+   entropy-coded at any number of quality levels.  tjCompressToSize() also
+   uses them to estimate the size of the JPEG image at each candidate quality
+   from the code lengths in the standard Huffman tables, so the image need
+   only be entropy-coded once. */
+
+typedef struct
+{
+	struct jpeg_destination_mgr pub;
+	JOCTET buffer[256];
+	unsigned long count;
+} tjcountdest;
+
+static void countInit(j_compress_ptr cinfo)
+{
+	tjcountdest *dest=(tjcountdest *)cinfo->dest;
+	dest->pub.next_output_byte=dest->buffer;
+	dest->pub.free_in_buffer=sizeof(dest->buffer);
+}
+
+static boolean countEmpty(j_compress_ptr cinfo)
+{
+	tjcountdest *dest=(tjcountdest *)cinfo->dest;
+	dest->count+=sizeof(dest->buffer);
+	dest->pub.next_output_byte=dest->buffer;
+	dest->pub.free_in_buffer=sizeof(dest->buffer);
+	return TRUE;
+}
+
+static void countTerm(j_compress_ptr cinfo)
+{
+}
+
+typedef struct
+{
+	/* Unquantized coefficients for each component.  The arrays are padded to
+	   a whole number of MCUs. */
+	JCOEF *coefs[MAX_COMPONENTS];
+	JDIMENSION blocksWide[MAX_COMPONENTS], blocksHigh[MAX_COMPONENTS];
+	/* Geometry of the (single) scan */
+	int compsInScan, compIndex[MAX_COMPS_IN_SCAN];
+	int mcuWidth[MAX_COMPS_IN_SCAN], mcuHeight[MAX_COMPS_IN_SCAN];
+	JDIMENSION mcusPerRow, mcuRows, mcuCount;
+	/* Size of the markers preceding the entropy-coded data */
+	unsigned long headerSize;
+	/* State of the compressor that is swapped out during the capture pass */
+	tjcountdest countDest;
+	struct jpeg_destination_mgr *savedDest;
+	void *savedClientData;
+	boolean capturing;
+} tjcoefcache;
+
+/* This replaces the entropy encoder's encode_mcu() method during the capture
+   pass. */
+static boolean cacheMCU(j_compress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+	tjcoefcache *cache=(tjcoefcache *)cinfo->client_data;
+	JDIMENSION mcuRow=cache->mcuCount/cache->mcusPerRow,
+		mcuCol=cache->mcuCount%cache->mcusPerRow;
+	int ci, x, y, blkn=0;
+
+	for(ci=0; ci<cache->compsInScan; ci++)
+	{
+		int c=cache->compIndex[ci];
+		for(y=0; y<cache->mcuHeight[ci]; y++)
+		{
+			JCOEF *dst=cache->coefs[c]+((size_t)(mcuRow*cache->mcuHeight[ci]+y)
+				*cache->blocksWide[c]+mcuCol*cache->mcuWidth[ci])*DCTSIZE2;
+			for(x=0; x<cache->mcuWidth[ci]; x++, blkn++, dst+=DCTSIZE2)
+				memcpy(dst, MCU_data[blkn][0], sizeof(JBLOCK));
+		}
+	}
+	cache->mcuCount++;
+	return TRUE;
+}
+
+/* Compress the image using the parameters in cinfo, but divert the DCT
+   coefficients into the cache rather than entropy-coding them.  The caller
+   should have selected unit quantization tables and a single-scan image. */
+static void cacheCoefficients(j_compress_ptr cinfo, JSAMPROW *row_pointer,
+	tjcoefcache *cache)
+{
+	int i;
+
+	memset(&cache->countDest, 0, sizeof(tjcountdest));
+	cache->countDest.pub.init_destination=countInit;
+	cache->countDest.pub.empty_output_buffer=countEmpty;
+	cache->countDest.pub.term_destination=countTerm;
+	cache->savedDest=cinfo->dest;
+	cache->savedClientData=cinfo->client_data;
+	cache->capturing=TRUE;
+	cinfo->dest=&cache->countDest.pub;
+
+	jpeg_start_compress(cinfo, TRUE);
+	cache->compsInScan=cinfo->comps_in_scan;
+	for(i=0; i<cinfo->comps_in_scan; i++)
+	{
+		jpeg_component_info *compptr=cinfo->cur_comp_info[i];
+		int c=compptr->component_index;
+		size_t size;
+		cache->compIndex[i]=c;
+		cache->mcuWidth[i]=compptr->MCU_width;
+		cache->mcuHeight[i]=compptr->MCU_height;
+		cache->blocksWide[c]=cinfo->MCUs_per_row*compptr->MCU_width;
+		cache->blocksHigh[c]=cinfo->MCU_rows_in_scan*compptr->MCU_height;
+		size=(size_t)cache->blocksWide[c]*cache->blocksHigh[c]*DCTSIZE2;
+		if((cache->coefs[c]=(JCOEF *)malloc(size*sizeof(JCOEF)))==NULL)
+			ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+	}
+	cache->mcusPerRow=cinfo->MCUs_per_row;
+	cache->mcuRows=cinfo->MCU_rows_in_scan;
+	cache->mcuCount=0;
+	cinfo->client_data=(void *)cache;
+	cinfo->entropy->encode_mcu=cacheMCU;
+
+	while(cinfo->next_scanline<cinfo->image_height)
+	{
+		jpeg_write_scanlines(cinfo, &row_pointer[cinfo->next_scanline],
+			cinfo->image_height-cinfo->next_scanline);
+	}
+	/* Only the markers have been written to the destination manager. */
+	cache->headerSize=cache->countDest.count+sizeof(cache->countDest.buffer)
+		-cache->countDest.pub.free_in_buffer;
+	jpeg_abort_compress(cinfo);
+	cinfo->dest=cache->savedDest;  cinfo->client_data=cache->savedClientData;
+	cache->capturing=FALSE;
+}
+
+/* Restore the compressor (if an error occurred during the capture pass) and
+   free the cache */
+static void releaseCache(j_compress_ptr cinfo, tjcoefcache *cache)
+{
+	int i;
+
+	if(cache->capturing)
+	{
+		if(cinfo->global_state>CSTATE_START) jpeg_abort_compress(cinfo);
+		cinfo->dest=cache->savedDest;  cinfo->client_data=cache->savedClientData;
+		cache->capturing=FALSE;
+	}
+	for(i=0; i<MAX_COMPONENTS; i++)
+	{
+		if(cache->coefs[i]) free(cache->coefs[i]);
+		cache->coefs[i]=NULL;
+	}
+}
+
+/* Quantization is performed using a reciprocal multiply, which is exact as
+   long as the dividend is less than 4096.  That covers the full range of
+   8-bit DCT coefficients (which are at most 11 bits in magnitude), plus the
+   rounding term. */
+#define RECIP_SHIFT  20
+
+typedef struct
+{
+	unsigned int recip[DCTSIZE2], half[DCTSIZE2];
+} tjquant;
+
+static void setQuant(tjquant *quant, JQUANT_TBL *qtbl)
+{
+	int k;
+	for(k=0; k<DCTSIZE2; k++)
+	{
+		unsigned int q=qtbl->quantval[k];
+		quant->half[k]=(q-1)>>1;
+		quant->recip[k]=(1U<<RECIP_SHIFT)/q+1;
+	}
+}
+
+/* Quantize a block of cached coefficients, storing the magnitudes */
+static void quantizeBlock(const tjquant *quant, const JCOEF *block,
+	unsigned int *mag)
+{
+	int k;
+	for(k=0; k<DCTSIZE2; k++)
+	{
+		int c=block[k];
+		unsigned int temp=(unsigned int)(c<0? -c:c);
+		mag[k]=((temp+quant->half[k])*quant->recip[k])>>RECIP_SHIFT;
+	}
+}
+
+/* Quantize rows of cached coefficients for component ci, using the
+   quantization table currently assigned to that component */
+static void quantizeRows(j_compress_ptr cinfo, tjcoefcache *cache, int ci,
+	JDIMENSION startRow, int numRows, JBLOCKARRAY buffer)
+{
+	jpeg_component_info *compptr=&cinfo->comp_info[ci];
+	tjquant quant;  JDIMENSION bx;  int y, k;
+
+	setQuant(&quant, cinfo->quant_tbl_ptrs[compptr->quant_tbl_no]);
+	for(y=0; y<numRows; y++)
+	{
+		JCOEF *src=cache->coefs[ci]
+			+(size_t)(startRow+y)*cache->blocksWide[ci]*DCTSIZE2;
+		for(bx=0; bx<cache->blocksWide[ci]; bx++, src+=DCTSIZE2)
+		{
+			JCOEF *dst=buffer[y][bx];
+			for(k=0; k<DCTSIZE2; k++)
+			{
+				int c=src[k], sign=c>>(sizeof(int)*8-1);
+				unsigned int temp=(unsigned int)((c^sign)-sign);
+				temp=((temp+quant.half[k])*quant.recip[k])>>RECIP_SHIFT;
+				dst[k]=(JCOEF)(((int)temp^sign)-sign);
+			}
+		}
+	}
+}
+
+/* Write a JPEG image from the cached coefficients, using the parameters,
+   quantization tables, and destination manager in cinfo.  Single-pass images
+   are written one iMCU row at a time.  Images that require multiple passes
+   (optimized Huffman tables or multiple scans) are first requantized into
+   virtual coefficient arrays. */
+static void writeCachedCoefficients(j_compress_ptr cinfo, tjcoefcache *cache)
+{
+	/* The coefficient controller retains a pointer to this array until the
+	   image is finished. */
+	jvirt_barray_ptr coefArrays[MAX_COMPONENTS];
+	int ci;
+
+	#if JPEG_LIB_VERSION>=70
+	/* jpeg_write_coefficients() expects the JPEG dimensions to have been set by
+	   the application (normally via jpeg_copy_critical_parameters()), and the
+	   per-level compressors in tjCompressMulti() never call
+	   jpeg_start_compress(). */
+	jpeg_calc_jpeg_dimensions(cinfo);
+	#endif
+
+	if(cinfo->optimize_coding || cinfo->num_scans>1)
+	{
+		JDIMENSION row;
+
+		for(ci=0; ci<cinfo->num_components; ci++)
+			coefArrays[ci]=(cinfo->mem->request_virt_barray)((j_common_ptr)cinfo,
+				JPOOL_IMAGE, FALSE, cache->blocksWide[ci], cache->blocksHigh[ci],
+				(JDIMENSION)cinfo->comp_info[ci].v_samp_factor);
+		jpeg_write_coefficients(cinfo, coefArrays);
+		for(ci=0; ci<cinfo->num_components; ci++)
+		{
+			int v=cinfo->comp_info[ci].v_samp_factor;
+			for(row=0; row<cache->blocksHigh[ci]; row+=v)
+			{
+				JBLOCKARRAY buffer=(cinfo->mem->access_virt_barray)
+					((j_common_ptr)cinfo, coefArrays[ci], row, (JDIMENSION)v, TRUE);
+				quantizeRows(cinfo, cache, ci, row, v, buffer);
+			}
+		}
+	}
+	else
+	{
+		JBLOCKARRAY rowBuf[MAX_COMPONENTS];  JDIMENSION row;
+
+		jpeg_write_coefficients(cinfo, NULL);
+		for(ci=0; ci<cinfo->num_components; ci++)
+			rowBuf[ci]=(cinfo->mem->alloc_barray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+				cache->blocksWide[ci], cinfo->comp_info[ci].v_samp_factor);
+		for(row=0; row<cinfo->total_iMCU_rows; row++)
+		{
+			for(ci=0; ci<cinfo->num_components; ci++)
+			{
+				int v=cinfo->comp_info[ci].v_samp_factor;
+				quantizeRows(cinfo, cache, ci, row*v, v, rowBuf[ci]);
+			}
+			jpeg_write_coefficient_row(cinfo, rowBuf);
+		}
+	}
+	jpeg_finish_compress(cinfo);
+}
+
+/* Derive the code length of each symbol in a Huffman table */
+static void getCodeLengths(JHUFF_TBL *htbl, int *length)
+{
+	int i, l, p=0;
+	/* A symbol missing from the table can't be encoded, so make it expensive
+	   enough to push the quality down. */
+	for(i=0; i<256; i++) length[i]=32;
+	if(!htbl) return;
+	for(l=1; l<=16; l++)
+		for(i=0; i<(int)htbl->bits[l] && p<256; i++)
+			length[htbl->huffval[p++]]=l;
+}
+
+/* Estimate the size of the JPEG image generated from the cached coefficients
+   using the quantization tables currently assigned to cinfo.  The number of
+   bits is exact for the standard Huffman tables, except for byte stuffing. */
+static unsigned long estimateSize(j_compress_ptr cinfo, tjcoefcache *cache)
+{
+	tjquant quant[MAX_COMPS_IN_SCAN];
+	int dcLength[MAX_COMPS_IN_SCAN][256], acLength[MAX_COMPS_IN_SCAN][256];
+	int lastDC[MAX_COMPS_IN_SCAN], pos[DCTSIZE2], ci, x, y, k, i;
+	unsigned int mag[DCTSIZE2];
+	JDIMENSION mcuRow, mcuCol;
+	unsigned long bits=0, bytes;
+
+	for(ci=0; ci<cache->compsInScan; ci++)
+	{
+		jpeg_component_info *compptr=&cinfo->comp_info[cache->compIndex[ci]];
+		setQuant(&quant[ci], cinfo->quant_tbl_ptrs[compptr->quant_tbl_no]);
+		getCodeLengths(cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no], dcLength[ci]);
+		getCodeLengths(cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no], acLength[ci]);
+		lastDC[ci]=0;
+	}
+
+	for(mcuRow=0; mcuRow<cache->mcuRows; mcuRow++)
+	{
+		for(mcuCol=0; mcuCol<cache->mcusPerRow; mcuCol++)
+		{
+			for(ci=0; ci<cache->compsInScan; ci++)
+			{
+				int c=cache->compIndex[ci], *acl=acLength[ci];
+				for(y=0; y<cache->mcuHeight[ci]; y++)
+				{
+					JCOEF *block=cache->coefs[c]
+						+((size_t)(mcuRow*cache->mcuHeight[ci]+y)*cache->blocksWide[c]
+							+mcuCol*cache->mcuWidth[ci])*DCTSIZE2;
+					for(x=0; x<cache->mcuWidth[ci]; x++, block+=DCTSIZE2)
+					{
+						int dc, diff, count=0, prev=0, r, n;
+
+						quantizeBlock(&quant[ci], block, mag);
+						dc=block[0]<0? -(int)mag[0]:(int)mag[0];
+						diff=dc-lastDC[ci];  lastDC[ci]=dc;
+						n=JPEG_NBITS(diff<0? -diff:diff);
+						bits+=dcLength[ci][n]+n;
+
+						/* Gather the positions of the nonzero AC coefficients without
+						   branching, since their distribution is unpredictable. */
+						for(k=1; k<DCTSIZE2; k++)
+						{
+							pos[count]=k;  count+=(mag[jpeg_natural_order[k]]!=0);
+						}
+						for(i=0; i<count; i++)
+						{
+							k=pos[i];  r=k-prev-1;  prev=k;
+							n=JPEG_NBITS(mag[jpeg_natural_order[k]]);
+							bits+=(r>>4)*acl[0xF0]+acl[((r&15)<<4)+n]+n;
+						}
+						if(prev<DCTSIZE2-1) bits+=acl[0];
+					}
+				}
+			}
+		}
+	}
+
+	/* Allow for byte stuffing, which occurs after roughly one in every 256
+	   bytes of entropy-coded data */
+	bytes=(bits+7)/8;
+	return cache->headerSize+bytes+bytes/256+2;
+}
+
+/* Set up the capture pass, which uses unit quantization tables and a
+   single-scan image */
+static int setCaptureDefaults(j_compress_ptr cinfo, int pixelFormat,
+	int subsamp, int flags)
+{
+	if(setCompDefaults(cinfo, pixelFormat, subsamp, 100, flags)==-1) return -1;
+	cinfo->optimize_coding=FALSE;
+	cinfo->arith_code=FALSE;
+	cinfo->scan_info=NULL;  cinfo->num_scans=0;
+	cinfo->dct_method=(flags&TJFLAG_FASTDCT)? JDCT_FASTEST:JDCT_ISLOW;
+	return 0;
+}
+
+DLLEXPORT int DLLCALL tjCompressToSize(tjhandle handle, unsigned char *srcBuf,
+	int width, int pitch, int height, int pixelFormat, unsigned char **jpegBuf,
+	unsigned long *jpegSize, int jpegSubsamp, unsigned long targetSize,
+	int *jpegQual, int flags)
+{
+	int i, retval=0, alloc=1, lo, hi, qual=0;  JSAMPROW *row_pointer=NULL;
+	tjcoefcache cache;
+	#ifndef JCS_EXTENSIONS
+	unsigned char *rgbBuf=NULL;
+	#endif
+
+	getcinstance(handle)
+	TJTRACE4(api__entry, "tjCompressToSize", width, height, 0);
+	memset(&cache, 0, sizeof(tjcoefcache));
+	if((this->init&COMPRESS)==0)
+		_throw("tjCompressToSize(): Instance has not been initialized for compression");
+	resetMemoryStats(this);
+
+	if(srcBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
+		|| pixelFormat>=TJ_NUMPF || jpegBuf==NULL || jpegSize==NULL
+		|| jpegSubsamp<0 || jpegSubsamp>=NUMSUBOPT || targetSize==0)
+		_throw("tjCompressToSize(): Invalid argument");
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	if(pitch==0) pitch=width*tjPixelSize[pixelFormat];
+
+	#ifndef JCS_EXTENSIONS
+	if(pixelFormat!=TJPF_GRAY && pixelFormat!=TJPF_CMYK)
+	{
+		rgbBuf=(unsigned char *)malloc(width*height*RGB_PIXELSIZE);
+		if(!rgbBuf) _throw("tjCompressToSize(): Memory allocation failure");
+		srcBuf=toRGB(srcBuf, width, pitch, height, pixelFormat, rgbBuf);
+		pitch=width*RGB_PIXELSIZE;
+	}
+	#endif
+
+	cinfo->image_width=width;
+	cinfo->image_height=height;
+
+	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+	else if(flags&TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+
+	if((row_pointer=(JSAMPROW *)malloc(sizeof(JSAMPROW)*height))==NULL)
+		_throw("tjCompressToSize(): Memory allocation failure");
+	for(i=0; i<height; i++)
+	{
+		if(flags&TJFLAG_BOTTOMUP) row_pointer[i]=&srcBuf[(height-i-1)*pitch];
+		else row_pointer[i]=&srcBuf[i*pitch];
+	}
+	/* The size estimate assumes a baseline Huffman-coded image with the
+	   standard tables, so the output uses the same settings. */
+	if(setCaptureDefaults(cinfo, pixelFormat, jpegSubsamp, flags)==-1)
+	{
+		retval=-1;  goto bailout;
+	}
+	cacheCoefficients(cinfo, row_pointer, &cache);
+
+	/* Find the highest quality whose estimated size fits within the target */
+	lo=1;  hi=100;  qual=1;
+	while(lo<=hi)
+	{
+		int mid=(lo+hi)/2;
+		jpeg_set_quality(cinfo, mid, TRUE);
+		if(estimateSize(cinfo, &cache)<=targetSize) {qual=mid;  lo=mid+1;}
+		else hi=mid-1;
+	}
+
+	/* Entropy-code the image at the chosen quality.  If the estimate was too
+	   optimistic, then back off until the image fits. */
+	if(flags&TJFLAG_NOREALLOC) alloc=0;
+	for(;;)
+	{
+		if(!alloc) *jpegSize=tjBufSize(width, height, jpegSubsamp);
+		jpeg_mem_dest_tj(cinfo, jpegBuf, jpegSize, alloc);
+		jpeg_set_quality(cinfo, qual, TRUE);
+		writeCachedCoefficients(cinfo, &cache);
+		if(*jpegSize<=targetSize) break;
+		if(qual<=1)
+			_throw("tjCompressToSize(): The JPEG image cannot be made small enough");
+		qual--;
+	}
+	if(jpegQual) *jpegQual=qual;
+
+	bailout:
+	releaseCache(cinfo, &cache);
+	if(cinfo->global_state>CSTATE_START) jpeg_abort_compress(cinfo);
+	#ifndef JCS_EXTENSIONS
+	if(rgbBuf) free(rgbBuf);
+	#endif
+	if(row_pointer) free(row_pointer);
+	TJTRACE5(api__return, "tjCompressToSize", retval, width, height,
+		jpegSize ? *jpegSize : 0);
+	return retval;
+}
+
+
+/* tjCompressMulti() entropy-codes each quality level with a separate
+   compressor, so that the levels can be encoded in parallel. */
+
+typedef struct
+{
+	struct my_error_mgr jerr;  /* must be first */
+	char errStr[JMSG_LENGTH_MAX];
+	tjcoefcache *cache;
+	int width, height, pixelFormat, subsamp, flags;
+	tjqualitylevel *level;
+	unsigned char **jpegBuf;
+	unsigned long *jpegSize;
+	int failed;
+} tjleveljob;
+
+static void levelOutputMessage(j_common_ptr cinfo)
+{
+	tjleveljob *job=(tjleveljob *)cinfo->err;
+	(*cinfo->err->format_message)(cinfo, job->errStr);
+}
+
+static void compressLevel(void *arg, int task)
+{
+	tjleveljob *job=&((tjleveljob *)arg)[task];
+	struct jpeg_compress_struct cinfo;
+
+	memset(&cinfo, 0, sizeof(struct jpeg_compress_struct));
+	cinfo.err=jpeg_std_error(&job->jerr.pub);
+	job->jerr.pub.error_exit=my_error_exit;
+	job->jerr.pub.output_message=levelOutputMessage;
+	if(setjmp(job->jerr.setjmp_buffer))
+	{
+		job->failed=1;
+		jpeg_destroy_compress(&cinfo);
+		return;
+	}
+	jpeg_create_compress(&cinfo);
+
+	cinfo.image_width=job->width;
+	cinfo.image_height=job->height;
+	if(job->flags&TJFLAG_NOREALLOC)
+		*job->jpegSize=tjBufSize(job->width, job->height, job->subsamp);
+	jpeg_mem_dest_tj(&cinfo, job->jpegBuf, job->jpegSize,
+		(job->flags&TJFLAG_NOREALLOC)==0);
+	if(setCompDefaults(&cinfo, job->pixelFormat, job->subsamp,
+		job->level->quality, job->flags)==-1)
+	{
+		snprintf(job->errStr, JMSG_LENGTH_MAX,
+			"tjCompressMulti(): Could not set compression parameters");
+		job->failed=1;
+		jpeg_destroy_compress(&cinfo);
+		return;
+	}
+	if(job->level->options&TJQOPT_OPTIMIZE) cinfo.optimize_coding=TRUE;
+	if(job->level->options&TJQOPT_PROGRESSIVE) jpeg_simple_progression(&cinfo);
+	writeCachedCoefficients(&cinfo, job->cache);
+	jpeg_destroy_compress(&cinfo);
+}
+
+DLLEXPORT int DLLCALL tjCompressMulti(tjhandle handle, unsigned char *srcBuf,
+	int width, int pitch, int height, int pixelFormat, int n,
+	unsigned char **jpegBufs, unsigned long *jpegSizes, int jpegSubsamp,
+	tjqualitylevel *levels, int flags)
+{
+	int i, retval=0;  JSAMPROW *row_pointer=NULL;
+	tjcoefcache cache;  tjleveljob *jobs=NULL;
+	#ifdef WITH_THREADS
+	int numThreads=n;  char *env=NULL;
+	#endif
+	#ifndef JCS_EXTENSIONS
+	unsigned char *rgbBuf=NULL;
+	#endif
+
+	getcinstance(handle)
+	TJTRACE4(api__entry, "tjCompressMulti", width, height, n);
+	memset(&cache, 0, sizeof(tjcoefcache));
+	if((this->init&COMPRESS)==0)
+		_throw("tjCompressMulti(): Instance has not been initialized for compression");
+	resetMemoryStats(this);
+
+	if(srcBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
+		|| pixelFormat>=TJ_NUMPF || n<1 || jpegBufs==NULL || jpegSizes==NULL
+		|| jpegSubsamp<0 || jpegSubsamp>=NUMSUBOPT || levels==NULL)
+		_throw("tjCompressMulti(): Invalid argument");
+	for(i=0; i<n; i++)
+	{
+		if(levels[i].quality<1 || levels[i].quality>100)
+			_throw("tjCompressMulti(): Invalid argument");
+	}
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	if(pitch==0) pitch=width*tjPixelSize[pixelFormat];
+
+	#ifndef JCS_EXTENSIONS
+	if(pixelFormat!=TJPF_GRAY && pixelFormat!=TJPF_CMYK)
+	{
+		rgbBuf=(unsigned char *)malloc(width*height*RGB_PIXELSIZE);
+		if(!rgbBuf) _throw("tjCompressMulti(): Memory allocation failure");
+		srcBuf=toRGB(srcBuf, width, pitch, height, pixelFormat, rgbBuf);
+		pitch=width*RGB_PIXELSIZE;
+		pixelFormat=TJPF_RGB;
+	}
+	#endif
+
+	cinfo->image_width=width;
+	cinfo->image_height=height;
+
+	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+	else if(flags&TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+
+	if((row_pointer=(JSAMPROW *)malloc(sizeof(JSAMPROW)*height))==NULL)
+		_throw("tjCompressMulti(): Memory allocation failure");
+	for(i=0; i<height; i++)
+	{
+		if(flags&TJFLAG_BOTTOMUP) row_pointer[i]=&srcBuf[(height-i-1)*pitch];
+		else row_pointer[i]=&srcBuf[i*pitch];
+	}
+	if(setCaptureDefaults(cinfo, pixelFormat, jpegSubsamp, flags)==-1)
+	{
+		retval=-1;  goto bailout;
+	}
+	cacheCoefficients(cinfo, row_pointer, &cache);
+
+	if((jobs=(tjleveljob *)malloc(sizeof(tjleveljob)*n))==NULL)
+		_throw("tjCompressMulti(): Memory allocation failure");
+	memset(jobs, 0, sizeof(tjleveljob)*n);
+	for(i=0; i<n; i++)
+	{
+		jobs[i].cache=&cache;
+		jobs[i].width=width;  jobs[i].height=height;
+		jobs[i].pixelFormat=pixelFormat;  jobs[i].subsamp=jpegSubsamp;
+		jobs[i].flags=flags;
+		jobs[i].level=&levels[i];
+		jobs[i].jpegBuf=&jpegBufs[i];  jobs[i].jpegSize=&jpegSizes[i];
+	}
+
+	#ifdef WITH_THREADS
+	if((env=getenv("TJ_THREADS"))!=NULL && strlen(env)>0)
+	{
+		int temp=-1;
+		if(sscanf(env, "%d", &temp)==1 && temp>=1) numThreads=temp;
+	}
+	jthread_run_tasks(compressLevel, (void *)jobs, n, numThreads);
+	#else
+	for(i=0; i<n; i++) compressLevel((void *)jobs, i);
+	#endif
+
+	for(i=0; i<n; i++)
+	{
+		if(jobs[i].failed)
+		{
+			snprintf(errStr, JMSG_LENGTH_MAX, "%s", jobs[i].errStr);
+			retval=-1;  break;
+		}
+	}
+
+	bailout:
+	releaseCache(cinfo, &cache);
+	if(cinfo->global_state>CSTATE_START) jpeg_abort_compress(cinfo);
+	#ifndef JCS_EXTENSIONS
+	if(rgbBuf) free(rgbBuf);
+	#endif
+	if(row_pointer) free(row_pointer);
+	if(jobs) free(jobs);
+	TJTRACE5(api__return, "tjCompressMulti", retval, width, height, 0);
+	return retval;
+}
+
+
+
+/* Image pyramids.  The source image is compressed at full size, and each
+   subsequent level is generated by downsampling the previous level by a factor
+   of 2 in both directions.  All of the levels are compressed in a single
+   top-to-bottom pass:  as soon as two rows of a level have been passed to
+   its compressor, they are averaged into one row of the next level, which is
+   passed to the next compressor right away.  Thus, each row of the source
+   image is read from memory only once, and the downsampled levels are never
+   stored in full. */
+
+#define MAXLEVELS 16
+
+typedef struct
+{
+	int n, pixelSize;
+	struct jpeg_compress_struct *cinfo[MAXLEVELS];
+	int width[MAXLEVELS];
+	JDIMENSION rows[MAXLEVELS];   /* # of rows passed to each compressor */
+	JSAMPROW pending[MAXLEVELS];  /* last even-numbered row of each level */
+	JSAMPROW buf[MAXLEVELS][2];   /* row buffers for levels 1 and above */
+} tjpyramid;
+
+/* Average each 2x2 group of pixels in two rows of a packed-pixel image,
+   replicating the last column if the width is odd.  The rounding bias
+   alternates between 1 and 2 from one output pixel to the next, as in
+   h2v2_downsample() in jcsample.c, so that there is no systematic bias. */
+static void downsampleRows(JSAMPROW inptr0, JSAMPROW inptr1, JSAMPROW outptr,
+	int width, int pixelSize)
+{
+	int x, c, bias=1;
+
+	for(x=0; x<width/2; x++)
+	{
+		for(c=0; c<pixelSize; c++)
+			outptr[c]=(JSAMPLE)((inptr0[c]+inptr0[c+pixelSize]+inptr1[c]
+				+inptr1[c+pixelSize]+bias)>>2);
+		inptr0+=pixelSize*2;  inptr1+=pixelSize*2;  outptr+=pixelSize;
+		bias^=3;
+	}
+	if(width&1)
+	{
+		for(c=0; c<pixelSize; c++)
+			outptr[c]=(JSAMPLE)((inptr0[c]*2+inptr1[c]*2+bias)>>2);
+	}
+}
+
+/* Pass a row to the compressor for the given level, and generate a row of
+   the next level if this row completes a pair. */
+static void pushRow(tjpyramid *pyr, int level, JSAMPROW row)
+{
+	JSAMPROW outptr;
+
+	jpeg_write_scanlines(pyr->cinfo[level], &row, 1);
+	if(level<pyr->n-1)
+	{
+		if((pyr->rows[level]&1)==0) pyr->pending[level]=row;
+		else
+		{
+			outptr=pyr->buf[level+1][pyr->rows[level+1]&1];
+			downsampleRows(pyr->pending[level], row, outptr, pyr->width[level],
+				pyr->pixelSize);
+			pushRow(pyr, level+1, outptr);
+		}
+	}
+	pyr->rows[level]++;
+}
+
+DLLEXPORT int DLLCALL tjCompressPyramid(tjhandle handle,
+	unsigned char *srcBuf, int width, int pitch, int height, int pixelFormat,
+	int n, unsigned char **jpegBufs, unsigned long *jpegSizes, int jpegSubsamp,
+	int jpegQual, int flags)
+{
+	int i, retval=0;  JSAMPROW outptr;
+	tjpyramid pyr;  struct jpeg_compress_struct *extra=NULL;
+	unsigned char *rowBuf=NULL;
+	#ifndef JCS_EXTENSIONS
+	unsigned char *rgbBuf=NULL;
+	#endif
+
+	getcinstance(handle)
+	TJTRACE4(api__entry, "tjCompressPyramid", width, height, n);
+	memset(&pyr, 0, sizeof(tjpyramid));
+	if((this->init&COMPRESS)==0)
+		_throw("tjCompressPyramid(): Instance has not been initialized for compression");
+	resetMemoryStats(this);
+
+	if(srcBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
+		|| pixelFormat>=TJ_NUMPF || n<1 || n>MAXLEVELS || jpegBufs==NULL
+		|| jpegSizes==NULL || jpegSubsamp<0 || jpegSubsamp>=NUMSUBOPT
+		|| jpegQual<0 || jpegQual>100)
+		_throw("tjCompressPyramid(): Invalid argument");
+
+	/* The compressors for levels 1 and above share the instance's error
+	   manager, so an error in any of them lands here. */
+	if((extra=(struct jpeg_compress_struct *)malloc(
+		sizeof(struct jpeg_compress_struct)*(n-1)+1))==NULL)
+		_throw("tjCompressPyramid(): Memory allocation failure");
+	memset(extra, 0, sizeof(struct jpeg_compress_struct)*(n-1));
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	if(pitch==0) pitch=width*tjPixelSize[pixelFormat];
+
+	#ifndef JCS_EXTENSIONS
+	if(pixelFormat!=TJPF_GRAY && pixelFormat!=TJPF_CMYK)
+	{
+		rgbBuf=(unsigned char *)malloc(width*height*RGB_PIXELSIZE);
+		if(!rgbBuf) _throw("tjCompressPyramid(): Memory allocation failure");
+		srcBuf=toRGB(srcBuf, width, pitch, height, pixelFormat, rgbBuf);
+		pitch=width*RGB_PIXELSIZE;
+		pixelFormat=TJPF_RGB;
+	}
+	#endif
+
+	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+	else if(flags&TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+
+	pyr.n=n;  pyr.pixelSize=tjPixelSize[pixelFormat];
+	if((rowBuf=(unsigned char *)malloc(
+		(TJPYRAMIDSCALED(width, 1)*pyr.pixelSize+1)*2*n))==NULL)
+		_throw("tjCompressPyramid(): Memory allocation failure");
+	for(i=0; i<n; i++)
+	{
+		struct jpeg_compress_struct *levelinfo=cinfo;
+		int levelw=TJPYRAMIDSCALED(width, i), levelh=TJPYRAMIDSCALED(height, i);
+
+		if(i>0)
+		{
+			levelinfo=&extra[i-1];
+			levelinfo->err=&this->jerr.pub;
+			jpeg_create_compress(levelinfo);
+			pyr.buf[i][0]=&rowBuf[TJPYRAMIDSCALED(width, 1)*pyr.pixelSize*2*i];
+			pyr.buf[i][1]=pyr.buf[i][0]+TJPYRAMIDSCALED(width, 1)*pyr.pixelSize;
+		}
+		pyr.cinfo[i]=levelinfo;  pyr.width[i]=levelw;
+		levelinfo->image_width=levelw;
+		levelinfo->image_height=levelh;
+		if(flags&TJFLAG_NOREALLOC)
+			jpegSizes[i]=tjBufSize(levelw, levelh, jpegSubsamp);
+		jpeg_mem_dest_tj(levelinfo, &jpegBufs[i], &jpegSizes[i],
+			(flags&TJFLAG_NOREALLOC)==0);
+		if(setCompDefaults(levelinfo, pixelFormat, jpegSubsamp, jpegQual,
+			flags)==-1)
+		{
+			retval=-1;  goto bailout;
+		}
+		jpeg_start_compress(levelinfo, TRUE);
+	}
+
+	for(i=0; i<height; i++)
+	{
+		if(flags&TJFLAG_BOTTOMUP) pushRow(&pyr, 0, &srcBuf[(height-i-1)*pitch]);
+		else pushRow(&pyr, 0, &srcBuf[i*pitch]);
+	}
+	/* If a level has an odd number of rows, then its last row is paired with
+	   itself. */
+	for(i=0; i<n-1; i++)
+	{
+		if(pyr.rows[i]&1)
+		{
+			outptr=pyr.buf[i+1][pyr.rows[i+1]&1];
+			downsampleRows(pyr.pending[i], pyr.pending[i], outptr, pyr.width[i],
+				pyr.pixelSize);
+			pushRow(&pyr, i+1, outptr);
+		}
+	}
+	for(i=0; i<n; i++) jpeg_finish_compress(pyr.cinfo[i]);
+
+	bailout:
+	if(cinfo->global_state>CSTATE_START) jpeg_abort_compress(cinfo);
+	if(extra)
+	{
+		for(i=0; i<n-1; i++) jpeg_destroy_compress(&extra[i]);
+		free(extra);
+	}
+	#ifndef JCS_EXTENSIONS
+	if(rgbBuf) free(rgbBuf);
+	#endif
+	if(rowBuf) free(rowBuf);
+	TJTRACE5(api__return, "tjCompressPyramid", retval, width, height, 0);
+	return retval;
+}
 
 DLLEXPORT int DLLCALL tjEncodeYUVPlanes(tjhandle handle, unsigned char *srcBuf,
 	int width, int pitch, int height, int pixelFormat, unsigned char **dstPlanes,
@@ -824,6 +1736,7 @@ DLLEXPORT int DLLCALL tjEncodeYUVPlanes(tjhandle handle, unsigned char *srcBuf,
 	#endif
 
 	getcinstance(handle);
+	TJTRACE4(api__entry, "tjEncodeYUVPlanes", width, height, 0);
 
 	for(i=0; i<MAX_COMPONENTS; i++)
 	{
@@ -833,6 +1746,7 @@ DLLEXPORT int DLLCALL tjEncodeYUVPlanes(tjhandle handle, unsigned char *srcBuf,
 
 	if((this->init&COMPRESS)==0)
 		_throw("tjEncodeYUVPlanes(): Instance has not been initialized for compression");
+	resetMemoryStats(this);
 
 	if(srcBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
 		|| pixelFormat>=TJ_NUMPF || !dstPlanes || !dstPlanes[0] || subsamp<0
@@ -965,6 +1879,7 @@ DLLEXPORT int DLLCALL tjEncodeYUVPlanes(tjhandle handle, unsigned char *srcBuf,
 		if(_tmpbuf2[i]!=NULL) free(_tmpbuf2[i]);
 		if(outbuf[i]!=NULL) free(outbuf[i]);
 	}
+	TJTRACE5(api__return, "tjEncodeYUVPlanes", retval, width, height, 0);
 	return retval;
 }
 
@@ -1021,16 +1936,47 @@ DLLEXPORT int DLLCALL tjEncodeYUV(tjhandle handle, unsigned char *srcBuf,
 }
 
 
-DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
+/* For each YUV layout (see enum TJYUV), the plane that holds each component,
+   the offset of the component's first sample within a line of that plane, and
+   the distance (in bytes) between consecutive samples of the component */
+static const int yuvPlane[TJ_NUMYUV][3]={{0, 1, 1}, {0, 1, 1}, {0, 0, 0},
+	{0, 0, 0}};
+static const int yuvOffset[TJ_NUMYUV][3]={{0, 0, 1}, {0, 1, 0}, {0, 1, 3},
+	{1, 0, 2}};
+static const int yuvStep[TJ_NUMYUV][3]={{1, 2, 2}, {1, 2, 2}, {2, 4, 4},
+	{2, 4, 4}};
+
+static void deinterleave(JSAMPROW src, int step, JSAMPROW dst, int n)
+{
+	int k;
+	if(step==1) memcpy(dst, src, n);
+	else if(step==2) for(k=0; k<n; k++) dst[k]=src[k*2];
+	else for(k=0; k<n; k++) dst[k]=src[k*4];
+}
+
+static void interleave(JSAMPROW src, JSAMPROW dst, int step, int n)
+{
+	int k;
+	if(step==1) memcpy(dst, src, n);
+	else if(step==2) for(k=0; k<n; k++) dst[k*2]=src[k];
+	else for(k=0; k<n; k++) dst[k*4]=src[k];
+}
+
+/* Compress a YUV image stored either in separate planes (layout<0) or in one
+   of the interleaved YUV layouts.  funcName is used in error messages and
+   trace probes. */
+static int compressFromYUV(tjhandle handle, const char *funcName,
 	unsigned char **srcPlanes, int width, int *strides, int height, int subsamp,
-	unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual, int flags)
+	int layout, unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual,
+	int flags)
 {
 	int i, row, retval=0, alloc=1;  JSAMPROW *inbuf[MAX_COMPONENTS];
 	int pw[MAX_COMPONENTS], ph[MAX_COMPONENTS], iw[MAX_COMPONENTS],
-		tmpbufsize=0, usetmpbuf=0, th[MAX_COMPONENTS];
+		tmpbufsize=0, usetmpbuf=0, th[MAX_COMPONENTS], step[MAX_COMPONENTS];
 	JSAMPLE *_tmpbuf=NULL, *ptr;  JSAMPROW *tmpbuf[MAX_COMPONENTS];
 
 	getcinstance(handle)
+	TJTRACE4(api__entry, funcName, width, height, 0);
 
 	for(i=0; i<MAX_COMPONENTS; i++)
 	{
@@ -1038,14 +1984,17 @@ DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
 	}
 
 	if((this->init&COMPRESS)==0)
-		_throw("tjCompressFromYUVPlanes(): Instance has not been initialized for compression");
+		_throwfn("Instance has not been initialized for compression");
+	resetMemoryStats(this);
 
 	if(!srcPlanes || !srcPlanes[0] || width<=0 || height<=0 || subsamp<0
-		|| subsamp>=NUMSUBOPT || jpegBuf==NULL || jpegSize==NULL || jpegQual<0
-		|| jpegQual>100)
-		_throw("tjCompressFromYUVPlanes(): Invalid argument");
-	if(subsamp!=TJSAMP_GRAY && (!srcPlanes[1] || !srcPlanes[2]))
-		_throw("tjCompressFromYUVPlanes(): Invalid argument");
+		|| subsamp>=NUMSUBOPT || layout>=TJ_NUMYUV || jpegBuf==NULL
+		|| jpegSize==NULL || jpegQual<0 || jpegQual>100)
+		_throwfn("Invalid argument");
+	if(layout<0 && subsamp!=TJSAMP_GRAY && (!srcPlanes[1] || !srcPlanes[2]))
+		_throwfn("Invalid argument");
+	if(layout>=0 && yuvPlane[layout][1]!=0 && !srcPlanes[1])
+		_throwfn("Invalid argument");
 
 	if(setjmp(this->jerr.setjmp_buffer))
 	{
@@ -1081,27 +2030,41 @@ DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
 			*compptr->h_samp_factor/cinfo->max_h_samp_factor;
 		ph[i]=PAD(cinfo->image_height, cinfo->max_v_samp_factor)
 			*compptr->v_samp_factor/cinfo->max_v_samp_factor;
-		if(iw[i]!=pw[i] || ih!=ph[i]) usetmpbuf=1;
+		step[i]=layout<0? 1:yuvStep[layout][i];
+		if(iw[i]!=pw[i] || ih!=ph[i] || step[i]!=1) usetmpbuf=1;
 		th[i]=compptr->v_samp_factor*DCTSIZE;
 		tmpbufsize+=iw[i]*th[i];
 		if((inbuf[i]=(JSAMPROW *)malloc(sizeof(JSAMPROW)*ph[i]))==NULL)
-			_throw("tjCompressFromYUVPlanes(): Memory allocation failure");
-		ptr=srcPlanes[i];
-		for(row=0; row<ph[i]; row++)
+			_throwfn("Memory allocation failure");
+		if(layout<0)
+		{
+			ptr=srcPlanes[i];
+			for(row=0; row<ph[i]; row++)
+			{
+				inbuf[i][row]=ptr;
+				ptr+=(strides && strides[i]!=0)? strides[i]:pw[i];
+			}
+		}
+		else
 		{
-			inbuf[i][row]=ptr;
-			ptr+=(strides && strides[i]!=0)? strides[i]:pw[i];
+			int p=yuvPlane[layout][i];
+			ptr=srcPlanes[p]+yuvOffset[layout][i];
+			for(row=0; row<ph[i]; row++)
+			{
+				inbuf[i][row]=ptr;
+				ptr+=(strides && strides[p]!=0)? strides[p]:pw[i]*step[i];
+			}
 		}
 	}
 	if(usetmpbuf)
 	{
 		if((_tmpbuf=(JSAMPLE *)malloc(sizeof(JSAMPLE)*tmpbufsize))==NULL)
-			_throw("tjCompressFromYUVPlanes(): Memory allocation failure");
+			_throwfn("Memory allocation failure");
 		ptr=_tmpbuf;
 		for(i=0; i<cinfo->num_components; i++)
 		{
 			if((tmpbuf[i]=(JSAMPROW *)malloc(sizeof(JSAMPROW)*th[i]))==NULL)
-				_throw("tjCompressFromYUVPlanes(): Memory allocation failure");
+				_throwfn("Memory allocation failure");
 			for(row=0; row<th[i]; row++)
 			{
 				tmpbuf[i][row]=ptr;
@@ -1124,7 +2087,7 @@ DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
 				int j, k;
 				for(j=0; j<min(th[i], ph[i]-crow[i]); j++)
 				{
-					memcpy(tmpbuf[i][j], inbuf[i][crow[i]+j], pw[i]);
+					deinterleave(inbuf[i][crow[i]+j], step[i], tmpbuf[i][j], pw[i]);
 					/* Duplicate last sample in row to fill out MCU */
 					for(k=pw[i]; k<iw[i]; k++) tmpbuf[i][j][k]=tmpbuf[i][j][pw[i]-1];
 				}
@@ -1148,6 +2111,33 @@ DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
 		if(inbuf[i]) free(inbuf[i]);
 	}
 	if(_tmpbuf) free(_tmpbuf);
+	TJTRACE5(api__return, funcName, retval, width, height,
+		jpegSize ? *jpegSize : 0);
+	return retval;
+}
+
+DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
+	unsigned char **srcPlanes, int width, int *strides, int height, int subsamp,
+	unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual, int flags)
+{
+	return compressFromYUV(handle, "tjCompressFromYUVPlanes", srcPlanes, width,
+		strides, height, subsamp, -1, jpegBuf, jpegSize, jpegQual, flags);
+}
+
+DLLEXPORT int DLLCALL tjCompressFromYUVLayout(tjhandle handle,
+	unsigned char **srcPlanes, int width, int *strides, int height, int layout,
+	unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual, int flags)
+{
+	int retval=-1;
+
+	if(layout<0 || layout>=TJ_NUMYUV)
+		_throw("tjCompressFromYUVLayout(): Invalid argument");
+
+	return compressFromYUV(handle, "tjCompressFromYUVLayout", srcPlanes, width,
+		strides, height, tjYUVSubsamp[layout], layout, jpegBuf, jpegSize,
+		jpegQual, flags);
+
+	bailout:
 	return retval;
 }
 
@@ -1234,6 +2224,7 @@ DLLEXPORT int DLLCALL tjDecompressHeader3(tjhandle handle,
 	int retval=0;
 
 	getdinstance(handle);
+	TJTRACE4(api__entry, "tjDecompressHeader3", 0, 0, jpegSize);
 	if((this->init&DECOMPRESS)==0)
 		_throw("tjDecompressHeader3(): Instance has not been initialized for decompression");
 
@@ -1244,7 +2235,9 @@ DLLEXPORT int DLLCALL tjDecompressHeader3(tjhandle handle,
 	if(setjmp(this->jerr.setjmp_buffer))
 	{
 		/* If we get here, the JPEG code has signaled an error. */
-		return -1;
+		if(dinfo->global_state>DSTATE_START) jpeg_abort_decompress(dinfo);
+		retval=-1;
+		goto bailout;
 	}
 
 	jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
@@ -1253,15 +2246,7 @@ DLLEXPORT int DLLCALL tjDecompressHeader3(tjhandle handle,
 	*width=dinfo->image_width;
 	*height=dinfo->image_height;
 	*jpegSubsamp=getSubsamp(dinfo);
-	switch(dinfo->jpeg_color_space)
-	{
-		case JCS_GRAYSCALE:  *jpegColorspace=TJCS_GRAY;  break;
-		case JCS_RGB:        *jpegColorspace=TJCS_RGB;  break;
-		case JCS_YCbCr:      *jpegColorspace=TJCS_YCbCr;  break;
-		case JCS_CMYK:       *jpegColorspace=TJCS_CMYK;  break;
-		case JCS_YCCK:       *jpegColorspace=TJCS_YCCK;  break;
-		default:             *jpegColorspace=-1;  break;
-	}
+	*jpegColorspace=getColorspace(dinfo->jpeg_color_space);
 
 	jpeg_abort_decompress(dinfo);
 
@@ -1273,6 +2258,8 @@ DLLEXPORT int DLLCALL tjDecompressHeader3(tjhandle handle,
 		_throw("tjDecompressHeader3(): Invalid data returned in header");
 
 	bailout:
+	TJTRACE5(api__return, "tjDecompressHeader3", retval, dinfo->image_width,
+		dinfo->image_height, jpegSize);
 	return retval;
 }
 
@@ -1294,6 +2281,221 @@ DLLEXPORT int DLLCALL tjDecompressHeader(tjhandle handle,
 }
 
 
+
+/* tjProbeHeader() reads the markers directly, so that it needs neither a
+   decompressor instance nor any memory allocation.  The checks that it
+   performs on the SOF marker, and the colorspace that it infers from the JFIF
+   and Adobe markers, mirror those of jdmarker.c and jdapimin.c. */
+
+#define GET16(p)  (((unsigned int)(p)[0]<<8)|(unsigned int)(p)[1])
+
+static unsigned int getExif16(const unsigned char *p, int bigEndian)
+{
+	if(bigEndian) return ((unsigned int)p[0]<<8)|(unsigned int)p[1];
+	else return ((unsigned int)p[1]<<8)|(unsigned int)p[0];
+}
+
+static unsigned long getExif32(const unsigned char *p, int bigEndian)
+{
+	if(bigEndian)
+		return ((unsigned long)getExif16(p, 1)<<16)|getExif16(&p[2], 1);
+	else return ((unsigned long)getExif16(&p[2], 0)<<16)|getExif16(p, 0);
+}
+
+/* Return the value of the orientation tag in IFD0 of the Exif data, or 0 if
+   there is no valid orientation tag.  tiff points to the TIFF header that
+   follows the Exif identifier, and len is the number of bytes remaining in
+   the APP1 marker. */
+static int getExifOrientation(const unsigned char *tiff, unsigned long len)
+{
+	unsigned long offset, numEntries, i;  unsigned int value;
+	int bigEndian;
+
+	if(len<8) return 0;
+	if(tiff[0]=='M' && tiff[1]=='M') bigEndian=1;
+	else if(tiff[0]=='I' && tiff[1]=='I') bigEndian=0;
+	else return 0;
+	if(getExif16(&tiff[2], bigEndian)!=42) return 0;
+
+	offset=getExif32(&tiff[4], bigEndian);
+	if(offset<8 || offset>len-2) return 0;
+	numEntries=getExif16(&tiff[offset], bigEndian);
+	offset+=2;
+	for(i=0; i<numEntries && offset+12<=len; i++, offset+=12)
+	{
+		if(getExif16(&tiff[offset], bigEndian)!=0x0112) continue;
+		/* The orientation tag must be a single SHORT value */
+		if(getExif16(&tiff[offset+2], bigEndian)!=3
+			|| getExif32(&tiff[offset+4], bigEndian)!=1)
+			return 0;
+		value=getExif16(&tiff[offset+8], bigEndian);
+		return (value>=1 && value<=8)? (int)value:0;
+	}
+	return 0;
+}
+
+DLLEXPORT int DLLCALL tjProbeHeader(unsigned char *jpegBuf,
+	unsigned long jpegSize, tjheaderinfo *info)
+{
+	unsigned long pos=2, len;  const unsigned char *data;
+	int marker, i, sawSOF=0, sawJFIF=0, sawAdobe=0, adobeTransform=0;
+	int compID[MAX_COMPONENTS], hSampFactor[MAX_COMPONENTS],
+		vSampFactor[MAX_COMPONENTS];
+	J_COLOR_SPACE colorspace;
+
+	if(jpegBuf==NULL || jpegSize<4 || info==NULL) return -1;
+	if(jpegBuf[0]!=0xFF || jpegBuf[1]!=0xD8) return -1;
+	memset(info, 0, sizeof(tjheaderinfo));
+
+	/* Scan the markers up to the first SOS (or EOI, or the end of the
+	   buffer) */
+	for(;;)
+	{
+		/* Skip any garbage and fill bytes preceding the next marker, as
+		   jdmarker.c does */
+		while(pos<jpegSize && jpegBuf[pos]!=0xFF) pos++;
+		while(pos<jpegSize && jpegBuf[pos]==0xFF) pos++;
+		if(pos>=jpegSize) break;
+		marker=jpegBuf[pos++];
+
+		if(marker==0xDA || marker==0xD9) break;  /* SOS or EOI */
+		if(marker==0xD8) return -1;  /* duplicate SOI */
+		if(marker==0x00 || marker==0x01 || (marker>=0xD0 && marker<=0xD7))
+			continue;  /* markers without parameters */
+
+		if(pos+2>jpegSize) break;
+		len=GET16(&jpegBuf[pos]);
+		if(len<2) return -1;
+		len-=2;
+		if(len>jpegSize-pos-2) break;  /* truncated marker */
+		data=&jpegBuf[pos+2];
+		pos+=len+2;
+
+		switch(marker)
+		{
+			case 0xC0:  case 0xC1:  case 0xC2:  case 0xC3:
+			case 0xC5:  case 0xC6:  case 0xC7:
+			case 0xC9:  case 0xCA:  case 0xCB:
+			case 0xCD:  case 0xCE:  case 0xCF:
+				if(sawSOF || len<6) return -1;
+				info->precision=data[0];
+				info->height=GET16(&data[1]);
+				info->width=GET16(&data[3]);
+				info->numComponents=data[5];
+				if(info->width<1 || info->height<1 || info->numComponents<1
+					|| info->numComponents>MAX_COMPONENTS
+					|| len!=6+(unsigned long)info->numComponents*3)
+					return -1;
+				for(i=0; i<info->numComponents; i++)
+				{
+					compID[i]=data[6+i*3];
+					hSampFactor[i]=data[7+i*3]>>4;
+					vSampFactor[i]=data[7+i*3]&15;
+					if(hSampFactor[i]<1 || hSampFactor[i]>MAX_SAMP_FACTOR
+						|| vSampFactor[i]<1 || vSampFactor[i]>MAX_SAMP_FACTOR)
+						return -1;
+				}
+				info->progressive=((marker&3)==2);
+				info->arithmetic=(marker>=0xC9);
+				sawSOF=1;
+				break;
+			case 0xE0:  /* APP0 */
+				if(len>=14 && !memcmp(data, "JFIF", 5)) sawJFIF=1;
+				break;
+			case 0xE1:  /* APP1 */
+				if(info->orientation==0 && len>=6 && !memcmp(data, "Exif\0", 6))
+					info->orientation=getExifOrientation(&data[6], len-6);
+				break;
+			case 0xE2:  /* APP2 */
+				if(len>=14 && !memcmp(data, "ICC_PROFILE", 12))
+					info->hasICCProfile=1;
+				break;
+			case 0xEE:  /* APP14 */
+				if(len>=12 && !memcmp(data, "Adobe", 5))
+				{
+					sawAdobe=1;  adobeTransform=data[11];
+				}
+				break;
+		}
+	}
+	if(!sawSOF) return -1;
+
+	/* Guess the colorspace in the same way as default_decompress_parms() in
+	   jdapimin.c */
+	switch(info->numComponents)
+	{
+		case 1:
+			colorspace=JCS_GRAYSCALE;  break;
+		case 3:
+			if(sawJFIF) colorspace=JCS_YCbCr;
+			else if(sawAdobe)
+				colorspace=(adobeTransform==0? JCS_RGB:JCS_YCbCr);
+			else if(compID[0]==82 && compID[1]==71 && compID[2]==66)
+				colorspace=JCS_RGB;
+			else colorspace=JCS_YCbCr;
+			break;
+		case 4:
+			if(sawAdobe && adobeTransform!=0) colorspace=JCS_YCCK;
+			else colorspace=JCS_CMYK;
+			break;
+		default:
+			colorspace=JCS_UNKNOWN;
+	}
+	info->colorspace=getColorspace(colorspace);
+	info->subsamp=getSubsampFromFactors(info->numComponents, colorspace,
+		hSampFactor, vSampFactor);
+	return 0;
+}
+
+DLLEXPORT int DLLCALL tjValidate(tjhandle handle, unsigned char *jpegBuf,
+	unsigned long jpegSize, tjvalidateinfo *info)
+{
+	int retval=0;  jpeg_validation_result result;
+
+	getdinstance(handle);
+	TJTRACE4(api__entry, "tjValidate", 0, 0, jpegSize);
+	if((this->init&DECOMPRESS)==0)
+		_throw("tjValidate(): Instance has not been initialized for decompression");
+	resetMemoryStats(this);
+
+	if(jpegBuf==NULL || jpegSize<=0)
+		_throw("tjValidate(): Invalid argument");
+
+	if(info) memset(info, 0, sizeof(tjvalidateinfo));
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+	jpeg_read_header(dinfo, TRUE);
+	/* Ensure that the first warning issued while decoding the scans is stored
+	   in the error string. */
+	this->jerr.pub.num_warnings=0;
+	jpeg_validate(dinfo, &result);
+	jpeg_finish_decompress(dinfo);
+
+	if(info)
+	{
+		info->numScans=result.num_scans;
+		info->numWarnings=(int)result.num_warnings;
+		info->badScan=result.bad_scan;
+		info->badMCUX=(int)result.bad_MCU_col;
+		info->badMCUY=(int)result.bad_MCU_row;
+	}
+	if(result.num_warnings>0) retval=-1;
+
+	bailout:
+	if(dinfo->global_state>DSTATE_START) jpeg_abort_decompress(dinfo);
+	TJTRACE5(api__return, "tjValidate", retval, dinfo->image_width,
+		dinfo->image_height, jpegSize);
+	return retval;
+}
+
+
 DLLEXPORT tjscalingfactor* DLLCALL tjGetScalingFactors(int *numscalingfactors)
 {
 	if(numscalingfactors==NULL)
@@ -1308,9 +2510,13 @@ DLLEXPORT tjscalingfactor* DLLCALL tjGetScalingFactors(int *numscalingfactors)
 }
 
 
-DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
-	unsigned long jpegSize, unsigned char *dstBuf, int width, int pitch,
-	int height, int pixelFormat, int flags)
+/* Decompress a JPEG image, optionally stopping after maxScans scans or after
+   maxBytes bytes of a multi-scan image (see tjDecompressPreview()).  funcName
+   is used in error messages and trace probes. */
+static int decompress(tjhandle handle, const char *funcName,
+	unsigned char *jpegBuf, unsigned long jpegSize, unsigned char *dstBuf,
+	int width, int pitch, int height, int pixelFormat, int flags, int maxScans,
+	unsigned long maxBytes)
 {
 	int i, retval=0;  JSAMPROW *row_pointer=NULL;
 	int jpegwidth, jpegheight, scaledw, scaledh;
@@ -1320,12 +2526,14 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 	#endif
 
 	getdinstance(handle);
+	TJTRACE4(api__entry, funcName, width, height, jpegSize);
 	if((this->init&DECOMPRESS)==0)
-		_throw("tjDecompress2(): Instance has not been initialized for decompression");
+		_throwfn("Instance has not been initialized for decompression");
+	resetMemoryStats(this);
 
 	if(jpegBuf==NULL || jpegSize<=0 || dstBuf==NULL || width<0 || pitch<0
-		|| height<0 || pixelFormat<0 || pixelFormat>=TJ_NUMPF)
-		_throw("tjDecompress2(): Invalid argument");
+		|| height<0 || pixelFormat<0 || pixelFormat>=TJ_NUMPF || maxScans<0)
+		_throwfn("Invalid argument");
 
 	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
 	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
@@ -1346,6 +2554,7 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 	}
 
 	if(flags&TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling=FALSE;
+	if(flags&TJFLAG_DCTUPSAMPLE) jpeg_set_idct_upsampling(dinfo, TRUE);
 
 	jpegwidth=dinfo->image_width;  jpegheight=dinfo->image_height;
 	if(width==0) width=jpegwidth;
@@ -1358,12 +2567,26 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 			break;
 	}
 	if(scaledw>width || scaledh>height)
-		_throw("tjDecompress2(): Could not scale down to desired image dimensions");
+		_throwfn("Could not scale down to desired image dimensions");
 	width=scaledw;  height=scaledh;
 	dinfo->scale_num=sf[i].num;
 	dinfo->scale_denom=sf[i].denom;
 
+	/* In order to stop early, we must use buffered-image mode, which is
+	   possible only for multi-scan (e.g. progressive) images. */
+	if((maxScans>0 || maxBytes>0) && jpeg_has_multiple_scans(dinfo))
+		dinfo->buffered_image=TRUE;
+
 	jpeg_start_decompress(dinfo);
+	if(dinfo->buffered_image)
+	{
+		unsigned long used=jpegSize-(unsigned long)dinfo->src->bytes_in_buffer;
+		long budget=0;
+		if(maxBytes>0)
+			budget=maxBytes>used? (long)(maxBytes-used):1;
+		jpeg_consume_scans(dinfo, maxScans, budget);
+		jpeg_start_output(dinfo, dinfo->input_scan_number);
+	}
 	if(pitch==0) pitch=dinfo->output_width*tjPixelSize[pixelFormat];
 
 	#ifndef JCS_EXTENSIONS
@@ -1374,7 +2597,7 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 			RGB_PIXELSIZE!=tjPixelSize[pixelFormat]))
 	{
 		rgbBuf=(unsigned char *)malloc(width*height*3);
-		if(!rgbBuf) _throw("tjDecompress2(): Memory allocation failure");
+		if(!rgbBuf) _throwfn("Memory allocation failure");
 		_pitch=pitch;  pitch=width*3;
 		_dstBuf=dstBuf;  dstBuf=rgbBuf;
 	}
@@ -1382,7 +2605,7 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 
 	if((row_pointer=(JSAMPROW *)malloc(sizeof(JSAMPROW)
 		*dinfo->output_height))==NULL)
-		_throw("tjDecompress2(): Memory allocation failure");
+		_throwfn("Memory allocation failure");
 	for(i=0; i<(int)dinfo->output_height; i++)
 	{
 		if(flags&TJFLAG_BOTTOMUP)
@@ -1394,6 +2617,7 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 		jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
 			dinfo->output_height-dinfo->output_scanline);
 	}
+	if(dinfo->buffered_image) jpeg_finish_output(dinfo);
 	jpeg_finish_decompress(dinfo);
 
 	#ifndef JCS_EXTENSIONS
@@ -1406,6 +2630,216 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
 	if(rgbBuf) free(rgbBuf);
 	#endif
 	if(row_pointer) free(row_pointer);
+	TJTRACE5(api__return, funcName, retval, width, height, jpegSize);
+	return retval;
+}
+
+DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle, unsigned char *jpegBuf,
+	unsigned long jpegSize, unsigned char *dstBuf, int width, int pitch,
+	int height, int pixelFormat, int flags)
+{
+	return decompress(handle, "tjDecompress2", jpegBuf, jpegSize, dstBuf, width,
+		pitch, height, pixelFormat, flags, 0, 0);
+}
+
+DLLEXPORT int DLLCALL tjDecompressPreview(tjhandle handle,
+	unsigned char *jpegBuf, unsigned long jpegSize, unsigned char *dstBuf,
+	int width, int pitch, int height, int pixelFormat, int flags, int maxScans,
+	unsigned long maxBytes)
+{
+	return decompress(handle, "tjDecompressPreview", jpegBuf, jpegSize, dstBuf,
+		width, pitch, height, pixelFormat, flags, maxScans, maxBytes);
+}
+
+DLLEXPORT int DLLCALL tjDecompressScales(tjhandle handle,
+	unsigned char *jpegBuf, unsigned long jpegSize, int n,
+	unsigned char **dstBufs, tjscalingfactor *scalingFactors, int pixelFormat,
+	int flags)
+{
+	int i, j, retval=0;  JSAMPROW *row_pointer=NULL;
+	int width=0, height=0, pitch;  unsigned char *dstBuf;
+	#ifndef JCS_EXTENSIONS
+	unsigned char *rgbBuf=NULL;
+	#endif
+
+	getdinstance(handle);
+	TJTRACE4(api__entry, "tjDecompressScales", 0, 0, jpegSize);
+	if((this->init&DECOMPRESS)==0)
+		_throw("tjDecompressScales(): Instance has not been initialized for decompression");
+	resetMemoryStats(this);
+
+	if(jpegBuf==NULL || jpegSize<=0 || n<1 || dstBufs==NULL
+		|| scalingFactors==NULL || pixelFormat<0 || pixelFormat>=TJ_NUMPF)
+		_throw("tjDecompressScales(): Invalid argument");
+	for(i=0; i<n; i++)
+	{
+		if(dstBufs[i]==NULL)
+			_throw("tjDecompressScales(): Invalid argument");
+		for(j=0; j<NUMSF; j++)
+		{
+			if(scalingFactors[i].num*sf[j].denom==sf[j].num*scalingFactors[i].denom)
+				break;
+		}
+		if(j>=NUMSF || scalingFactors[i].denom<=0)
+			_throw("tjDecompressScales(): Unsupported scaling factor");
+	}
+
+	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
+	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
+	else if(flags&TJFLAG_FORCESSE2) putenv("JSIMD_FORCESSE2=1");
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+	jpeg_read_header(dinfo, TRUE);
+	if(setDecompDefaults(dinfo, pixelFormat, flags)==-1)
+	{
+		retval=-1;  goto bailout;
+	}
+
+	if(flags&TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling=FALSE;
+	if(flags&TJFLAG_DCTUPSAMPLE) jpeg_set_idct_upsampling(dinfo, TRUE);
+
+	/* Allocate the row pointers (and the intermediate RGB buffer, if any) for
+	   the largest destination image. */
+	for(i=0; i<n; i++)
+	{
+		if(TJSCALED((int)dinfo->image_width, scalingFactors[i])>width)
+			width=TJSCALED((int)dinfo->image_width, scalingFactors[i]);
+		if(TJSCALED((int)dinfo->image_height, scalingFactors[i])>height)
+			height=TJSCALED((int)dinfo->image_height, scalingFactors[i]);
+	}
+	if((row_pointer=(JSAMPROW *)malloc(sizeof(JSAMPROW)*height))==NULL)
+		_throw("tjDecompressScales(): Memory allocation failure");
+	#ifndef JCS_EXTENSIONS
+	if(pixelFormat!=TJPF_GRAY && pixelFormat!=TJPF_CMYK &&
+		(RGB_RED!=tjRedOffset[pixelFormat] ||
+			RGB_GREEN!=tjGreenOffset[pixelFormat] ||
+			RGB_BLUE!=tjBlueOffset[pixelFormat] ||
+			RGB_PIXELSIZE!=tjPixelSize[pixelFormat]))
+	{
+		rgbBuf=(unsigned char *)malloc(width*height*3);
+		if(!rgbBuf) _throw("tjDecompressScales(): Memory allocation failure");
+	}
+	#endif
+
+	/* Buffered-image mode keeps the coefficients of the whole image, so all of
+	   the input can be absorbed up front, and each destination image can then
+	   be generated by a separate output pass. */
+	dinfo->buffered_image=TRUE;
+	dinfo->scale_num=scalingFactors[0].num;
+	dinfo->scale_denom=scalingFactors[0].denom;
+	jpeg_start_decompress(dinfo);
+	while(!jpeg_input_complete(dinfo))
+	{
+		if(jpeg_consume_input(dinfo)==JPEG_SUSPENDED) break;
+	}
+
+	for(i=0; i<n; i++)
+	{
+		if(i>0)
+		{
+			dinfo->scale_num=scalingFactors[i].num;
+			dinfo->scale_denom=scalingFactors[i].denom;
+			jpeg_new_output_scale(dinfo);
+		}
+		jpeg_start_output(dinfo, dinfo->input_scan_number);
+		width=dinfo->output_width;  height=dinfo->output_height;
+		dstBuf=dstBufs[i];  pitch=width*tjPixelSize[pixelFormat];
+		#ifndef JCS_EXTENSIONS
+		if(rgbBuf) {dstBuf=rgbBuf;  pitch=width*3;}
+		#endif
+		for(j=0; j<height; j++)
+		{
+			if(flags&TJFLAG_BOTTOMUP)
+				row_pointer[j]=&dstBuf[(height-j-1)*pitch];
+			else row_pointer[j]=&dstBuf[j*pitch];
+		}
+		while(dinfo->output_scanline<dinfo->output_height)
+		{
+			jpeg_read_scanlines(dinfo, &row_pointer[dinfo->output_scanline],
+				dinfo->output_height-dinfo->output_scanline);
+		}
+		jpeg_finish_output(dinfo);
+		#ifndef JCS_EXTENSIONS
+		if(rgbBuf)
+			fromRGB(rgbBuf, dstBufs[i], width, width*tjPixelSize[pixelFormat],
+				height, pixelFormat);
+		#endif
+	}
+	jpeg_finish_decompress(dinfo);
+
+	bailout:
+	if(dinfo->global_state>DSTATE_START) jpeg_abort_decompress(dinfo);
+	#ifndef JCS_EXTENSIONS
+	if(rgbBuf) free(rgbBuf);
+	#endif
+	if(row_pointer) free(row_pointer);
+	TJTRACE5(api__return, "tjDecompressScales", retval, width, height,
+		jpegSize);
+	return retval;
+}
+
+DLLEXPORT int DLLCALL tjGetDecompressCost(tjhandle handle,
+	unsigned char *jpegBuf, unsigned long jpegSize, int width, int height,
+	int pixelFormat, int flags, tjdecompcost *cost)
+{
+	int i, retval=0;  jpeg_decompress_requirements req;
+	int jpegwidth, jpegheight, scaledw, scaledh;
+
+	getdinstance(handle);
+	if((this->init&DECOMPRESS)==0)
+		_throw("tjGetDecompressCost(): Instance has not been initialized for decompression");
+
+	if(jpegBuf==NULL || jpegSize<=0 || width<0 || height<0 || pixelFormat<0
+		|| pixelFormat>=TJ_NUMPF || cost==NULL)
+		_throw("tjGetDecompressCost(): Invalid argument");
+
+	if(setjmp(this->jerr.setjmp_buffer))
+	{
+		/* If we get here, the JPEG code has signaled an error. */
+		retval=-1;
+		goto bailout;
+	}
+
+	/* This must select the same decompression parameters as tjDecompress2() */
+	jpeg_mem_src_tj(dinfo, jpegBuf, jpegSize);
+	jpeg_read_header(dinfo, TRUE);
+	if(setDecompDefaults(dinfo, pixelFormat, flags)==-1)
+	{
+		retval=-1;  goto bailout;
+	}
+
+	if(flags&TJFLAG_FASTUPSAMPLE) dinfo->do_fancy_upsampling=FALSE;
+	if(flags&TJFLAG_DCTUPSAMPLE) jpeg_set_idct_upsampling(dinfo, TRUE);
+
+	jpegwidth=dinfo->image_width;  jpegheight=dinfo->image_height;
+	if(width==0) width=jpegwidth;
+	if(height==0) height=jpegheight;
+	for(i=0; i<NUMSF; i++)
+	{
+		scaledw=TJSCALED(jpegwidth, sf[i]);
+		scaledh=TJSCALED(jpegheight, sf[i]);
+		if(scaledw<=width && scaledh<=height)
+			break;
+	}
+	if(scaledw>width || scaledh>height)
+		_throw("tjGetDecompressCost(): Could not scale down to desired image dimensions");
+	dinfo->scale_num=sf[i].num;
+	dinfo->scale_denom=sf[i].denom;
+
+	jpeg_calc_decompress_requirements(dinfo, &req);
+	cost->peakBytes=(unsigned long)req.peak_bytes;
+	cost->coefBufBytes=(unsigned long)req.coef_buffer_bytes;
+	cost->cpuCost=req.cpu_cost;
+
+	bailout:
+	if(dinfo->global_state>DSTATE_START) jpeg_abort_decompress(dinfo);
 	return retval;
 }
 
@@ -1492,6 +2926,7 @@ DLLEXPORT int DLLCALL tjDecodeYUVPlanes(tjhandle handle,
 	void (*old_reset_marker_reader)(j_decompress_ptr);
 
 	getdinstance(handle);
+	TJTRACE4(api__entry, "tjDecodeYUVPlanes", width, height, 0);
 
 	for(i=0; i<MAX_COMPONENTS; i++)
 	{
@@ -1500,6 +2935,7 @@ DLLEXPORT int DLLCALL tjDecodeYUVPlanes(tjhandle handle,
 
 	if((this->init&DECOMPRESS)==0)
 		_throw("tjDecodeYUVPlanes(): Instance has not been initialized for decompression");
+	resetMemoryStats(this);
 
 	if(!srcPlanes || !srcPlanes[0] || subsamp<0 || subsamp>=NUMSUBOPT
 		|| dstBuf==NULL || width<=0 || pitch<0 || height<=0 || pixelFormat<0
@@ -1631,6 +3067,7 @@ DLLEXPORT int DLLCALL tjDecodeYUVPlanes(tjhandle handle,
 		if(_tmpbuf[i]!=NULL) free(_tmpbuf[i]);
 		if(inbuf[i]!=NULL) free(inbuf[i]);
 	}
+	TJTRACE5(api__return, "tjDecodeYUVPlanes", retval, width, height, 0);
 	return retval;
 }
 
@@ -1670,18 +3107,22 @@ DLLEXPORT int DLLCALL tjDecodeYUV(tjhandle handle, unsigned char *srcBuf,
 	return retval;
 }
 
-DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
+/* Decompress a JPEG image into either separate Y, U, and V planes (layout<0)
+   or one of the interleaved YUV layouts.  funcName is used in error messages
+   and trace probes. */
+static int decompressToYUV(tjhandle handle, const char *funcName,
 	unsigned char *jpegBuf, unsigned long jpegSize, unsigned char **dstPlanes,
-	int width, int *strides, int height, int flags)
+	int width, int *strides, int height, int layout, int flags)
 {
 	int i, sfi, row, retval=0;  JSAMPROW *outbuf[MAX_COMPONENTS];
 	int jpegwidth, jpegheight, jpegSubsamp, scaledw, scaledh;
 	int pw[MAX_COMPONENTS], ph[MAX_COMPONENTS], iw[MAX_COMPONENTS],
-		tmpbufsize=0, usetmpbuf=0, th[MAX_COMPONENTS];
+		tmpbufsize=0, usetmpbuf=0, th[MAX_COMPONENTS], step[MAX_COMPONENTS];
 	JSAMPLE *_tmpbuf=NULL, *ptr;  JSAMPROW *tmpbuf[MAX_COMPONENTS];
 	int dctsize;
 
 	getdinstance(handle);
+	TJTRACE4(api__entry, funcName, width, height, jpegSize);
 
 	for(i=0; i<MAX_COMPONENTS; i++)
 	{
@@ -1689,11 +3130,12 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 	}
 
 	if((this->init&DECOMPRESS)==0)
-		_throw("tjDecompressToYUVPlanes(): Instance has not been initialized for decompression");
+		_throwfn("Instance has not been initialized for decompression");
+	resetMemoryStats(this);
 
 	if(jpegBuf==NULL || jpegSize<=0 || !dstPlanes || !dstPlanes[0] || width<0
-		|| height<0)
-		_throw("tjDecompressToYUVPlanes(): Invalid argument");
+		|| height<0 || layout>=TJ_NUMYUV)
+		_throwfn("Invalid argument");
 
 	if(flags&TJFLAG_FORCEMMX) putenv("JSIMD_FORCEMMX=1");
 	else if(flags&TJFLAG_FORCESSE) putenv("JSIMD_FORCESSE=1");
@@ -1714,10 +3156,17 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 	this->headerRead=0;
 	jpegSubsamp=getSubsamp(dinfo);
 	if(jpegSubsamp<0)
-		_throw("tjDecompressToYUVPlanes(): Could not determine subsampling type for JPEG image");
+		_throwfn("Could not determine subsampling type for JPEG image");
 
-	if(jpegSubsamp!=TJSAMP_GRAY && (!dstPlanes[1] || !dstPlanes[2]))
-		_throw("tjDecompressToYUVPlanes(): Invalid argument");
+	if(layout<0 && jpegSubsamp!=TJSAMP_GRAY && (!dstPlanes[1] || !dstPlanes[2]))
+		_throwfn("Invalid argument");
+	if(layout>=0)
+	{
+		if(jpegSubsamp!=tjYUVSubsamp[layout] || dinfo->num_components!=3)
+			_throwfn("JPEG image subsampling does not match the YUV layout");
+		if(yuvPlane[layout][1]!=0 && !dstPlanes[1])
+			_throwfn("Invalid argument");
+	}
 
 	jpegwidth=dinfo->image_width;  jpegheight=dinfo->image_height;
 	if(width==0) width=jpegwidth;
@@ -1730,9 +3179,9 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 			break;
 	}
 	if(scaledw>width || scaledh>height)
-		_throw("tjDecompressToYUVPlanes(): Could not scale down to desired image dimensions");
+		_throwfn("Could not scale down to desired image dimensions");
 	if(dinfo->num_components>3)
-		_throw("tjDecompressToYUVPlanes(): JPEG image must have 3 or fewer components");
+		_throwfn("JPEG image must have 3 or fewer components");
 
 	width=scaledw;  height=scaledh;
 	dinfo->scale_num=sf[i].num;
@@ -1752,27 +3201,41 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 			*compptr->h_samp_factor/dinfo->max_h_samp_factor;
 		ph[i]=PAD(dinfo->output_height, dinfo->max_v_samp_factor)
 			*compptr->v_samp_factor/dinfo->max_v_samp_factor;
-		if(iw[i]!=pw[i] || ih!=ph[i]) usetmpbuf=1;
+		step[i]=layout<0? 1:yuvStep[layout][i];
+		if(iw[i]!=pw[i] || ih!=ph[i] || step[i]!=1) usetmpbuf=1;
 		th[i]=compptr->v_samp_factor*dctsize;
 		tmpbufsize+=iw[i]*th[i];
 		if((outbuf[i]=(JSAMPROW *)malloc(sizeof(JSAMPROW)*ph[i]))==NULL)
-			_throw("tjDecompressToYUVPlanes(): Memory allocation failure");
-		ptr=dstPlanes[i];
-		for(row=0; row<ph[i]; row++)
+			_throwfn("Memory allocation failure");
+		if(layout<0)
 		{
-			outbuf[i][row]=ptr;
-			ptr+=(strides && strides[i]!=0)? strides[i]:pw[i];
+			ptr=dstPlanes[i];
+			for(row=0; row<ph[i]; row++)
+			{
+				outbuf[i][row]=ptr;
+				ptr+=(strides && strides[i]!=0)? strides[i]:pw[i];
+			}
+		}
+		else
+		{
+			int p=yuvPlane[layout][i];
+			ptr=dstPlanes[p]+yuvOffset[layout][i];
+			for(row=0; row<ph[i]; row++)
+			{
+				outbuf[i][row]=ptr;
+				ptr+=(strides && strides[p]!=0)? strides[p]:pw[i]*step[i];
+			}
 		}
 	}
 	if(usetmpbuf)
 	{
 		if((_tmpbuf=(JSAMPLE *)malloc(sizeof(JSAMPLE)*tmpbufsize))==NULL)
-			_throw("tjDecompressToYUVPlanes(): Memory allocation failure");
+			_throwfn("Memory allocation failure");
 		ptr=_tmpbuf;
 		for(i=0; i<dinfo->num_components; i++)
 		{
 			if((tmpbuf[i]=(JSAMPROW *)malloc(sizeof(JSAMPROW)*th[i]))==NULL)
-				_throw("tjDecompressToYUVPlanes(): Memory allocation failure");
+				_throwfn("Memory allocation failure");
 			for(row=0; row<th[i]; row++)
 			{
 				tmpbuf[i][row]=ptr;
@@ -1825,7 +3288,7 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 			{
 				for(j=0; j<min(th[i], ph[i]-crow[i]); j++)
 				{
-					memcpy(outbuf[i][crow[i]+j], tmpbuf[i][j], pw[i]);
+					interleave(tmpbuf[i][j], outbuf[i][crow[i]+j], step[i], pw[i]);
 				}
 			}
 		}
@@ -1840,6 +3303,31 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
 		if(outbuf[i]) free(outbuf[i]);
 	}
 	if(_tmpbuf) free(_tmpbuf);
+	TJTRACE5(api__return, funcName, retval, width, height, jpegSize);
+	return retval;
+}
+
+DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
+	unsigned char *jpegBuf, unsigned long jpegSize, unsigned char **dstPlanes,
+	int width, int *strides, int height, int flags)
+{
+	return decompressToYUV(handle, "tjDecompressToYUVPlanes", jpegBuf, jpegSize,
+		dstPlanes, width, strides, height, -1, flags);
+}
+
+DLLEXPORT int DLLCALL tjDecompressToYUVLayout(tjhandle handle,
+	unsigned char *jpegBuf, unsigned long jpegSize, unsigned char **dstPlanes,
+	int width, int *strides, int height, int layout, int flags)
+{
+	int retval=-1;
+
+	if(layout<0 || layout>=TJ_NUMYUV)
+		_throw("tjDecompressToYUVLayout(): Invalid argument");
+
+	return decompressToYUV(handle, "tjDecompressToYUVLayout", jpegBuf, jpegSize,
+		dstPlanes, width, strides, height, layout, flags);
+
+	bailout:
 	return retval;
 }
 
@@ -1936,12 +3424,14 @@ DLLEXPORT int DLLCALL tjTransform(tjhandle handle, unsigned char *jpegBuf,
 	unsigned long *dstSizes, tjtransform *t, int flags)
 {
 	jpeg_transform_info *xinfo=NULL;
-	jvirt_barray_ptr *srccoefs, *dstcoefs;
-	int retval=0, i, jpegSubsamp;
+	jvirt_barray_ptr *srccoefs=NULL, *dstcoefs;
+	int retval=0, i, jpegSubsamp, stream;
 
 	getinstance(handle);
+	TJTRACE4(api__entry, "tjTransform", 0, 0, jpegSize);
 	if((this->init&COMPRESS)==0 || (this->init&DECOMPRESS)==0)
 		_throw("tjTransform(): Instance has not been initialized for transformation");
+	resetMemoryStats(this);
 
 	if(jpegBuf==NULL || jpegSize<=0 || n<1 || dstBufs==NULL || dstSizes==NULL
 		|| t==NULL || flags<0)
@@ -2017,7 +3507,12 @@ DLLEXPORT int DLLCALL tjTransform(tjhandle handle, unsigned char *jpegBuf,
 		}
 	}
 
-	srccoefs=jpeg_read_coefficients(dinfo);
+	/* A single-scan image that isn't being transformed can be transcoded one
+	   iMCU row at a time, rather than reading all of its coefficients first. */
+	stream=(n==1 && t[0].op==TJXOP_NONE && !t[0].customFilter
+		&& !(t[0].options&(TJXOPT_CROP|TJXOPT_GRAY|TJXOPT_NOOUTPUT))
+		&& !jpeg_has_multiple_scans(dinfo));
+	if(!stream) srccoefs=jpeg_read_coefficients(dinfo);
 
 	for(i=0; i<n; i++)
 	{
@@ -2037,8 +3532,40 @@ DLLEXPORT int DLLCALL tjTransform(tjhandle handle, unsigned char *jpegBuf,
 		if(!(t[i].options&TJXOPT_NOOUTPUT))
 			jpeg_mem_dest_tj(cinfo, &dstBufs[i], &dstSizes[i], alloc);
 		jpeg_copy_critical_parameters(dinfo, cinfo);
+		if(t[i].options&TJXOPT_ARITHMETIC) cinfo->arith_code=TRUE;
 		dstcoefs=jtransform_adjust_parameters(dinfo, cinfo, srccoefs,
 			&xinfo[i]);
+		if(stream)
+		{
+			JBLOCKARRAY rowBuf[MAX_COMPONENTS], dstRows[MAX_COMPONENTS];
+			JDIMENSION row, dstRow=0;  int ci, y;
+			jpeg_write_coefficients(cinfo, NULL);
+			jcopy_markers_execute(dinfo, cinfo, JCOPYOPT_ALL);
+			for(ci=0; ci<dinfo->num_components; ci++)
+			{
+				jpeg_component_info *compptr=&dinfo->comp_info[ci];
+				rowBuf[ci]=(dinfo->mem->alloc_barray)((j_common_ptr)dinfo,
+					JPOOL_IMAGE, (JDIMENSION)jround_up(compptr->width_in_blocks,
+					compptr->h_samp_factor), compptr->v_samp_factor);
+			}
+			/* jtransform_adjust_parameters() gives a single-component image 1x1
+			   sampling factors, in which case each source iMCU row holds several
+			   destination iMCU rows. */
+			for(row=0; row<dinfo->total_iMCU_rows; row++)
+			{
+				jpeg_read_coefficient_row(dinfo, rowBuf);
+				for(y=0; y<dinfo->comp_info[0].v_samp_factor
+					&& dstRow<cinfo->total_iMCU_rows;
+					y+=cinfo->comp_info[0].v_samp_factor, dstRow++)
+				{
+					for(ci=0; ci<dinfo->num_components; ci++)
+						dstRows[ci]=&rowBuf[ci][y];
+					jpeg_write_coefficient_row(cinfo, dstRows);
+				}
+			}
+			jpeg_finish_compress(cinfo);
+			continue;
+		}
 		if(!(t[i].options&TJXOPT_NOOUTPUT))
 		{
 			jpeg_write_coefficients(cinfo, dstcoefs);
@@ -2081,5 +3608,7 @@ DLLEXPORT int DLLCALL tjTransform(tjhandle handle, unsigned char *jpegBuf,
 	if(cinfo->global_state>CSTATE_START) jpeg_abort_compress(cinfo);
 	if(dinfo->global_state>DSTATE_START) jpeg_abort_decompress(dinfo);
 	if(xinfo) free(xinfo);
+	TJTRACE5(api__return, "tjTransform", retval, dinfo->image_width,
+		dinfo->image_height, jpegSize);
 	return retval;
 }
@@ -71,6 +71,16 @@
  * 4 bytes on top of this, then the luminance plane would be 36 x 35 bytes, and
  * each of the chrominance planes would be 20 x 35 bytes.
  *
+ * The interleaved YUV layouts (see @ref TJYUV "YUV layouts") store the same
+ * samples in fewer planes.  A semi-planar (NV12 or NV21) image consists of the
+ * luminance plane, followed by a single chrominance plane in which each line
+ * holds alternating Cb and Cr samples and is thus twice as wide (in bytes) as
+ * a 4:2:0 chrominance plane.  A packed (YUYV or UYVY) image consists of a
+ * single 4:2:2 plane in which each line holds two bytes per pixel of the
+ * padded luminance plane width.  In the example above (a 35 x 35-pixel image),
+ * a YUYV image would be 72 x 35 bytes, whereas an NV12 image would consist of
+ * a 36 x 36-byte luminance plane and a 36 x 18-byte chrominance plane.
+ *
  * @{
  */
 
@@ -155,6 +165,50 @@ static const int tjMCUWidth[TJ_NUMSAMP]  = {8, 16, 16, 8, 8, 32};
 static const int tjMCUHeight[TJ_NUMSAMP] = {8, 8, 16, 8, 16, 8};
 
 
+/**
+ * The number of interleaved YUV layouts
+ */
+#define TJ_NUMYUV 4
+
+/**
+ * Interleaved YUV layouts.
+ * These layouts are used by #tjCompressFromYUVLayout() and
+ * #tjDecompressToYUVLayout() to read or write the chrominance components of
+ * a YUV image in the interleaved forms expected by many video codecs and
+ * display APIs.  Each layout implies a particular level of chrominance
+ * subsampling (see #tjYUVSubsamp.)
+ */
+enum TJYUV
+{
+  /**
+   * Semi-planar 4:2:0 format.  The Y plane is followed by a single chrominance
+   * plane containing interleaved Cb and Cr samples (Cb first.)
+   */
+  TJYUV_NV12=0,
+  /**
+   * Semi-planar 4:2:0 format.  The Y plane is followed by a single chrominance
+   * plane containing interleaved Cr and Cb samples (Cr first.)
+   */
+  TJYUV_NV21,
+  /**
+   * Packed 4:2:2 format.  Each pair of pixels is stored as Y0, Cb, Y1, Cr.
+   */
+  TJYUV_YUYV,
+  /**
+   * Packed 4:2:2 format.  Each pair of pixels is stored as Cb, Y0, Cr, Y1.
+   */
+  TJYUV_UYVY
+};
+
+/**
+ * Level of chrominance subsampling (see @ref TJSAMP
+ * "Chrominance subsampling options") implied by a given YUV layout.
+ */
+static const int tjYUVSubsamp[TJ_NUMYUV] = {
+  TJSAMP_420, TJSAMP_420, TJSAMP_422, TJSAMP_422
+};
+
+
 /**
  * The number of pixel formats
  */
@@ -383,6 +437,14 @@ enum TJCS
  * when decompressing, because this has been shown to have a larger effect.
  */
 #define TJFLAG_ACCURATEDCT   4096
+/**
+ * When decompressing a 4:2:0 JPEG image to an RGB, grayscale, or CMYK image
+ * at full size, reconstruct the chrominance components directly at full size
+ * using a 16x16 inverse DCT, rather than reconstructing them at half size and
+ * then upsampling them.  This flag overrides #TJFLAG_FASTUPSAMPLE for such
+ * images, and it has no effect on other images or when scaling.
+ */
+#define TJFLAG_DCTUPSAMPLE   8192
 
 
 /**
@@ -475,6 +537,31 @@ enum TJXOP
  * them.)
  */
 #define TJXOPT_NOOUTPUT 16
+/**
+ * This option will cause #tjTransform() to use arithmetic entropy coding in
+ * the output image, rather than Huffman coding.  If the input image has a
+ * single scan (that is, it is not progressive and all of its components are
+ * interleaved) and only one transform is requested, with no transform
+ * operation, cropping, grayscale conversion, or custom filter, then
+ * #tjTransform() transcodes the image one MCU row at a time rather than
+ * reading all of its DCT coefficients into memory first.  That makes lossless
+ * conversion between Huffman and arithmetic coding (in either direction)
+ * relatively fast and memory-efficient.
+ */
+#define TJXOPT_ARITHMETIC 32
+
+
+/**
+ * This option will cause #tjCompressMulti() to generate optimal Huffman tables
+ * for this quality level, rather than using the standard tables.  This
+ * requires an extra pass over the DCT coefficients.
+ */
+#define TJQOPT_OPTIMIZE    1
+/**
+ * This option will cause #tjCompressMulti() to generate a progressive JPEG
+ * image for this quality level.
+ */
+#define TJQOPT_PROGRESSIVE 2
 
 
 /**
@@ -579,6 +666,176 @@ typedef struct tjtransform
     struct tjtransform *transform);
 } tjtransform;
 
+/**
+ * Quality level for #tjCompressMulti()
+ */
+typedef struct
+{
+  /**
+   * The image quality of the JPEG image generated for this level (1 = worst,
+   * 100 = best)
+   */
+  int quality;
+  /**
+   * The bitwise OR of zero or more of the @ref TJQOPT_OPTIMIZE
+   * "quality level options"
+   */
+  int options;
+} tjqualitylevel;
+
+/**
+ * Memory usage statistics
+ */
+typedef struct
+{
+  /**
+   * The peak amount of memory (in bytes) that the underlying codec had
+   * allocated at any one time during the most recent compression,
+   * decompression, YUV encoding/decoding, or transform operation.  For a
+   * transformer instance, this is the sum of the peak values for the
+   * decompressor and the compressor.  This does not include any buffers that
+   * were supplied by the calling program or allocated on its behalf (such as
+   * JPEG destination buffers.)
+   */
+  unsigned long peakBytes;
+  /**
+   * The amount of memory (in bytes) that the underlying codec currently has
+   * allocated.  This memory is retained until the instance is destroyed.
+   */
+  unsigned long currentBytes;
+  /**
+   * The number of individual memory allocations that the underlying codec
+   * performed during the most recent operation
+   */
+  unsigned long numAllocs;
+  /**
+   * The total size (in bytes) of the whole-image buffers (such as the DCT
+   * coefficient buffer used for progressive JPEG images or transforms) that
+   * were created during the most recent operation.  These buffers are
+   * included in #peakBytes.
+   */
+  unsigned long virtArrayBytes;
+} tjmemstats;
+
+
+/**
+ * Estimated resource requirements of a decompression operation
+ */
+typedef struct
+{
+  /**
+   * The estimated peak amount of memory (in bytes) that the underlying codec
+   * will have allocated at any one time during the decompression.  This is
+   * comparable to #tjmemstats::peakBytes, and it likewise does not include
+   * the destination buffer.  The estimate is exact unless later scans of a
+   * multi-scan image use entropy coding tables that the first scan doesn't
+   * use, in which case the actual value may be a few kilobytes larger.
+   */
+  unsigned long peakBytes;
+  /**
+   * The portion of #peakBytes (in bytes) that will be used by the whole-image
+   * DCT coefficient buffer.  This buffer is needed only for progressive and
+   * multi-scan JPEG images, and it is usually the dominant memory cost for
+   * those images.
+   */
+  unsigned long coefBufBytes;
+  /**
+   * The estimated CPU cost of the decompression, in units of the time
+   * required to decompress one 8x8 DCT block of a baseline JPEG image with
+   * 4:4:4 subsampling.  This is intended for comparing the relative cost of
+   * different images rather than for predicting absolute decompression times.
+   */
+  double cpuCost;
+} tjdecompcost;
+
+
+/**
+ * JPEG header information returned by #tjProbeHeader()
+ */
+typedef struct
+{
+  /**
+   * The width (in pixels) of the JPEG image
+   */
+  int width;
+  /**
+   * The height (in pixels) of the JPEG image
+   */
+  int height;
+  /**
+   * The number of color components in the JPEG image
+   */
+  int numComponents;
+  /**
+   * The level of chrominance subsampling used in the JPEG image (see
+   * @ref TJSAMP "Chrominance subsampling options"), or -1 if the sampling
+   * factors do not correspond to any of the TurboJPEG subsampling options
+   */
+  int subsamp;
+  /**
+   * The colorspace of the JPEG image (see @ref TJCS "JPEG colorspaces"), or
+   * -1 if it cannot be determined.  This is the same colorspace that
+   * #tjDecompressHeader3() would report.
+   */
+  int colorspace;
+  /**
+   * The sample precision (in bits) of the JPEG image
+   */
+  int precision;
+  /**
+   * 1 if the JPEG image is progressive, or 0 otherwise
+   */
+  int progressive;
+  /**
+   * 1 if the JPEG image uses arithmetic entropy coding, or 0 otherwise
+   */
+  int arithmetic;
+  /**
+   * The value (1-8) of the orientation tag in the Exif APP1 marker, or 0 if
+   * the image has no Exif orientation tag
+   */
+  int orientation;
+  /**
+   * 1 if the JPEG image contains an embedded ICC profile (one or more
+   * ICC_PROFILE APP2 markers), or 0 otherwise
+   */
+  int hasICCProfile;
+} tjheaderinfo;
+
+
+/**
+ * JPEG image integrity information returned by #tjValidate()
+ */
+typedef struct
+{
+  /**
+   * The number of scans that were decoded
+   */
+  int numScans;
+  /**
+   * The number of warnings (corrupt entropy-coded data, premature end of
+   * data, etc.) that were issued while decoding the scans
+   */
+  int numWarnings;
+  /**
+   * The scan number (starting at 1) in which the first warning was issued, or
+   * 0 if there were no warnings
+   */
+  int badScan;
+  /**
+   * The column (in MCUs) within that scan at which the first warning was
+   * issued, or -1 if there were no warnings or if the first warning was issued
+   * while reading the markers between scans
+   */
+  int badMCUX;
+  /**
+   * The row (in MCUs) within that scan at which the first warning was issued,
+   * or -1 if there were no warnings or if the first warning was issued while
+   * reading the markers between scans
+   */
+  int badMCUY;
+} tjvalidateinfo;
+
 /**
  * TurboJPEG instance handle
  */
@@ -598,6 +855,14 @@ typedef void* tjhandle;
 #define TJSCALED(dimension, scalingFactor) ((dimension * scalingFactor.num \
   + scalingFactor.denom - 1) / scalingFactor.denom)
 
+/**
+ * Compute the value of <tt>dimension</tt> at the given level of an image
+ * pyramid generated by #tjCompressPyramid().  This macro performs the integer
+ * equivalent of <tt>ceil(dimension / 2<sup>level</sup>)</tt>.
+ */
+#define TJPYRAMIDSCALED(dimension, level) \
+  (((dimension) + (1 << (level)) - 1) >> (level))
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -650,7 +915,8 @@ DLLEXPORT tjhandle DLLCALL tjInitCompress(void);
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If TurboJPEG had to grow the buffer, then it will have
+ * freed the pre-allocated buffer.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -677,6 +943,182 @@ DLLEXPORT int DLLCALL tjCompress2(tjhandle handle, unsigned char *srcBuf,
   unsigned long *jpegSize, int jpegSubsamp, int jpegQual, int flags);
 
 
+/**
+ * Compress an RGB, grayscale, or CMYK image into a JPEG image whose size does
+ * not exceed a given target.  This function performs color conversion and the
+ * forward DCT only once, and it estimates the size of the JPEG image at each
+ * candidate quality from the cached DCT coefficients, so it is much faster
+ * than repeatedly calling #tjCompress2() with different quality values.  The
+ * highest quality whose estimated size fits within the target is chosen, and
+ * the image is then entropy-coded.  If the estimate proves to be too low,
+ * then the quality is reduced until the image fits.
+ *
+ * The generated JPEG image always uses the accurate integer DCT (unless
+ * #TJFLAG_FASTDCT is specified), baseline Huffman coding, and the standard
+ * Huffman tables.  The <tt>TJ_OPTIMIZE</tt>, <tt>TJ_ARITHMETIC</tt>, and
+ * <tt>TJ_PROGRESSIVE</tt> environment variables are ignored.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcBuf pointer to an image buffer containing RGB, grayscale, or
+ * CMYK pixels to be compressed
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param pitch bytes per line in the source image (see #tjCompress2().)
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param pixelFormat pixel format of the source image (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param jpegBuf address of a pointer to an image buffer that will receive the
+ * JPEG image (see #tjCompress2().)
+ *
+ * @param jpegSize pointer to an unsigned long variable that holds the size of
+ * the JPEG image buffer (see #tjCompress2().)  Upon return,
+ * <tt>*jpegSize</tt> will contain the size of the JPEG image (in bytes.)
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG image (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param targetSize the maximum size (in bytes) of the JPEG image
+ *
+ * @param jpegQual if not NULL, then the quality of the generated JPEG image
+ * (1 = worst, 100 = best) is stored here upon return.
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ * An error is returned if the JPEG image cannot be made smaller than
+ * <tt>targetSize</tt> even at quality 1.
+*/
+DLLEXPORT int DLLCALL tjCompressToSize(tjhandle handle, unsigned char *srcBuf,
+  int width, int pitch, int height, int pixelFormat, unsigned char **jpegBuf,
+  unsigned long *jpegSize, int jpegSubsamp, unsigned long targetSize,
+  int *jpegQual, int flags);
+
+
+/**
+ * Compress an RGB, grayscale, or CMYK image into several JPEG images with
+ * different qualities.  Color conversion, chrominance subsampling, and the
+ * forward DCT are performed only once, and the resulting DCT coefficients are
+ * quantized and entropy-coded separately for each quality level.  If the
+ * library was built with thread support, then the quality levels are encoded
+ * in parallel, using (by default) one thread per level.  The
+ * <tt>TJ_THREADS</tt> environment variable can be set to limit the number of
+ * threads, including the calling thread.
+ *
+ * The JPEG images always use the accurate integer DCT (unless
+ * #TJFLAG_FASTDCT is specified.)  Because the DCT coefficients are rounded
+ * before they are quantized for each level, the JPEG images may differ
+ * slightly from those generated by #tjCompress2() with the same quality.
+ * The <tt>TJ_OPTIMIZE</tt>, <tt>TJ_ARITHMETIC</tt>, <tt>TJ_PROGRESSIVE</tt>,
+ * and <tt>TJ_RESTART</tt> environment variables are honored, in addition to
+ * the per-level options.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcBuf pointer to an image buffer containing RGB, grayscale, or
+ * CMYK pixels to be compressed
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param pitch bytes per line in the source image (see #tjCompress2().)
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param pixelFormat pixel format of the source image (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param n the number of quality levels (and JPEG images) to generate
+ *
+ * @param jpegBufs pointer to an array of n image buffers.  <tt>jpegBufs[i]</tt>
+ * will receive the JPEG image for the ith quality level.  Each buffer is
+ * handled in the same manner as the <tt>jpegBuf</tt> parameter of
+ * #tjCompress2(), so it can be pre-allocated or set to NULL.
+ *
+ * @param jpegSizes pointer to an array of n unsigned long variables that will
+ * receive the actual sizes (in bytes) of each JPEG image.  If
+ * <tt>jpegBufs[i]</tt> points to a pre-allocated buffer, then
+ * <tt>jpegSizes[i]</tt> should be set to the size of the buffer.
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG images (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param levels pointer to an array of n #tjqualitylevel structures, each of
+ * which specifies the quality and options for one JPEG image
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+*/
+DLLEXPORT int DLLCALL tjCompressMulti(tjhandle handle, unsigned char *srcBuf,
+  int width, int pitch, int height, int pixelFormat, int n,
+  unsigned char **jpegBufs, unsigned long *jpegSizes, int jpegSubsamp,
+  tjqualitylevel *levels, int flags);
+
+
+/**
+ * Compress an RGB, grayscale, or CMYK image into an image pyramid:  a set of
+ * JPEG images whose dimensions are 1/1, 1/2, 1/4, etc. of the source image
+ * dimensions.  Each level of the pyramid is generated by averaging each 2x2
+ * group of pixels in the previous level (replicating the last column or row if
+ * the width or height is odd), and all levels are compressed in a single pass
+ * over the source image, so the source image is read from memory only once
+ * and the downsampled images are never stored in full.
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcBuf pointer to an image buffer containing RGB, grayscale, or
+ * CMYK pixels to be compressed
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param pitch bytes per line in the source image (see #tjCompress2().)
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param pixelFormat pixel format of the source image (see @ref TJPF
+ * "Pixel formats".)
+ *
+ * @param n the number of pyramid levels (and JPEG images) to generate (1 to
+ * 16.)  The width and height of level i are
+ * <tt>TJPYRAMIDSCALED(width, i)</tt> and
+ * <tt>TJPYRAMIDSCALED(height, i)</tt> (see #TJPYRAMIDSCALED().)
+ *
+ * @param jpegBufs pointer to an array of n image buffers.  <tt>jpegBufs[i]</tt>
+ * will receive the JPEG image for level i.  Each buffer is handled in the same
+ * manner as the <tt>jpegBuf</tt> parameter of #tjCompress2(), so it can be
+ * pre-allocated or set to NULL.
+ *
+ * @param jpegSizes pointer to an array of n unsigned long variables that will
+ * receive the actual sizes (in bytes) of each JPEG image.  If
+ * <tt>jpegBufs[i]</tt> points to a pre-allocated buffer, then
+ * <tt>jpegSizes[i]</tt> should be set to the size of the buffer.
+ *
+ * @param jpegSubsamp the level of chrominance subsampling to be used when
+ * generating the JPEG images (see @ref TJSAMP
+ * "Chrominance subsampling options".)
+ *
+ * @param jpegQual the image quality of the generated JPEG images (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+*/
+DLLEXPORT int DLLCALL tjCompressPyramid(tjhandle handle,
+  unsigned char *srcBuf, int width, int pitch, int height, int pixelFormat,
+  int n, unsigned char **jpegBufs, unsigned long *jpegSizes, int jpegSubsamp,
+  int jpegQual, int flags);
+
+
 /**
  * Compress a YUV planar image into a JPEG image.
  *
@@ -718,7 +1160,8 @@ DLLEXPORT int DLLCALL tjCompress2(tjhandle handle, unsigned char *srcBuf,
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If TurboJPEG had to grow the buffer, then it will have
+ * freed the pre-allocated buffer.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -788,7 +1231,8 @@ DLLEXPORT int DLLCALL tjCompressFromYUV(tjhandle handle, unsigned char *srcBuf,
  * If you choose option 1, <tt>*jpegSize</tt> should be set to the size of your
  * pre-allocated buffer.  In any case, unless you have set #TJFLAG_NOREALLOC,
  * you should always check <tt>*jpegBuf</tt> upon return from this function, as
- * it may have changed.
+ * it may have changed.  If TurboJPEG had to grow the buffer, then it will have
+ * freed the pre-allocated buffer.
  *
  * @param jpegSize pointer to an unsigned long variable that holds the size of
  * the JPEG image buffer.  If <tt>*jpegBuf</tt> points to a pre-allocated
@@ -811,6 +1255,56 @@ DLLEXPORT int DLLCALL tjCompressFromYUVPlanes(tjhandle handle,
 	unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual, int flags);
 
 
+/**
+ * Compress a YUV image with interleaved chrominance components (NV12, NV21,
+ * YUYV, or UYVY) into a JPEG image.  The components are separated one MCU row
+ * at a time as they are passed to the underlying codec, so this is equivalent
+ * to, but faster than, converting the image to separate Y, U (Cb), and V (Cr)
+ * planes and calling #tjCompressFromYUVPlanes().
+ *
+ * @param handle a handle to a TurboJPEG compressor or transformer instance
+ *
+ * @param srcPlanes an array of pointers to the image planes that contain the
+ * YUV image to be compressed.  For the semi-planar layouts, this array should
+ * contain a pointer to the Y plane followed by a pointer to the interleaved
+ * chrominance plane.  For the packed layouts, only the first pointer is used.
+ * These planes can be contiguous or non-contiguous in memory.  Refer to
+ * @ref YUVnotes "YUV Image Format Notes" for more details.
+ *
+ * @param width width (in pixels) of the source image
+ *
+ * @param strides an array of integers, each specifying the number of bytes per
+ * line in the corresponding plane of the YUV source image.  Setting the stride
+ * for any plane to 0 is the same as setting it to the width of that plane (in
+ * bytes.)  If <tt>strides</tt> is NULL, then the strides for all planes will
+ * be set to their respective plane widths.
+ *
+ * @param height height (in pixels) of the source image
+ *
+ * @param layout the layout of the YUV source image (see @ref TJYUV
+ * "YUV layouts".)  The JPEG image will use the level of chrominance
+ * subsampling implied by this layout.
+ *
+ * @param jpegBuf address of a pointer to an image buffer that will receive the
+ * JPEG image.  See #tjCompressFromYUVPlanes() for a description of the buffer
+ * allocation options.
+ *
+ * @param jpegSize pointer to an unsigned long variable that holds the size of
+ * the JPEG image buffer.  See #tjCompressFromYUVPlanes().
+ *
+ * @param jpegQual the image quality of the generated JPEG image (1 = worst,
+ * 100 = best)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+*/
+DLLEXPORT int DLLCALL tjCompressFromYUVLayout(tjhandle handle,
+	unsigned char **srcPlanes, int width, int *strides, int height, int layout,
+	unsigned char **jpegBuf, unsigned long *jpegSize, int jpegQual, int flags);
+
+
 /**
  * The maximum size of the buffer (in bytes) required to hold a JPEG image with
  * the given parameters.  The number of bytes returned by this function is
@@ -1067,6 +1561,58 @@ DLLEXPORT int DLLCALL tjDecompressHeader3(tjhandle handle,
   int *jpegSubsamp, int *jpegColorspace);
 
 
+/**
+ * Retrieve basic information about a JPEG image by scanning its markers,
+ * without creating a TurboJPEG instance.  This function reads only the
+ * markers that precede the first scan, and it skips over all of them except
+ * SOF and the Exif, ICC_PROFILE, JFIF, and Adobe APPn markers.  It performs no
+ * memory allocation and uses no global state, so it can be called
+ * concurrently from any number of threads.  Unlike #tjDecompressHeader3(),
+ * this function does not validate the quantization or Huffman tables, so a
+ * successful return does not guarantee that the image can be decompressed.
+ *
+ * @param jpegBuf pointer to a buffer containing a JPEG image, or at least the
+ * beginning of one
+ *
+ * @param jpegSize size of the buffer (in bytes)
+ *
+ * @param info pointer to a #tjheaderinfo structure that will receive the
+ * header information
+ *
+ * @return 0 if successful, or -1 if the buffer does not contain a valid JPEG
+ * header up to and including the SOF marker.  This function does not set the
+ * error string returned by #tjGetErrorStr().
+*/
+DLLEXPORT int DLLCALL tjProbeHeader(unsigned char *jpegBuf,
+  unsigned long jpegSize, tjheaderinfo *info);
+
+
+/**
+ * Check the integrity of a JPEG image without decompressing it.  This function
+ * reads all of the markers and entropy decodes all of the scans in the JPEG
+ * image, but it does not store the DCT coefficients (except when the image is
+ * progressive), and it performs no inverse DCT, upsampling, or color
+ * conversion, so it is several times faster than #tjDecompress2().  It can be
+ * used to detect truncated or corrupt JPEG images.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to check
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param info pointer to a #tjvalidateinfo structure that will receive
+ * information about the integrity of the JPEG image, or NULL if this
+ * information is not needed
+ *
+ * @return 0 if the JPEG image is intact, or -1 if it is corrupt or an error
+ * occurred.  In the latter case, #tjGetErrorStr() describes the error or the
+ * first problem that was detected in the JPEG image.
+*/
+DLLEXPORT int DLLCALL tjValidate(tjhandle handle, unsigned char *jpegBuf,
+  unsigned long jpegSize, tjvalidateinfo *info);
+
+
 /**
  * Returns a list of fractional scaling factors that the JPEG decompressor in
  * this implementation of TurboJPEG supports.
@@ -1134,6 +1680,102 @@ DLLEXPORT int DLLCALL tjDecompress2(tjhandle handle,
   int width, int pitch, int height, int pixelFormat, int flags);
 
 
+/**
+ * Decompress a preview of a progressive JPEG image to an RGB, grayscale, or
+ * CMYK image.  This function is identical to #tjDecompress2(), except that,
+ * if the JPEG image contains multiple scans (as progressive JPEG images do),
+ * then it stops reading the image after the specified number of scans or the
+ * specified number of bytes, whichever comes first, and it generates the
+ * destination image from the partially refined DCT coefficients.  The
+ * remainder of the JPEG image is not read or decoded, so this is much faster
+ * than decompressing the whole image if only a low-quality thumbnail or
+ * placeholder is needed.  Images with a single scan are decompressed in full.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstBuf pointer to an image buffer that will receive the decompressed
+ * image (see #tjDecompress2().)
+ *
+ * @param width desired width (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pitch bytes per line in the destination image (see #tjDecompress2().)
+ *
+ * @param height desired height (in pixels) of the destination image (see
+ * #tjDecompress2().)
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @param maxScans the number of scans to read, or 0 for no limit.  For
+ * instance, a value of 1 generally reads only the first DC scan of a
+ * progressive image.
+ *
+ * @param maxBytes the number of bytes of the JPEG image (including the
+ * headers) to read, or 0 for no limit.  This limit is checked after each row
+ * of MCU blocks, so slightly more data may be read.  If the limit falls
+ * within a scan, then the part of the image below the last row that was read
+ * will not receive that scan's refinements.
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ */
+DLLEXPORT int DLLCALL tjDecompressPreview(tjhandle handle,
+  unsigned char *jpegBuf, unsigned long jpegSize, unsigned char *dstBuf,
+  int width, int pitch, int height, int pixelFormat, int flags, int maxScans,
+  unsigned long maxBytes);
+
+
+/**
+ * Decompress a JPEG image to several RGB, grayscale, or CMYK images of
+ * different sizes.  The JPEG image is entropy-decoded only once, and each of
+ * the destination images is then generated from the same DCT coefficients
+ * using a scaled inverse DCT, so producing a set of downscaled images (for
+ * instance, 1/1, 1/2, 1/4, and 1/8 scale) costs little more than
+ * decompressing the image once.  Each destination image is identical to the
+ * image that #tjDecompress2() would produce with the same scaling factor,
+ * pixel format, and flags.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param n the number of destination images to generate
+ *
+ * @param dstBufs an array of <tt>n</tt> pointers to image buffers that will
+ * receive the decompressed images.  Each buffer should be at least
+ * <tt>scaledWidth * tjPixelSize[pixelFormat] * scaledHeight</tt> bytes, where
+ * <tt>scaledWidth</tt> and <tt>scaledHeight</tt> are the dimensions of the
+ * JPEG image scaled with the corresponding scaling factor (see
+ * #TJSCALED().)  The rows of each destination image are stored contiguously,
+ * with no padding.
+ *
+ * @param scalingFactors an array of <tt>n</tt> scaling factors, each of which
+ * must be one of the scaling factors returned by #tjGetScalingFactors().  The
+ * same scaling factor may be given more than once.
+ *
+ * @param pixelFormat pixel format of the destination images (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ */
+DLLEXPORT int DLLCALL tjDecompressScales(tjhandle handle,
+  unsigned char *jpegBuf, unsigned long jpegSize, int n,
+  unsigned char **dstBufs, tjscalingfactor *scalingFactors, int pixelFormat,
+  int flags);
+
+
 /**
  * Decompress a JPEG image to a YUV planar image.  This function performs JPEG
  * decompression but leaves out the color conversion step, so a planar YUV
@@ -1240,6 +1882,52 @@ DLLEXPORT int DLLCALL tjDecompressToYUVPlanes(tjhandle handle,
   int width, int *strides, int height, int flags);
 
 
+/**
+ * Decompress a JPEG image into a YUV image with interleaved chrominance
+ * components (NV12, NV21, YUYV, or UYVY.)  The components are interleaved one
+ * MCU row at a time as they are produced by the underlying codec, so this is
+ * equivalent to, but faster than, calling #tjDecompressToYUVPlanes() and then
+ * interleaving the U (Cb) and V (Cr) planes.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image to decompress
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param dstPlanes an array of pointers to the image planes that will receive
+ * the YUV image.  For the semi-planar layouts, this array should contain a
+ * pointer to the Y plane followed by a pointer to the interleaved chrominance
+ * plane.  For the packed layouts, only the first pointer is used.  These
+ * planes can be contiguous or non-contiguous in memory.  Refer to
+ * @ref YUVnotes "YUV Image Format Notes" for more details.
+ *
+ * @param width desired width (in pixels) of the YUV image.  This is handled
+ * in the same manner as in #tjDecompressToYUVPlanes().
+ *
+ * @param strides an array of integers, each specifying the number of bytes per
+ * line in the corresponding plane of the output image.  Setting the stride for
+ * any plane to 0 is the same as setting it to the width of that plane (in
+ * bytes.)  If <tt>strides</tt> is NULL, then the strides for all planes will
+ * be set to their respective plane widths.
+ *
+ * @param height desired height (in pixels) of the YUV image.  This is handled
+ * in the same manner as in #tjDecompressToYUVPlanes().
+ *
+ * @param layout the layout of the YUV image (see @ref TJYUV "YUV layouts".)
+ * The level of chrominance subsampling in the JPEG image must match the level
+ * implied by this layout (see #tjYUVSubsamp.)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags"
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ */
+DLLEXPORT int DLLCALL tjDecompressToYUVLayout(tjhandle handle,
+  unsigned char *jpegBuf, unsigned long jpegSize, unsigned char **dstPlanes,
+  int width, int *strides, int height, int layout, int flags);
+
+
 /**
  * Decode a YUV planar image into an RGB or grayscale image.  This function
  * uses the accelerated color conversion routines in the underlying
@@ -1396,7 +2084,8 @@ DLLEXPORT tjhandle DLLCALL tjInitTransform(void);
  * If you choose option 1, <tt>dstSizes[i]</tt> should be set to the size of
  * your pre-allocated buffer.  In any case, unless you have set
  * #TJFLAG_NOREALLOC, you should always check <tt>dstBufs[i]</tt> upon return
- * from this function, as it may have changed.
+ * from this function, as it may have changed.  If TurboJPEG had to grow the
+ * buffer, then it will have freed the pre-allocated buffer.
  *
  * @param dstSizes pointer to an array of n unsigned long variables that will
  * receive the actual sizes (in bytes) of each transformed JPEG image.  If
@@ -1429,6 +2118,58 @@ DLLEXPORT int DLLCALL tjTransform(tjhandle handle, unsigned char *jpegBuf,
 DLLEXPORT int DLLCALL tjDestroy(tjhandle handle);
 
 
+/**
+ * Retrieve memory usage statistics for the most recent operation performed by
+ * a TurboJPEG compressor, decompressor, or transformer instance.  The
+ * statistics are reset whenever a compression, decompression, YUV encoding or
+ * decoding, or transform operation begins, so this function should be called
+ * after the operation of interest has completed.
+ *
+ * @param handle a handle to a TurboJPEG compressor, decompressor or
+ * transformer instance
+ *
+ * @param stats pointer to a #tjmemstats structure that will receive the
+ * statistics
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ */
+DLLEXPORT int DLLCALL tjGetMemoryStats(tjhandle handle, tjmemstats *stats);
+
+
+/**
+ * Estimate the memory usage and CPU cost of decompressing a JPEG image with
+ * #tjDecompress2(), without decompressing it.  Only the JPEG header is read,
+ * so this function can be used to reject or defer the decompression of
+ * images that would consume an unreasonable amount of resources.
+ *
+ * @param handle a handle to a TurboJPEG decompressor or transformer instance
+ *
+ * @param jpegBuf pointer to a buffer containing the JPEG image
+ *
+ * @param jpegSize size of the JPEG image (in bytes)
+ *
+ * @param width desired width (in pixels) of the destination image, as it
+ * would be passed to #tjDecompress2()
+ *
+ * @param height desired height (in pixels) of the destination image, as it
+ * would be passed to #tjDecompress2()
+ *
+ * @param pixelFormat pixel format of the destination image (see @ref
+ * TJPF "Pixel formats".)
+ *
+ * @param flags the bitwise OR of one or more of the @ref TJFLAG_BOTTOMUP
+ * "flags", as they would be passed to #tjDecompress2()
+ *
+ * @param cost pointer to a #tjdecompcost structure that will receive the
+ * estimates
+ *
+ * @return 0 if successful, or -1 if an error occurred (see #tjGetErrorStr().)
+ */
+DLLEXPORT int DLLCALL tjGetDecompressCost(tjhandle handle,
+  unsigned char *jpegBuf, unsigned long jpegSize, int width, int height,
+  int pixelFormat, int flags, tjdecompcost *cost);
+
+
 /**
  * Allocate an image buffer for use with TurboJPEG.  You should always use
  * this function to allocate the JPEG destination buffer(s) for #tjCompress2()